@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON outputs and flags regressions.
+
+Usage: compare.py BASELINE.json CURRENT.json [--threshold=0.10] [--metric=cpu_time]
+
+Exits with status 1 when any benchmark present in both files got slower than
+the baseline by more than the threshold (a fraction, 0.10 = 10%). When a run
+used --benchmark_repetitions, the median aggregate is compared.
+"""
+
+import json
+import sys
+
+
+def load(path, metric):
+    with open(path) as f:
+        report = json.load(f)
+    results = {}
+    medians = {}
+    for run in report.get("benchmarks", []):
+        if run.get("error_occurred"):
+            continue
+        if run.get("run_type") == "aggregate":
+            if run.get("aggregate_name") == "median":
+                medians[run["run_name"]] = run[metric]
+            continue
+        # Without repetitions there is exactly one iteration run per name.
+        results.setdefault(run.get("run_name", run["name"]), run[metric])
+    results.update(medians)
+    return results
+
+
+def main(argv):
+    threshold = 0.10
+    metric = "cpu_time"
+    paths = []
+    for arg in argv[1:]:
+        if arg.startswith("--threshold="):
+            threshold = float(arg.split("=", 1)[1])
+        elif arg.startswith("--metric="):
+            metric = arg.split("=", 1)[1]
+        else:
+            paths.append(arg)
+    if len(paths) != 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+
+    baseline = load(paths[0], metric)
+    current = load(paths[1], metric)
+
+    regressions = 0
+    width = max((len(name) for name in current), default=0)
+    for name, value in current.items():
+        if name not in baseline:
+            print(f"{name:<{width}}  {'new':>10}")
+            continue
+        base = baseline[name]
+        change = (value - base) / base if base else 0.0
+        flag = ""
+        if change > threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -threshold:
+            flag = "  improved"
+        print(f"{name:<{width}}  {change:+10.1%}{flag}")
+    for name in baseline.keys() - current.keys():
+        print(f"{name:<{width}}  {'missing':>10}")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) regressed by more than "
+              f"{threshold:.0%} in {metric}.")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,493 @@
+#include "bench/generators.h"
+#include "justadb/dml.h"
+#include "justadb/kernels.h"
+#include "justadb/like.h"
+#include "justadb/lsm.h"
+#include "justadb/result_cache.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using namespace JustADb;
+using JustADb::Bench::Distribution;
+using JustADb::Bench::TableSpec;
+
+// Runs the query to completion and returns the number of rows produced.
+auto Drain(DmlQueryExec &exec, const SelectQuery &query) -> size_t {
+  auto cursor = exec.ExecuteSelectQuery(query);
+  size_t rows = 0;
+  while (auto batch = cursor->NextBatch().value()) {
+    benchmark::DoNotOptimize(batch->columns.data());
+    rows += batch->row_count();
+  }
+  return rows;
+}
+
+auto SpecFor(const benchmark::State &state) -> TableSpec {
+  TableSpec spec;
+  spec.rows = state.range(0);
+  return spec;
+}
+
+// Args: rows per table, extra INT columns.
+void BM_Insert(benchmark::State &state) {
+  TableSpec spec;
+  spec.rows = state.range(0);
+  spec.int_columns = state.range(1);
+  Bench::RowGenerator generator(spec);
+  std::vector<InsertQuery> queries;
+  for (size_t id = 0; id < spec.rows; ++id) {
+    queries.emplace_back("t", generator.Next(static_cast<int>(id)));
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    Database db("bench");
+    db.CreateTable("t", generator.Columns());
+    DmlQueryExec exec(db);
+    state.ResumeTiming();
+    for (const auto &query : queries) {
+      benchmark::DoNotOptimize(exec.ExecuteInsertQuery(query));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+}
+BENCHMARK(BM_Insert)->Args({10000, 2})->Args({10000, 16});
+
+// Args: rows.
+void BM_PointSelect(benchmark::State &state) {
+  Database db("bench");
+  const auto spec = SpecFor(state);
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  int id = 0;
+  for (auto _ : state) {
+    SelectQuery query("t", {Column("id", Column::Type::INT),
+                            Column("s0", Column::Type::STRING)});
+    query.Where("id", std::to_string(id), WhereClause::Operator::EQUAL);
+    benchmark::DoNotOptimize(Drain(exec, query));
+    id = (id + 7919) % spec.rows;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PointSelect)->Arg(10000)->Arg(100000);
+
+// Args: rows, range width in rows.
+void BM_RangeScan(benchmark::State &state) {
+  Database db("bench");
+  const auto spec = SpecFor(state);
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  const auto width = state.range(1);
+  size_t rows = 0;
+  for (auto _ : state) {
+    SelectQuery query("t", {Column("id", Column::Type::INT),
+                            Column("i0", Column::Type::INT)});
+    query.Where("id", std::to_string(spec.rows / 2),
+                WhereClause::Operator::GREATER_THAN_OR_EQUAL)
+        .Where("id", std::to_string(spec.rows / 2 + width),
+               WhereClause::Operator::LESS_THAN);
+    rows += Drain(exec, query);
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+  state.counters["rows_out"] =
+      benchmark::Counter(rows, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_RangeScan)->Args({100000, 100})->Args({100000, 10000});
+
+// Args: rows, selectivity in percent, distribution.
+void BM_FilterSelectivity(benchmark::State &state) {
+  Database db("bench");
+  auto spec = SpecFor(state);
+  spec.distribution = static_cast<Distribution>(state.range(2));
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  // With a uniform column, i0 < cardinality * p% keeps p% of the rows.
+  const auto bound = spec.cardinality * state.range(1) / 100;
+  size_t rows = 0;
+  for (auto _ : state) {
+    SelectQuery query("t", {Column("id", Column::Type::INT),
+                            Column("s0", Column::Type::STRING)});
+    query.Where("i0", std::to_string(bound), WhereClause::Operator::LESS_THAN);
+    rows += Drain(exec, query);
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+  state.counters["rows_out"] =
+      benchmark::Counter(rows, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_FilterSelectivity)
+    ->ArgsProduct({{100000},
+                   {1, 10, 50, 90},
+                   {static_cast<int64_t>(Distribution::UNIFORM)}})
+    ->Args({100000, 10, static_cast<int64_t>(Distribution::ZIPF)});
+
+// Args: rows, limit (0 for none).
+void BM_Sort(benchmark::State &state) {
+  Database db("bench");
+  const auto spec = SpecFor(state);
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  for (auto _ : state) {
+    SelectQuery query("t", {Column("id", Column::Type::INT),
+                            Column("i0", Column::Type::INT)});
+    query.OrderBy("i0", OrderByClause::Order::ASCENDING);
+    if (state.range(1) > 0) {
+      query.Limit(state.range(1));
+    }
+    benchmark::DoNotOptimize(Drain(exec, query));
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+}
+BENCHMARK(BM_Sort)->Args({100000, 0})->Args({100000, 10});
+
+// Args: rows, query memory limit in KiB (0 for none). Under a limit the sort
+// spills runs and merges them.
+void BM_SortSpill(benchmark::State &state) {
+  Database db("bench");
+  const auto spec = SpecFor(state);
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  if (state.range(1) > 0) {
+    exec.set_query_memory_limit(state.range(1) << 10);
+  }
+  SelectQuery query("t", {Column("id", Column::Type::INT),
+                          Column("i0", Column::Type::INT)});
+  query.OrderBy("i0", OrderByClause::Order::ASCENDING);
+  const auto spilled_before = SpillFile::total_bytes_written();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Drain(exec, query));
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+  state.counters["spilled_bytes"] = static_cast<double>(
+      SpillFile::total_bytes_written() - spilled_before) /
+      state.iterations();
+}
+BENCHMARK(BM_SortSpill)->Args({100000, 0})->Args({100000, 256});
+
+// Args: rows, mode. A dashboard's repeated SUM over the rows that match a
+// filter: mode 0 scans the table and sums the rows it returns, mode 1 reads
+// a materialized view holding the sum, and mode 2 runs the scan through the
+// result cache, so every iteration after the first sums cached rows.
+void BM_DashboardQuery(benchmark::State &state) {
+  Database db("bench");
+  const auto spec = SpecFor(state);
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  const auto mode = state.range(1);
+  ResultCache cache(64 << 20);
+  if (mode == 2) {
+    exec.set_result_cache(&cache);
+  }
+
+  SelectQuery scan("t", {Column("i1", Column::Type::INT)});
+  scan.Where("i0", "100", WhereClause::Operator::LESS_THAN);
+  CreateViewQuery view("dashboard", "t", {});
+  view.Where("i0", "100", WhereClause::Operator::LESS_THAN);
+  view.Aggregate(AggregateClause::Function::SUM, "i1");
+  if (mode == 1) {
+    exec.ExecuteCreateViewQuery(view).value();
+  }
+  const SelectQuery read_view("dashboard",
+                              {Column("sum(i1)", Column::Type::INT)});
+  for (auto _ : state) {
+    auto cursor = exec.ExecuteSelectQuery(mode == 1 ? read_view : scan);
+    int64_t sum = 0;
+    while (auto batch = cursor->NextBatch().value()) {
+      for (const auto *value : batch->columns[0]) {
+        sum += std::get<int>(value->value());
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+}
+BENCHMARK(BM_DashboardQuery)->ArgsProduct({{100000}, {0, 1, 2}});
+
+// Args: rows, extra INT columns. Projects every column of the table.
+void BM_FullScan(benchmark::State &state) {
+  Database db("bench");
+  auto spec = SpecFor(state);
+  spec.int_columns = state.range(1);
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  std::vector<Column> columns;
+  for (const auto *column : db.GetTable("t").value()->columns()) {
+    columns.push_back(*column);
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Drain(exec, SelectQuery("t", columns)));
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+}
+BENCHMARK(BM_FullScan)->Args({100000, 2})->Args({100000, 32});
+
+// Args: haystack bytes, 1 for FindSubstring or 0 for std::string_view::find.
+// The needle never occurs, so every byte is scanned.
+void BM_FindSubstring(benchmark::State &state) {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::string haystack(state.range(0), ' ');
+  for (auto &c : haystack) {
+    c = static_cast<char>(letter(rng));
+  }
+  const std::string_view needle = "needle!";
+  const bool simd = state.range(1) != 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        simd ? FindSubstring(haystack, needle)
+             : std::string_view(haystack).find(needle));
+  }
+  state.SetBytesProcessed(state.iterations() * haystack.size());
+}
+BENCHMARK(BM_FindSubstring)->ArgsProduct({{1 << 20}, {0, 1}});
+
+// Args: rows, string length. LIKE '%needle%' over a STRING column.
+void BM_LikeSelect(benchmark::State &state) {
+  Database db("bench");
+  auto spec = SpecFor(state);
+  spec.string_length = state.range(1);
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  size_t rows = 0;
+  for (auto _ : state) {
+    SelectQuery query("t", {Column("id", Column::Type::INT)});
+    query.Where("s0", "%123%", WhereClause::Operator::LIKE);
+    rows += Drain(exec, query);
+  }
+  state.SetBytesProcessed(state.iterations() * spec.rows * spec.string_length);
+  state.counters["rows_out"] =
+      benchmark::Counter(rows, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_LikeSelect)->Args({100000, 16})->Args({100000, 256});
+
+// Args: rows, 1 for the specialized kernels or 0 for Predicate::Matches.
+// Filters the table batch by batch with three conjuncts, keeping about 9% of
+// the rows.
+void BM_FilterKernels(benchmark::State &state) {
+  Database db("bench");
+  const auto spec = SpecFor(state);
+  const auto *table = Bench::GenerateTable(db, "t", spec);
+  std::vector<Predicate> predicates;
+  for (const auto &where :
+       {WhereClause("i0", "300", WhereClause::Operator::LESS_THAN),
+        WhereClause("f0", "70", WhereClause::Operator::GREATER_THAN_OR_EQUAL),
+        WhereClause("s0", "", WhereClause::Operator::IS_NOT_NULL)}) {
+    predicates.push_back(Predicate::Compile(where, *table).value());
+  }
+  const auto &tuples = table->tuples();
+  CompiledFilter filter(predicates);
+  const bool specialized = state.range(1) != 0;
+  constexpr auto kBatchRows = DmlQueryExec::kDefaultBatchRows;
+  TupleBatch batch;
+  size_t rows = 0;
+  for (auto _ : state) {
+    for (size_t begin = 0; begin < tuples.size(); begin += kBatchRows) {
+      const auto end = std::min(tuples.size(), begin + kBatchRows);
+      batch.assign(tuples.begin() + begin, tuples.begin() + end);
+      if (specialized) {
+        filter.Apply(batch);
+      } else {
+        std::erase_if(batch, [&predicates](const Tuple *tuple) {
+          return !std::all_of(predicates.begin(), predicates.end(),
+                              [tuple](const Predicate &predicate) {
+                                return predicate.Matches(*tuple);
+                              });
+        });
+      }
+      rows += batch.size();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+  state.counters["rows_out"] =
+      benchmark::Counter(rows, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_FilterKernels)->ArgsProduct({{100000}, {0, 1}});
+
+// Args: rows, partitions (1 for an unpartitioned table). Selects the newest
+// 1% of ids from a table range-partitioned on id.
+void BM_PartitionPruning(benchmark::State &state) {
+  Database db("bench");
+  auto spec = SpecFor(state);
+  const auto partitions = static_cast<size_t>(state.range(1));
+  if (partitions > 1) {
+    std::vector<int> bounds;
+    for (size_t i = 1; i < partitions; ++i) {
+      bounds.push_back(static_cast<int>(spec.rows * i / partitions));
+    }
+    spec.partitioning = PartitionSpec::Range("id", std::move(bounds));
+  }
+  Bench::GenerateTable(db, "t", spec);
+  DmlQueryExec exec(db);
+  for (auto _ : state) {
+    SelectQuery query("t", {Column("id", Column::Type::INT),
+                            Column("i0", Column::Type::INT)});
+    query.Where("id", std::to_string(spec.rows - spec.rows / 100),
+                WhereClause::Operator::GREATER_THAN_OR_EQUAL);
+    benchmark::DoNotOptimize(Drain(exec, query));
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+}
+BENCHMARK(BM_PartitionPruning)->Args({100000, 1})->Args({100000, 100});
+
+// Args: rows per partition. Drops the oldest of 30 daily partitions.
+void BM_DropPartition(benchmark::State &state) {
+  auto spec = SpecFor(state);
+  spec.rows *= 30;
+  std::vector<int> bounds;
+  for (int day = 1; day < 30; ++day) {
+    bounds.push_back(day * static_cast<int>(state.range(0)));
+  }
+  spec.partitioning = PartitionSpec::Range("id", std::move(bounds));
+  Database db("bench");
+  auto *table = Bench::GenerateTable(db, "t", spec);
+  size_t partition = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table->DropPartition(partition));
+    partition = (partition + 1) % 30;
+  }
+}
+BENCHMARK(BM_DropPartition)->Arg(10000);
+
+// Args: rows, engine (0 = heap, 1 = LSM keyed by the random column i0).
+// Sustained insert rate into an empty table; the LSM compacts in the
+// background while rows keep arriving.
+void BM_Ingest(benchmark::State &state) {
+  auto spec = SpecFor(state);
+  Bench::RowGenerator generator(spec);
+  std::vector<std::vector<std::pair<std::string, Value>>> rows;
+  for (size_t id = 0; id < spec.rows; ++id) {
+    auto values = generator.Next(static_cast<int>(id));
+    rows.emplace_back(values.begin(), values.end());
+  }
+  const auto storage = state.range(1) == 0 ? StorageOptions()
+                                           : StorageOptions::Lsm("i0");
+  std::unique_ptr<Table> table;
+  for (auto _ : state) {
+    state.PauseTiming();
+    // Stopping the previous table's compaction is not part of the ingest.
+    table = std::make_unique<Table>("t", generator.Columns(), std::nullopt,
+                                    storage);
+    std::vector<Tuple *> tuples;
+    for (const auto &row : rows) {
+      auto *tuple = new Tuple();
+      for (const auto &[column_name, value] : row) {
+        tuple->InsertValue(column_name, new Value(value));
+      }
+      tuples.push_back(tuple);
+    }
+    state.ResumeTiming();
+    for (auto *tuple : tuples) {
+      benchmark::DoNotOptimize(table->InsertTuple(tuple));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * spec.rows);
+}
+BENCHMARK(BM_Ingest)->Args({100000, 0})->Args({100000, 1});
+
+// Args: rows, engine (0 = heap, 1 = LSM keyed by i0). SELECT ... WHERE
+// i0 = k, which the heap answers with a full scan and the LSM with a seek.
+void BM_KeyLookup(benchmark::State &state) {
+  auto spec = SpecFor(state);
+  spec.cardinality = static_cast<int>(spec.rows);
+  if (state.range(1) != 0) {
+    spec.storage = StorageOptions::Lsm("i0");
+  }
+  Database db("bench");
+  auto *table = Bench::GenerateTable(db, "t", spec);
+  if (table->lsm() != nullptr) {
+    const_cast<LsmTree *>(table->lsm())->WaitForCompaction();
+  }
+  DmlQueryExec exec(db);
+  int key = 0;
+  for (auto _ : state) {
+    SelectQuery query("t", {Column("id", Column::Type::INT)});
+    query.Where("i0", std::to_string(key), WhereClause::Operator::EQUAL);
+    benchmark::DoNotOptimize(Drain(exec, query));
+    key = (key + 7919) % spec.cardinality;
+  }
+}
+BENCHMARK(BM_KeyLookup)->Args({100000, 0})->Args({100000, 1});
+
+// Creates p(id INT) holding 0..keys-1 and an empty c(id INT, p_id INT),
+// where p_id references p.id if `references` is set.
+void CreateParentAndChild(Database &db, int keys, bool references) {
+  db.CreateTable("p", {new Column("id", Column::Type::INT)});
+  auto *parent = db.GetModifiableTable("p").value();
+  for (int id = 0; id < keys; ++id) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue("id", new Value(id));
+    parent->InsertTuple(tuple);
+  }
+  db.CreateTable("c",
+                 {new Column("id", Column::Type::INT),
+                  new Column("p_id", Column::Type::INT)},
+                 std::nullopt, {},
+                 references ? std::vector<ForeignKey>{{"p_id", "p", "id"}}
+                            : std::vector<ForeignKey>{});
+}
+
+// Args: rows, batch (0 = one insert per row, 1 = a single batch). Every row
+// is checked against a parent of 100k keys.
+void BM_ForeignKeyInsert(benchmark::State &state) {
+  const auto rows = static_cast<int>(state.range(0));
+  constexpr int kParentKeys = 100000;
+  std::vector<InsertQuery::Row> values;
+  for (int id = 0; id < rows; ++id) {
+    values.push_back(
+        {{"id", Value(id)}, {"p_id", Value((id * 7919) % kParentKeys)}});
+  }
+  for (auto _ : state) {
+    state.PauseTiming();
+    Database db("bench");
+    CreateParentAndChild(db, kParentKeys, true);
+    DmlQueryExec exec(db);
+    state.ResumeTiming();
+    if (state.range(1) == 0) {
+      for (const auto &row : values) {
+        benchmark::DoNotOptimize(
+            exec.ExecuteInsertQuery(InsertQuery("c", row)));
+      }
+    } else {
+      benchmark::DoNotOptimize(
+          exec.ExecuteInsertQuery(InsertQuery::Batch("c", values)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_ForeignKeyInsert)->Args({10000, 0})->Args({10000, 1});
+
+// Args: probe rows, build keys. Joins c to p on c.p_id = p.id, where p_id is
+// spread over 0..probe rows, so only build keys / probe rows of the probe
+// side has a match; the runtime filter drops the rest in the scan.
+void BM_HashJoin(benchmark::State &state) {
+  const auto rows = static_cast<int>(state.range(0));
+  Database db("bench");
+  CreateParentAndChild(db, static_cast<int>(state.range(1)), false);
+  auto *child = db.GetModifiableTable("c").value();
+  std::vector<Tuple *> tuples;
+  for (int id = 0; id < rows; ++id) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue("id", new Value(id));
+    tuple->InsertValue("p_id", new Value((id * 7919) % rows));
+    tuples.push_back(tuple);
+  }
+  child->InsertTuples(tuples);
+  DmlQueryExec exec(db);
+  SelectQuery query("c", {Column("c.id", Column::Type::INT)});
+  query.Join("p", "p_id", "p.id");
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Drain(exec, query));
+  }
+  state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_HashJoin)->Args({100000, 1000})->Args({100000, 100000});
+
+} // namespace
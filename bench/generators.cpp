@@ -0,0 +1,113 @@
+#include "bench/generators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace JustADb::Bench {
+
+namespace {
+
+// A benchmark over a partial or empty table would measure the wrong thing,
+// so setup errors end the run.
+[[noreturn]] void Fail(const std::string &what, const Error &error) {
+  std::fprintf(stderr, "%s: %s\n", what.c_str(), error.message().c_str());
+  std::abort();
+}
+
+} // namespace
+
+ZipfGenerator::ZipfGenerator(int n, double skew) {
+  cdf_.reserve(n);
+  double sum = 0;
+  for (int k = 0; k < n; ++k) {
+    sum += 1.0 / std::pow(k + 1, skew);
+    cdf_.push_back(sum);
+  }
+  for (auto &p : cdf_) {
+    p /= sum;
+  }
+}
+
+auto ZipfGenerator::operator()(std::mt19937_64 &rng) -> int {
+  const double u = std::uniform_real_distribution<double>(0, 1)(rng);
+  const auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+  return static_cast<int>(std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1));
+}
+
+RowGenerator::RowGenerator(const TableSpec &spec)
+    : spec_(spec), rng_(spec.seed), uniform_(0, spec.cardinality - 1),
+      zipf_(spec.cardinality, spec.zipf_skew) {}
+
+auto RowGenerator::Columns() const -> std::vector<Column *> {
+  std::vector<Column *> columns = {new Column("id", Column::Type::INT)};
+  for (size_t i = 0; i < spec_.int_columns; ++i) {
+    columns.push_back(new Column("i" + std::to_string(i), Column::Type::INT));
+  }
+  for (size_t i = 0; i < spec_.float_columns; ++i) {
+    columns.push_back(new Column("f" + std::to_string(i), Column::Type::FLOAT));
+  }
+  for (size_t i = 0; i < spec_.string_columns; ++i) {
+    columns.push_back(
+        new Column("s" + std::to_string(i), Column::Type::STRING));
+  }
+  for (size_t i = 0; i < spec_.bool_columns; ++i) {
+    columns.push_back(new Column("b" + std::to_string(i), Column::Type::BOOL));
+  }
+  return columns;
+}
+
+auto RowGenerator::Draw() -> int {
+  if (spec_.distribution == Distribution::ZIPF) {
+    return zipf_(rng_);
+  }
+  return uniform_(rng_);
+}
+
+auto RowGenerator::Next(int id) -> std::unordered_map<std::string, Value> {
+  std::unordered_map<std::string, Value> values;
+  values.insert({"id", Value(id)});
+  for (size_t i = 0; i < spec_.int_columns; ++i) {
+    values.insert({"i" + std::to_string(i), Value(Draw())});
+  }
+  for (size_t i = 0; i < spec_.float_columns; ++i) {
+    values.insert({"f" + std::to_string(i), Value(Draw() / 10.0f)});
+  }
+  for (size_t i = 0; i < spec_.string_columns; ++i) {
+    // Zero-padded so that string order matches numeric order.
+    auto digits = std::to_string(Draw());
+    std::string value(spec_.string_length > digits.size()
+                          ? spec_.string_length - digits.size()
+                          : 0,
+                      '0');
+    values.insert({"s" + std::to_string(i), Value(value + digits)});
+  }
+  for (size_t i = 0; i < spec_.bool_columns; ++i) {
+    values.insert({"b" + std::to_string(i), Value(Draw() % 2 == 0)});
+  }
+  return values;
+}
+
+auto GenerateTable(Database &db, const std::string &name, const TableSpec &spec)
+    -> Table * {
+  RowGenerator generator(spec);
+  if (auto created = db.CreateTable(name, generator.Columns(),
+                                    spec.partitioning, spec.storage);
+      !created) {
+    Fail("Cannot create table " + name, created.error());
+  }
+  auto *table = db.GetModifiableTable(name).value();
+  for (size_t id = 0; id < spec.rows; ++id) {
+    auto *tuple = new Tuple();
+    for (auto &[column_name, value] : generator.Next(static_cast<int>(id))) {
+      tuple->InsertValue(column_name, new Value(std::move(value)));
+    }
+    if (auto inserted = table->InsertTuple(tuple); !inserted) {
+      Fail("Cannot fill table " + name, inserted.error());
+    }
+  }
+  return table;
+}
+
+} // namespace JustADb::Bench
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "justadb/ddl.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace JustADb::Bench {
+
+enum class Distribution { UNIFORM, ZIPF };
+
+// Shape of a synthetic table. Every table has an INT column "id" holding the
+// row number, followed by `int_columns` INT columns i0.., `float_columns`
+// FLOAT columns f0.., `string_columns` STRING columns s0.. and `bool_columns`
+// BOOL columns b0... Non-id values are drawn from `cardinality` distinct
+// values with the given distribution.
+struct TableSpec {
+  size_t rows = 10000;
+  size_t int_columns = 2;
+  size_t float_columns = 1;
+  size_t string_columns = 1;
+  size_t bool_columns = 0;
+
+  Distribution distribution = Distribution::UNIFORM;
+  // Exponent of the Zipf distribution; larger is more skewed.
+  double zipf_skew = 1.0;
+  int cardinality = 1000;
+  size_t string_length = 16;
+  uint64_t seed = 42;
+  std::optional<PartitionSpec> partitioning;
+  StorageOptions storage;
+};
+
+// Draws ranks in [0, n) with P(k) proportional to 1 / (k + 1)^skew.
+class ZipfGenerator {
+public:
+  ZipfGenerator(int n, double skew);
+
+  auto operator()(std::mt19937_64 &rng) -> int;
+
+private:
+  std::vector<double> cdf_;
+};
+
+class RowGenerator {
+public:
+  explicit RowGenerator(const TableSpec &spec);
+
+  [[nodiscard]] auto Columns() const -> std::vector<Column *>;
+
+  // The values of row `id`.
+  auto Next(int id) -> std::unordered_map<std::string, Value>;
+
+private:
+  auto Draw() -> int;
+
+  TableSpec spec_;
+  std::mt19937_64 rng_;
+  std::uniform_int_distribution<int> uniform_;
+  ZipfGenerator zipf_;
+};
+
+// Creates table `name` in `db` and fills it according to `spec`. Aborts the
+// process if the table cannot be created or filled.
+auto GenerateTable(Database &db, const std::string &name, const TableSpec &spec)
+    -> Table *;
+
+} // namespace JustADb::Bench
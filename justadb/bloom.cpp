@@ -0,0 +1,53 @@
+#include "bloom.h"
+
+#include <algorithm>
+
+namespace JustADb {
+
+namespace {
+
+// Odd constants that spread the low half of a hash over the words of a block.
+constexpr std::array<uint32_t, 8> kSalts = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+
+auto BitsOf(uint64_t hash) -> std::array<uint32_t, 8> {
+  const auto low = static_cast<uint32_t>(hash);
+  std::array<uint32_t, 8> bits{};
+  for (size_t i = 0; i < bits.size(); ++i) {
+    bits[i] = uint32_t{1} << ((low * kSalts[i]) >> 27);
+  }
+  return bits;
+}
+
+} // namespace
+
+BloomFilter::BloomFilter(size_t expected_keys, size_t bits_per_key)
+    : blocks_(std::max<size_t>(
+          1, (expected_keys * bits_per_key + 8 * sizeof(Block) - 1) /
+                 (8 * sizeof(Block)))) {}
+
+auto BloomFilter::BlockOf(uint64_t hash) const -> size_t {
+  // The high half picks the block without a division.
+  return static_cast<size_t>(((hash >> 32) * blocks_.size()) >> 32);
+}
+
+void BloomFilter::Add(uint64_t hash) {
+  auto &block = blocks_[BlockOf(hash)];
+  const auto bits = BitsOf(hash);
+  for (size_t i = 0; i < block.size(); ++i) {
+    block[i] |= bits[i];
+  }
+}
+
+auto BloomFilter::MayContain(uint64_t hash) const -> bool {
+  const auto &block = blocks_[BlockOf(hash)];
+  const auto bits = BitsOf(hash);
+  bool contains = true;
+  for (size_t i = 0; i < block.size(); ++i) {
+    contains &= (block[i] & bits[i]) != 0;
+  }
+  return contains;
+}
+
+} // namespace JustADb
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace JustADb {
+
+// A split-block Bloom filter: a key sets one bit in each of the eight 32-bit
+// words of a single 32-byte block, so adding or probing a key touches one
+// cache line. About 10 bits per key give a false positive rate near 1%.
+class BloomFilter {
+public:
+  explicit BloomFilter(size_t expected_keys, size_t bits_per_key = 10);
+
+  // `hash` should be well mixed, e.g. from HashValue().
+  void Add(uint64_t hash);
+
+  // False only if no key with this hash was added.
+  [[nodiscard]] auto MayContain(uint64_t hash) const -> bool;
+
+  [[nodiscard]] auto bytes_allocated() const -> size_t {
+    return blocks_.size() * sizeof(Block);
+  }
+
+private:
+  using Block = std::array<uint32_t, 8>;
+
+  [[nodiscard]] auto BlockOf(uint64_t hash) const -> size_t;
+
+  std::vector<Block> blocks_;
+};
+
+} // namespace JustADb
@@ -0,0 +1,160 @@
+#include "client.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace JustADb {
+
+namespace {
+
+auto SystemError(const std::string &what) -> Error {
+  return Error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+auto Client::ConnectTcp(const std::string &host, uint16_t port)
+    -> std::expected<Client, Error> {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    return std::unexpected(Error("Invalid server address"));
+  }
+
+  const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address),
+                        sizeof(address)) < 0) {
+    auto error = SystemError("Cannot connect");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return std::unexpected(error);
+  }
+  int no_delay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+  return Client(fd);
+}
+
+auto Client::ConnectUnix(const std::string &path)
+    -> std::expected<Client, Error> {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return std::unexpected(Error("Unix socket path too long"));
+  }
+  std::strcpy(address.sun_path, path.c_str());
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address),
+                        sizeof(address)) < 0) {
+    auto error = SystemError("Cannot connect");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return std::unexpected(error);
+  }
+  return Client(fd);
+}
+
+Client::Client(Client &&other) noexcept
+    : fd_(std::exchange(other.fd_, -1)),
+      next_request_id_(other.next_request_id_),
+      read_buffer_(std::move(other.read_buffer_)) {}
+
+auto Client::operator=(Client &&other) noexcept -> Client & {
+  if (this != &other) {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    fd_ = std::exchange(other.fd_, -1);
+    next_request_id_ = other.next_request_id_;
+    read_buffer_ = std::move(other.read_buffer_);
+  }
+  return *this;
+}
+
+Client::~Client() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+auto Client::Send(const Request &request) -> std::expected<uint32_t, Error> {
+  const auto request_id = next_request_id_++;
+  const auto frame = EncodeRequest(request_id, request);
+  size_t written = 0;
+  while (written < frame.size()) {
+    const ssize_t n = send(fd_, frame.data() + written, frame.size() - written,
+                           MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return std::unexpected(SystemError("Cannot send request"));
+    }
+    written += n;
+  }
+  return request_id;
+}
+
+auto Client::ReadFrame() -> std::expected<Frame, Error> {
+  while (true) {
+    size_t consumed = 0;
+    auto frame = ParseFrame(read_buffer_, consumed);
+    if (!frame) {
+      return std::unexpected(frame.error());
+    }
+    if (frame->has_value()) {
+      read_buffer_.erase(0, consumed);
+      return std::move(**frame);
+    }
+
+    char chunk[64 * 1024];
+    const ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+    if (n == 0) {
+      return std::unexpected(Error("Connection closed by server"));
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return std::unexpected(SystemError("Cannot read response"));
+    }
+    read_buffer_.append(chunk, n);
+  }
+}
+
+auto Client::ReadResponse() -> std::expected<Response, Error> {
+  Response response;
+  while (true) {
+    auto frame = ReadFrame();
+    if (!frame) {
+      return std::unexpected(frame.error());
+    }
+    auto done = ApplyResponseFrame(*frame, response);
+    if (!done) {
+      return std::unexpected(done.error());
+    }
+    if (*done) {
+      return response;
+    }
+  }
+}
+
+auto Client::Execute(const Request &request) -> std::expected<Response, Error> {
+  if (auto sent = Send(request); !sent) {
+    return std::unexpected(sent.error());
+  }
+  return ReadResponse();
+}
+
+} // namespace JustADb
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "protocol.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <expected>
+#include <string>
+
+namespace JustADb {
+
+// A blocking client for the wire protocol in protocol.h. Send() and
+// ReadResponse() can be interleaved freely to keep several requests in flight
+// on one connection; responses arrive in the order the requests were sent.
+class Client {
+public:
+  static auto ConnectTcp(const std::string &host, uint16_t port)
+      -> std::expected<Client, Error>;
+
+  static auto ConnectUnix(const std::string &path)
+      -> std::expected<Client, Error>;
+
+  Client(Client &&other) noexcept;
+  auto operator=(Client &&other) noexcept -> Client &;
+
+  Client(const Client &) = delete;
+  auto operator=(const Client &) -> Client & = delete;
+
+  ~Client();
+
+  // Sends a request and returns the id its response will carry.
+  auto Send(const Request &request) -> std::expected<uint32_t, Error>;
+
+  // Blocks until the next complete response has arrived.
+  auto ReadResponse() -> std::expected<Response, Error>;
+
+  // Sends a request and waits for its response.
+  auto Execute(const Request &request) -> std::expected<Response, Error>;
+
+private:
+  explicit Client(int fd) : fd_(fd) {}
+
+  auto ReadFrame() -> std::expected<Frame, Error>;
+
+  int fd_ = -1;
+  uint32_t next_request_id_ = 1;
+  std::string read_buffer_;
+};
+
+} // namespace JustADb
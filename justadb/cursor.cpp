@@ -0,0 +1,171 @@
+#include "cursor.h"
+
+#include "kernels.h"
+#include "operators.h"
+
+#include <algorithm>
+
+namespace JustADb {
+
+ResultCursor::ResultCursor(std::unique_ptr<Operator> root,
+                           std::vector<const Column *> columns,
+                           std::unique_ptr<MemoryTracker> memory)
+    : memory_(std::move(memory)), root_(std::move(root)),
+      columns_(std::move(columns)) {
+  for (const auto *column : columns_) {
+    projections_.push_back(SelectProjectKernel(*column));
+    column_names_.push_back(column->name());
+  }
+}
+
+ResultCursor::ResultCursor(std::shared_ptr<const ResultBatch> rows,
+                           std::vector<std::string> column_names,
+                           size_t batch_rows)
+    : column_names_(std::move(column_names)), cached_(std::move(rows)),
+      batch_rows_(batch_rows) {}
+
+ResultCursor::ResultCursor(ResultCursor &&other) noexcept = default;
+
+auto ResultCursor::operator=(ResultCursor &&other) noexcept
+    -> ResultCursor & {
+  if (this != &other) {
+    // The operators go before the tracker they report to.
+    Close();
+    memory_ = std::move(other.memory_);
+    root_ = std::move(other.root_);
+    columns_ = std::move(other.columns_);
+    projections_ = std::move(other.projections_);
+    copy_values_ = other.copy_values_;
+    column_names_ = std::move(other.column_names_);
+    tuples_ = std::move(other.tuples_);
+    rows_produced_ = other.rows_produced_;
+    cached_ = std::move(other.cached_);
+    cached_position_ = other.cached_position_;
+    batch_rows_ = other.batch_rows_;
+    recording_ = std::move(other.recording_);
+    recording_max_bytes_ = other.recording_max_bytes_;
+    recorded_ = std::move(other.recorded_);
+  }
+  return *this;
+}
+
+ResultCursor::~ResultCursor() = default;
+
+void ResultCursor::Close() {
+  root_.reset();
+  memory_.reset();
+  cached_.reset();
+  recording_.reset();
+  recorded_ = nullptr;
+}
+
+void ResultCursor::Record(size_t max_bytes,
+                          std::function<void(ResultBatch)> done) {
+  recording_.emplace();
+  recording_->columns.resize(column_names_.size());
+  recording_max_bytes_ = max_bytes;
+  recorded_ = std::move(done);
+}
+
+auto ResultCursor::NextBatch()
+    -> std::expected<std::optional<ResultBatch>, Error> {
+  if (cached_) {
+    return NextCachedBatch();
+  }
+  if (!root_) {
+    return std::nullopt;
+  }
+  auto has_rows = root_->Next(tuples_);
+  if (!has_rows) {
+    return std::unexpected(has_rows.error());
+  }
+  if (!*has_rows) {
+    if (recording_) {
+      recorded_(std::move(*recording_));
+    }
+    Close();
+    return std::nullopt;
+  }
+
+  // Project only the rows that made it through the pipeline.
+  ResultBatch batch;
+  batch.columns.resize(columns_.size());
+  for (size_t c = 0; c < columns_.size(); ++c) {
+    batch.columns[c].reserve(tuples_.size());
+    projections_[c](*columns_[c], tuples_, batch.columns[c]);
+  }
+  if (copy_values_) {
+    // Reserved up front, so that the copies never move.
+    auto copies = std::make_shared<std::vector<Value>>();
+    copies->reserve(columns_.size() * tuples_.size());
+    for (auto &column : batch.columns) {
+      for (auto &value : column) {
+        if (value != nullptr) {
+          value = &copies->emplace_back(*value);
+        }
+      }
+    }
+    batch.owners.push_back(std::move(copies));
+  }
+  rows_produced_ += tuples_.size();
+  if (recording_) {
+    if (rows_produced_ * columns_.size() * sizeof(const Value *) >
+        recording_max_bytes_) {
+      recording_.reset();
+      recorded_ = nullptr;
+    } else {
+      for (size_t c = 0; c < columns_.size(); ++c) {
+        recording_->columns[c].insert(recording_->columns[c].end(),
+                                      batch.columns[c].begin(),
+                                      batch.columns[c].end());
+      }
+      recording_->owners.insert(recording_->owners.end(),
+                                batch.owners.begin(), batch.owners.end());
+    }
+  }
+  return batch;
+}
+
+auto ResultCursor::NextCachedBatch() -> std::optional<ResultBatch> {
+  const auto rows = cached_->row_count();
+  if (cached_position_ == rows) {
+    Close();
+    return std::nullopt;
+  }
+  const auto end = std::min(rows, cached_position_ + batch_rows_);
+  ResultBatch batch;
+  batch.columns.reserve(cached_->columns.size());
+  for (const auto &column : cached_->columns) {
+    batch.columns.emplace_back(column.begin() + cached_position_,
+                               column.begin() + end);
+  }
+  if (!cached_->owners.empty()) {
+    batch.owners.push_back(cached_);
+  }
+  rows_produced_ += end - cached_position_;
+  cached_position_ = end;
+  return batch;
+}
+
+auto ResultCursor::Collect() -> std::expected<ResultBatch, Error> {
+  ResultBatch result;
+  result.columns.resize(column_names_.size());
+  while (true) {
+    auto batch = NextBatch();
+    if (!batch) {
+      return std::unexpected(batch.error());
+    }
+    if (!batch->has_value()) {
+      return result;
+    }
+    for (size_t c = 0; c < column_names_.size(); ++c) {
+      result.columns[c].insert(result.columns[c].end(),
+                               (*batch)->columns[c].begin(),
+                               (*batch)->columns[c].end());
+    }
+    result.owners.insert(result.owners.end(), (*batch)->owners.begin(),
+                         (*batch)->owners.end());
+  }
+}
+
+} // namespace JustADb
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "ddl.h"
+#include "memory.h"
+#include "utils.h"
+
+#include <cstddef>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace JustADb {
+
+class Operator;
+
+using TupleBatch = std::vector<const Tuple *>;
+
+// Appends the value of `column` in every row of `batch` to `out`; see
+// SelectProjectKernel().
+using ProjectKernel = void (*)(const Column &column, const TupleBatch &batch,
+                               std::vector<const Value *> &out);
+
+// One batch of result rows, column-major: columns[c][r] is the value of
+// projected column c in row r, or nullptr for NULL. The values are owned by
+// the table, or, for those a view replaces as it changes (see
+// MaterializedView), by `owners`, so they stay valid after the cursor is gone
+// and while the table changes.
+struct ResultBatch {
+  std::vector<std::vector<const Value *>> columns;
+  // Keep alive the copies that `columns` points at, if any.
+  std::vector<std::shared_ptr<const void>> owners;
+
+  [[nodiscard]] auto row_count() const -> size_t {
+    return columns.empty() ? 0 : columns.front().size();
+  }
+};
+
+// Streams the result of a query batch by batch. Nothing is computed until the
+// first NextBatch(), and only as much as the caller pulls: a caller that stops
+// early, or calls Close(), never pays for the rest of the result.
+class ResultCursor {
+public:
+  // `columns` are the table's columns to project, which must outlive the
+  // cursor. The operators' memory trackers hang off `memory`, the query's,
+  // which the cursor keeps until it is closed.
+  ResultCursor(std::unique_ptr<Operator> root,
+               std::vector<const Column *> columns,
+               std::unique_ptr<MemoryTracker> memory = nullptr);
+
+  // Streams a result computed earlier, `batch_rows` rows at a time.
+  ResultCursor(std::shared_ptr<const ResultBatch> rows,
+               std::vector<std::string> column_names, size_t batch_rows);
+
+  ResultCursor(ResultCursor &&other) noexcept;
+  auto operator=(ResultCursor &&other) noexcept -> ResultCursor &;
+
+  ~ResultCursor();
+
+  // Returns std::nullopt once the result is exhausted or the cursor closed.
+  auto NextBatch() -> std::expected<std::optional<ResultBatch>, Error>;
+
+  // Pulls the rest of the result into a single batch.
+  auto Collect() -> std::expected<ResultBatch, Error>;
+
+  // Releases the operator tree, and with it any buffered rows.
+  void Close();
+
+  // Projects copies of the values instead of the values, for a source that
+  // frees its values when its table changes (an aggregate view).
+  void CopyValues() {
+    copy_values_ = true;
+  }
+
+  // Keeps a copy of the rows as they are pulled and hands it to `done` once
+  // the result is exhausted. Recording stops, and `done` is never called,
+  // if the copy grows past `max_bytes` or the cursor is closed early.
+  void Record(size_t max_bytes, std::function<void(ResultBatch)> done);
+
+  // The query's memory tracker, until the cursor is closed.
+  [[nodiscard]] auto memory() const -> const MemoryTracker * {
+    return memory_.get();
+  }
+
+  [[nodiscard]] auto column_names() const -> const std::vector<std::string> & {
+    return column_names_;
+  }
+
+  [[nodiscard]] auto rows_produced() const {
+    return rows_produced_;
+  }
+
+private:
+  auto NextCachedBatch() -> std::optional<ResultBatch>;
+
+  // Declared first so that it outlives the operators tracked under it.
+  std::unique_ptr<MemoryTracker> memory_;
+  std::unique_ptr<Operator> root_;
+  std::vector<const Column *> columns_;
+  std::vector<ProjectKernel> projections_;
+  bool copy_values_ = false;
+  std::vector<std::string> column_names_;
+  TupleBatch tuples_;
+  size_t rows_produced_ = 0;
+  // Set instead of root_ when streaming an earlier result.
+  std::shared_ptr<const ResultBatch> cached_;
+  size_t cached_position_ = 0;
+  size_t batch_rows_ = 0;
+  std::optional<ResultBatch> recording_;
+  size_t recording_max_bytes_ = 0;
+  std::function<void(ResultBatch)> recorded_;
+};
+
+} // namespace JustADb
@@ -1,50 +1,575 @@
 #include "ddl.h"
+#include "key_index.h"
+#include "lsm.h"
+#include "statistics.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <functional>
+#include <limits>
 
 namespace JustADb {
 
+namespace {
+
+// Storage keys of added columns append a NUL to the name (see
+// Table::NewStorageKey), so names must not contain one themselves.
+auto ValidateColumnName(const std::string &name)
+    -> std::expected<void, Error> {
+  if (name.find('\0') != std::string::npos) {
+    return std::unexpected(Error("Column name cannot contain NUL"));
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+// The column among `columns` that `foreign_key` constrains, and the column
+// of `parent` it references.
+auto ResolveForeignKey(const ForeignKey &foreign_key,
+                       const std::vector<Column *> &columns,
+                       const Table &parent)
+    -> std::expected<std::pair<const Column *, const Column *>, Error> {
+  const auto column =
+      std::find_if(columns.begin(), columns.end(), [&](const auto *column) {
+        return column->name() == foreign_key.column;
+      });
+  if (column == columns.end()) {
+    return std::unexpected(Error("No column found: " + foreign_key.column,
+                                 Error::Kind::NoColumnFound));
+  }
+  const auto parent_column = parent.GetColumn(foreign_key.parent_column);
+  if (!parent_column) {
+    return std::unexpected(
+        Error("No column found: " + foreign_key.parent_column,
+              Error::Kind::NoColumnFound));
+  }
+  if ((*column)->type() != (*parent_column)->type()) {
+    return std::unexpected(
+        Error("Foreign key " + foreign_key.column +
+              " does not match the type of " + foreign_key.parent_table +
+              "." + foreign_key.parent_column));
+  }
+  return std::pair<const Column *, const Column *>(*column, *parent_column);
+}
+
+} // namespace
+
+auto Column::Read(const Tuple &tuple) const -> const Value * {
+  if (tuple.schema_version() < added_version_) {
+    return default_value_;
+  }
+  return tuple.GetValue(storage_key_, slot_).value_or(nullptr);
+}
+
+auto TypeOf(const Value &value) -> Column::Type {
+  switch (value.value().index()) {
+  case 0:
+    return Column::Type::STRING;
+  case 1:
+    return Column::Type::INT;
+  case 2:
+    return Column::Type::FLOAT;
+  default:
+    return Column::Type::BOOL;
+  }
+}
+
+auto HashValue(const Value &value) -> uint64_t {
+  // std::hash is the identity for integers, which would leave the high bits
+  // mostly zero.
+  uint64_t hash = std::hash<std::variant<std::string, int, float, bool>>{}(
+      value.value());
+  hash += 0x9e3779b97f4a7c15ull;
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+  return hash ^ (hash >> 31);
+}
+
+auto ConvertValue(const Value &value, Column::Type type)
+    -> std::optional<Value> {
+  if (TypeOf(value) == type) {
+    return value;
+  }
+  if (const auto *string = std::get_if<std::string>(&value.value())) {
+    const auto *begin = string->data();
+    const auto *end = string->data() + string->size();
+    switch (type) {
+    case Column::Type::INT: {
+      int result = 0;
+      auto [ptr, ec] = std::from_chars(begin, end, result);
+      if (ec != std::errc() || ptr != end) {
+        return std::nullopt;
+      }
+      return Value(result);
+    }
+    case Column::Type::FLOAT: {
+      float result = 0;
+      auto [ptr, ec] = std::from_chars(begin, end, result);
+      if (ec != std::errc() || ptr != end) {
+        return std::nullopt;
+      }
+      return Value(result);
+    }
+    default:
+      if (*string == "true" || *string == "1") {
+        return Value(true);
+      }
+      if (*string == "false" || *string == "0") {
+        return Value(false);
+      }
+      return std::nullopt;
+    }
+  }
+
+  // INT, FLOAT and BOOL convert through their numeric value.
+  const double number = std::visit(
+      [](const auto &v) -> double {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, std::string>) {
+          return 0;
+        } else {
+          return static_cast<double>(v);
+        }
+      },
+      value.value());
+  switch (type) {
+  case Column::Type::INT:
+    if (!std::isfinite(number) ||
+        number < static_cast<double>(std::numeric_limits<int>::min()) ||
+        number > static_cast<double>(std::numeric_limits<int>::max())) {
+      return std::nullopt;
+    }
+    return Value(static_cast<int>(number));
+  case Column::Type::FLOAT:
+    return Value(static_cast<float>(number));
+  case Column::Type::BOOL:
+    return Value(number != 0);
+  case Column::Type::STRING:
+    if (const auto *b = std::get_if<bool>(&value.value())) {
+      return Value(std::string(*b ? "true" : "false"));
+    }
+    if (const auto *i = std::get_if<int>(&value.value())) {
+      return Value(std::to_string(*i));
+    }
+    char buffer[32];
+    auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer),
+                                   std::get<float>(value.value()));
+    return Value(std::string(buffer, ptr));
+  }
+  return std::nullopt;
+}
+
 auto Tuple::GetValue(const std::string &column_name) const
     -> std::optional<const Value *> {
-  auto value = value_map_.find(column_name);
-  if (value != value_map_.end()) {
-    return value->second;
+  for (const auto &[key, value] : values_) {
+    if (key == column_name) {
+      return value;
+    }
   }
   return std::nullopt;
 }
 
 void Tuple::InsertValue(const std::string &column_name, const Value *value) {
-  value_map_.insert({column_name, value});
+  if (!GetValue(column_name)) {
+    values_.emplace_back(column_name, value);
+  }
+}
+
+auto PartitionSpec::Validate(const std::vector<Column *> &columns) const
+    -> std::expected<void, Error> {
+  const auto column =
+      std::find_if(columns.begin(), columns.end(), [this](const auto *column) {
+        return column->name() == column_;
+      });
+  if (column == columns.end()) {
+    return std::unexpected(Error("No column found: " + column_,
+                                 Error::Kind::NoColumnFound));
+  }
+  if (kind_ == Kind::RANGE && (*column)->type() != Column::Type::INT) {
+    return std::unexpected(
+        Error("Range partitioning requires an INT column: " + column_));
+  }
+  if (kind_ == Kind::RANGE &&
+      std::adjacent_find(bounds_.begin(), bounds_.end(),
+                         std::greater_equal<>()) != bounds_.end()) {
+    return std::unexpected(Error("Partition bounds must be ascending"));
+  }
+  if (partition_count_ == 0 || partition_count_ > kMaxPartitions) {
+    return std::unexpected(Error("A table needs between 1 and " +
+                                 std::to_string(kMaxPartitions) +
+                                 " partitions"));
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto PartitionSpec::PartitionOf(const Value &key) const -> size_t {
+  if (kind_ == Kind::RANGE) {
+    return std::upper_bound(bounds_.begin(), bounds_.end(),
+                            std::get<int>(key.value())) -
+           bounds_.begin();
+  }
+  return std::hash<std::variant<std::string, int, float, bool>>{}(
+             key.value()) %
+         partition_count_;
+}
+
+auto StorageOptions::Validate(
+    const std::vector<Column *> &columns,
+    const std::optional<PartitionSpec> &partitioning) const
+    -> std::expected<void, Error> {
+  if (engine == Engine::HEAP) {
+    return std::expected<void, Error>(std::in_place);
+  }
+  if (std::none_of(columns.begin(), columns.end(), [this](const auto *column) {
+        return column->name() == key_column;
+      })) {
+    return std::unexpected(Error("No column found: " + key_column,
+                                 Error::Kind::NoColumnFound));
+  }
+  if (partitioning) {
+    return std::unexpected(Error("LSM tables cannot be partitioned"));
+  }
+  if (memtable_rows == 0) {
+    return std::unexpected(Error("An LSM memtable needs room for a row"));
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+Table::Table(std::string name, std::vector<Column *> columns,
+             std::optional<PartitionSpec> partitioning,
+             StorageOptions storage)
+    : name_(std::move(name)), columns_(std::move(columns)),
+      partitioning_(std::move(partitioning)), storage_(std::move(storage)) {
+  for (size_t slot = 0; slot < columns_.size(); ++slot) {
+    columns_[slot]->slot_ = slot;
+  }
+  if (storage_.engine == StorageOptions::Engine::LSM) {
+    LsmOptions options;
+    options.memtable_entries = storage_.memtable_rows;
+    lsm_ = std::make_unique<LsmTree>(options);
+    lsm_key_column_ = *GetColumn(storage_.key_column);
+    return;
+  }
+  const size_t partition_count =
+      partitioning_ ? partitioning_->partition_count() : 1;
+  for (size_t i = 0; i < partition_count; ++i) {
+    partitions_.push_back(new Partition());
+  }
+  if (partitioning_) {
+    partition_column_ = *GetColumn(partitioning_->column());
+  }
+}
+
+// Only a table that was never added to a database is destroyed.
+Table::~Table() {
+  for (const auto *partition : partitions_) {
+    delete partition;
+  }
 }
 
 auto Table::InsertTuple(Tuple *tuple) -> std::expected<const Tuple *, Error> {
-  if (tuple->values_map().size() != columns_.size()) {
+  if (auto inserted = InsertTuples({tuple}); !inserted) {
+    return std::unexpected(inserted.error());
+  }
+  return tuple;
+}
+
+auto Table::InsertTuples(const std::vector<Tuple *> &tuples)
+    -> std::expected<void, Error> {
+  for (auto *tuple : tuples) {
+    if (auto prepared = PrepareTuple(tuple); !prepared) {
+      return std::unexpected(prepared.error());
+    }
+  }
+  // One column of the batch at a time, so that the parent's Bloom filter
+  // and hash set stay in cache.
+  std::vector<const Value *> keys;
+  for (const auto &reference : references_) {
+    keys.clear();
+    for (const auto *tuple : tuples) {
+      if (const auto *key = reference.column->Read(*tuple); key != nullptr) {
+        keys.push_back(key);
+      }
+    }
+    if (reference.index->FirstMissing(keys)) {
+      return std::unexpected(Error(
+          "Foreign key violation: " + reference.column->name() +
+          " has no match in " + reference.parent->name() + "." +
+          reference.parent_column->name()));
+    }
+  }
+  for (auto *tuple : tuples) {
+    StoreTuple(tuple);
+  }
+  ++data_version_;
+  for (auto *view : views_) {
+    view->RowsInserted(tuples);
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto Table::PrepareTuple(Tuple *tuple) -> std::expected<void, Error> {
+  // Lay the values out in column order, so that every column finds its
+  // value at its slot.
+  Tuple::Values values;
+  values.reserve(columns_.size());
+  // Owned here until the tuple takes them, so a rejected tuple is left as
+  // it was.
+  std::vector<std::unique_ptr<Value>> defaults;
+  size_t given = 0;
+  for (const auto *column : columns_) {
+    auto value = tuple->GetValue(column->storage_key(), values.size());
+    if (value) {
+      ++given;
+    } else if (column->default_value() == nullptr) {
+      return std::unexpected(Error("Tuple does not match table schema"));
+    } else {
+      defaults.push_back(std::make_unique<Value>(*column->default_value()));
+      value = defaults.back().get();
+    }
+    values.emplace_back(column->storage_key(), *value);
+  }
+  if (given != tuple->values().size()) {
     return std::unexpected(Error("Tuple does not match table schema"));
   }
+  if (lsm_ != nullptr && values[lsm_key_column_->slot()].second == nullptr) {
+    return std::unexpected(Error("LSM key cannot be NULL"));
+  }
+  if (partitioning_ &&
+      values[partition_column_->slot()].second == nullptr) {
+    return std::unexpected(Error("Partition key cannot be NULL"));
+  }
 
-  tuples_.push_back(tuple);
-  return tuple;
+  tuple->set_values(std::move(values));
+  tuple->set_schema_version(schema_version_);
+  for (auto &value : defaults) {
+    (void)value.release();
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+void Table::StoreTuple(Tuple *tuple) {
+  if (lsm_ != nullptr) {
+    // The conversion only visits the rows it started with.
+    if (conversion_) {
+      ConvertTuple(tuple);
+    }
+    lsm_->Insert(lsm_key_column_->Read(*tuple), tuple);
+  } else {
+    const auto partition =
+        partitioning_
+            ? partitioning_->PartitionOf(*partition_column_->Read(*tuple))
+            : 0;
+    // Rows of partitions the conversion has yet to finish are converted
+    // when it gets there.
+    if (conversion_ && partition < conversion_->next_partition) {
+      ConvertTuple(tuple);
+    }
+    partitions_[partition]->tuples.push_back(tuple);
+  }
+  for (auto &index : key_indexes_) {
+    if (const auto *key = index->column()->Read(*tuple); key != nullptr) {
+      index->Add(key);
+    }
+  }
+  if (statistics_ != nullptr) {
+    statistics_->Add(*tuple);
+  }
+}
+
+auto Table::AddForeignKey(const ForeignKey &foreign_key, Table *parent)
+    -> std::expected<void, Error> {
+  const auto resolved = ResolveForeignKey(foreign_key, columns_, *parent);
+  if (!resolved) {
+    return std::unexpected(resolved.error());
+  }
+  const auto [column, parent_column] = *resolved;
+
+  // A new index joins the parent only with the foreign key, so that a
+  // rejected one leaves nothing behind for the parent's inserts to update.
+  const KeyIndex *index = parent->key_index(parent_column);
+  std::unique_ptr<KeyIndex> created;
+  if (index == nullptr) {
+    created = std::make_unique<KeyIndex>(parent_column);
+    for (const auto *tuple : parent->tuples()) {
+      if (const auto *key = parent_column->Read(*tuple); key != nullptr) {
+        created->Add(key);
+      }
+    }
+    index = created.get();
+  }
+  std::vector<const Value *> keys;
+  for (const auto *tuple : tuples()) {
+    if (const auto *key = column->Read(*tuple); key != nullptr) {
+      keys.push_back(key);
+    }
+  }
+  if (index->FirstMissing(keys)) {
+    return std::unexpected(Error("Existing rows violate foreign key " +
+                                 foreign_key.column));
+  }
+  if (created) {
+    parent->key_indexes_.push_back(std::move(created));
+  }
+  references_.push_back({column, parent, parent_column, index});
+  parent->referenced_by_.push_back(this);
+  return std::expected<void, Error>(std::in_place);
+}
+
+void Table::DropForeignKeys() {
+  for (const auto &reference : references_) {
+    auto &referenced_by = reference.parent->referenced_by_;
+    // Each foreign key added one entry.
+    referenced_by.erase(
+        std::find(referenced_by.begin(), referenced_by.end(), this));
+  }
+  references_.clear();
+}
+
+void Table::StopBackgroundWork() {
+  if (lsm_ != nullptr) {
+    lsm_->Stop();
+  }
+}
+
+auto Table::key_index(const Column *column) const -> const KeyIndex * {
+  for (const auto &index : key_indexes_) {
+    if (index->column() == column) {
+      return index.get();
+    }
+  }
+  return nullptr;
+}
+
+auto Table::ColumnLocked(const Column *column) const
+    -> std::optional<std::string> {
+  if (column == partition_column_) {
+    return "the partition key column";
+  }
+  if (column == lsm_key_column_) {
+    return "the LSM key column";
+  }
+  for (const auto &reference : references_) {
+    if (reference.column == column) {
+      return "a foreign key column";
+    }
+  }
+  for (const auto *child : referenced_by_) {
+    for (const auto &reference : child->references_) {
+      if (reference.parent == this && reference.parent_column == column) {
+        return "referenced by a foreign key of " + child->name();
+      }
+    }
+  }
+  for (const auto *view : views_) {
+    if (view->ReadsColumn(column)) {
+      return "read by view " + view->name();
+    }
+  }
+  return std::nullopt;
+}
+
+void Table::RemoveView(const View *view) {
+  std::erase(views_, view);
+}
+
+auto Table::Analyze() -> const TableStatistics * {
+  statistics_ = TableStatistics::Analyze(*this);
+  return statistics_.get();
 }
 
 auto Table::SelectTuple(const std::string &column_name,
                         const Value *value) const
     -> std::vector<const Tuple *> {
+  const auto column = GetColumn(column_name);
+  if (!column) {
+    return {};
+  }
   std::vector<const Tuple *> result;
-  for (const auto &tuple : tuples_) {
-    if (auto tuple_value = tuple->GetValue(column_name);
-        tuple_value.has_value() && tuple_value.value() == value) {
+  for (const auto *tuple : tuples()) {
+    if ((*column)->Read(*tuple) == value) {
       result.push_back(tuple);
     }
   }
   return result;
 }
 
+auto Table::SelectByKey(const std::string &column_name,
+                        const Value &key) const
+    -> std::vector<const Tuple *> {
+  const auto column = GetColumn(column_name);
+  if (!column) {
+    return {};
+  }
+  if (*column == lsm_key_column_) {
+    return lsm_->Get(key);
+  }
+  std::vector<const Tuple *> result;
+  for (const auto *tuple : tuples()) {
+    const auto *value = (*column)->Read(*tuple);
+    if (value != nullptr && value->value() == key.value()) {
+      result.push_back(tuple);
+    }
+  }
+  return result;
+}
+
+auto Table::tuples() const -> std::vector<Tuple *> {
+  std::vector<Tuple *> tuples;
+  tuples.reserve(row_count());
+  if (lsm_ != nullptr) {
+    auto cursor = lsm_->Scan(std::nullopt, std::nullopt);
+    std::vector<const Tuple *> rows;
+    while (cursor.Next(lsm_->size(), rows)) {
+    }
+    for (const auto *tuple : rows) {
+      tuples.push_back(const_cast<Tuple *>(tuple));
+    }
+    return tuples;
+  }
+  for (const auto *partition : partitions_) {
+    tuples.insert(tuples.end(), partition->tuples.begin(),
+                  partition->tuples.end());
+  }
+  return tuples;
+}
+
+auto Table::row_count() const -> size_t {
+  if (lsm_ != nullptr) {
+    return lsm_->size();
+  }
+  size_t rows = 0;
+  for (const auto *partition : partitions_) {
+    rows += partition->tuples.size();
+  }
+  return rows;
+}
+
 auto Table::AddColumn(Column *column) -> std::expected<void, Error> {
+  if (auto valid = ValidateColumnName(column->name()); !valid) {
+    return valid;
+  }
   for (const auto &col : columns_) {
     if (col->name() == column->name()) {
       return std::unexpected(Error("Column already exists"));
     }
   }
+  if (column->default_value() != nullptr &&
+      TypeOf(*column->default_value()) != column->type()) {
+    return std::unexpected(
+        Error("Default value does not match the type of column " +
+              column->name()));
+  }
 
+  // A fresh storage key keeps values of a dropped column with the same name
+  // from showing through.
+  ++schema_version_;
+  column->added_version_ = schema_version_;
+  column->storage_key_ = NewStorageKey(column->name());
+  column->slot_ = columns_.size();
   columns_.push_back(column);
+  if (statistics_ != nullptr) {
+    statistics_->AddColumn(column);
+  }
   return std::expected<void, Error>(std::in_place);
 }
 
@@ -52,7 +577,23 @@ auto Table::DropColumn(const std::string &column_name)
     -> std::expected<void, Error> {
   for (auto it = columns_.begin(); it != columns_.end(); ++it) {
     if ((*it)->name() == column_name) {
+      if (const auto locked = ColumnLocked(*it); locked) {
+        return std::unexpected(
+            Error("Cannot drop " + column_name + ": " + *locked));
+      }
+      if (statistics_ != nullptr) {
+        statistics_->DropColumn(*it);
+      }
+      if (conversion_ && conversion_->column == *it) {
+        conversion_.reset();
+      }
+      ++schema_version_;
       columns_.erase(it);
+      // Rows inserted from now on close the gap; older rows keep the value,
+      // and reads of the later columns search them.
+      for (size_t slot = 0; slot < columns_.size(); ++slot) {
+        columns_[slot]->slot_ = slot;
+      }
       return std::expected<void, Error>(std::in_place);
     }
   }
@@ -60,30 +601,239 @@ auto Table::DropColumn(const std::string &column_name)
   return std::unexpected(Error("Column does not exist"));
 }
 
+auto Table::RenameColumn(const std::string &column_name, std::string new_name)
+    -> std::expected<void, Error> {
+  if (auto valid = ValidateColumnName(new_name); !valid) {
+    return valid;
+  }
+  if (GetColumn(new_name)) {
+    return std::unexpected(Error("Column already exists"));
+  }
+  for (auto *column : columns_) {
+    if (column->name() == column_name) {
+      column->rename_column(std::move(new_name));
+      ++schema_version_;
+      return std::expected<void, Error>(std::in_place);
+    }
+  }
+
+  return std::unexpected(Error("Column not found"));
+}
+
+auto Table::ModifyColumnType(const std::string &column_name, Column::Type type)
+    -> std::expected<void, Error> {
+  Column *column = nullptr;
+  for (auto *candidate : columns_) {
+    if (candidate->name() == column_name) {
+      column = candidate;
+    }
+  }
+  if (column == nullptr) {
+    return std::unexpected(Error("Column not found"));
+  }
+  if (const auto locked = ColumnLocked(column); locked) {
+    return std::unexpected(
+        Error("Cannot change the type of " + column_name + ": " + *locked));
+  }
+  if (conversion_) {
+    return std::unexpected(
+        Error("A column type change is already in progress"));
+  }
+  if (column->type() == type) {
+    return std::expected<void, Error>(std::in_place);
+  }
+
+  ++schema_version_;
+  conversion_ = TypeConversion{.column = column,
+                               .type = type,
+                               .storage_key = NewStorageKey(column->name()),
+                               .next_partition = 0,
+                               .next_row = 0,
+                               .lsm_rows = {}};
+  if (lsm_ != nullptr) {
+    conversion_->lsm_rows = tuples();
+  }
+  // An empty table switches over right away.
+  ConvertRows(0);
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto Table::ConvertRows(size_t max_rows) -> bool {
+  if (!conversion_) {
+    return true;
+  }
+  auto &conversion = *conversion_;
+  auto *column = conversion.column;
+  for (; conversion.next_row < conversion.lsm_rows.size();
+       ++conversion.next_row) {
+    if (max_rows == 0) {
+      return false;
+    }
+    --max_rows;
+    ConvertTuple(conversion.lsm_rows[conversion.next_row]);
+  }
+  for (; conversion.next_partition < partitions_.size();
+       ++conversion.next_partition, conversion.next_row = 0) {
+    const auto &tuples = partitions_[conversion.next_partition]->tuples;
+    for (; conversion.next_row < tuples.size(); ++conversion.next_row) {
+      if (max_rows == 0) {
+        return false;
+      }
+      --max_rows;
+      ConvertTuple(tuples[conversion.next_row]);
+    }
+  }
+
+  // Every row has a value under the new key: switch the column over.
+  if (column->default_value_ != nullptr) {
+    auto converted = ConvertValue(*column->default_value_, conversion.type);
+    column->default_value_ =
+        converted ? new Value(std::move(*converted)) : nullptr;
+  }
+  column->type_ = conversion.type;
+  column->storage_key_ = std::move(conversion.storage_key);
+  if (statistics_ != nullptr) {
+    // They describe the old values; the next ANALYZE rebuilds them.
+    statistics_->DropColumn(column);
+  }
+  ++schema_version_;
+  conversion_.reset();
+  return true;
+}
+
+void Table::ConvertTuple(Tuple *tuple) {
+  const auto &conversion = *conversion_;
+  if (tuple->schema_version() < conversion.column->added_version()) {
+    // The row reads the default, which is converted when the column
+    // switches over.
+    return;
+  }
+  const auto *value = conversion.column->Read(*tuple);
+  auto converted = value ? ConvertValue(*value, conversion.type) : std::nullopt;
+  tuple->InsertValue(conversion.storage_key,
+                     converted ? new Value(std::move(*converted)) : nullptr);
+}
+
+auto Table::DropPartition(size_t index) -> std::expected<size_t, Error> {
+  if (lsm_ != nullptr) {
+    return std::unexpected(Error("LSM tables have no partitions"));
+  }
+  if (!referenced_by_.empty()) {
+    return std::unexpected(
+        Error("Cannot drop a partition of " + name_ +
+              ": referenced by a foreign key of " +
+              referenced_by_.front()->name()));
+  }
+  if (index >= partitions_.size()) {
+    return std::unexpected(Error("Partition " + std::to_string(index) +
+                                 " does not exist"));
+  }
+  const auto *dropped = partitions_[index];
+  partitions_[index] = new Partition();
+  ++data_version_;
+  for (auto *view : views_) {
+    view->RowsRemoved(dropped->tuples);
+  }
+  return dropped->tuples.size();
+}
+
+auto Table::NewStorageKey(const std::string &column_name) -> std::string {
+  // ValidateColumnName keeps NUL out of column names, so this never
+  // collides with the storage key of a column created with the table (its
+  // name).
+  return column_name + '\0' + std::to_string(schema_version_);
+}
+
 auto Database::CreateTable(const std::string &name,
-                           std::vector<Column *> columns)
+                           std::vector<Column *> columns,
+                           std::optional<PartitionSpec> partitioning,
+                           StorageOptions storage,
+                           const std::vector<ForeignKey> &foreign_keys)
     -> std::expected<const Table *, Error> {
   if (tables_.find(name) != tables_.end()) {
     return std::unexpected(Error("Table already exists"));
   }
-  auto *table = new Table(name, std::move(columns));
-  auto [it, is_inserted] = tables_.insert({table->name(), table});
+  if (views_.find(name) != views_.end()) {
+    return std::unexpected(Error("A view named " + name + " exists"));
+  }
+  for (const auto *column : columns) {
+    if (auto valid = ValidateColumnName(column->name()); !valid) {
+      return std::unexpected(valid.error());
+    }
+  }
+  if (partitioning) {
+    if (auto valid = partitioning->Validate(columns); !valid) {
+      return std::unexpected(valid.error());
+    }
+  }
+  if (auto valid = storage.Validate(columns, partitioning); !valid) {
+    return std::unexpected(valid.error());
+  }
+  std::vector<Table *> parents;
+  for (const auto &foreign_key : foreign_keys) {
+    auto parent = GetModifiableTable(foreign_key.parent_table);
+    if (!parent) {
+      return std::unexpected(
+          Error("Table does not exist: " + foreign_key.parent_table));
+    }
+    if (auto resolved = ResolveForeignKey(foreign_key, columns, **parent);
+        !resolved) {
+      return std::unexpected(resolved.error());
+    }
+    parents.push_back(*parent);
+  }
+
+  auto table = std::make_unique<Table>(
+      name, std::move(columns), std::move(partitioning), std::move(storage));
+  // The table has no rows yet, so its checked foreign keys cannot fail.
+  for (size_t i = 0; i < foreign_keys.size(); ++i) {
+    if (auto added = table->AddForeignKey(foreign_keys[i], parents[i]);
+        !added) {
+      table->DropForeignKeys();
+      return std::unexpected(added.error());
+    }
+  }
+  auto [it, is_inserted] = tables_.insert({table->name(), table.get()});
   if (!is_inserted) {
+    table->DropForeignKeys();
     return std::unexpected(Error("Cannot create table"));
   }
+  (void)table.release();
+  ++catalog_version_;
   return it->second;
 }
 
 auto Database::DropTable(const std::string &table_name)
     -> std::expected<void, Error> {
-  if (tables_.find(table_name) == tables_.end()) {
+  const auto table = tables_.find(table_name);
+  if (table == tables_.end()) {
     return std::unexpected(Error("Table does not exist"));
   }
+  if (const auto &children = table->second->referenced_by();
+      !children.empty()) {
+    return std::unexpected(Error("Table " + table_name +
+                                 " is referenced by a foreign key of " +
+                                 children.front()->name()));
+  }
+  if (const auto &views = table->second->views(); !views.empty()) {
+    return std::unexpected(Error("Table " + table_name + " is read by view " +
+                                 views.front()->name()));
+  }
 
+  table->second->DropForeignKeys();
+  // Tables are never freed, since queries may still be reading them.
+  table->second->StopBackgroundWork();
   tables_.erase(table_name);
+  ++catalog_version_;
   return std::expected<void, Error>(std::in_place);
 }
 
+void Database::StopBackgroundWork() {
+  for (auto &[name, table] : tables_) {
+    table->StopBackgroundWork();
+  }
+}
+
 auto Database::UpdateTable(const std::string &table_name, Table *table)
     -> std::expected<const Table *, Error> {
   if (tables_.find(table_name) == tables_.end()) {
@@ -92,6 +842,7 @@ auto Database::UpdateTable(const std::string &table_name, Table *table)
 
   tables_.erase(table_name);
   tables_[table_name] = table;
+  ++catalog_version_;
   return table;
 }
 
@@ -113,6 +864,46 @@ auto Database::GetModifiableTable(const std::string &name) const
   return std::nullopt;
 }
 
+auto Database::AddView(std::unique_ptr<View> view)
+    -> std::expected<const View *, Error> {
+  const auto &name = view->name();
+  if (tables_.find(name) != tables_.end()) {
+    return std::unexpected(Error("A table named " + name + " exists"));
+  }
+  if (views_.find(name) != views_.end()) {
+    return std::unexpected(Error("View already exists"));
+  }
+  const auto table = GetModifiableTable(view->table()->name());
+  if (!table || *table != view->table()) {
+    return std::unexpected(Error("Table does not exist"));
+  }
+  (*table)->AddView(view.get());
+  ++catalog_version_;
+  return views_.emplace(name, std::move(view)).first->second.get();
+}
+
+auto Database::DropView(const std::string &name)
+    -> std::expected<void, Error> {
+  const auto view = views_.find(name);
+  if (view == views_.end()) {
+    return std::unexpected(Error("View does not exist"));
+  }
+  if (auto table = GetModifiableTable(view->second->table()->name()); table) {
+    (*table)->RemoveView(view->second.get());
+  }
+  views_.erase(view);
+  ++catalog_version_;
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto Database::GetView(const std::string &name) const
+    -> std::optional<const View *> {
+  if (auto view = views_.find(name); view != views_.end()) {
+    return view->second.get();
+  }
+  return std::nullopt;
+}
+
 auto DatabaseManager::CreateDatabase(const std::string &name)
     -> std::expected<void, Error> {
   if (databases_.find(name) != databases_.end()) {
@@ -130,6 +921,7 @@ auto DatabaseManager::DropDatabase(const std::string &name)
     return std::unexpected(Error("Database does not exist"));
   }
 
+  it->second->StopBackgroundWork();
   databases_.erase(it);
   return std::expected<void, Error>(std::in_place);
 }
@@ -171,7 +963,9 @@ auto DdlQueryExec::ExecuteCreateTableQuery(const CreateTableQuery &query)
   if (!current_db) {
     return std::unexpected(Error("No database selected"));
   }
-  return (*current_db)->CreateTable(query.table_name(), query.columns());
+  return (*current_db)->CreateTable(query.table_name(), query.columns(),
+                                    query.partitioning(), query.storage(),
+                                    query.foreign_keys());
 }
 
 auto DdlQueryExec::ExecuteDropTableQuery(const DropTableQuery &query)
@@ -205,29 +999,49 @@ auto DdlQueryExec::ExecuteAlterTableQuery(const AlterTableQuery &query)
   }
 
   case AlterTableQuery::AlterType::MODIFY_DATATYPE: {
-    for (auto *column : (*table)->columns()) {
-      if (column->name() == query.column()->name()) {
-        const auto new_column_type = query.new_column_type().value();
-        column->set_type(new_column_type);
-        return std::expected<void, Error>(std::in_place);
-      }
+    if (!query.new_column_type()) {
+      return std::unexpected(Error("No new column type given"));
     }
-
-    return std::unexpected(Error("Column not found"));
+    return (*table)->ModifyColumnType(query.column()->name(),
+                                      *query.new_column_type());
   }
 
   case AlterTableQuery::AlterType::RENAME_COLUMN: {
-    for (auto *column : (*table)->columns()) {
-      if (column->name() == query.column()->name()) {
-        const auto new_name = query.new_column_name().value();
-        column->rename_column(new_name);
-        return std::expected<void, Error>(std::in_place);
-      }
+    if (!query.new_column_name()) {
+      return std::unexpected(Error("No new column name given"));
     }
+    return (*table)->RenameColumn(query.column()->name(),
+                                  *query.new_column_name());
+  }
+  }
+}
 
-    return std::unexpected(Error("Column not found"));
+auto DdlQueryExec::ExecuteAnalyzeTableQuery(const AnalyzeTableQuery &query)
+    -> std::expected<const TableStatistics *, Error> {
+  auto current_db = db_manager_->current_database();
+  if (!current_db) {
+    return std::unexpected(Error("No database selected"));
+  }
+
+  auto table = (*current_db)->GetModifiableTable(query.table_name());
+  if (!table) {
+    return std::unexpected(Error("Table name not found"));
+  }
+  return (*table)->Analyze();
+}
+
+auto DdlQueryExec::ExecuteDropPartitionQuery(const DropPartitionQuery &query)
+    -> std::expected<size_t, Error> {
+  auto current_db = db_manager_->current_database();
+  if (!current_db) {
+    return std::unexpected(Error("No database selected"));
   }
+
+  auto table = (*current_db)->GetModifiableTable(query.table_name());
+  if (!table) {
+    return std::unexpected(Error("Table name not found"));
   }
+  return (*table)->DropPartition(query.partition());
 }
 
 } // namespace JustADb
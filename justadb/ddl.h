@@ -1,8 +1,11 @@
 #pragma once
 
+#include "memory.h"
 #include "utils.h"
 
+#include <cstdint>
 #include <expected>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -12,12 +15,16 @@
 
 namespace JustADb {
 
+class TableStatistics;
+class Tuple;
+
 class Value {
 public:
   explicit Value(std::variant<std::string, int, float, bool> value)
       : value_(std::move(value)) {}
 
-  [[nodiscard]] auto value() const {
+  [[nodiscard]] auto value() const
+      -> const std::variant<std::string, int, float, bool> & {
     return value_;
   }
 
@@ -29,7 +36,9 @@ class Column {
 public:
   enum class Type { INT, STRING, BOOL, FLOAT };
 
-  Column(std::string name, Type type) : name_(std::move(name)), type_(type) {}
+  Column(std::string name, Type type, const Value *default_value = nullptr)
+      : name_(std::move(name)), type_(type), default_value_(default_value),
+        storage_key_(name_) {}
 
   [[nodiscard]] auto name() const {
     return name_;
@@ -49,53 +58,342 @@ public:
     return this;
   }
 
+  // Filled in for rows inserted without a value for the column, and read by
+  // rows written before the column was added. nullptr means NULL.
+  [[nodiscard]] auto default_value() const -> const Value * {
+    return default_value_;
+  }
+
+  // The key the column's values are stored under in a Tuple. Unlike the name
+  // it survives renames, and a new one is used when the type changes.
+  [[nodiscard]] auto storage_key() const -> const std::string & {
+    return storage_key_;
+  }
+
+  // The table schema version the column was added in.
+  [[nodiscard]] auto added_version() const {
+    return added_version_;
+  }
+
+  // Where the column's value sits in tuples laid out in the table's column
+  // order. Resolved once, when the column joins the table, so that reads
+  // usually find the value without searching the tuple for its key.
+  [[nodiscard]] auto slot() const {
+    return slot_;
+  }
+
+  void set_slot(size_t slot) {
+    slot_ = slot;
+  }
+
+  // The column's value in `tuple`, or nullptr for NULL.
+  [[nodiscard]] auto Read(const Tuple &tuple) const -> const Value *;
+
 private:
+  friend class Table;
+
   std::string name_;
   Type type_;
+  const Value *default_value_;
+  std::string storage_key_;
+  uint64_t added_version_ = 0;
+  size_t slot_ = 0;
 };
 
+[[nodiscard]] auto TypeOf(const Value &value) -> Column::Type;
+
+// A well-mixed 64-bit hash, for structures that index by the hash's bits.
+[[nodiscard]] auto HashValue(const Value &value) -> uint64_t;
+
+// `value` as a value of `type`, or std::nullopt when it has no such
+// representation (e.g. the string "abc" as an INT).
+[[nodiscard]] auto ConvertValue(const Value &value, Column::Type type)
+    -> std::optional<Value>;
+
 class Tuple {
 public:
-  Tuple() : value_map_({}) {}
+  using Values = std::vector<std::pair<std::string, const Value *>>;
 
-  explicit Tuple(std::unordered_map<std::string, const Value *> value_map)
-      : value_map_(std::move(value_map)) {}
+  Tuple() = default;
+
+  explicit Tuple(const std::unordered_map<std::string, const Value *> &values)
+      : values_(values.begin(), values.end()) {}
 
   [[nodiscard]] auto GetValue(const std::string &column_name) const
       -> std::optional<const Value *>;
 
+  // Checks `slot` before searching the rest of the tuple.
+  [[nodiscard]] auto GetValue(const std::string &column_name, size_t slot) const
+      -> std::optional<const Value *> {
+    if (slot < values_.size() && values_[slot].first == column_name) {
+      return values_[slot].second;
+    }
+    return GetValue(column_name);
+  }
+
+  // Does nothing if the tuple already has a value for `column_name`.
   void InsertValue(const std::string &column_name, const Value *value);
 
   [[nodiscard]] auto is_empty() const {
-    return value_map_.empty();
+    return values_.empty();
   }
 
-  [[nodiscard]] auto values_map() const {
-    return value_map_;
+  // Keyed by storage key. Tables store their rows in column order (see
+  // Column::slot()); values added later, e.g. by a type change, follow.
+  [[nodiscard]] auto values() const -> const Values & {
+    return values_;
+  }
+
+  void set_values(Values values) {
+    values_ = std::move(values);
+  }
+
+  // The schema version of the table when the tuple was inserted.
+  [[nodiscard]] auto schema_version() const {
+    return schema_version_;
+  }
+
+  void set_schema_version(uint64_t schema_version) {
+    schema_version_ = schema_version;
   }
 
 private:
-  std::unordered_map<std::string, const Value *> value_map_;
+  Values values_;
+  uint64_t schema_version_ = 0;
+};
+
+// How a table's rows are split into partitions. Each partition is stored on
+// its own, so that queries can skip the partitions their where-clauses rule
+// out and a partition can be dropped without touching its rows.
+class PartitionSpec {
+public:
+  enum class Kind { RANGE, HASH };
+
+  static constexpr size_t kMaxPartitions = 4096;
+
+  // Partition i holds the rows with bounds[i - 1] <= key < bounds[i]; the
+  // first partition is unbounded below and the last one above, so there is
+  // one more partition than bounds. The key must be an INT column.
+  static auto Range(std::string column, std::vector<int> bounds)
+      -> PartitionSpec {
+    const auto partition_count = bounds.size() + 1;
+    return PartitionSpec(Kind::RANGE, std::move(column), std::move(bounds),
+                         partition_count);
+  }
+
+  static auto Hash(std::string column, size_t partition_count)
+      -> PartitionSpec {
+    return PartitionSpec(Kind::HASH, std::move(column), {}, partition_count);
+  }
+
+  // Checks the spec against the columns of the table it is for.
+  [[nodiscard]] auto Validate(const std::vector<Column *> &columns) const
+      -> std::expected<void, Error>;
+
+  // The partition a (non-NULL) key belongs to.
+  [[nodiscard]] auto PartitionOf(const Value &key) const -> size_t;
+
+  [[nodiscard]] auto kind() const {
+    return kind_;
+  }
+
+  [[nodiscard]] auto column() const -> const std::string & {
+    return column_;
+  }
+
+  [[nodiscard]] auto bounds() const -> const std::vector<int> & {
+    return bounds_;
+  }
+
+  [[nodiscard]] auto partition_count() const {
+    return partition_count_;
+  }
+
+private:
+  PartitionSpec(Kind kind, std::string column, std::vector<int> bounds,
+                size_t partition_count)
+      : kind_(kind), column_(std::move(column)), bounds_(std::move(bounds)),
+        partition_count_(partition_count) {}
+
+  Kind kind_;
+  std::string column_;
+  std::vector<int> bounds_;
+  size_t partition_count_;
+};
+
+// How a table stores its rows. A HEAP table appends them to its partitions
+// in insertion order. An LSM table files them under a key column in a
+// log-structured merge tree (lsm.h), which keeps them in key order at a low
+// insert cost: for ingest-heavy tables that are read by key or key range.
+struct StorageOptions {
+  enum class Engine { HEAP, LSM };
+
+  static auto Lsm(std::string key_column, size_t memtable_rows = 4096)
+      -> StorageOptions {
+    return {Engine::LSM, std::move(key_column), memtable_rows};
+  }
+
+  // Checks the options against the table they are for.
+  [[nodiscard]] auto
+  Validate(const std::vector<Column *> &columns,
+           const std::optional<PartitionSpec> &partitioning) const
+      -> std::expected<void, Error>;
+
+  Engine engine = Engine::HEAP;
+  // The column an LSM table is ordered by.
+  std::string key_column;
+  // Rows an LSM table buffers in its memtable before they are flushed into
+  // a sorted run.
+  size_t memtable_rows = 4096;
+};
+
+// Every non-NULL value of `column` must appear in `parent_column` of
+// `parent_table`. Rows with a NULL key are not checked.
+struct ForeignKey {
+  std::string column;
+  std::string parent_table;
+  std::string parent_column;
+};
+
+class KeyIndex;
+class LsmTree;
+class Table;
+
+// Something derived from one table's rows and kept current by the table,
+// which reports every change to the rows to it; see MaterializedView
+// (view.h).
+class View {
+public:
+  virtual ~View() = default;
+
+  [[nodiscard]] virtual auto name() const -> const std::string & = 0;
+
+  [[nodiscard]] virtual auto table() const -> const Table * = 0;
+
+  virtual void RowsInserted(const std::vector<Tuple *> &tuples) = 0;
+
+  virtual void RowsRemoved(const std::vector<Tuple *> &tuples) = 0;
+
+  // The columns the view reads cannot be dropped or retyped.
+  [[nodiscard]] virtual auto ReadsColumn(const Column *column) const
+      -> bool = 0;
+};
+
+// The rows of one partition, in insertion order. Partitions are never freed:
+// a scan that started before its partition was dropped finishes reading the
+// old rows.
+struct Partition {
+  std::vector<Tuple *> tuples;
 };
 
 class Table {
 public:
-  Table(std::string name, std::vector<Column *> columns)
-      : name_(std::move(name)), columns_(std::move(columns)), tuples_({}) {}
+  // An unpartitioned heap table keeps all of its rows in a single partition;
+  // an LSM table has no partitions.
+  Table(std::string name, std::vector<Column *> columns,
+        std::optional<PartitionSpec> partitioning = std::nullopt,
+        StorageOptions storage = {});
 
+  ~Table();
+
+  // Fails when the tuple's partition key or LSM key is NULL, or when it
+  // breaks a foreign key.
   auto InsertTuple(Tuple *tuple) -> std::expected<const Tuple *, Error>;
 
+  // Inserts all of `tuples`, or none of them if one fails. Foreign keys are
+  // checked for the whole batch at once. The table owns the tuples and
+  // their values once inserted; after a failure they are still the
+  // caller's.
+  auto InsertTuples(const std::vector<Tuple *> &tuples)
+      -> std::expected<void, Error>;
+
+  // Makes `foreign_key.column` reference a column of `parent`, whose current
+  // rows must already satisfy it.
+  auto AddForeignKey(const ForeignKey &foreign_key, Table *parent)
+      -> std::expected<void, Error>;
+
+  // Undoes AddForeignKey() for every foreign key of the table, so that the
+  // tables it references can be dropped.
+  void DropForeignKeys();
+
+  // Ends the table's background work once it is dropped. Its rows stay
+  // readable for queries still running.
+  void StopBackgroundWork();
+
+  // Recomputes the table's statistics from its rows. Until a table has been
+  // analyzed it has none; afterwards inserts keep them current.
+  auto Analyze() -> const TableStatistics *;
+
+  [[nodiscard]] auto statistics() const -> const TableStatistics * {
+    return statistics_.get();
+  }
+
   auto SelectTuple(const std::string &column_name, const Value *value) const
       -> std::vector<const Tuple *>;
 
   [[nodiscard]] auto SelectAll() const -> std::vector<Tuple *> {
-    return tuples_;
+    return tuples();
   }
 
+  // The rows whose `column_name` equals `key`. Looked up in the tree when
+  // the column is an LSM table's key, otherwise found by a full scan.
+  [[nodiscard]] auto SelectByKey(const std::string &column_name,
+                                 const Value &key) const
+      -> std::vector<const Tuple *>;
+
+  // Schema changes only touch metadata: existing rows are not rewritten.
+  // Rows written before a column was added read its default value.
   auto AddColumn(Column *column) -> std::expected<void, Error>;
 
   auto DropColumn(const std::string &column_name) -> std::expected<void, Error>;
 
+  auto RenameColumn(const std::string &column_name, std::string new_name)
+      -> std::expected<void, Error>;
+
+  // Starts converting a column to `type`. Converted values are written under
+  // a new storage key by ConvertRows(), a chunk at a time, while the column
+  // keeps its old type for readers and writers; once every row is converted
+  // the column switches over at once. Values that have no representation in
+  // the new type become NULL. One conversion may run per table at a time.
+  auto ModifyColumnType(const std::string &column_name, Column::Type type)
+      -> std::expected<void, Error>;
+
+  // Converts up to `max_rows` more rows for the pending type change. Returns
+  // true when no conversion is left pending.
+  auto ConvertRows(size_t max_rows) -> bool;
+
+  // Replaces a partition by an empty one in O(1) and returns how many rows
+  // it held. The partition keeps its key range or hash bucket. The table's
+  // statistics still count the dropped rows until the next ANALYZE. Fails
+  // for LSM tables, and for tables another table's foreign key references,
+  // whose rows could still point into the partition.
+  auto DropPartition(size_t index) -> std::expected<size_t, Error>;
+
+  [[nodiscard]] auto conversion_pending() const {
+    return conversion_.has_value();
+  }
+
+  // Bumped by every schema change.
+  [[nodiscard]] auto schema_version() const {
+    return schema_version_;
+  }
+
+  // Bumped by every change to the rows: each insert and dropped partition.
+  [[nodiscard]] auto data_version() const {
+    return data_version_;
+  }
+
+  // Reports every later change to the rows to `view`, until RemoveView().
+  void AddView(View *view) {
+    views_.push_back(view);
+  }
+
+  void RemoveView(const View *view);
+
+  [[nodiscard]] auto views() const -> const std::vector<View *> & {
+    return views_;
+  }
+
   [[nodiscard]] auto GetColumn(const std::string &name) const
       -> std::optional<const Column *> {
     for (const auto *column : columns_) {
@@ -114,14 +412,103 @@ public:
     return columns_;
   }
 
-  [[nodiscard]] auto tuples() const {
-    return tuples_;
+  // Every row of the table, partition by partition (in key order for an LSM
+  // table). Copies the row pointers; scans should read partitions() or
+  // lsm() instead.
+  [[nodiscard]] auto tuples() const -> std::vector<Tuple *>;
+
+  [[nodiscard]] auto row_count() const -> size_t;
+
+  [[nodiscard]] auto partitioning() const
+      -> const std::optional<PartitionSpec> & {
+    return partitioning_;
+  }
+
+  // The partition key column of a partitioned table.
+  [[nodiscard]] auto partition_column() const -> const Column * {
+    return partition_column_;
   }
 
+  [[nodiscard]] auto partitions() const -> const std::vector<Partition *> & {
+    return partitions_;
+  }
+
+  [[nodiscard]] auto storage() const -> const StorageOptions & {
+    return storage_;
+  }
+
+  // The rows of an LSM table, or nullptr for a heap table.
+  [[nodiscard]] auto lsm() const -> const LsmTree * {
+    return lsm_.get();
+  }
+
+  // The key column of an LSM table.
+  [[nodiscard]] auto lsm_key_column() const -> const Column * {
+    return lsm_key_column_;
+  }
+
+  // The tables with foreign keys into this one.
+  [[nodiscard]] auto referenced_by() const
+      -> const std::vector<const Table *> & {
+    return referenced_by_;
+  }
+
+  // The index of `column`'s values, if a foreign key references it.
+  [[nodiscard]] auto key_index(const Column *column) const
+      -> const KeyIndex *;
+
 private:
+  struct Reference {
+    const Column *column;
+    Table *parent;
+    const Column *parent_column;
+    const KeyIndex *index;
+  };
+
+  struct TypeConversion {
+    Column *column;
+    Column::Type type;
+    std::string storage_key;
+    size_t next_partition = 0;
+    size_t next_row = 0;
+    // The rows of an LSM table when the conversion started; later rows are
+    // converted as they are inserted.
+    std::vector<Tuple *> lsm_rows = {};
+  };
+
+  // Fills in defaults and checks the tuple against the schema.
+  auto PrepareTuple(Tuple *tuple) -> std::expected<void, Error>;
+
+  // Stores a prepared tuple and updates what is derived from the rows.
+  void StoreTuple(Tuple *tuple);
+
+  // Why `column` may not be dropped or retyped, if anything prevents it.
+  [[nodiscard]] auto ColumnLocked(const Column *column) const
+      -> std::optional<std::string>;
+
+  // A storage key no column of the table has used yet.
+  auto NewStorageKey(const std::string &column_name) -> std::string;
+
+  // Writes the converted value of a pending type change for one row.
+  void ConvertTuple(Tuple *tuple);
+
   std::string name_;
   std::vector<Column *> columns_;
-  std::vector<Tuple *> tuples_;
+  std::optional<PartitionSpec> partitioning_;
+  const Column *partition_column_ = nullptr;
+  std::vector<Partition *> partitions_;
+  StorageOptions storage_;
+  // Owned, unlike the rows: it runs the compaction thread.
+  std::unique_ptr<LsmTree> lsm_;
+  const Column *lsm_key_column_ = nullptr;
+  std::vector<Reference> references_;
+  std::vector<const Table *> referenced_by_;
+  std::vector<std::unique_ptr<KeyIndex>> key_indexes_;
+  std::unique_ptr<TableStatistics> statistics_;
+  std::vector<View *> views_;
+  uint64_t schema_version_ = 0;
+  uint64_t data_version_ = 0;
+  std::optional<TypeConversion> conversion_;
 };
 
 class DdlQuery {
@@ -132,7 +519,9 @@ public:
     CREATE_TABLE,
     DROP_TABLE,
     ALTER_TABLE,
-    USE_DB
+    USE_DB,
+    ANALYZE_TABLE,
+    DROP_PARTITION
   };
 
   explicit DdlQuery(Type type) : type_(type) {}
@@ -186,9 +575,12 @@ private:
 
 class CreateTableQuery : public DdlQuery {
 public:
-  CreateTableQuery(std::string table_name, std::vector<Column *> columns)
+  CreateTableQuery(std::string table_name, std::vector<Column *> columns,
+                   std::optional<PartitionSpec> partitioning = std::nullopt,
+                   StorageOptions storage = {})
       : DdlQuery(Type::CREATE_TABLE), table_name_(std::move(table_name)),
-        columns_(std::move(columns)) {}
+        columns_(std::move(columns)), partitioning_(std::move(partitioning)),
+        storage_(std::move(storage)) {}
 
   [[nodiscard]] auto columns() const {
     return columns_;
@@ -198,9 +590,33 @@ public:
     return table_name_;
   }
 
+  [[nodiscard]] auto partitioning() const
+      -> const std::optional<PartitionSpec> & {
+    return partitioning_;
+  }
+
+  [[nodiscard]] auto storage() const -> const StorageOptions & {
+    return storage_;
+  }
+
+  CreateTableQuery &References(std::string column, std::string parent_table,
+                               std::string parent_column) {
+    foreign_keys_.push_back({std::move(column), std::move(parent_table),
+                             std::move(parent_column)});
+    return *this;
+  }
+
+  [[nodiscard]] auto foreign_keys() const
+      -> const std::vector<ForeignKey> & {
+    return foreign_keys_;
+  }
+
 private:
   std::string table_name_;
   std::vector<Column *> columns_;
+  std::optional<PartitionSpec> partitioning_;
+  StorageOptions storage_;
+  std::vector<ForeignKey> foreign_keys_;
 };
 
 class DropTableQuery : public DdlQuery {
@@ -216,6 +632,38 @@ private:
   std::string table_name_;
 };
 
+class AnalyzeTableQuery : public DdlQuery {
+public:
+  explicit AnalyzeTableQuery(std::string table_name)
+      : DdlQuery(Type::ANALYZE_TABLE), table_name_(std::move(table_name)) {}
+
+  [[nodiscard]] auto table_name() const {
+    return table_name_;
+  }
+
+private:
+  std::string table_name_;
+};
+
+class DropPartitionQuery : public DdlQuery {
+public:
+  DropPartitionQuery(std::string table_name, size_t partition)
+      : DdlQuery(Type::DROP_PARTITION), table_name_(std::move(table_name)),
+        partition_(partition) {}
+
+  [[nodiscard]] auto table_name() const {
+    return table_name_;
+  }
+
+  [[nodiscard]] auto partition() const {
+    return partition_;
+  }
+
+private:
+  std::string table_name_;
+  size_t partition_;
+};
+
 class AlterTableQuery : public DdlQuery {
 public:
   enum class AlterType {
@@ -263,13 +711,25 @@ private:
 
 class Database {
 public:
-  explicit Database(std::string name) : name_(std::move(name)) {}
-
-  auto CreateTable(const std::string &name, std::vector<Column *> columns)
+  explicit Database(std::string name)
+      : name_(std::move(name)), memory_(name_, &MemoryTracker::Process()) {}
+
+  // The table takes `columns`; if it cannot be created, they stay the
+  // caller's and nothing else changes.
+  auto CreateTable(const std::string &name, std::vector<Column *> columns,
+                   std::optional<PartitionSpec> partitioning = std::nullopt,
+                   StorageOptions storage = {},
+                   const std::vector<ForeignKey> &foreign_keys = {})
       -> std::expected<const Table *, Error>;
 
+  // Fails while another table has a foreign key into the table, or a view
+  // reads it.
   auto DropTable(const std::string &table_name) -> std::expected<void, Error>;
 
+  // Table::StopBackgroundWork() for every table, once the database is
+  // dropped.
+  void StopBackgroundWork();
+
   auto UpdateTable(const std::string &table_name, Table *table)
       -> std::expected<const Table *, Error>;
 
@@ -279,13 +739,43 @@ public:
   [[nodiscard]] auto GetModifiableTable(const std::string &name) const
       -> std::optional<Table *>;
 
+  // Views share the namespace of tables. The database owns the view, and
+  // the view's table reports its changes to it from now on.
+  auto AddView(std::unique_ptr<View> view)
+      -> std::expected<const View *, Error>;
+
+  auto DropView(const std::string &name) -> std::expected<void, Error>;
+
+  [[nodiscard]] auto GetView(const std::string &name) const
+      -> std::optional<const View *>;
+
   [[nodiscard]] auto name() const {
     return name_;
   }
 
+  // Bumped whenever a table or view is created, dropped or replaced, so
+  // that what was looked up by name can be told apart from what the name
+  // refers to now.
+  [[nodiscard]] auto catalog_version() const {
+    return catalog_version_;
+  }
+
+  // What the database's queries hold, under the process tracker. A limit
+  // here bounds all of them together.
+  [[nodiscard]] auto memory() -> MemoryTracker & {
+    return memory_;
+  }
+
+  [[nodiscard]] auto memory() const -> const MemoryTracker & {
+    return memory_;
+  }
+
 private:
   std::string name_;
+  MemoryTracker memory_;
   std::unordered_map<std::string, Table *> tables_;
+  std::unordered_map<std::string, std::unique_ptr<View>> views_;
+  uint64_t catalog_version_ = 0;
 };
 
 class DatabaseManager {
@@ -338,6 +828,13 @@ public:
   auto ExecuteAlterTableQuery(const AlterTableQuery &query)
       -> std::expected<void, Error>;
 
+  auto ExecuteAnalyzeTableQuery(const AnalyzeTableQuery &query)
+      -> std::expected<const TableStatistics *, Error>;
+
+  // Returns the number of rows dropped.
+  auto ExecuteDropPartitionQuery(const DropPartitionQuery &query)
+      -> std::expected<size_t, Error>;
+
   [[nodiscard]] auto db_manager() const {
     return db_manager_;
   }
@@ -1,39 +1,521 @@
 #include "dml.h"
 
+#include "operators.h"
+#include "planner.h"
+#include "predicate.h"
+#include "result_cache.h"
+#include "view.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
 namespace JustADb {
 
-auto DmlQueryExec::ExecuteSelectQuery(const SelectQuery &query)
-    -> std::expected<std::vector<const Tuple *>, Error> {
+namespace {
+
+// Frees rows a table did not take, with their values.
+void FreeTuples(const std::vector<Tuple *> &tuples) {
+  for (const auto *tuple : tuples) {
+    for (const auto &[key, value] : tuple->values()) {
+      delete value;
+    }
+    delete tuple;
+  }
+}
+
+// A column of one of the tables a select reads: side 0 is the query's own
+// table and side 1 the joined one.
+struct ResolvedColumn {
+  size_t side;
+  const Column *column;
+
+  auto operator==(const ResolvedColumn &other) const -> bool = default;
+};
+
+// Finds "table.column" or a bare "column" among `tables`, earlier tables
+// first.
+auto Resolve(const std::string &name, const std::vector<const Table *> &tables)
+    -> std::expected<ResolvedColumn, Error> {
+  if (const auto dot = name.find('.'); dot != std::string::npos) {
+    for (size_t side = 0; side < tables.size(); ++side) {
+      if (tables[side]->name() != name.substr(0, dot)) {
+        continue;
+      }
+      if (const auto column = tables[side]->GetColumn(name.substr(dot + 1));
+          column) {
+        return ResolvedColumn{side, *column};
+      }
+    }
+  }
+  for (size_t side = 0; side < tables.size(); ++side) {
+    if (const auto column = tables[side]->GetColumn(name); column) {
+      return ResolvedColumn{side, *column};
+    }
+  }
+  return std::unexpected(
+      Error("No column found: " + name, Error::Kind::NoColumnFound));
+}
+
+} // namespace
+
+auto AggregateClause::name() const -> std::string {
+  static constexpr const char *kFunctions[] = {"count", "sum", "min", "max",
+                                               "avg"};
+  return std::string(kFunctions[static_cast<int>(function_)]) + "(" +
+         (column_.empty() ? "*" : column_) + ")";
+}
+
+auto DmlQueryExec::ExecuteSelectQuery(const SelectQuery &query,
+                                      size_t batch_rows, QueryProfile *profile)
+    -> std::expected<ResultCursor, Error> {
+  if (result_cache_ != nullptr && profile == nullptr) {
+    return ExecuteCachedSelectQuery(query, batch_rows);
+  }
+  return PlanSelectQuery(query, batch_rows, profile);
+}
+
+auto DmlQueryExec::ExecuteCachedSelectQuery(const SelectQuery &query,
+                                            size_t batch_rows)
+    -> std::expected<ResultCursor, Error> {
+  const auto versions = ResultCache::CurrentVersions(db_, query);
+  if (!versions) {
+    return PlanSelectQuery(query, batch_rows, nullptr);
+  }
+  auto key = ResultCache::Key(db_, query);
+  if (auto cached = result_cache_->Lookup(key, *versions); cached) {
+    return ResultCursor(std::move(cached->rows),
+                        std::move(cached->column_names), batch_rows);
+  }
+
+  auto cursor = PlanSelectQuery(query, batch_rows, nullptr);
+  if (!cursor) {
+    return cursor;
+  }
+  // A result too large to keep is not worth copying either.
+  cursor->Record(
+      result_cache_->capacity(),
+      [cache = result_cache_, key = std::move(key), versions = *versions,
+       column_names = cursor->column_names()](ResultBatch rows) mutable {
+        cache->Insert(std::move(key), std::move(versions),
+                      {std::make_shared<const ResultBatch>(std::move(rows)),
+                       std::move(column_names)});
+      });
+  return cursor;
+}
+
+auto DmlQueryExec::PlanSelectQuery(const SelectQuery &query,
+                                   size_t batch_rows, QueryProfile *profile)
+    -> std::expected<ResultCursor, Error> {
   if (query.columns().empty()) {
     return std::unexpected(Error("No columns are selected"));
   }
+  if (const auto view = this->db_.GetView(query.table_name()); view) {
+    // Materialized views are the only kind there is.
+    return PlanViewSelectQuery(
+        query, static_cast<const MaterializedView &>(**view), batch_rows,
+        profile);
+  }
 
-  std::optional<const Table *> table = this->db_.GetTable(query.table().name());
+  std::optional<const Table *> table = this->db_.GetTable(query.table_name());
   if (!table.has_value()) {
     return std::unexpected(Error("Table not found"));
   }
+  std::vector<const Table *> tables = {*table};
+  const auto join = query.join();
+  if (join) {
+    const auto joined = this->db_.GetTable(join->table());
+    if (!joined.has_value()) {
+      return std::unexpected(Error("Table not found"));
+    }
+    tables.push_back(*joined);
+  }
+
+  std::vector<ResolvedColumn> selected;
+  for (const auto &column : query.columns()) {
+    auto resolved = Resolve(column.name(), tables);
+    if (!resolved) {
+      return std::unexpected(resolved.error());
+    }
+    selected.push_back(*resolved);
+  }
+
+  // Each table's filter gets the where clauses on its columns.
+  std::vector<std::vector<WhereClause>> where_clauses(tables.size());
+  for (const auto &where : query.where_clause()) {
+    auto resolved = Resolve(where.column(), tables);
+    if (!resolved) {
+      return std::unexpected(resolved.error());
+    }
+    where_clauses[resolved->side].emplace_back(resolved->column->name(),
+                                               where.value(), where.op());
+  }
 
-  std::vector<const Tuple *> result;
-  for (const auto &tuple : (*table)->tuples()) {
-    Tuple new_tuple;
-    for (const auto &column : query.columns()) {
-      auto value = tuple->GetValue(column.name());
-      if (value.has_value()) {
-        new_tuple.InsertValue(column.name(), *value);
+  std::optional<ResolvedColumn> order_by_column;
+  if (const auto order_by = query.orderByClause(); order_by) {
+    auto resolved = Resolve(order_by->column(), tables);
+    if (!resolved) {
+      return std::unexpected(resolved.error());
+    }
+    order_by_column = *resolved;
+  }
+
+  auto memory = std::make_unique<MemoryTracker>(
+      "query", &this->db_.memory(), query_memory_limit_);
+
+  // Each operator becomes the new root of the plan. When profiling, it is
+  // wrapped so that its profile node adopts the previous root's.
+  std::unique_ptr<Operator> root;
+  double estimated_rows = 0;
+  auto push = [&](std::unique_ptr<Operator> op) -> OperatorProfile * {
+    OperatorProfile *node = nullptr;
+    if (profile != nullptr) {
+      node = profile->Push(
+          std::make_unique<OperatorProfile>(op->name(), op->detail()));
+      node->estimated_rows = estimated_rows;
+      op = std::make_unique<ProfiledOperator>(std::move(op), node,
+                                              profile->perf_counters());
+    }
+    root = std::move(op);
+    return node;
+  };
+
+  // Scans one table and filters it with its where clauses.
+  auto push_table = [&](size_t side,
+                        std::shared_ptr<const RuntimeFilter> runtime_filter)
+      -> std::expected<void, Error> {
+    const auto &side_table = *tables[side];
+    std::vector<Predicate> predicates;
+    for (const auto &where : where_clauses[side]) {
+      auto predicate = Predicate::Compile(where, side_table);
+      if (!predicate) {
+        return std::unexpected(predicate.error());
       }
+      predicates.push_back(std::move(*predicate));
+    }
+    const Planner planner(side_table);
+    const auto partitions = planner.PrunePartitions(predicates);
+
+    estimated_rows = 0;
+    for (const auto partition : partitions) {
+      estimated_rows += side_table.partitions()[partition]->tuples.size();
+    }
+    std::unique_ptr<ScanOperator> scan;
+    if (const auto *lsm = side_table.lsm(); lsm != nullptr) {
+      // The filter still checks the key predicates; the range only limits
+      // the rows the scan reads.
+      estimated_rows = side_table.row_count();
+      auto [low, high] = planner.KeyRange(predicates);
+      scan = std::make_unique<ScanOperator>(
+          &side_table, lsm->Scan(std::move(low), std::move(high)),
+          batch_rows);
+    } else {
+      scan =
+          std::make_unique<ScanOperator>(&side_table, partitions, batch_rows);
+    }
+    if (runtime_filter) {
+      scan->set_runtime_filter(std::move(runtime_filter));
+    }
+    push(std::move(scan));
+
+    if (!predicates.empty()) {
+      planner.OrderPredicates(predicates);
+      estimated_rows =
+          std::min(estimated_rows, planner.EstimateRows(predicates));
+      push(std::make_unique<FilterOperator>(std::move(root),
+                                            std::move(predicates)));
     }
+    return std::expected<void, Error>(std::in_place);
+  };
 
-    if (new_tuple.is_empty()) {
-      return std::unexpected(Error("No column found"));
+  std::vector<const Column *> columns;
+  const Column *order_by_output = nullptr;
+  if (!join) {
+    if (auto pushed = push_table(0, nullptr); !pushed) {
+      return std::unexpected(pushed.error());
+    }
+    for (const auto &column : selected) {
+      columns.push_back(column.column);
+    }
+    if (order_by_column) {
+      order_by_output = order_by_column->column;
+    }
+  } else {
+    auto left = Resolve(join->left_column(), tables);
+    if (!left) {
+      return std::unexpected(left.error());
     }
+    auto right = Resolve(join->right_column(), tables);
+    if (!right) {
+      return std::unexpected(right.error());
+    }
+    if (left->side == right->side) {
+      return std::unexpected(
+          Error("A join must compare a column of each table"));
+    }
+    if (left->column->type() != right->column->type()) {
+      return std::unexpected(
+          Error("Join columns " + left->column->name() + " and " +
+                right->column->name() + " have different types"));
+    }
+    std::vector<const Column *> keys(tables.size());
+    keys[left->side] = left->column;
+    keys[right->side] = right->column;
+
+    // The smaller table is hashed, and the larger one streams past it.
+    const size_t build = tables[1]->row_count() <= tables[0]->row_count();
+    const size_t probe = 1 - build;
+    if (auto pushed = push_table(build, nullptr); !pushed) {
+      return std::unexpected(pushed.error());
+    }
+    auto build_root = std::move(root);
+    auto build_profile =
+        profile != nullptr ? profile->TakeRoot() : nullptr;
+    auto runtime_filter = std::make_shared<RuntimeFilter>(keys[probe]);
+    if (auto pushed = push_table(probe, runtime_filter); !pushed) {
+      return std::unexpected(pushed.error());
+    }
+
+    // The joined rows carry only the columns read above the join.
+    std::vector<HashJoinOperator::Output> outputs;
+    std::vector<ResolvedColumn> output_sources;
+    auto output_of = [&](const ResolvedColumn &resolved) -> const Column * {
+      const auto found = std::ranges::find(output_sources, resolved);
+      if (found != output_sources.end()) {
+        return outputs[found - output_sources.begin()].column.get();
+      }
+      auto column = std::make_unique<Column>(
+          tables[resolved.side]->name() + "." + resolved.column->name(),
+          resolved.column->type());
+      column->set_slot(outputs.size());
+      const auto *output = column.get();
+      outputs.push_back({resolved.column, resolved.side == build,
+                         std::move(column)});
+      output_sources.push_back(resolved);
+      return output;
+    };
+    for (const auto &column : selected) {
+      columns.push_back(output_of(column));
+    }
+    if (order_by_column) {
+      order_by_output = output_of(*order_by_column);
+    }
+
+    auto *node = push(std::make_unique<HashJoinOperator>(
+        std::move(root), keys[probe], std::move(build_root), keys[build],
+        std::move(runtime_filter), std::move(outputs), batch_rows,
+        order_by_output != nullptr, memory.get()));
+    if (node != nullptr) {
+      node->children.push_back(std::move(build_profile));
+    }
+  }
+
+  if (const auto order_by = query.orderByClause(); order_by) {
+    push(std::make_unique<SortOperator>(std::move(root), *order_by,
+                                        order_by_output, batch_rows,
+                                        memory.get()));
+  }
+
+  if (const auto limit = query.limit(); limit) {
+    estimated_rows = std::min(estimated_rows, static_cast<double>(*limit));
+    push(std::make_unique<LimitOperator>(std::move(root), *limit));
+  }
+
+  return ResultCursor(std::move(root), std::move(columns), std::move(memory));
+}
+
+auto DmlQueryExec::PlanViewSelectQuery(const SelectQuery &query,
+                                       const MaterializedView &view,
+                                       size_t batch_rows,
+                                       QueryProfile *profile)
+    -> std::expected<ResultCursor, Error> {
+  if (query.join()) {
+    return std::unexpected(Error("View " + view.name() + " cannot be joined"));
+  }
+  // Columns may be qualified with the view's name.
+  auto resolve = [&view](const std::string &name)
+      -> std::expected<const Column *, Error> {
+    const auto prefix = view.name() + ".";
+    const auto column = view.GetColumn(
+        name.starts_with(prefix) ? name.substr(prefix.size()) : name);
+    if (!column) {
+      return std::unexpected(
+          Error("No column found: " + name, Error::Kind::NoColumnFound));
+    }
+    return *column;
+  };
+
+  std::vector<const Column *> columns;
+  for (const auto &column : query.columns()) {
+    auto resolved = resolve(column.name());
+    if (!resolved) {
+      return std::unexpected(resolved.error());
+    }
+    columns.push_back(*resolved);
+  }
+  std::vector<Predicate> predicates;
+  for (const auto &where : query.where_clause()) {
+    auto resolved = resolve(where.column());
+    if (!resolved) {
+      return std::unexpected(resolved.error());
+    }
+    auto predicate = Predicate::Compile(where, *resolved);
+    if (!predicate) {
+      return std::unexpected(predicate.error());
+    }
+    predicates.push_back(std::move(*predicate));
+  }
+  const Column *order_by_column = nullptr;
+  if (const auto order_by = query.orderByClause(); order_by) {
+    auto resolved = resolve(order_by->column());
+    if (!resolved) {
+      return std::unexpected(resolved.error());
+    }
+    order_by_column = *resolved;
+  }
+
+  auto memory = std::make_unique<MemoryTracker>(
+      "query", &this->db_.memory(), query_memory_limit_);
+  std::unique_ptr<Operator> root;
+  auto estimated_rows = static_cast<double>(view.rows().size());
+  auto push = [&](std::unique_ptr<Operator> op) {
+    if (profile != nullptr) {
+      auto *node = profile->Push(
+          std::make_unique<OperatorProfile>(op->name(), op->detail()));
+      node->estimated_rows = estimated_rows;
+      op = std::make_unique<ProfiledOperator>(std::move(op), node,
+                                              profile->perf_counters());
+    }
+    root = std::move(op);
+  };
+
+  push(std::make_unique<ViewScanOperator>(&view, batch_rows));
+  if (!predicates.empty()) {
+    push(std::make_unique<FilterOperator>(std::move(root),
+                                          std::move(predicates)));
+  }
+  if (const auto order_by = query.orderByClause(); order_by) {
+    push(std::make_unique<SortOperator>(std::move(root), *order_by,
+                                        order_by_column, batch_rows,
+                                        memory.get()));
+  }
+  if (const auto limit = query.limit(); limit) {
+    estimated_rows = std::min(estimated_rows, static_cast<double>(*limit));
+    push(std::make_unique<LimitOperator>(std::move(root), *limit));
+  }
+  ResultCursor cursor(std::move(root), std::move(columns), std::move(memory));
+  if (view.aggregated()) {
+    cursor.CopyValues();
+  }
+  return cursor;
+}
+
+auto DmlQueryExec::ExecuteExplainAnalyzeQuery(const ExplainAnalyzeQuery &query)
+    -> std::expected<QueryProfile, Error> {
+  QueryProfile profile;
+  auto cursor =
+      ExecuteSelectQuery(query.select(), kDefaultBatchRows, &profile);
+  if (!cursor) {
+    return std::unexpected(cursor.error());
+  }
+
+  // The result node accounts for projecting the rows the plan produced.
+  std::vector<std::string> columns;
+  for (const auto &column : query.select().columns()) {
+    columns.push_back(column.name());
   }
+  const auto estimated_rows = profile.root()->estimated_rows;
+  auto *result = profile.Push(std::make_unique<OperatorProfile>(
+      "Result", [&columns] {
+        std::string detail;
+        for (const auto &column : columns) {
+          detail += (detail.empty() ? "" : ", ") + column;
+        }
+        return detail;
+      }()));
+  result->estimated_rows = estimated_rows;
+  const auto *perf_counters = profile.perf_counters();
 
-  return result;
+  while (true) {
+    const auto counters_before =
+        perf_counters ? perf_counters->Read() : HardwareCounters{};
+    const auto start = std::chrono::steady_clock::now();
+    auto batch = cursor->NextBatch();
+    result->wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    if (perf_counters) {
+      if (!result->counters) {
+        result->counters = HardwareCounters{};
+      }
+      *result->counters += perf_counters->Read() - counters_before;
+    }
+    if (!batch) {
+      return std::unexpected(batch.error());
+    }
+    if (!batch->has_value()) {
+      break;
+    }
+    result->rows_out += (*batch)->row_count();
+    ++result->batches;
+    result->bytes_allocated =
+        std::max<uint64_t>(result->bytes_allocated,
+                           (*batch)->row_count() * columns.size() *
+                               sizeof(const Value *));
+  }
+  return profile;
 }
 
 auto DmlQueryExec::ExecuteInsertQuery(const InsertQuery &query)
     -> std::expected<std::vector<const Tuple *>, Error> {
-  return std::unexpected(Error("Not implemented"));
+  auto table = this->db_.GetModifiableTable(query.table_name());
+  if (!table.has_value()) {
+    return std::unexpected(Error("Table not found"));
+  }
+
+  const auto columns = (*table)->columns();
+  std::vector<Tuple *> tuples;
+  auto fail = [&tuples](Error error) {
+    FreeTuples(tuples);
+    return std::unexpected(std::move(error));
+  };
+  for (const auto &row : query.rows()) {
+    // The values go in column order, which is how the table stores them.
+    // Columns left out take their default, which InsertTuples fills in.
+    // They point into the query until the row is known to be valid.
+    Tuple::Values values;
+    values.reserve(columns.size());
+    for (const auto *column : columns) {
+      const auto value = row.find(column->name());
+      if (value == row.end()) {
+        continue;
+      }
+      if (TypeOf(value->second) != column->type()) {
+        return fail(Error("Value does not match the type of column " +
+                          column->name()));
+      }
+      values.emplace_back(column->storage_key(), &value->second);
+    }
+    if (values.size() != row.size()) {
+      for (const auto &[column_name, value] : row) {
+        if (!(*table)->GetColumn(column_name)) {
+          return fail(Error("No column found: " + column_name,
+                            Error::Kind::NoColumnFound));
+        }
+      }
+    }
+    for (auto &[key, value] : values) {
+      value = new Value(*value);
+    }
+    auto *tuple = new Tuple();
+    tuple->set_values(std::move(values));
+    tuples.push_back(tuple);
+  }
+
+  if (auto inserted = (*table)->InsertTuples(tuples); !inserted) {
+    return fail(inserted.error());
+  }
+  return std::vector<const Tuple *>(tuples.begin(), tuples.end());
 }
 
 auto DmlQueryExec::ExecuteUpdateQuery(const UpdateQuery &query)
@@ -46,4 +528,22 @@ auto DmlQueryExec::ExecuteDeleteQuery(const JustADb::DeleteQuery &query)
   return std::unexpected(Error("Not implemented"));
 }
 
+auto DmlQueryExec::ExecuteCreateViewQuery(const CreateViewQuery &query)
+    -> std::expected<const View *, Error> {
+  const auto table = db_.GetModifiableTable(query.table_name());
+  if (!table) {
+    return std::unexpected(Error("Table not found"));
+  }
+  auto view = MaterializedView::Create(query, **table);
+  if (!view) {
+    return std::unexpected(view.error());
+  }
+  return db_.AddView(std::move(*view));
+}
+
+auto DmlQueryExec::ExecuteDropViewQuery(const DropViewQuery &query)
+    -> std::expected<void, Error> {
+  return db_.DropView(query.view_name());
+}
+
 } // namespace JustADb
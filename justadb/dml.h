@@ -1,6 +1,8 @@
 #pragma once
 
+#include "cursor.h"
 #include "ddl.h"
+#include "profile.h"
 #include "utils.h"
 #include <optional>
 #include <string>
@@ -67,12 +69,47 @@ private:
   Order order_;
 };
 
+// An inner equi-join of the query's table with `table` on
+// left_column = right_column. Either column may be qualified as
+// "table.column".
+class JoinClause {
+public:
+  JoinClause(std::string table, std::string left_column,
+             std::string right_column)
+      : table_(std::move(table)), left_column_(std::move(left_column)),
+        right_column_(std::move(right_column)) {}
+
+  [[nodiscard]] auto table() const {
+    return table_;
+  }
+  [[nodiscard]] auto left_column() const {
+    return left_column_;
+  }
+  [[nodiscard]] auto right_column() const {
+    return right_column_;
+  }
+
+private:
+  std::string table_;
+  std::string left_column_;
+  std::string right_column_;
+};
+
 class DmlQuery {
 public:
-  enum class Kind { SELECT, INSERT, UPDATE, DELETE };
+  enum class Kind {
+    SELECT,
+    INSERT,
+    UPDATE,
+    DELETE,
+    EXPLAIN_ANALYZE,
+    CREATE_VIEW,
+    DROP_VIEW
+  };
 
-  DmlQuery(Kind kind, Table table, std::vector<WhereClause> where_clause = {})
-      : kind_(kind), table_(std::move(table)),
+  DmlQuery(Kind kind, std::string table_name,
+           std::vector<WhereClause> where_clause = {})
+      : kind_(kind), table_name_(std::move(table_name)),
         where_clauses_(std::move(where_clause)) {}
 
   DmlQuery &Where(const std::string &column, const std::string &value,
@@ -84,8 +121,8 @@ public:
   [[nodiscard]] auto kind() const {
     return kind_;
   }
-  [[nodiscard]] auto table() const {
-    return table_;
+  [[nodiscard]] auto table_name() const {
+    return table_name_;
   }
   [[nodiscard]] auto where_clause() const {
     return where_clauses_;
@@ -93,7 +130,7 @@ public:
 
 private:
   Kind kind_;
-  Table table_;
+  std::string table_name_;
 
   // TODO: Think about generalizing this to filters.
   std::vector<WhereClause> where_clauses_;
@@ -101,46 +138,104 @@ private:
 
 class SelectQuery : public DmlQuery {
 public:
-  SelectQuery(Table table, std::vector<Column> columns)
-      : DmlQuery(Kind::SELECT, std::move(table)), columns_(std::move(columns)) {
-  }
+  SelectQuery(std::string table_name, std::vector<Column> columns)
+      : DmlQuery(Kind::SELECT, std::move(table_name)),
+        columns_(std::move(columns)) {}
 
   SelectQuery &OrderBy(std::string column, OrderByClause::Order order) {
     orderByClause_ = OrderByClause(std::move(column), order);
     return *this;
   }
 
+  SelectQuery &Limit(size_t limit) {
+    limit_ = limit;
+    return *this;
+  }
+
+  // Once joined, columns anywhere in the query may be qualified with their
+  // table's name; a bare name refers to the query's own table if it has such
+  // a column, and to the joined table otherwise.
+  SelectQuery &Join(std::string table, std::string left_column,
+                    std::string right_column) {
+    join_ = JoinClause(std::move(table), std::move(left_column),
+                       std::move(right_column));
+    return *this;
+  }
+
+  [[nodiscard]] auto join() const {
+    return join_;
+  }
+
   [[nodiscard]] auto orderByClause() const {
     return orderByClause_;
   }
 
+  [[nodiscard]] auto limit() const {
+    return limit_;
+  }
+
   [[nodiscard]] auto columns() const {
     return columns_;
   }
 
 private:
   std::optional<OrderByClause> orderByClause_;
+  std::optional<size_t> limit_;
+  std::optional<JoinClause> join_;
   std::vector<Column> columns_;
 };
 
-class InsertQuery : public DmlQuery {
+// Runs the select and reports how each operator of its plan performed
+// instead of returning rows.
+class ExplainAnalyzeQuery : public DmlQuery {
 public:
-  InsertQuery(Table table, std::unordered_map<std::string, Value> insert_values,
-              std::vector<WhereClause> where_clauses)
-      : DmlQuery(Kind::INSERT, std::move(table), std::move(where_clauses)),
-        insert_values_(std::move(insert_values)) {}
+  explicit ExplainAnalyzeQuery(SelectQuery select)
+      : DmlQuery(Kind::EXPLAIN_ANALYZE, select.table_name(),
+                 select.where_clause()),
+        select_(std::move(select)) {}
+
+  [[nodiscard]] auto select() const -> const SelectQuery & {
+    return select_;
+  }
 
 private:
+  SelectQuery select_;
+};
+
+class InsertQuery : public DmlQuery {
+public:
   // Key is column name, value is the value to insert.
-  std::unordered_map<std::string, Value> insert_values_;
+  using Row = std::unordered_map<std::string, Value>;
+
+  InsertQuery(std::string table_name, Row insert_values,
+              std::vector<WhereClause> where_clauses = {})
+      : DmlQuery(Kind::INSERT, std::move(table_name), std::move(where_clauses)) {
+    rows_.push_back(std::move(insert_values));
+  }
+
+  // Inserts all of `rows` or, if one of them is rejected, none. Foreign keys
+  // are checked once for the whole batch.
+  static auto Batch(std::string table_name, std::vector<Row> rows)
+      -> InsertQuery {
+    InsertQuery query(std::move(table_name), {});
+    query.rows_ = std::move(rows);
+    return query;
+  }
+
+  [[nodiscard]] auto rows() const -> const std::vector<Row> & {
+    return rows_;
+  }
+
+private:
+  std::vector<Row> rows_;
 };
 
 class UpdateQuery : public DmlQuery {
 public:
-  UpdateQuery(Table table,
+  UpdateQuery(std::string table_name,
               const std::unordered_map<std::string, Value> &columns,
               std::vector<WhereClause> where_clauses)
-      : DmlQuery(Kind::UPDATE, std::move(table), std::move(where_clauses)) {}
+      : DmlQuery(Kind::UPDATE, std::move(table_name), std::move(where_clauses)) {}
 
 private:
   std::unordered_map<std::string, Value> set_values_;
@@ -148,26 +243,152 @@ private:
 
 class DeleteQuery : public DmlQuery {
 public:
-  explicit DeleteQuery(Table table)
-      : DmlQuery(Kind::DELETE, std::move(table)) {}
+  explicit DeleteQuery(std::string table_name)
+      : DmlQuery(Kind::DELETE, std::move(table_name)) {}
+
+  DeleteQuery(std::string table_name, std::vector<WhereClause> where_clauses)
+      : DmlQuery(Kind::DELETE, std::move(table_name), std::move(where_clauses)) {}
+};
+
+// An aggregate of a materialized view over `column`, or over rows for COUNT
+// without a column. NULLs are skipped; an aggregate of no values is NULL,
+// except COUNT, which is 0.
+class AggregateClause {
+public:
+  enum class Function { COUNT, SUM, MIN, MAX, AVG };
+
+  AggregateClause(Function function, std::string column)
+      : function_(function), column_(std::move(column)) {}
+
+  [[nodiscard]] auto function() const {
+    return function_;
+  }
+  [[nodiscard]] auto column() const {
+    return column_;
+  }
+
+  // E.g. "sum(amount)" or "count(*)": the name of the view's column.
+  [[nodiscard]] auto name() const -> std::string;
+
+private:
+  Function function_;
+  std::string column_;
+};
+
+// Defines a materialized view (view.h) of one table: its rows that match the
+// where clauses, projected to `columns`. With aggregates, `columns` group the
+// matching rows instead, and the view holds one row per group: the grouping
+// columns followed by the aggregates.
+class CreateViewQuery : public DmlQuery {
+public:
+  CreateViewQuery(std::string view_name, std::string table_name,
+                  std::vector<std::string> columns)
+      : DmlQuery(Kind::CREATE_VIEW, std::move(table_name)),
+        view_name_(std::move(view_name)), columns_(std::move(columns)) {}
+
+  // An empty column counts rows.
+  CreateViewQuery &Aggregate(AggregateClause::Function function,
+                             std::string column = "") {
+    aggregates_.emplace_back(function, std::move(column));
+    return *this;
+  }
+
+  [[nodiscard]] auto view_name() const {
+    return view_name_;
+  }
+  [[nodiscard]] auto columns() const {
+    return columns_;
+  }
+  [[nodiscard]] auto aggregates() const {
+    return aggregates_;
+  }
+
+private:
+  std::string view_name_;
+  std::vector<std::string> columns_;
+  std::vector<AggregateClause> aggregates_;
+};
+
+class DropViewQuery : public DmlQuery {
+public:
+  explicit DropViewQuery(std::string view_name)
+      : DmlQuery(Kind::DROP_VIEW, ""), view_name_(std::move(view_name)) {}
 
-  DeleteQuery(Table table, std::vector<WhereClause> where_clauses)
-      : DmlQuery(Kind::DELETE, std::move(table), std::move(where_clauses)) {}
+  [[nodiscard]] auto view_name() const {
+    return view_name_;
+  }
+
+private:
+  std::string view_name_;
 };
 
+class MaterializedView;
+class ResultCache;
+
 class DmlQueryExec {
 public:
+  static constexpr size_t kDefaultBatchRows = 1024;
+
   explicit DmlQueryExec(Database &db) : db_(db) {}
 
-  auto ExecuteSelectQuery(const SelectQuery &query)
-      -> std::expected<std::vector<const Tuple *>, Error>;
+  // Bounds the memory each select holds, under the database's own limit.
+  // Sorts and joins that reach it spill to disk; other operators fail.
+  void set_query_memory_limit(std::optional<size_t> limit) {
+    query_memory_limit_ = limit;
+  }
+
+  // Answers selects from `cache` while the tables they read are unchanged,
+  // and caches the results of those that run to completion. Profiled
+  // queries always run.
+  void set_result_cache(ResultCache *cache) {
+    result_cache_ = cache;
+  }
+
+  // Plans the query and returns a cursor over its result; rows are produced
+  // as the cursor is pulled, at most `batch_rows` at a time. The table must
+  // not be modified while the cursor is open. With a `profile`, every
+  // operator of the plan records into it while the cursor is drained.
+  //
+  // The query may name a materialized view instead of a table, which is
+  // read without touching the table; it cannot be joined.
+  auto ExecuteSelectQuery(const SelectQuery &query,
+                          size_t batch_rows = kDefaultBatchRows,
+                          QueryProfile *profile = nullptr)
+      -> std::expected<ResultCursor, Error>;
+
+  auto ExecuteExplainAnalyzeQuery(const ExplainAnalyzeQuery &query)
+      -> std::expected<QueryProfile, Error>;
+
+  // Returns the inserted tuples.
   auto ExecuteInsertQuery(const InsertQuery &query)
       -> std::expected<std::vector<const Tuple *>, Error>;
   auto ExecuteUpdateQuery(const UpdateQuery &query) -> std::expected<int, Error>;
   auto ExecuteDeleteQuery(const DeleteQuery &query) -> std::expected<int, Error>;
 
+  // Creates the view and fills it from the table's current rows.
+  auto ExecuteCreateViewQuery(const CreateViewQuery &query)
+      -> std::expected<const View *, Error>;
+  auto ExecuteDropViewQuery(const DropViewQuery &query)
+      -> std::expected<void, Error>;
+
 private:
+  // ExecuteSelectQuery() through the result cache.
+  auto ExecuteCachedSelectQuery(const SelectQuery &query, size_t batch_rows)
+      -> std::expected<ResultCursor, Error>;
+
+  // ExecuteSelectQuery() without the result cache.
+  auto PlanSelectQuery(const SelectQuery &query, size_t batch_rows,
+                       QueryProfile *profile)
+      -> std::expected<ResultCursor, Error>;
+
+  auto PlanViewSelectQuery(const SelectQuery &query,
+                           const MaterializedView &view, size_t batch_rows,
+                           QueryProfile *profile)
+      -> std::expected<ResultCursor, Error>;
+
   Database &db_;
+  std::optional<size_t> query_memory_limit_;
+  ResultCache *result_cache_ = nullptr;
 };
 
 } // End namespace JustADb
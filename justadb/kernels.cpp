@@ -0,0 +1,302 @@
+#include "kernels.h"
+
+#include "like.h"
+
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace JustADb {
+
+namespace {
+
+using Operator = WhereClause::Operator;
+
+// Column::Read() with the schema version check compiled out for columns that
+// every tuple has.
+template <bool kVersioned>
+auto ReadValue(const Column &column, const Tuple &tuple) -> const Value * {
+  if constexpr (kVersioned) {
+    if (tuple.schema_version() < column.added_version()) {
+      return column.default_value();
+    }
+  }
+  return tuple.GetValue(column.storage_key(), column.slot()).value_or(nullptr);
+}
+
+template <typename T>
+auto ReadTyped(const Value *value) -> const T * {
+  return value == nullptr ? nullptr : std::get_if<T>(&value->value());
+}
+
+// The comparisons, defined through operator< alone to agree with
+// CompareValues() on floats.
+struct Equal {
+  template <typename T>
+  auto operator()(const T &lhs, const T &rhs) const -> bool {
+    if constexpr (std::is_floating_point_v<T>) {
+      return !(lhs < rhs) && !(rhs < lhs);
+    } else {
+      return lhs == rhs;
+    }
+  }
+};
+
+struct NotEqual {
+  template <typename T>
+  auto operator()(const T &lhs, const T &rhs) const -> bool {
+    return !Equal()(lhs, rhs);
+  }
+};
+
+struct Less {
+  template <typename T>
+  auto operator()(const T &lhs, const T &rhs) const -> bool {
+    return lhs < rhs;
+  }
+};
+
+struct LessOrEqual {
+  template <typename T>
+  auto operator()(const T &lhs, const T &rhs) const -> bool {
+    return !(rhs < lhs);
+  }
+};
+
+struct Greater {
+  template <typename T>
+  auto operator()(const T &lhs, const T &rhs) const -> bool {
+    return rhs < lhs;
+  }
+};
+
+struct GreaterOrEqual {
+  template <typename T>
+  auto operator()(const T &lhs, const T &rhs) const -> bool {
+    return !(lhs < rhs);
+  }
+};
+
+// Every kernel writes each visited row to the next free slot and only
+// advances past it when the row matches, so the loops have no data-dependent
+// branch besides the predicate itself.
+
+template <bool kIsNull, bool kVersioned>
+auto NullKernel(const Predicate &predicate, const TupleBatch &batch,
+                uint32_t *selection, size_t count) -> size_t {
+  const auto &column = *predicate.column();
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const auto row = selection[i];
+    selection[kept] = row;
+    kept += (ReadValue<kVersioned>(column, *batch[row]) == nullptr) == kIsNull;
+  }
+  return kept;
+}
+
+template <typename T, typename Compare, bool kVersioned>
+auto CompareKernel(const Predicate &predicate, const TupleBatch &batch,
+                   uint32_t *selection, size_t count) -> size_t {
+  const auto &column = *predicate.column();
+  const auto &operand = std::get<T>(predicate.operands().front().value());
+  const Compare compare;
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const auto row = selection[i];
+    const auto *value =
+        ReadTyped<T>(ReadValue<kVersioned>(column, *batch[row]));
+    selection[kept] = row;
+    kept += value != nullptr && compare(*value, operand);
+  }
+  return kept;
+}
+
+template <typename T, bool kIn, bool kVersioned>
+auto InKernel(const Predicate &predicate, const TupleBatch &batch,
+              uint32_t *selection, size_t count) -> size_t {
+  const auto &column = *predicate.column();
+  std::vector<const T *> operands;
+  operands.reserve(predicate.operands().size());
+  for (const auto &operand : predicate.operands()) {
+    operands.push_back(&std::get<T>(operand.value()));
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const auto row = selection[i];
+    const auto *value =
+        ReadTyped<T>(ReadValue<kVersioned>(column, *batch[row]));
+    bool found = false;
+    if (value != nullptr) {
+      for (const auto *operand : operands) {
+        found |= Equal()(*value, *operand);
+      }
+    }
+    selection[kept] = row;
+    kept += value != nullptr && found == kIn;
+  }
+  return kept;
+}
+
+template <LikePattern::Kind kKind>
+auto MatchesLike(const LikePattern &pattern, std::string_view text) -> bool {
+  if constexpr (kKind == LikePattern::Kind::EXACT) {
+    return text == pattern.literal();
+  } else if constexpr (kKind == LikePattern::Kind::PREFIX) {
+    return text.starts_with(pattern.literal());
+  } else if constexpr (kKind == LikePattern::Kind::SUFFIX) {
+    return text.ends_with(pattern.literal());
+  } else if constexpr (kKind == LikePattern::Kind::CONTAINS) {
+    return FindSubstring(text, pattern.literal()) != std::string_view::npos;
+  } else {
+    return pattern.Matches(text);
+  }
+}
+
+template <LikePattern::Kind kKind, bool kLike, bool kVersioned>
+auto LikeKernel(const Predicate &predicate, const TupleBatch &batch,
+                uint32_t *selection, size_t count) -> size_t {
+  const auto &column = *predicate.column();
+  const auto &pattern = *predicate.like();
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const auto row = selection[i];
+    const auto *text =
+        ReadTyped<std::string>(ReadValue<kVersioned>(column, *batch[row]));
+    selection[kept] = row;
+    kept += text != nullptr && MatchesLike<kKind>(pattern, *text) == kLike;
+  }
+  return kept;
+}
+
+template <bool kLike, bool kVersioned>
+auto SelectLikeKernel(LikePattern::Kind kind) -> FilterKernel {
+  switch (kind) {
+  case LikePattern::Kind::EXACT:
+    return LikeKernel<LikePattern::Kind::EXACT, kLike, kVersioned>;
+  case LikePattern::Kind::PREFIX:
+    return LikeKernel<LikePattern::Kind::PREFIX, kLike, kVersioned>;
+  case LikePattern::Kind::SUFFIX:
+    return LikeKernel<LikePattern::Kind::SUFFIX, kLike, kVersioned>;
+  case LikePattern::Kind::CONTAINS:
+    return LikeKernel<LikePattern::Kind::CONTAINS, kLike, kVersioned>;
+  case LikePattern::Kind::GENERAL:
+    return LikeKernel<LikePattern::Kind::GENERAL, kLike, kVersioned>;
+  }
+  return GenericFilterKernel;
+}
+
+template <typename T, bool kVersioned>
+auto SelectTypedKernel(Operator op) -> FilterKernel {
+  switch (op) {
+  case Operator::EQUAL:
+    return CompareKernel<T, Equal, kVersioned>;
+  case Operator::NOT_EQUAL:
+    return CompareKernel<T, NotEqual, kVersioned>;
+  case Operator::LESS_THAN:
+    return CompareKernel<T, Less, kVersioned>;
+  case Operator::LESS_THAN_OR_EQUAL:
+    return CompareKernel<T, LessOrEqual, kVersioned>;
+  case Operator::GREATER_THAN:
+    return CompareKernel<T, Greater, kVersioned>;
+  case Operator::GREATER_THAN_OR_EQUAL:
+    return CompareKernel<T, GreaterOrEqual, kVersioned>;
+  case Operator::IN:
+    return InKernel<T, true, kVersioned>;
+  case Operator::NOT_IN:
+    return InKernel<T, false, kVersioned>;
+  default:
+    return GenericFilterKernel;
+  }
+}
+
+template <bool kVersioned>
+auto SelectKernel(const Predicate &predicate) -> FilterKernel {
+  switch (predicate.op()) {
+  case Operator::IS_NULL:
+    return NullKernel<true, kVersioned>;
+  case Operator::IS_NOT_NULL:
+    return NullKernel<false, kVersioned>;
+  case Operator::LIKE:
+    return SelectLikeKernel<true, kVersioned>(predicate.like()->kind());
+  case Operator::NOT_LIKE:
+    return SelectLikeKernel<false, kVersioned>(predicate.like()->kind());
+  default:
+    break;
+  }
+  // The operands were parsed as the column's type; an empty IN list has none.
+  const auto type = predicate.operands().empty()
+                        ? predicate.column()->type()
+                        : TypeOf(predicate.operands().front());
+  switch (type) {
+  case Column::Type::INT:
+    return SelectTypedKernel<int, kVersioned>(predicate.op());
+  case Column::Type::FLOAT:
+    return SelectTypedKernel<float, kVersioned>(predicate.op());
+  case Column::Type::STRING:
+    return SelectTypedKernel<std::string, kVersioned>(predicate.op());
+  case Column::Type::BOOL:
+    return SelectTypedKernel<bool, kVersioned>(predicate.op());
+  }
+  return GenericFilterKernel;
+}
+
+template <bool kVersioned>
+void ProjectColumn(const Column &column, const TupleBatch &batch,
+                   std::vector<const Value *> &out) {
+  for (const auto *tuple : batch) {
+    out.push_back(ReadValue<kVersioned>(column, *tuple));
+  }
+}
+
+} // namespace
+
+auto GenericFilterKernel(const Predicate &predicate, const TupleBatch &batch,
+                         uint32_t *selection, size_t count) -> size_t {
+  size_t kept = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const auto row = selection[i];
+    selection[kept] = row;
+    kept += predicate.Matches(*batch[row]);
+  }
+  return kept;
+}
+
+auto SelectFilterKernel(const Predicate &predicate) -> FilterKernel {
+  // Columns only get a later added version by being added after the table
+  // was created, never by being altered.
+  if (predicate.column()->added_version() == 0) {
+    return SelectKernel<false>(predicate);
+  }
+  return SelectKernel<true>(predicate);
+}
+
+auto SelectProjectKernel(const Column &column) -> ProjectKernel {
+  if (column.added_version() == 0) {
+    return ProjectColumn<false>;
+  }
+  return ProjectColumn<true>;
+}
+
+CompiledFilter::CompiledFilter(std::vector<Predicate> predicates)
+    : predicates_(std::move(predicates)) {
+  for (const auto &predicate : predicates_) {
+    kernels_.push_back(SelectFilterKernel(predicate));
+  }
+}
+
+void CompiledFilter::Apply(TupleBatch &batch) {
+  selection_.resize(batch.size());
+  std::iota(selection_.begin(), selection_.end(), 0);
+  size_t count = batch.size();
+  for (size_t i = 0; i < kernels_.size() && count > 0; ++i) {
+    count = kernels_[i](predicates_[i], batch, selection_.data(), count);
+  }
+  // selection_[i] >= i, so the batch can be compacted in place.
+  for (size_t i = 0; i < count; ++i) {
+    batch[i] = batch[selection_[i]];
+  }
+  batch.resize(count);
+}
+
+} // namespace JustADb
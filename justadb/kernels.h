@@ -0,0 +1,56 @@
+#pragma once
+
+#include "cursor.h"
+#include "ddl.h"
+#include "predicate.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace JustADb {
+
+// Keeps the rows `selection[0, count)` of `batch` that match `predicate`,
+// compacted in order at the front of `selection`, and returns how many there
+// are.
+using FilterKernel = size_t (*)(const Predicate &predicate,
+                                const TupleBatch &batch, uint32_t *selection,
+                                size_t count);
+
+// Evaluates any predicate through Predicate::Matches, re-dispatching on the
+// operator and value type for every row. The baseline the specialized kernels
+// are measured against.
+auto GenericFilterKernel(const Predicate &predicate, const TupleBatch &batch,
+                         uint32_t *selection, size_t count) -> size_t;
+
+// The loop instantiated for the predicate's operator and value type (or LIKE
+// pattern kind), so that nothing is dispatched on per row.
+[[nodiscard]] auto SelectFilterKernel(const Predicate &predicate)
+    -> FilterKernel;
+
+// Columns that existed when the table was created skip the schema version
+// check of Column::Read().
+[[nodiscard]] auto SelectProjectKernel(const Column &column) -> ProjectKernel;
+
+// A conjunction with one kernel per predicate, picked once per query. The
+// predicates run in order over a shared selection vector, so each one only
+// visits the rows the previous ones kept, and the batch is compacted once at
+// the end.
+class CompiledFilter {
+public:
+  explicit CompiledFilter(std::vector<Predicate> predicates);
+
+  // Removes the rows of `batch` that fail any predicate.
+  void Apply(TupleBatch &batch);
+
+  [[nodiscard]] auto predicates() const -> const std::vector<Predicate> & {
+    return predicates_;
+  }
+
+private:
+  std::vector<Predicate> predicates_;
+  std::vector<FilterKernel> kernels_;
+  std::vector<uint32_t> selection_;
+};
+
+} // namespace JustADb
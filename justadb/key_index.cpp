@@ -0,0 +1,58 @@
+#include "key_index.h"
+
+namespace JustADb {
+
+namespace {
+
+constexpr size_t kInitialBloomKeys = 1024;
+
+} // namespace
+
+KeyIndex::KeyIndex(const Column *column)
+    : column_(column), bloom_(kInitialBloomKeys),
+      bloom_capacity_(kInitialBloomKeys) {}
+
+void KeyIndex::Add(const Value *key) {
+  if (!keys_.insert(key).second) {
+    return;
+  }
+  if (keys_.size() > bloom_capacity_) {
+    RebuildBloom();
+  } else {
+    bloom_.Add(HashValue(*key));
+  }
+}
+
+void KeyIndex::RebuildBloom() {
+  bloom_capacity_ = 2 * keys_.size();
+  bloom_ = BloomFilter(bloom_capacity_);
+  for (const auto *key : keys_) {
+    bloom_.Add(HashValue(*key));
+  }
+}
+
+auto KeyIndex::Contains(const Value &key) const -> bool {
+  if (!bloom_.MayContain(HashValue(key))) {
+    ++bloom_rejects_;
+    return false;
+  }
+  return keys_.contains(&key);
+}
+
+auto KeyIndex::FirstMissing(const std::vector<const Value *> &keys) const
+    -> std::optional<size_t> {
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!bloom_.MayContain(HashValue(*keys[i]))) {
+      ++bloom_rejects_;
+      return i;
+    }
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!keys_.contains(keys[i])) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+} // namespace JustADb
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "bloom.h"
+#include "ddl.h"
+
+#include <cstddef>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+namespace JustADb {
+
+// The distinct non-NULL values of a column that foreign keys reference.
+// Probes go through a Bloom filter first, so most keys the column does not
+// hold are turned away without touching the hash set.
+class KeyIndex {
+public:
+  explicit KeyIndex(const Column *column);
+
+  // `key` must outlive the index, as the values of a table's rows do.
+  void Add(const Value *key);
+
+  [[nodiscard]] auto Contains(const Value &key) const -> bool;
+
+  // The position of a key of `keys` that the index does not hold, if any.
+  // The whole batch goes through the Bloom filter before any key is looked
+  // up in the hash set, so a violation is usually found without one.
+  [[nodiscard]] auto FirstMissing(const std::vector<const Value *> &keys) const
+      -> std::optional<size_t>;
+
+  [[nodiscard]] auto column() const {
+    return column_;
+  }
+
+  [[nodiscard]] auto size() const {
+    return keys_.size();
+  }
+
+  // Probes the Bloom filter answered on its own.
+  [[nodiscard]] auto bloom_rejects() const {
+    return bloom_rejects_;
+  }
+
+private:
+  struct KeyHash {
+    auto operator()(const Value *key) const -> size_t {
+      return HashValue(*key);
+    }
+  };
+
+  struct KeyEqual {
+    auto operator()(const Value *lhs, const Value *rhs) const -> bool {
+      return lhs->value() == rhs->value();
+    }
+  };
+
+  // Sizes the Bloom filter for twice the current keys.
+  void RebuildBloom();
+
+  const Column *column_;
+  std::unordered_set<const Value *, KeyHash, KeyEqual> keys_;
+  BloomFilter bloom_;
+  size_t bloom_capacity_;
+  mutable size_t bloom_rejects_ = 0;
+};
+
+} // namespace JustADb
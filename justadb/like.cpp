@@ -0,0 +1,230 @@
+#include "like.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JUSTADB_X86_SIMD 1
+#endif
+
+namespace JustADb {
+
+namespace {
+
+// Finishes a search from `from` for the positions a vector loop could not
+// cover without reading past the end.
+auto FindTail(const char *haystack, size_t size, std::string_view needle,
+              size_t from) -> size_t {
+  const auto found =
+      std::string_view(haystack + from, size - from).find(needle);
+  return found == std::string_view::npos ? found : from + found;
+}
+
+#ifdef JUSTADB_X86_SIMD
+
+// Both loops require needle.size() >= 2.
+
+__attribute__((target("avx2"))) auto FindAvx2(const char *haystack,
+                                              size_t size,
+                                              std::string_view needle)
+    -> size_t {
+  const auto k = needle.size();
+  const __m256i first = _mm256_set1_epi8(needle.front());
+  const __m256i last = _mm256_set1_epi8(needle.back());
+  size_t i = 0;
+  for (; i + k - 1 + 32 <= size; i += 32) {
+    const __m256i block_first = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(haystack + i));
+    const __m256i block_last = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(haystack + i + k - 1));
+    auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                         _mm256_cmpeq_epi8(last, block_last))));
+    while (mask != 0) {
+      const auto offset = std::countr_zero(mask);
+      if (std::memcmp(haystack + i + offset + 1, needle.data() + 1, k - 2) ==
+          0) {
+        return i + offset;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return FindTail(haystack, size, needle, i);
+}
+
+auto FindSse2(const char *haystack, size_t size, std::string_view needle)
+    -> size_t {
+  const auto k = needle.size();
+  const __m128i first = _mm_set1_epi8(needle.front());
+  const __m128i last = _mm_set1_epi8(needle.back());
+  size_t i = 0;
+  for (; i + k - 1 + 16 <= size; i += 16) {
+    const __m128i block_first =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+    const __m128i block_last = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(haystack + i + k - 1));
+    auto mask = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                        _mm_cmpeq_epi8(last, block_last))));
+    while (mask != 0) {
+      const auto offset = std::countr_zero(mask);
+      if (std::memcmp(haystack + i + offset + 1, needle.data() + 1, k - 2) ==
+          0) {
+        return i + offset;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return FindTail(haystack, size, needle, i);
+}
+
+using FindFunction = size_t (*)(const char *, size_t, std::string_view);
+
+auto PickFind() -> FindFunction {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? FindAvx2 : FindSse2;
+}
+
+#endif
+
+} // namespace
+
+auto FindSubstring(std::string_view haystack, std::string_view needle)
+    -> size_t {
+  if (needle.size() > haystack.size()) {
+    return std::string_view::npos;
+  }
+  if (needle.size() < 2) {
+    return haystack.find(needle);
+  }
+#ifdef JUSTADB_X86_SIMD
+  static const FindFunction find = PickFind();
+  return find(haystack.data(), haystack.size(), needle);
+#else
+  return haystack.find(needle);
+#endif
+}
+
+auto LikePattern::Compile(std::string_view pattern) -> LikePattern {
+  std::vector<Token> tokens;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    const char c = pattern[i];
+    if (c == '\\' && i + 1 < pattern.size()) {
+      tokens.push_back({Token::Type::CHAR, pattern[++i]});
+    } else if (c == '%') {
+      // '%%' is the same as '%'.
+      if (tokens.empty() || tokens.back().type != Token::Type::ANY_RUN) {
+        tokens.push_back({Token::Type::ANY_RUN, 0});
+      }
+    } else if (c == '_') {
+      tokens.push_back({Token::Type::ANY_ONE, 0});
+    } else {
+      tokens.push_back({Token::Type::CHAR, c});
+    }
+  }
+
+  // A specialized matcher needs a single run of literal characters with
+  // wildcards at most at either end.
+  const bool leading_run =
+      !tokens.empty() && tokens.front().type == Token::Type::ANY_RUN;
+  const bool trailing_run = tokens.size() > leading_run &&
+                            tokens.back().type == Token::Type::ANY_RUN;
+  std::string literal;
+  bool single_literal = true;
+  for (size_t i = leading_run; i < tokens.size() - trailing_run; ++i) {
+    if (tokens[i].type != Token::Type::CHAR) {
+      single_literal = false;
+      break;
+    }
+    literal.push_back(tokens[i].c);
+  }
+  if (!single_literal) {
+    return LikePattern(Kind::GENERAL, "", std::move(tokens));
+  }
+  if (leading_run && trailing_run) {
+    return LikePattern(Kind::CONTAINS, std::move(literal), {});
+  }
+  if (leading_run) {
+    // A lone '%' is an empty prefix, which matches every string.
+    const auto kind = literal.empty() ? Kind::PREFIX : Kind::SUFFIX;
+    return LikePattern(kind, std::move(literal), {});
+  }
+  if (trailing_run) {
+    return LikePattern(Kind::PREFIX, std::move(literal), {});
+  }
+  return LikePattern(Kind::EXACT, std::move(literal), {});
+}
+
+auto LikePattern::Matches(std::string_view text) const -> bool {
+  switch (kind_) {
+  case Kind::EXACT:
+    return text == literal_;
+  case Kind::PREFIX:
+    return text.starts_with(literal_);
+  case Kind::SUFFIX:
+    return text.ends_with(literal_);
+  case Kind::CONTAINS:
+    return FindSubstring(text, literal_) != std::string_view::npos;
+  case Kind::GENERAL:
+    return MatchesGeneral(text);
+  }
+  return false;
+}
+
+auto LikePattern::MatchesGeneral(std::string_view text) const -> bool {
+  // Greedy matching that backtracks only to the most recent '%': when a
+  // later literal fails, that '%' absorbs one more character and the rest of
+  // the pattern is retried. Linear for patterns with at most one '%'.
+  size_t t = 0;
+  size_t p = 0;
+  size_t star = tokens_.size();
+  size_t star_text = 0;
+  while (t < text.size()) {
+    if (p < tokens_.size() &&
+        (tokens_[p].type == Token::Type::ANY_ONE ||
+         (tokens_[p].type == Token::Type::CHAR && tokens_[p].c == text[t]))) {
+      ++t;
+      ++p;
+    } else if (p < tokens_.size() && tokens_[p].type == Token::Type::ANY_RUN) {
+      star = p++;
+      star_text = t;
+    } else if (star != tokens_.size()) {
+      p = star + 1;
+      t = ++star_text;
+    } else {
+      return false;
+    }
+  }
+  while (p < tokens_.size() && tokens_[p].type == Token::Type::ANY_RUN) {
+    ++p;
+  }
+  return p == tokens_.size();
+}
+
+auto LikePattern::PrefixRange() const
+    -> std::optional<std::pair<std::string, std::optional<std::string>>> {
+  if (kind_ == Kind::EXACT) {
+    // The smallest string greater than the literal is the literal plus a
+    // NUL byte.
+    return std::make_pair(literal_, literal_ + '\0');
+  }
+  if (kind_ != Kind::PREFIX) {
+    return std::nullopt;
+  }
+  // Every string with the prefix sorts before the prefix with its last byte
+  // incremented; 0xff bytes cannot be incremented and are dropped first.
+  std::string upper = literal_;
+  while (!upper.empty() && static_cast<unsigned char>(upper.back()) == 0xff) {
+    upper.pop_back();
+  }
+  if (upper.empty()) {
+    return std::make_pair(literal_, std::nullopt);
+  }
+  upper.back() =
+      static_cast<char>(static_cast<unsigned char>(upper.back()) + 1);
+  return std::make_pair(literal_, std::optional<std::string>(upper));
+}
+
+} // namespace JustADb
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace JustADb {
+
+// The position of the first occurrence of `needle` in `haystack`, or
+// std::string_view::npos. Vectorized (AVX2 or SSE2, picked at runtime) by
+// comparing the needle's first and last bytes against 32 or 16 candidate
+// positions at once and only checking the full needle where both match.
+[[nodiscard]] auto FindSubstring(std::string_view haystack,
+                                 std::string_view needle) -> size_t;
+
+// A LIKE pattern compiled once per query: '%' matches any run of bytes, '_'
+// any single byte and '\' escapes the next character. Patterns with a single
+// literal run become a specialized matcher; anything else falls back to a
+// general wildcard match.
+class LikePattern {
+public:
+  enum class Kind {
+    // 'abc'
+    EXACT,
+    // 'abc%'
+    PREFIX,
+    // '%abc'
+    SUFFIX,
+    // '%abc%'
+    CONTAINS,
+    // Anything else, e.g. 'a%b' or 'a_c'.
+    GENERAL,
+  };
+
+  static auto Compile(std::string_view pattern) -> LikePattern;
+
+  [[nodiscard]] auto Matches(std::string_view text) const -> bool;
+
+  [[nodiscard]] auto kind() const {
+    return kind_;
+  }
+
+  // The literal of a specialized matcher, escapes removed.
+  [[nodiscard]] auto literal() const -> const std::string & {
+    return literal_;
+  }
+
+  // For EXACT and PREFIX patterns, the range [lower, upper) of strings that
+  // can match, for range scans over ordered data. There is no upper bound
+  // when the prefix is empty or all 0xff bytes.
+  [[nodiscard]] auto PrefixRange() const
+      -> std::optional<std::pair<std::string, std::optional<std::string>>>;
+
+private:
+  // A GENERAL pattern as tokens: a literal character, or one of the
+  // wildcards.
+  struct Token {
+    enum class Type { CHAR, ANY_ONE, ANY_RUN };
+    Type type;
+    char c;
+  };
+
+  LikePattern(Kind kind, std::string literal, std::vector<Token> tokens)
+      : kind_(kind), literal_(std::move(literal)), tokens_(std::move(tokens)) {}
+
+  [[nodiscard]] auto MatchesGeneral(std::string_view text) const -> bool;
+
+  Kind kind_;
+  std::string literal_;
+  std::vector<Token> tokens_;
+};
+
+} // namespace JustADb
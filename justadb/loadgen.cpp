@@ -0,0 +1,205 @@
+// Drives a running justadb_server with pipelined point selects and reports
+// latency percentiles and throughput.
+#include "client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string host = "127.0.0.1";
+  uint16_t port = 7070;
+  std::optional<std::string> unix_socket_path;
+  size_t connections = 4;
+  size_t pipeline = 16;
+  size_t requests = 10000;
+  // Rows inserted into the table before the run; point selects hit them.
+  size_t rows = 1000;
+};
+
+auto FlagValue(std::string_view arg, std::string_view flag)
+    -> std::optional<std::string> {
+  if (arg.starts_with(flag) && arg.size() > flag.size() &&
+      arg[flag.size()] == '=') {
+    return std::string(arg.substr(flag.size() + 1));
+  }
+  return std::nullopt;
+}
+
+auto Connect(const Options &options)
+    -> std::expected<JustADb::Client, JustADb::Error> {
+  if (options.unix_socket_path) {
+    return JustADb::Client::ConnectUnix(*options.unix_socket_path);
+  }
+  return JustADb::Client::ConnectTcp(options.host, options.port);
+}
+
+auto PointSelect(std::mt19937 &rng, size_t rows) -> JustADb::SelectQuery {
+  using namespace JustADb;
+  SelectQuery query("kv", {Column("k", Column::Type::INT),
+                           Column("v", Column::Type::STRING)});
+  query.Where("k", std::to_string(rng() % std::max<size_t>(rows, 1)),
+              WhereClause::Operator::EQUAL);
+  return query;
+}
+
+// Keeps `options.pipeline` requests in flight until `options.requests` have
+// completed, recording the latency of each in nanoseconds.
+auto RunConnection(const Options &options, unsigned seed,
+                   std::vector<int64_t> &latencies) -> bool {
+  auto client = Connect(options);
+  if (!client) {
+    std::cerr << "Error: " << client.error().message() << std::endl;
+    return false;
+  }
+  auto used = client->Execute(JustADb::UseDatabaseQuery("loadgen"));
+  if (!used || used->error) {
+    std::cerr << "Error: cannot use database loadgen" << std::endl;
+    return false;
+  }
+
+  std::mt19937 rng(seed);
+  std::unordered_map<uint32_t, Clock::time_point> sent_at;
+  size_t sent = 0;
+  size_t completed = 0;
+  latencies.reserve(options.requests);
+  while (completed < options.requests) {
+    while (sent < options.requests && sent - completed < options.pipeline) {
+      const auto now = Clock::now();
+      auto request_id = client->Send(PointSelect(rng, options.rows));
+      if (!request_id) {
+        std::cerr << "Error: " << request_id.error().message() << std::endl;
+        return false;
+      }
+      sent_at[*request_id] = now;
+      ++sent;
+    }
+
+    auto response = client->ReadResponse();
+    if (!response) {
+      std::cerr << "Error: " << response.error().message() << std::endl;
+      return false;
+    }
+    const auto it = sent_at.find(response->request_id);
+    latencies.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             it->second)
+            .count());
+    sent_at.erase(it);
+    ++completed;
+  }
+  return true;
+}
+
+auto Percentile(const std::vector<int64_t> &sorted, double p) -> double {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const auto index = static_cast<size_t>(p * (sorted.size() - 1));
+  return sorted[index] / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (auto value = FlagValue(arg, "--host")) {
+      options.host = *value;
+    } else if (auto value = FlagValue(arg, "--port")) {
+      options.port = static_cast<uint16_t>(std::stoi(*value));
+    } else if (auto value = FlagValue(arg, "--unix")) {
+      options.unix_socket_path = *value;
+    } else if (auto value = FlagValue(arg, "--connections")) {
+      options.connections = std::stoul(*value);
+    } else if (auto value = FlagValue(arg, "--pipeline")) {
+      options.pipeline = std::max<size_t>(1, std::stoul(*value));
+    } else if (auto value = FlagValue(arg, "--requests")) {
+      options.requests = std::stoul(*value);
+    } else if (auto value = FlagValue(arg, "--rows")) {
+      options.rows = std::stoul(*value);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--host=ADDR] [--port=N] [--unix=PATH] [--connections=N]"
+                   " [--pipeline=N] [--requests=N_PER_CONNECTION] [--rows=N]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  {
+    using namespace JustADb;
+    auto client = Connect(options);
+    if (!client) {
+      std::cerr << "Error: " << client.error().message() << std::endl;
+      return 1;
+    }
+    (void)client->Execute(CreateDatabaseQuery("loadgen"));
+    (void)client->Execute(UseDatabaseQuery("loadgen"));
+    // The table is only seeded the first time the server sees it.
+    auto created = client->Execute(CreateTableQuery(
+        "kv", {new Column("k", Column::Type::INT),
+               new Column("v", Column::Type::STRING)}));
+    if (created && !created->error) {
+      for (size_t k = 0; k < options.rows; ++k) {
+        std::unordered_map<std::string, Value> values;
+        values.insert({"k", Value(static_cast<int>(k))});
+        values.insert({"v", Value("value_" + std::to_string(k))});
+        (void)client->Send(InsertQuery("kv", std::move(values)));
+      }
+      for (size_t k = 0; k < options.rows; ++k) {
+        auto inserted = client->ReadResponse();
+        if (!inserted || inserted->error) {
+          std::cerr << "Error: cannot seed table kv" << std::endl;
+          return 1;
+        }
+      }
+    }
+  }
+
+  std::vector<std::vector<int64_t>> latencies(options.connections);
+  std::vector<std::thread> workers;
+  std::vector<char> succeeded(options.connections, 0);
+  const auto start = Clock::now();
+  for (size_t i = 0; i < options.connections; ++i) {
+    workers.emplace_back([&, i] {
+      succeeded[i] = RunConnection(options, i + 1, latencies[i]);
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  if (std::count(succeeded.begin(), succeeded.end(), 0) != 0) {
+    return 1;
+  }
+
+  std::vector<int64_t> all;
+  for (const auto &connection_latencies : latencies) {
+    all.insert(all.end(), connection_latencies.begin(),
+               connection_latencies.end());
+  }
+  std::sort(all.begin(), all.end());
+
+  std::cout << "requests:    " << all.size() << "\n"
+            << "connections: " << options.connections << "\n"
+            << "pipeline:    " << options.pipeline << "\n"
+            << "qps:         " << all.size() / elapsed.count() << "\n"
+            << "p50_us:      " << Percentile(all, 0.50) << "\n"
+            << "p99_us:      " << Percentile(all, 0.99) << "\n"
+            << "p999_us:     " << Percentile(all, 0.999) << std::endl;
+  return 0;
+}
@@ -0,0 +1,443 @@
+#include "lsm.h"
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+
+namespace JustADb {
+
+namespace {
+
+// Keys of one tree all have the column's type, so the variant order is the
+// value order.
+auto KeyLess(const Value &lhs, const Value &rhs) -> bool {
+  return lhs.value() < rhs.value();
+}
+
+auto EntryLess(const LsmEntry &lhs, const LsmEntry &rhs) -> bool {
+  if (KeyLess(*lhs.key, *rhs.key)) {
+    return true;
+  }
+  if (KeyLess(*rhs.key, *lhs.key)) {
+    return false;
+  }
+  return lhs.sequence < rhs.sequence;
+}
+
+// Whether `key` lies before the range starting at `low`.
+auto BelowLow(const Value &key, const LsmBound &low) -> bool {
+  return low.inclusive ? KeyLess(key, low.key) : !KeyLess(low.key, key);
+}
+
+// Whether `key` lies past the range ending at `high`.
+auto AboveHigh(const Value &key, const LsmBound &high) -> bool {
+  return high.inclusive ? KeyLess(high.key, key) : !KeyLess(key, high.key);
+}
+
+auto Merge(const std::vector<std::shared_ptr<const SortedRun>> &runs)
+    -> std::vector<LsmEntry> {
+  std::vector<LsmEntry> merged;
+  for (const auto &run : runs) {
+    std::vector<LsmEntry> next;
+    next.reserve(merged.size() + run->entries().size());
+    std::merge(merged.begin(), merged.end(), run->entries().begin(),
+               run->entries().end(), std::back_inserter(next), EntryLess);
+    merged = std::move(next);
+  }
+  return merged;
+}
+
+} // namespace
+
+// The links follow the node in memory, as many as its height: a lookup
+// touches one cache line per node it passes.
+struct MemTable::Iterator::Node {
+  explicit Node(const LsmEntry &entry) : entry(entry) {}
+
+  LsmEntry entry;
+  std::atomic<Node *> next[1];
+};
+
+namespace {
+
+constexpr size_t kArenaBlockBytes = 64 * 1024;
+
+} // namespace
+
+auto MemTable::Iterator::entry() const -> const LsmEntry & {
+  return node_->entry;
+}
+
+void MemTable::Iterator::Next() {
+  node_ = node_->next[0].load(std::memory_order_acquire);
+}
+
+MemTable::MemTable() : head_(NewNode({}, kMaxHeight)) {}
+
+MemTable::~MemTable() = default;
+
+auto MemTable::NewNode(const LsmEntry &entry, size_t height) -> Node * {
+  const auto bytes =
+      sizeof(Node) + (height - 1) * sizeof(std::atomic<Node *>);
+  const auto offset = (arena_used_ + alignof(Node) - 1) & ~(alignof(Node) - 1);
+  if (arena_.empty() || offset + bytes > kArenaBlockBytes) {
+    arena_.push_back(std::make_unique<std::byte[]>(kArenaBlockBytes));
+    arena_used_ = 0;
+    return NewNode(entry, height);
+  }
+  arena_used_ = offset + bytes;
+  auto *node = new (arena_.back().get() + offset) Node(entry);
+  for (size_t level = 0; level < height; ++level) {
+    new (&node->next[level]) std::atomic<Node *>(nullptr);
+  }
+  return node;
+}
+
+auto MemTable::RandomHeight() -> size_t {
+  // Each level holds about a quarter of the nodes of the one below.
+  size_t height = 1;
+  while (height < kMaxHeight && rng_() % 4 == 0) {
+    ++height;
+  }
+  return height;
+}
+
+void MemTable::Insert(const LsmEntry &entry) {
+  // The last node before the new entry on every level.
+  Node *previous[kMaxHeight];
+  std::fill(std::begin(previous), std::end(previous), head_);
+  auto *node = head_;
+  for (auto level = height_.load(std::memory_order_relaxed); level-- > 0;) {
+    auto *next = node->next[level].load(std::memory_order_relaxed);
+    while (next != nullptr && EntryLess(next->entry, entry)) {
+      node = next;
+      next = node->next[level].load(std::memory_order_relaxed);
+    }
+    previous[level] = node;
+  }
+
+  const auto height = RandomHeight();
+  auto *inserted = NewNode(entry, height);
+  // Link bottom up; a reader that sees the node on a level finds it fully
+  // linked below.
+  for (size_t level = 0; level < height; ++level) {
+    inserted->next[level].store(
+        previous[level]->next[level].load(std::memory_order_relaxed),
+        std::memory_order_relaxed);
+    previous[level]->next[level].store(inserted, std::memory_order_release);
+  }
+  if (height > height_.load(std::memory_order_relaxed)) {
+    height_.store(height, std::memory_order_relaxed);
+  }
+  size_.fetch_add(1, std::memory_order_release);
+}
+
+auto MemTable::Seek(const std::optional<LsmBound> &low) const -> Iterator {
+  const auto *node = head_;
+  if (low) {
+    for (auto level = height_.load(std::memory_order_relaxed); level-- > 0;) {
+      auto *next = node->next[level].load(std::memory_order_acquire);
+      while (next != nullptr && BelowLow(*next->entry.key, *low)) {
+        node = next;
+        next = node->next[level].load(std::memory_order_acquire);
+      }
+    }
+  }
+  return Iterator(node->next[0].load(std::memory_order_acquire));
+}
+
+auto MemTable::Entries() const -> std::vector<LsmEntry> {
+  std::vector<LsmEntry> entries;
+  entries.reserve(size());
+  for (auto it = Seek(std::nullopt); it.Valid(); it.Next()) {
+    entries.push_back(it.entry());
+  }
+  return entries;
+}
+
+SortedRun::SortedRun(std::vector<LsmEntry> entries)
+    : entries_(std::move(entries)), bloom_(entries_.size()) {
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (i % kBlockEntries == 0) {
+      block_index_.push_back(entries_[i].key);
+    }
+    bloom_.Add(HashValue(*entries_[i].key));
+  }
+}
+
+auto SortedRun::MayContain(const Value &key) const -> bool {
+  return bloom_.MayContain(HashValue(key));
+}
+
+auto SortedRun::Seek(const std::optional<LsmBound> &low) const -> size_t {
+  if (!low) {
+    return 0;
+  }
+  // The index narrows the search to the block before the first block that
+  // starts inside the range; only that block is searched entry by entry.
+  const auto block =
+      std::partition_point(block_index_.begin(), block_index_.end(),
+                           [&low](const Value *first) {
+                             return BelowLow(*first, *low);
+                           }) -
+      block_index_.begin();
+  const auto begin =
+      entries_.begin() + (block == 0 ? 0 : (block - 1) * kBlockEntries);
+  const auto end = entries_.begin() +
+                   std::min(entries_.size(), block * kBlockEntries);
+  return std::partition_point(begin, end,
+                              [&low](const LsmEntry &entry) {
+                                return BelowLow(*entry.key, *low);
+                              }) -
+         entries_.begin();
+}
+
+LsmTree::LsmTree(LsmOptions options)
+    : options_(options), active_(std::make_shared<MemTable>()),
+      levels_(1), compactor_([this] { CompactionLoop(); }) {}
+
+LsmTree::~LsmTree() {
+  Stop();
+}
+
+void LsmTree::Stop() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  work_.notify_all();
+  idle_.notify_all();
+  if (compactor_.joinable()) {
+    compactor_.join();
+  }
+}
+
+auto LsmTree::stopped() const -> bool {
+  std::lock_guard lock(mutex_);
+  return stopping_;
+}
+
+void LsmTree::Insert(const Value *key, Tuple *tuple) {
+  active_->Insert(
+      {key, sequence_.fetch_add(1, std::memory_order_acq_rel), tuple});
+  size_.fetch_add(1, std::memory_order_release);
+  if (active_->size() < options_.memtable_entries) {
+    return;
+  }
+  {
+    std::lock_guard lock(mutex_);
+    frozen_.push_back(std::move(active_));
+    active_ = std::make_shared<MemTable>();
+    pending_ = true;
+  }
+  work_.notify_one();
+}
+
+auto LsmTree::CurrentVersion() const -> Version {
+  std::lock_guard lock(mutex_);
+  Version version;
+  version.memtables = frozen_;
+  version.memtables.push_back(active_);
+  version.levels = levels_;
+  return version;
+}
+
+auto LsmTree::Scan(std::optional<LsmBound> low,
+                   std::optional<LsmBound> high) const -> Cursor {
+  Cursor cursor;
+  // Rows inserted after this point are not part of the snapshot.
+  cursor.sequence_ = sequence_.load(std::memory_order_acquire);
+  cursor.high_ = std::move(high);
+  auto version = CurrentVersion();
+  for (auto &memtable : version.memtables) {
+    auto position = memtable->Seek(low);
+    cursor.sources_.push_back({std::move(memtable), position, nullptr, 0});
+  }
+  for (auto &level : version.levels) {
+    for (auto &run : level) {
+      const auto position = run->Seek(low);
+      cursor.sources_.push_back({nullptr, std::nullopt, std::move(run),
+                                 position});
+    }
+  }
+  return cursor;
+}
+
+auto LsmTree::Cursor::Current(const Source &source) const -> const LsmEntry * {
+  const LsmEntry *entry = nullptr;
+  if (source.memtable) {
+    auto position = *source.memtable_position;
+    while (position.Valid() && position.entry().sequence >= sequence_) {
+      position.Next();
+    }
+    entry = position.Valid() ? &position.entry() : nullptr;
+  } else if (source.run_position < source.run->entries().size()) {
+    entry = &source.run->entries()[source.run_position];
+  }
+  if (entry != nullptr && high_ && AboveHigh(*entry->key, *high_)) {
+    return nullptr;
+  }
+  return entry;
+}
+
+void LsmTree::Cursor::Advance(Source &source) const {
+  if (!source.memtable) {
+    ++source.run_position;
+    return;
+  }
+  auto &position = *source.memtable_position;
+  while (position.Valid() && position.entry().sequence >= sequence_) {
+    position.Next();
+  }
+  position.Next();
+}
+
+auto LsmTree::Cursor::Next(size_t max_rows, std::vector<const Tuple *> &out)
+    -> bool {
+  size_t added = 0;
+  while (added < max_rows) {
+    // A handful of sources: picking the smallest linearly beats a heap.
+    Source *smallest = nullptr;
+    const LsmEntry *smallest_entry = nullptr;
+    for (auto &source : sources_) {
+      const auto *entry = Current(source);
+      if (entry != nullptr &&
+          (smallest_entry == nullptr || EntryLess(*entry, *smallest_entry))) {
+        smallest = &source;
+        smallest_entry = entry;
+      }
+    }
+    if (smallest == nullptr) {
+      break;
+    }
+    out.push_back(smallest_entry->tuple);
+    Advance(*smallest);
+    ++added;
+  }
+  return added > 0;
+}
+
+auto LsmTree::Get(const Value &key) const -> std::vector<const Tuple *> {
+  const auto version = CurrentVersion();
+  const std::optional<LsmBound> bound = LsmBound{key, true};
+  std::vector<LsmEntry> found;
+  for (const auto &memtable : version.memtables) {
+    for (auto it = memtable->Seek(bound);
+         it.Valid() && !KeyLess(key, *it.entry().key); it.Next()) {
+      found.push_back(it.entry());
+    }
+  }
+  for (const auto &level : version.levels) {
+    for (const auto &run : level) {
+      if (!run->MayContain(key)) {
+        bloom_skips_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      const auto &entries = run->entries();
+      for (auto i = run->Seek(bound);
+           i < entries.size() && !KeyLess(key, *entries[i].key); ++i) {
+        found.push_back(entries[i]);
+      }
+    }
+  }
+  std::sort(found.begin(), found.end(), EntryLess);
+  std::vector<const Tuple *> tuples;
+  tuples.reserve(found.size());
+  for (const auto &entry : found) {
+    tuples.push_back(entry.tuple);
+  }
+  return tuples;
+}
+
+void LsmTree::WaitForCompaction() {
+  std::unique_lock lock(mutex_);
+  idle_.wait(lock, [this] {
+    return stopping_ || (!pending_ && !compacting_ && frozen_.empty());
+  });
+}
+
+auto LsmTree::LevelSizes() const -> std::vector<size_t> {
+  const auto version = CurrentVersion();
+  std::vector<size_t> sizes(1 + version.levels.size(), 0);
+  for (const auto &memtable : version.memtables) {
+    sizes[0] += memtable->size();
+  }
+  for (size_t level = 0; level < version.levels.size(); ++level) {
+    for (const auto &run : version.levels[level]) {
+      sizes[level + 1] += run->entries().size();
+    }
+  }
+  return sizes;
+}
+
+auto LsmTree::LevelCapacity(size_t level) const -> size_t {
+  auto capacity = options_.level_base_entries;
+  for (size_t i = 1; i < level; ++i) {
+    capacity *= options_.level_ratio;
+  }
+  return capacity;
+}
+
+void LsmTree::CompactionLoop() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    work_.wait(lock, [this] { return stopping_ || pending_; });
+    if (stopping_) {
+      return;
+    }
+    pending_ = false;
+    compacting_ = true;
+    lock.unlock();
+    while (CompactOnce()) {
+    }
+    lock.lock();
+    compacting_ = false;
+    idle_.notify_all();
+  }
+}
+
+auto LsmTree::CompactOnce() -> bool {
+  std::unique_lock lock(mutex_);
+  // Only this thread changes frozen_'s front and levels_, so what is read
+  // here stays valid while the lock is released for the merge.
+  if (!frozen_.empty()) {
+    auto memtable = frozen_.front();
+    lock.unlock();
+    auto run = std::make_shared<const SortedRun>(memtable->Entries());
+    lock.lock();
+    levels_[0].push_back(std::move(run));
+    frozen_.erase(frozen_.begin());
+    // Free the memtable's nodes without holding up the writer.
+    lock.unlock();
+    return true;
+  }
+
+  for (size_t level = 0; level < levels_.size(); ++level) {
+    size_t entries = 0;
+    for (const auto &run : levels_[level]) {
+      entries += run->entries().size();
+    }
+    const bool full = level == 0 ? levels_[0].size() >= options_.level0_runs
+                                 : entries > LevelCapacity(level);
+    if (!full) {
+      continue;
+    }
+    if (level + 1 == levels_.size()) {
+      levels_.emplace_back();
+    }
+    // Merge the level into the next one. The small runs go first, so that
+    // the next level's large run is copied only once.
+    auto inputs = levels_[level];
+    inputs.insert(inputs.end(), levels_[level + 1].begin(),
+                  levels_[level + 1].end());
+    lock.unlock();
+    auto merged = std::make_shared<const SortedRun>(Merge(inputs));
+    lock.lock();
+    levels_[level].clear();
+    levels_[level + 1] = {std::move(merged)};
+    return true;
+  }
+  return false;
+}
+
+} // namespace JustADb
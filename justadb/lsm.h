@@ -0,0 +1,238 @@
+#pragma once
+
+#include "bloom.h"
+#include "ddl.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace JustADb {
+
+// One row of an LSM table, filed under its key. Rows with equal keys are all
+// kept, ordered by sequence number (insertion order).
+struct LsmEntry {
+  const Value *key;
+  uint64_t sequence;
+  Tuple *tuple;
+};
+
+// One end of a key range.
+struct LsmBound {
+  Value key;
+  bool inclusive;
+};
+
+// The in-memory write buffer: a skiplist ordered by (key, sequence). One
+// thread inserts while any number of threads read.
+class MemTable {
+public:
+  MemTable();
+  ~MemTable();
+
+  MemTable(const MemTable &) = delete;
+  auto operator=(const MemTable &) -> MemTable & = delete;
+
+  void Insert(const LsmEntry &entry);
+
+  [[nodiscard]] auto size() const {
+    return size_.load(std::memory_order_acquire);
+  }
+
+  // The entries in order.
+  [[nodiscard]] auto Entries() const -> std::vector<LsmEntry>;
+
+  class Iterator {
+  public:
+    [[nodiscard]] auto Valid() const {
+      return node_ != nullptr;
+    }
+
+    [[nodiscard]] auto entry() const -> const LsmEntry &;
+
+    void Next();
+
+  private:
+    friend class MemTable;
+
+    struct Node;
+
+    explicit Iterator(const Node *node) : node_(node) {}
+
+    const Node *node_;
+  };
+
+  // The first entry whose key is not below `low`, or the first entry.
+  [[nodiscard]] auto Seek(const std::optional<LsmBound> &low) const
+      -> Iterator;
+
+private:
+  static constexpr size_t kMaxHeight = 12;
+
+  using Node = Iterator::Node;
+
+  auto RandomHeight() -> size_t;
+
+  // A node with `height` links, carved out of arena_.
+  auto NewNode(const LsmEntry &entry, size_t height) -> Node *;
+
+  // Nodes are never freed one by one, so they are bump-allocated from large
+  // blocks that die with the memtable.
+  std::vector<std::unique_ptr<std::byte[]>> arena_;
+  size_t arena_used_ = 0;
+  Node *head_;
+  std::atomic<size_t> height_ = 1;
+  std::atomic<size_t> size_ = 0;
+  std::minstd_rand rng_;
+};
+
+// An immutable sorted array of entries with a block index (the first key of
+// every block) and a Bloom filter over its keys.
+class SortedRun {
+public:
+  static constexpr size_t kBlockEntries = 64;
+
+  explicit SortedRun(std::vector<LsmEntry> entries);
+
+  [[nodiscard]] auto MayContain(const Value &key) const -> bool;
+
+  // The position of the first entry that is not below `low`.
+  [[nodiscard]] auto Seek(const std::optional<LsmBound> &low) const -> size_t;
+
+  [[nodiscard]] auto entries() const -> const std::vector<LsmEntry> & {
+    return entries_;
+  }
+
+private:
+  std::vector<LsmEntry> entries_;
+  std::vector<const Value *> block_index_;
+  BloomFilter bloom_;
+};
+
+struct LsmOptions {
+  // Entries a memtable takes before it is frozen and flushed into a run.
+  size_t memtable_entries = 4096;
+  // Level 0 holds flushed runs, which may overlap; this many trigger a merge
+  // into level 1.
+  size_t level0_runs = 4;
+  // Every later level holds a single run of at most level_base_entries *
+  // level_ratio^(level - 1) entries before it is merged into the next one.
+  size_t level_base_entries = 64 * 1024;
+  size_t level_ratio = 10;
+};
+
+// A log-structured merge tree over a table's rows. Inserts go to the active
+// memtable. Full memtables are frozen, and a background thread flushes them
+// into level 0 runs and compacts the levels, so inserts never wait for a
+// merge. Readers see a consistent snapshot of every memtable and run.
+class LsmTree {
+public:
+  explicit LsmTree(LsmOptions options = {});
+  ~LsmTree();
+
+  LsmTree(const LsmTree &) = delete;
+  auto operator=(const LsmTree &) -> LsmTree & = delete;
+
+  // Called by a single writer at a time.
+  void Insert(const Value *key, Tuple *tuple);
+
+  // Streams the rows with keys in [low, high] (or with a missing bound, to
+  // that end of the tree) in key order, as of when the cursor was created.
+  class Cursor {
+  public:
+    // Appends up to `max_rows` more rows to `out`; false once exhausted.
+    auto Next(size_t max_rows, std::vector<const Tuple *> &out) -> bool;
+
+  private:
+    friend class LsmTree;
+
+    struct Source {
+      std::shared_ptr<const MemTable> memtable;
+      std::optional<MemTable::Iterator> memtable_position;
+      std::shared_ptr<const SortedRun> run;
+      size_t run_position = 0;
+    };
+
+    [[nodiscard]] auto Current(const Source &source) const
+        -> const LsmEntry *;
+
+    void Advance(Source &source) const;
+
+    std::vector<Source> sources_;
+    std::optional<LsmBound> high_;
+    uint64_t sequence_ = 0;
+  };
+
+  [[nodiscard]] auto Scan(std::optional<LsmBound> low,
+                          std::optional<LsmBound> high) const -> Cursor;
+
+  // The rows with exactly this key. Runs whose Bloom filter rules the key
+  // out are not searched.
+  [[nodiscard]] auto Get(const Value &key) const -> std::vector<const Tuple *>;
+
+  [[nodiscard]] auto size() const {
+    return size_.load(std::memory_order_acquire);
+  }
+
+  // Blocks until every frozen memtable is flushed and no level needs a merge,
+  // or until the tree is stopped.
+  void WaitForCompaction();
+
+  // Ends the background thread once its current merge is done. The tree
+  // stays readable, but nothing is flushed or merged any more. Called by a
+  // single thread at a time.
+  void Stop();
+
+  [[nodiscard]] auto stopped() const -> bool;
+
+  // Entries per level, with the memtables as level "-1" in front.
+  [[nodiscard]] auto LevelSizes() const -> std::vector<size_t>;
+
+  // Lookups answered without searching a run, thanks to its Bloom filter.
+  [[nodiscard]] auto bloom_skips() const {
+    return bloom_skips_.load(std::memory_order_relaxed);
+  }
+
+private:
+  // Everything a reader needs, copied under the mutex.
+  struct Version {
+    // Frozen memtables, oldest first, then the active one.
+    std::vector<std::shared_ptr<const MemTable>> memtables;
+    // levels[0] holds runs oldest first; later levels hold at most one.
+    std::vector<std::vector<std::shared_ptr<const SortedRun>>> levels;
+  };
+
+  [[nodiscard]] auto CurrentVersion() const -> Version;
+
+  void CompactionLoop();
+
+  // Does one unit of background work; false when there is none.
+  auto CompactOnce() -> bool;
+
+  [[nodiscard]] auto LevelCapacity(size_t level) const -> size_t;
+
+  LsmOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable idle_;
+  std::shared_ptr<MemTable> active_;
+  std::vector<std::shared_ptr<const MemTable>> frozen_;
+  std::vector<std::vector<std::shared_ptr<const SortedRun>>> levels_;
+  // Set when a memtable is frozen, until the compactor picks the work up.
+  bool pending_ = false;
+  bool compacting_ = false;
+  bool stopping_ = false;
+  std::atomic<uint64_t> sequence_ = 0;
+  std::atomic<size_t> size_ = 0;
+  mutable std::atomic<uint64_t> bloom_skips_ = 0;
+  std::thread compactor_;
+};
+
+} // namespace JustADb
@@ -0,0 +1,216 @@
+#include "memory.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <utility>
+
+namespace JustADb {
+
+namespace {
+
+std::mutex spill_directory_mutex;
+std::string spill_directory;
+std::atomic<uint64_t> spilled_bytes = 0;
+
+auto SystemError(const std::string &what) -> Error {
+  return Error(what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+auto MemoryTracker::Process() -> MemoryTracker & {
+  static MemoryTracker process("process");
+  return process;
+}
+
+MemoryTracker::MemoryTracker(std::string name, MemoryTracker *parent,
+                             std::optional<size_t> limit)
+    : name_(std::move(name)), parent_(parent),
+      limit_(limit.value_or(kNoLimit)) {
+  if (parent_ != nullptr) {
+    std::lock_guard lock(parent_->children_mutex_);
+    parent_->children_.push_back(this);
+  }
+}
+
+MemoryTracker::~MemoryTracker() {
+  if (parent_ == nullptr) {
+    return;
+  }
+  parent_->Release(current());
+  std::lock_guard lock(parent_->children_mutex_);
+  std::erase(parent_->children_, this);
+}
+
+auto MemoryTracker::TryReserveLocal(size_t bytes) -> bool {
+  const auto limit = limit_.load(std::memory_order_relaxed);
+  auto current = current_.load(std::memory_order_relaxed);
+  do {
+    if (bytes > limit || current > limit - bytes) {
+      return false;
+    }
+  } while (!current_.compare_exchange_weak(current, current + bytes,
+                                           std::memory_order_relaxed));
+  return true;
+}
+
+auto MemoryTracker::TryReserve(size_t bytes) -> bool {
+  for (auto *tracker = this; tracker != nullptr; tracker = tracker->parent_) {
+    if (!tracker->TryReserveLocal(bytes)) {
+      // Undo the trackers below the one that refused.
+      for (auto *reserved = this; reserved != tracker;
+           reserved = reserved->parent_) {
+        reserved->current_.fetch_sub(bytes, std::memory_order_relaxed);
+      }
+      return false;
+    }
+  }
+  // Only now, so that a reservation an ancestor refused leaves no peak.
+  for (auto *tracker = this; tracker != nullptr; tracker = tracker->parent_) {
+    const auto current = tracker->current();
+    auto peak = tracker->peak_.load(std::memory_order_relaxed);
+    while (peak < current &&
+           !tracker->peak_.compare_exchange_weak(peak, current,
+                                                 std::memory_order_relaxed)) {
+    }
+  }
+  return true;
+}
+
+auto MemoryTracker::Reserve(size_t bytes) -> std::expected<void, Error> {
+  if (TryReserve(bytes)) {
+    return std::expected<void, Error>(std::in_place);
+  }
+  // Name the tracker that is full, e.g. the database rather than the query.
+  const MemoryTracker *full = this;
+  for (auto *tracker = this; tracker != nullptr; tracker = tracker->parent_) {
+    const auto limit = tracker->limit_.load(std::memory_order_relaxed);
+    if (bytes > limit || tracker->current() > limit - bytes) {
+      full = tracker;
+      break;
+    }
+  }
+  return std::unexpected(
+      Error("Memory limit of " + full->name_ + " exceeded: " +
+                std::to_string(full->current()) + " of " +
+                std::to_string(full->limit_.load(std::memory_order_relaxed)) +
+                " bytes in use, " + std::to_string(bytes) + " more requested",
+            Error::Kind::MemoryLimitExceeded));
+}
+
+void MemoryTracker::Release(size_t bytes) {
+  for (auto *tracker = this; tracker != nullptr; tracker = tracker->parent_) {
+    tracker->current_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+}
+
+void MemoryTracker::set_limit(std::optional<size_t> limit) {
+  limit_.store(limit.value_or(kNoLimit), std::memory_order_relaxed);
+}
+
+auto MemoryTracker::limit() const -> std::optional<size_t> {
+  const auto limit = limit_.load(std::memory_order_relaxed);
+  return limit == kNoLimit ? std::nullopt : std::optional<size_t>(limit);
+}
+
+auto MemoryTracker::Usage() const -> MemoryUsage {
+  MemoryUsage usage;
+  usage.name = name_;
+  usage.current = current();
+  usage.peak = peak();
+  usage.limit = limit();
+  std::lock_guard lock(children_mutex_);
+  for (const auto *child : children_) {
+    usage.children.push_back(child->Usage());
+  }
+  return usage;
+}
+
+void SpillFile::set_directory(std::string directory) {
+  std::lock_guard lock(spill_directory_mutex);
+  spill_directory = std::move(directory);
+}
+
+auto SpillFile::Create() -> std::expected<SpillFile, Error> {
+  std::filesystem::path directory;
+  {
+    std::lock_guard lock(spill_directory_mutex);
+    directory = spill_directory;
+  }
+  if (directory.empty()) {
+    std::error_code error;
+    directory = std::filesystem::temp_directory_path(error);
+    if (error) {
+      directory = "/tmp";
+    }
+  }
+  auto path = (directory / "justadb-spill-XXXXXX").string();
+  const int fd = mkstemp(path.data());
+  if (fd == -1) {
+    return std::unexpected(SystemError("Cannot create a spill file in " +
+                                       directory.string()));
+  }
+  unlink(path.c_str());
+  auto *file = fdopen(fd, "w+b");
+  if (file == nullptr) {
+    close(fd);
+    return std::unexpected(SystemError("Cannot open a spill file"));
+  }
+  return SpillFile(file);
+}
+
+SpillFile::SpillFile(SpillFile &&other) noexcept
+    : file_(std::exchange(other.file_, nullptr)),
+      bytes_written_(other.bytes_written_) {}
+
+auto SpillFile::operator=(SpillFile &&other) noexcept -> SpillFile & {
+  if (this != &other) {
+    if (file_ != nullptr) {
+      std::fclose(file_);
+    }
+    file_ = std::exchange(other.file_, nullptr);
+    bytes_written_ = other.bytes_written_;
+  }
+  return *this;
+}
+
+SpillFile::~SpillFile() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+  }
+}
+
+auto SpillFile::Write(const void *data, size_t size)
+    -> std::expected<void, Error> {
+  if (std::fwrite(data, 1, size, file_) != size) {
+    return std::unexpected(SystemError("Cannot write a spill file"));
+  }
+  bytes_written_ += size;
+  spilled_bytes.fetch_add(size, std::memory_order_relaxed);
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto SpillFile::Rewind() -> std::expected<void, Error> {
+  if (std::fseek(file_, 0, SEEK_SET) != 0) {
+    return std::unexpected(SystemError("Cannot rewind a spill file"));
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto SpillFile::Read(void *data, size_t size) -> std::expected<size_t, Error> {
+  const auto read = std::fread(data, 1, size, file_);
+  if (read < size && std::ferror(file_)) {
+    return std::unexpected(SystemError("Cannot read a spill file"));
+  }
+  return read;
+}
+
+auto SpillFile::total_bytes_written() -> uint64_t {
+  return spilled_bytes.load(std::memory_order_relaxed);
+}
+
+} // namespace JustADb
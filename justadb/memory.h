@@ -0,0 +1,130 @@
+#pragma once
+
+#include "utils.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <expected>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace JustADb {
+
+// A snapshot of a tracker and its descendants.
+struct MemoryUsage {
+  std::string name;
+  size_t current = 0;
+  size_t peak = 0;
+  std::optional<size_t> limit;
+  std::vector<MemoryUsage> children;
+};
+
+// Counts the bytes a part of the system holds. Trackers form a tree (the
+// process, then databases, queries and operators), and a reservation counts
+// against the tracker and all its ancestors, so a limit anywhere bounds
+// everything below it. Reserving and releasing are thread-safe.
+class MemoryTracker {
+public:
+  // The root of the tree. It has no limit unless one is set.
+  static auto Process() -> MemoryTracker &;
+
+  // `parent` must outlive the tracker.
+  explicit MemoryTracker(std::string name, MemoryTracker *parent = nullptr,
+                         std::optional<size_t> limit = std::nullopt);
+
+  // Gives back whatever the tracker still holds.
+  ~MemoryTracker();
+
+  MemoryTracker(const MemoryTracker &) = delete;
+  auto operator=(const MemoryTracker &) -> MemoryTracker & = delete;
+
+  // Counts `bytes` here and in every ancestor, or nowhere if that would take
+  // any of them over its limit.
+  [[nodiscard]] auto TryReserve(size_t bytes) -> bool;
+
+  // TryReserve() that reports which limit was hit.
+  auto Reserve(size_t bytes) -> std::expected<void, Error>;
+
+  void Release(size_t bytes);
+
+  // A lower limit does not take back what is already reserved; it only makes
+  // further reservations fail.
+  void set_limit(std::optional<size_t> limit);
+
+  [[nodiscard]] auto limit() const -> std::optional<size_t>;
+
+  [[nodiscard]] auto current() const {
+    return current_.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] auto peak() const {
+    return peak_.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] auto name() const -> const std::string & {
+    return name_;
+  }
+
+  [[nodiscard]] auto Usage() const -> MemoryUsage;
+
+private:
+  static constexpr size_t kNoLimit = SIZE_MAX;
+
+  // Reserves here only; false if it would pass the limit.
+  auto TryReserveLocal(size_t bytes) -> bool;
+
+  std::string name_;
+  MemoryTracker *parent_;
+  std::atomic<size_t> limit_;
+  std::atomic<size_t> current_ = 0;
+  std::atomic<size_t> peak_ = 0;
+  mutable std::mutex children_mutex_;
+  std::vector<const MemoryTracker *> children_;
+};
+
+// A temporary file that operators write data they cannot keep in memory to.
+// It is unlinked as soon as it is created, so it disappears with the process
+// even if the process dies.
+class SpillFile {
+public:
+  // The directory spill files are created in; the system's temporary
+  // directory unless set.
+  static void set_directory(std::string directory);
+
+  static auto Create() -> std::expected<SpillFile, Error>;
+
+  SpillFile(SpillFile &&other) noexcept;
+  auto operator=(SpillFile &&other) noexcept -> SpillFile &;
+
+  SpillFile(const SpillFile &) = delete;
+  auto operator=(const SpillFile &) -> SpillFile & = delete;
+
+  ~SpillFile();
+
+  auto Write(const void *data, size_t size) -> std::expected<void, Error>;
+
+  // Switches from writing to reading, from the start of the file.
+  auto Rewind() -> std::expected<void, Error>;
+
+  // Reads up to `size` bytes; fewer only at the end of the file.
+  auto Read(void *data, size_t size) -> std::expected<size_t, Error>;
+
+  [[nodiscard]] auto bytes_written() const {
+    return bytes_written_;
+  }
+
+  // Spill files written by the whole process so far.
+  static auto total_bytes_written() -> uint64_t;
+
+private:
+  explicit SpillFile(std::FILE *file) : file_(file) {}
+
+  std::FILE *file_;
+  size_t bytes_written_ = 0;
+};
+
+} // namespace JustADb
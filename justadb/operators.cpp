@@ -0,0 +1,686 @@
+#include "operators.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+
+namespace JustADb {
+
+ScanOperator::ScanOperator(const Table *table,
+                           const std::vector<size_t> &partitions,
+                           size_t batch_rows)
+    : table_(table), batch_rows_(batch_rows) {
+  for (const auto index : partitions) {
+    const auto *partition = table->partitions()[index];
+    partitions_.emplace_back(partition, partition->tuples.size());
+  }
+}
+
+auto ScanOperator::Next(TupleBatch &batch) -> std::expected<bool, Error> {
+  if (!runtime_filter_ || !runtime_filter_->bloom) {
+    return Fill(batch);
+  }
+  const auto &column = *runtime_filter_->column;
+  const auto &bloom = *runtime_filter_->bloom;
+  // Rows without a possible match are dropped here, before any operator
+  // above the scan sees them.
+  while (Fill(batch)) {
+    size_t kept = 0;
+    for (const auto *tuple : batch) {
+      const auto *key = column.Read(*tuple);
+      batch[kept] = tuple;
+      kept += key != nullptr && bloom.MayContain(HashValue(*key));
+    }
+    batch.resize(kept);
+    if (!batch.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto ScanOperator::Fill(TupleBatch &batch) -> bool {
+  batch.clear();
+  if (cursor_) {
+    return cursor_->Next(batch_rows_, batch);
+  }
+  while (batch.size() < batch_rows_ && partition_ < partitions_.size()) {
+    const auto &[partition, size] = partitions_[partition_];
+    const auto &tuples = partition->tuples;
+    const auto end =
+        std::min(size, position_ + (batch_rows_ - batch.size()));
+    batch.insert(batch.end(), tuples.begin() + position_,
+                 tuples.begin() + end);
+    position_ = end;
+    if (position_ == size) {
+      ++partition_;
+      position_ = 0;
+    }
+  }
+  return !batch.empty();
+}
+
+auto ScanOperator::detail() const -> std::string {
+  std::string detail = table_->name();
+  if (cursor_) {
+    detail += " (LSM by " + table_->lsm_key_column()->name() + ")";
+  } else if (table_->partitioning()) {
+    detail += " (" + std::to_string(partitions_.size()) + " of " +
+              std::to_string(table_->partitions().size()) + " partitions)";
+  }
+  if (runtime_filter_) {
+    detail += " [runtime filter on " + runtime_filter_->column->name() + "]";
+  }
+  return detail;
+}
+
+auto ViewScanOperator::Next(TupleBatch &batch) -> std::expected<bool, Error> {
+  const auto &rows = view_->rows();
+  const auto end = std::min(rows.size(), position_ + batch_rows_);
+  batch.assign(rows.begin() + position_, rows.begin() + end);
+  position_ = end;
+  return !batch.empty();
+}
+
+auto HashJoinOperator::GrowEntries(size_t rows) -> bool {
+  if (entries_.size() + rows <= entries_.capacity()) {
+    return true;
+  }
+  const auto capacity = std::max(
+      {entries_.size() + rows, 2 * entries_.capacity(), batch_rows_});
+  if (!memory_.TryReserve((capacity - entries_.capacity()) * sizeof(Entry))) {
+    return false;
+  }
+  entries_.reserve(capacity);
+  return true;
+}
+
+auto HashJoinOperator::Index() -> std::expected<void, Error> {
+  const auto buckets = std::bit_ceil(std::max<size_t>(entries_.size(), 1));
+  if (buckets > buckets_.capacity()) {
+    if (auto reserved = memory_.Reserve((buckets - buckets_.capacity()) *
+                                        sizeof(uint32_t));
+        !reserved) {
+      return reserved;
+    }
+    buckets_.reserve(buckets);
+  }
+  buckets_.assign(buckets, kNoEntry);
+  for (uint32_t i = 0; i < entries_.size(); ++i) {
+    auto &bucket = buckets_[entries_[i].hash & (buckets_.size() - 1)];
+    entries_[i].next = bucket;
+    bucket = i;
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto HashJoinOperator::SpillEntries() -> std::expected<void, Error> {
+  if (build_partitions_.empty()) {
+    for (size_t i = 0; i < kSpillPartitions; ++i) {
+      auto file = SpillFile::Create();
+      if (!file) {
+        return std::unexpected(file.error());
+      }
+      build_partitions_.push_back(std::move(*file));
+    }
+  }
+  for (const auto &entry : entries_) {
+    const SpilledRow row{entry.hash, entry.tuple};
+    if (auto written =
+            build_partitions_[PartitionOf(row.hash)].Write(&row, sizeof(row));
+        !written) {
+      return written;
+    }
+    bytes_spilled_ += sizeof(row);
+  }
+  // The partitions are loaded one at a time and need less room.
+  memory_.Release(entries_.capacity() * sizeof(Entry));
+  entries_ = {};
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto HashJoinOperator::Build() -> std::expected<void, Error> {
+  TupleBatch batch;
+  while (true) {
+    auto has_rows = build_->Next(batch);
+    if (!has_rows) {
+      return std::unexpected(has_rows.error());
+    }
+    if (!*has_rows) {
+      break;
+    }
+    if (build_partitions_.empty() && !GrowEntries(batch.size())) {
+      if (auto spilled = SpillEntries(); !spilled) {
+        return spilled;
+      }
+    }
+    for (const auto *tuple : batch) {
+      // NULL keys never join.
+      const auto *key = build_key_->Read(*tuple);
+      if (key == nullptr) {
+        continue;
+      }
+      const auto hash = HashValue(*key);
+      if (build_partitions_.empty()) {
+        entries_.push_back({hash, tuple, kNoEntry});
+        continue;
+      }
+      const SpilledRow row{hash, tuple};
+      if (auto written =
+              build_partitions_[PartitionOf(hash)].Write(&row, sizeof(row));
+          !written) {
+        return written;
+      }
+      bytes_spilled_ += sizeof(row);
+    }
+  }
+
+  if (build_partitions_.empty()) {
+    if (Index()) {
+      // Without memory for the runtime filter the probe side is not
+      // filtered, which costs time but nothing else.
+      BloomFilter bloom(entries_.size());
+      if (memory_.TryReserve(bloom.bytes_allocated())) {
+        for (const auto &entry : entries_) {
+          bloom.Add(entry.hash);
+        }
+        runtime_filter_->bloom.emplace(std::move(bloom));
+      }
+      built_ = true;
+      return std::expected<void, Error>(std::in_place);
+    }
+    if (auto spilled = SpillEntries(); !spilled) {
+      return spilled;
+    }
+  }
+
+  if (auto filled = FilterFromPartitions(); !filled) {
+    return filled;
+  }
+  if (auto partitioned = PartitionProbe(); !partitioned) {
+    return partitioned;
+  }
+  // The probe side is drained, so the filter has done its work.
+  if (runtime_filter_->bloom) {
+    memory_.Release(runtime_filter_->bloom->bytes_allocated());
+    runtime_filter_->bloom.reset();
+  }
+  built_ = true;
+  auto loaded = NextPartition();
+  if (!loaded) {
+    return std::unexpected(loaded.error());
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto HashJoinOperator::FilterFromPartitions() -> std::expected<void, Error> {
+  size_t rows = 0;
+  for (const auto &partition : build_partitions_) {
+    rows += partition.bytes_written() / sizeof(SpilledRow);
+  }
+  BloomFilter bloom(rows);
+  if (!memory_.TryReserve(bloom.bytes_allocated())) {
+    return std::expected<void, Error>(std::in_place);
+  }
+  std::array<SpilledRow, 1024> chunk;
+  for (auto &partition : build_partitions_) {
+    if (auto rewound = partition.Rewind(); !rewound) {
+      return rewound;
+    }
+    while (true) {
+      auto read = partition.Read(chunk.data(), sizeof(chunk));
+      if (!read) {
+        return std::unexpected(read.error());
+      }
+      if (*read == 0) {
+        break;
+      }
+      for (size_t i = 0; i < *read / sizeof(SpilledRow); ++i) {
+        bloom.Add(chunk[i].hash);
+      }
+    }
+  }
+  runtime_filter_->bloom.emplace(std::move(bloom));
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto HashJoinOperator::PartitionProbe() -> std::expected<void, Error> {
+  for (size_t i = 0; i < kSpillPartitions; ++i) {
+    auto file = SpillFile::Create();
+    if (!file) {
+      return std::unexpected(file.error());
+    }
+    probe_partitions_.push_back(std::move(*file));
+  }
+  TupleBatch batch;
+  while (true) {
+    auto has_rows = probe_->Next(batch);
+    if (!has_rows) {
+      return std::unexpected(has_rows.error());
+    }
+    if (!*has_rows) {
+      return std::expected<void, Error>(std::in_place);
+    }
+    for (const auto *tuple : batch) {
+      const auto *key = probe_key_->Read(*tuple);
+      if (key == nullptr) {
+        continue;
+      }
+      const SpilledRow row{HashValue(*key), tuple};
+      if (auto written =
+              probe_partitions_[PartitionOf(row.hash)].Write(&row, sizeof(row));
+          !written) {
+        return written;
+      }
+      bytes_spilled_ += sizeof(row);
+    }
+  }
+}
+
+auto HashJoinOperator::NextPartition() -> std::expected<bool, Error> {
+  if (current_partition_ == kSpillPartitions) {
+    return false;
+  }
+  auto &build = build_partitions_[current_partition_];
+  auto &probe = probe_partitions_[current_partition_];
+  ++current_partition_;
+
+  entries_.clear();
+  const auto rows = build.bytes_written() / sizeof(SpilledRow);
+  if (!GrowEntries(rows)) {
+    // A partition that does not fit on its own is not split further.
+    auto reserved = memory_.Reserve(
+        (entries_.size() + rows - entries_.capacity()) * sizeof(Entry));
+    if (!reserved) {
+      return std::unexpected(reserved.error());
+    }
+    entries_.reserve(rows);
+  }
+  if (auto rewound = build.Rewind(); !rewound) {
+    return std::unexpected(rewound.error());
+  }
+  std::array<SpilledRow, 1024> chunk;
+  while (true) {
+    auto read = build.Read(chunk.data(), sizeof(chunk));
+    if (!read) {
+      return std::unexpected(read.error());
+    }
+    if (*read == 0) {
+      break;
+    }
+    for (size_t i = 0; i < *read / sizeof(SpilledRow); ++i) {
+      entries_.push_back({chunk[i].hash, chunk[i].tuple, kNoEntry});
+    }
+  }
+  if (auto indexed = Index(); !indexed) {
+    return std::unexpected(indexed.error());
+  }
+  if (auto rewound = probe.Rewind(); !rewound) {
+    return std::unexpected(rewound.error());
+  }
+  spilled_probe_.clear();
+  probe_position_ = 0;
+  return true;
+}
+
+auto HashJoinOperator::NextProbe() -> std::expected<const Tuple *, Error> {
+  if (build_partitions_.empty()) {
+    while (true) {
+      if (probe_position_ == probe_batch_.size()) {
+        auto has_rows = probe_->Next(probe_batch_);
+        if (!has_rows) {
+          return std::unexpected(has_rows.error());
+        }
+        probe_position_ = 0;
+        if (!*has_rows) {
+          return nullptr;
+        }
+      }
+      const auto *probe = probe_batch_[probe_position_++];
+      if (probe_key_->Read(*probe) != nullptr) {
+        return probe;
+      }
+    }
+  }
+  if (probe_position_ == spilled_probe_.size()) {
+    spilled_probe_.resize(1024);
+    auto read =
+        probe_partitions_[current_partition_ - 1].Read(
+            spilled_probe_.data(), spilled_probe_.size() * sizeof(SpilledRow));
+    if (!read) {
+      return std::unexpected(read.error());
+    }
+    spilled_probe_.resize(*read / sizeof(SpilledRow));
+    probe_position_ = 0;
+    if (spilled_probe_.empty()) {
+      return nullptr;
+    }
+  }
+  return spilled_probe_[probe_position_++].tuple;
+}
+
+auto HashJoinOperator::Join(const Tuple &probe, const Tuple &build)
+    -> const Tuple * {
+  // Laid out in output order, the slots of the output columns.
+  Tuple::Values values;
+  values.reserve(outputs_.size());
+  for (const auto &output : outputs_) {
+    values.emplace_back(output.column->storage_key(),
+                        output.source->Read(output.from_build ? build : probe));
+  }
+  auto *tuple = new Tuple();
+  tuple->set_values(std::move(values));
+  joined_.emplace_back(tuple);
+  return tuple;
+}
+
+auto HashJoinOperator::Next(TupleBatch &batch) -> std::expected<bool, Error> {
+  if (!built_) {
+    if (auto built = Build(); !built) {
+      return std::unexpected(built.error());
+    }
+  }
+  if (!retain_output_) {
+    joined_.clear();
+  }
+  batch.clear();
+  // A probe row's matches all go into the same batch, which may therefore
+  // run a little over batch_rows_.
+  while (batch.size() < batch_rows_) {
+    auto probe = NextProbe();
+    if (!probe) {
+      return std::unexpected(probe.error());
+    }
+    if (*probe == nullptr) {
+      if (build_partitions_.empty()) {
+        break;
+      }
+      auto loaded = NextPartition();
+      if (!loaded) {
+        return std::unexpected(loaded.error());
+      }
+      if (!*loaded) {
+        break;
+      }
+      continue;
+    }
+    const auto *key = probe_key_->Read(**probe);
+    const auto hash = HashValue(*key);
+    for (auto i = buckets_[hash & (buckets_.size() - 1)]; i != kNoEntry;
+         i = entries_[i].next) {
+      const auto &entry = entries_[i];
+      if (entry.hash == hash &&
+          build_key_->Read(*entry.tuple)->value() == key->value()) {
+        batch.push_back(Join(**probe, *entry.tuple));
+      }
+    }
+  }
+
+  // Like any batch in flight, one that is freed on the next call is not
+  // counted; retained rows pile up and are.
+  if (retain_output_) {
+    const auto bytes =
+        batch.size() * (sizeof(Tuple) + sizeof(std::unique_ptr<Tuple>) +
+                        outputs_.size() * sizeof(Tuple::Values::value_type));
+    if (auto reserved = memory_.Reserve(bytes); !reserved) {
+      return std::unexpected(reserved.error());
+    }
+  }
+  return !batch.empty();
+}
+
+auto HashJoinOperator::detail() const -> std::string {
+  return probe_key_->name() + " = " + build_key_->name();
+}
+
+auto FilterOperator::Next(TupleBatch &batch) -> std::expected<bool, Error> {
+  // Keep pulling until some row survives, so that consumers never see an
+  // empty batch before the end.
+  while (true) {
+    auto has_rows = child_->Next(batch);
+    if (!has_rows || !*has_rows) {
+      return has_rows;
+    }
+    filter_.Apply(batch);
+    if (!batch.empty()) {
+      return true;
+    }
+  }
+}
+
+auto FilterOperator::detail() const -> std::string {
+  std::string detail;
+  for (const auto &predicate : filter_.predicates()) {
+    if (!detail.empty()) {
+      detail += " AND ";
+    }
+    detail += predicate.ToString();
+  }
+  return detail;
+}
+
+auto SortOperator::Precedes(const Value *lhs, const Value *rhs) const
+    -> bool {
+  if (order_by_.order() == OrderByClause::Order::DESCENDING) {
+    std::swap(lhs, rhs);
+  }
+  if (lhs == nullptr || rhs == nullptr) {
+    return lhs == nullptr && rhs != nullptr;
+  }
+  return CompareValues(*lhs, *rhs) < 0;
+}
+
+auto SortOperator::Drain() -> std::expected<void, Error> {
+  TupleBatch input;
+  // The bytes reserved for rows_, whose capacity is managed by hand so that
+  // it matches.
+  size_t rows_bytes = 0;
+  while (true) {
+    auto has_rows = child_->Next(input);
+    if (!has_rows) {
+      return std::unexpected(has_rows.error());
+    }
+    if (!*has_rows) {
+      break;
+    }
+    if (rows_.size() + input.size() > rows_.capacity()) {
+      const auto capacity = std::max(
+          {rows_.size() + input.size(), 2 * rows_.capacity(), batch_rows_});
+      const auto bytes = capacity * sizeof(KeyedRow);
+      if (memory_.TryReserve(bytes - rows_bytes)) {
+        rows_.reserve(capacity);
+        rows_bytes = bytes;
+      } else if (!rows_.empty()) {
+        if (auto spilled = Spill(); !spilled) {
+          return spilled;
+        }
+      }
+      if (input.size() > rows_.capacity()) {
+        // Not even one batch fits.
+        const auto needed = input.size() * sizeof(KeyedRow);
+        if (auto reserved = memory_.Reserve(needed - rows_bytes); !reserved) {
+          return reserved;
+        }
+        rows_.reserve(input.size());
+        rows_bytes = needed;
+      }
+    }
+    for (const auto *tuple : input) {
+      rows_.emplace_back(column_->Read(*tuple), tuple);
+    }
+  }
+
+  if (runs_.empty()) {
+    std::stable_sort(rows_.begin(), rows_.end(),
+                     [this](const KeyedRow &lhs, const KeyedRow &rhs) {
+                       return Precedes(lhs.first, rhs.first);
+                     });
+    return std::expected<void, Error>(std::in_place);
+  }
+
+  // Trade the row buffer for one read buffer per run.
+  if (!rows_.empty()) {
+    if (auto spilled = Spill(); !spilled) {
+      return spilled;
+    }
+  }
+  rows_ = {};
+  memory_.Release(rows_bytes);
+  if (auto reserved =
+          memory_.Reserve(runs_.size() * kMergeRows * sizeof(const Tuple *));
+      !reserved) {
+    return reserved;
+  }
+  for (auto &run : runs_) {
+    if (auto rewound = run.file.Rewind(); !rewound) {
+      return rewound;
+    }
+    auto advanced = Advance(run);
+    if (!advanced) {
+      return std::unexpected(advanced.error());
+    }
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto SortOperator::Spill() -> std::expected<void, Error> {
+  std::stable_sort(rows_.begin(), rows_.end(),
+                   [this](const KeyedRow &lhs, const KeyedRow &rhs) {
+                     return Precedes(lhs.first, rhs.first);
+                   });
+  auto file = SpillFile::Create();
+  if (!file) {
+    return std::unexpected(file.error());
+  }
+  // The keys are read again from the rows when the runs are merged.
+  std::array<const Tuple *, kMergeRows> chunk;
+  for (size_t start = 0; start < rows_.size(); start += kMergeRows) {
+    const auto count = std::min(kMergeRows, rows_.size() - start);
+    for (size_t i = 0; i < count; ++i) {
+      chunk[i] = rows_[start + i].second;
+    }
+    if (auto written = file->Write(chunk.data(), count * sizeof(chunk[0]));
+        !written) {
+      return written;
+    }
+  }
+  bytes_spilled_ += file->bytes_written();
+  runs_.push_back(Run{.file = std::move(*file),
+                      .buffer = {},
+                      .position = 0,
+                      .key = nullptr,
+                      .exhausted = false});
+  rows_.clear();
+  return std::expected<void, Error>(std::in_place);
+}
+
+auto SortOperator::Advance(Run &run) -> std::expected<bool, Error> {
+  if (run.position == run.buffer.size()) {
+    run.buffer.resize(kMergeRows);
+    auto read =
+        run.file.Read(run.buffer.data(), kMergeRows * sizeof(const Tuple *));
+    if (!read) {
+      return std::unexpected(read.error());
+    }
+    run.buffer.resize(*read / sizeof(const Tuple *));
+    run.position = 0;
+    if (run.buffer.empty()) {
+      run.exhausted = true;
+      return false;
+    }
+  }
+  run.key = column_->Read(*run.buffer[run.position]);
+  return true;
+}
+
+auto SortOperator::Merge(TupleBatch &batch) -> std::expected<bool, Error> {
+  batch.clear();
+  while (batch.size() < batch_rows_) {
+    // Ties go to the earlier run, which keeps the sort stable.
+    Run *next = nullptr;
+    for (auto &run : runs_) {
+      if (!run.exhausted &&
+          (next == nullptr || Precedes(run.key, next->key))) {
+        next = &run;
+      }
+    }
+    if (next == nullptr) {
+      break;
+    }
+    batch.push_back(next->buffer[next->position++]);
+    if (auto advanced = Advance(*next); !advanced) {
+      return std::unexpected(advanced.error());
+    }
+  }
+  return !batch.empty();
+}
+
+auto SortOperator::Next(TupleBatch &batch) -> std::expected<bool, Error> {
+  if (!sorted_) {
+    if (auto drained = Drain(); !drained) {
+      return std::unexpected(drained.error());
+    }
+    sorted_ = true;
+  }
+  if (!runs_.empty()) {
+    return Merge(batch);
+  }
+
+  batch.clear();
+  const auto end = std::min(rows_.size(), position_ + batch_rows_);
+  for (; position_ < end; ++position_) {
+    batch.push_back(rows_[position_].second);
+  }
+  return !batch.empty();
+}
+
+auto LimitOperator::Next(TupleBatch &batch) -> std::expected<bool, Error> {
+  if (remaining_ == 0) {
+    batch.clear();
+    return false;
+  }
+  auto has_rows = child_->Next(batch);
+  if (!has_rows || !*has_rows) {
+    return has_rows;
+  }
+  if (batch.size() > remaining_) {
+    batch.resize(remaining_);
+  }
+  remaining_ -= batch.size();
+  return true;
+}
+
+auto SortOperator::detail() const -> std::string {
+  return order_by_.column() +
+         (order_by_.order() == OrderByClause::Order::DESCENDING ? " DESC"
+                                                                : " ASC");
+}
+
+auto ProfiledOperator::Next(TupleBatch &batch) -> std::expected<bool, Error> {
+  const auto counters_before =
+      perf_counters_ ? perf_counters_->Read() : HardwareCounters{};
+  const auto start = std::chrono::steady_clock::now();
+
+  auto has_rows = op_->Next(batch);
+
+  profile_->wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+  if (perf_counters_) {
+    if (!profile_->counters) {
+      profile_->counters = HardwareCounters{};
+    }
+    *profile_->counters += perf_counters_->Read() - counters_before;
+  }
+  if (has_rows && *has_rows) {
+    profile_->rows_out += batch.size();
+    ++profile_->batches;
+  }
+  profile_->bytes_allocated =
+      std::max<uint64_t>(profile_->bytes_allocated, op_->bytes_allocated());
+  profile_->bytes_spilled = op_->bytes_spilled();
+  return has_rows;
+}
+
+} // namespace JustADb
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "bloom.h"
+#include "cursor.h"
+#include "ddl.h"
+#include "dml.h"
+#include "kernels.h"
+#include "lsm.h"
+#include "memory.h"
+#include "predicate.h"
+#include "profile.h"
+#include "utils.h"
+#include "view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace JustADb {
+
+// A pull-based query operator. Each call to Next() produces at most one batch
+// of rows, so a consumer that stops pulling stops all work below it.
+class Operator {
+public:
+  virtual ~Operator() = default;
+
+  // Replaces the contents of `batch` with the next rows. Returns false once
+  // the operator is exhausted; `batch` is empty then.
+  virtual auto Next(TupleBatch &batch) -> std::expected<bool, Error> = 0;
+
+  [[nodiscard]] virtual auto name() const -> std::string = 0;
+
+  // Operator arguments for EXPLAIN output.
+  [[nodiscard]] virtual auto detail() const -> std::string {
+    return "";
+  }
+
+  // Memory the operator currently holds beyond the batch it hands out.
+  [[nodiscard]] virtual auto bytes_allocated() const -> size_t {
+    return 0;
+  }
+
+  // Bytes written to spill files because the operator's memory ran out.
+  [[nodiscard]] virtual auto bytes_spilled() const -> size_t {
+    return 0;
+  }
+};
+
+// A Bloom filter over the keys of a hash join's build side, applied by the
+// probe side's scan so that rows without a match go no further. The join
+// fills it in before it first pulls the probe side.
+struct RuntimeFilter {
+  explicit RuntimeFilter(const Column *column) : column(column) {}
+
+  // The probe side's join key.
+  const Column *column;
+  std::optional<BloomFilter> bloom;
+};
+
+// Reads the given partitions of a table, in order.
+class ScanOperator : public Operator {
+public:
+  ScanOperator(const Table *table, const std::vector<size_t> &partitions,
+               size_t batch_rows);
+
+  // Streams an LSM table's rows from `cursor`, in key order.
+  ScanOperator(const Table *table, LsmTree::Cursor cursor, size_t batch_rows)
+      : table_(table), batch_rows_(batch_rows), cursor_(std::move(cursor)) {}
+
+  auto Next(TupleBatch &batch) -> std::expected<bool, Error> override;
+
+  [[nodiscard]] auto name() const -> std::string override {
+    return "Scan";
+  }
+
+  [[nodiscard]] auto detail() const -> std::string override;
+
+  void set_runtime_filter(std::shared_ptr<const RuntimeFilter> filter) {
+    runtime_filter_ = std::move(filter);
+  }
+
+private:
+  // Next() without the runtime filter.
+  auto Fill(TupleBatch &batch) -> bool;
+
+  const Table *table_;
+  size_t batch_rows_;
+  // Each partition with its row count when the scan started: rows appended
+  // later are not visible to the scan.
+  std::vector<std::pair<const Partition *, size_t>> partitions_;
+  size_t partition_ = 0;
+  size_t position_ = 0;
+  std::optional<LsmTree::Cursor> cursor_;
+  std::shared_ptr<const RuntimeFilter> runtime_filter_;
+};
+
+// Reads the rows of a materialized view, in the view's order.
+class ViewScanOperator : public Operator {
+public:
+  ViewScanOperator(const MaterializedView *view, size_t batch_rows)
+      : view_(view), batch_rows_(batch_rows) {}
+
+  auto Next(TupleBatch &batch) -> std::expected<bool, Error> override;
+
+  [[nodiscard]] auto name() const -> std::string override {
+    return "ViewScan";
+  }
+
+  [[nodiscard]] auto detail() const -> std::string override {
+    return view_->name();
+  }
+
+private:
+  const MaterializedView *view_;
+  size_t batch_rows_;
+  size_t position_ = 0;
+};
+
+class FilterOperator : public Operator {
+public:
+  FilterOperator(std::unique_ptr<Operator> child,
+                 std::vector<Predicate> predicates)
+      : child_(std::move(child)), filter_(std::move(predicates)) {}
+
+  auto Next(TupleBatch &batch) -> std::expected<bool, Error> override;
+
+  [[nodiscard]] auto name() const -> std::string override {
+    return "Filter";
+  }
+
+  [[nodiscard]] auto detail() const -> std::string override;
+
+private:
+  std::unique_ptr<Operator> child_;
+  CompiledFilter filter_;
+};
+
+// Sorts its input, which it drains on the first Next(). The rows are
+// buffered under the query's memory tracker; when it refuses more, the
+// buffered rows are sorted and written out as a run, and the runs are merged
+// once the input is exhausted.
+class SortOperator : public Operator {
+public:
+  SortOperator(std::unique_ptr<Operator> child, OrderByClause order_by,
+               const Column *column, size_t batch_rows,
+               MemoryTracker *query_memory)
+      : child_(std::move(child)), order_by_(std::move(order_by)),
+        column_(column), batch_rows_(batch_rows),
+        memory_("Sort", query_memory) {}
+
+  auto Next(TupleBatch &batch) -> std::expected<bool, Error> override;
+
+  [[nodiscard]] auto name() const -> std::string override {
+    return "Sort";
+  }
+
+  [[nodiscard]] auto detail() const -> std::string override;
+
+  [[nodiscard]] auto bytes_allocated() const -> size_t override {
+    return memory_.peak();
+  }
+
+  [[nodiscard]] auto bytes_spilled() const -> size_t override {
+    return bytes_spilled_;
+  }
+
+private:
+  // Rows of a spilled run read back at a time.
+  static constexpr size_t kMergeRows = 1024;
+
+  // A row with its sort key, looked up once instead of once per comparison.
+  using KeyedRow = std::pair<const Value *, const Tuple *>;
+
+  struct Run {
+    SpillFile file;
+    std::vector<const Tuple *> buffer;
+    size_t position = 0;
+    const Value *key = nullptr;
+    bool exhausted = false;
+  };
+
+  auto Drain() -> std::expected<void, Error>;
+
+  // Stably sorts rows_ and writes them out as a run.
+  auto Spill() -> std::expected<void, Error>;
+
+  // Refills the run's buffer if needed; false once it is exhausted.
+  auto Advance(Run &run) -> std::expected<bool, Error>;
+
+  auto Merge(TupleBatch &batch) -> std::expected<bool, Error>;
+
+  // NULLs sort first in ascending order.
+  [[nodiscard]] auto Precedes(const Value *lhs, const Value *rhs) const
+      -> bool;
+
+  std::unique_ptr<Operator> child_;
+  OrderByClause order_by_;
+  const Column *column_;
+  size_t batch_rows_;
+  MemoryTracker memory_;
+  bool sorted_ = false;
+  std::vector<KeyedRow> rows_;
+  size_t position_ = 0;
+  std::vector<Run> runs_;
+  size_t bytes_spilled_ = 0;
+};
+
+// An inner equi-join. The first Next() drains the build side into a hash
+// table on its key and publishes the keys to the probe side's scan as a
+// runtime filter; probe batches then stream through. Each output row is a new
+// tuple holding just the output columns, which the operator owns.
+//
+// When the query's memory tracker refuses to hold the build side, the join
+// falls back to partitioning both sides by key hash into spill files and
+// joining one partition at a time.
+class HashJoinOperator : public Operator {
+public:
+  // One column of the joined rows: `column` reads what `source` holds on
+  // the build side or the probe side.
+  struct Output {
+    const Column *source;
+    bool from_build;
+    std::unique_ptr<Column> column;
+  };
+
+  // Unless `retain_output` is set, each batch of joined rows is freed when
+  // the next one is produced; the operators above must not keep them.
+  HashJoinOperator(std::unique_ptr<Operator> probe, const Column *probe_key,
+                   std::unique_ptr<Operator> build, const Column *build_key,
+                   std::shared_ptr<RuntimeFilter> runtime_filter,
+                   std::vector<Output> outputs, size_t batch_rows,
+                   bool retain_output, MemoryTracker *query_memory)
+      : probe_(std::move(probe)), probe_key_(probe_key),
+        build_(std::move(build)), build_key_(build_key),
+        runtime_filter_(std::move(runtime_filter)),
+        outputs_(std::move(outputs)), batch_rows_(batch_rows),
+        retain_output_(retain_output), memory_("HashJoin", query_memory) {}
+
+  auto Next(TupleBatch &batch) -> std::expected<bool, Error> override;
+
+  [[nodiscard]] auto name() const -> std::string override {
+    return "HashJoin";
+  }
+
+  [[nodiscard]] auto detail() const -> std::string override;
+
+  [[nodiscard]] auto bytes_allocated() const -> size_t override {
+    return memory_.peak();
+  }
+
+  [[nodiscard]] auto bytes_spilled() const -> size_t override {
+    return bytes_spilled_;
+  }
+
+private:
+  // Partitions of a join that spills, by the top bits of the key hash.
+  static constexpr size_t kSpillPartitionBits = 4;
+  static constexpr size_t kSpillPartitions = size_t{1} << kSpillPartitionBits;
+  static constexpr uint32_t kNoEntry = UINT32_MAX;
+
+  // The build rows, chained by the hash of their key into buckets_ (a power
+  // of two of them); equal hashes are told apart by comparing the keys.
+  struct Entry {
+    uint64_t hash;
+    const Tuple *tuple;
+    uint32_t next;
+  };
+
+  // A row in a spill file.
+  struct SpilledRow {
+    uint64_t hash;
+    const Tuple *tuple;
+  };
+
+  auto Build() -> std::expected<void, Error>;
+
+  // Makes room in entries_ for `rows` more rows, if the tracker allows.
+  auto GrowEntries(size_t rows) -> bool;
+
+  // Chains entries_ into buckets_.
+  auto Index() -> std::expected<void, Error>;
+
+  // Moves entries_ into the build partitions, creating them on first use.
+  auto SpillEntries() -> std::expected<void, Error>;
+
+  static auto PartitionOf(uint64_t hash) -> size_t {
+    return hash >> (64 - kSpillPartitionBits);
+  }
+
+  // Fills the runtime filter from the build partitions.
+  auto FilterFromPartitions() -> std::expected<void, Error>;
+
+  // Drains the probe side into its partitions.
+  auto PartitionProbe() -> std::expected<void, Error>;
+
+  // Loads the next build partition into the hash table; false once all of
+  // them are done.
+  auto NextPartition() -> std::expected<bool, Error>;
+
+  // The next probe row with a key, or nullptr once the probe side (or, when
+  // spilled, the current partition) is exhausted.
+  auto NextProbe() -> std::expected<const Tuple *, Error>;
+
+  // A new tuple with the output columns of a matching pair.
+  auto Join(const Tuple &probe, const Tuple &build) -> const Tuple *;
+
+  std::unique_ptr<Operator> probe_;
+  const Column *probe_key_;
+  std::unique_ptr<Operator> build_;
+  const Column *build_key_;
+  std::shared_ptr<RuntimeFilter> runtime_filter_;
+  std::vector<Output> outputs_;
+  size_t batch_rows_;
+  bool retain_output_;
+  MemoryTracker memory_;
+  bool built_ = false;
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> buckets_;
+  TupleBatch probe_batch_;
+  size_t probe_position_ = 0;
+  // Set once the join spills: each side split into kSpillPartitions files,
+  // joined pairwise starting with current_partition_.
+  std::vector<SpillFile> build_partitions_;
+  std::vector<SpillFile> probe_partitions_;
+  size_t current_partition_ = 0;
+  std::vector<SpilledRow> spilled_probe_;
+  size_t bytes_spilled_ = 0;
+  std::vector<std::unique_ptr<Tuple>> joined_;
+};
+
+class LimitOperator : public Operator {
+public:
+  LimitOperator(std::unique_ptr<Operator> child, size_t limit)
+      : child_(std::move(child)), limit_(limit), remaining_(limit) {}
+
+  auto Next(TupleBatch &batch) -> std::expected<bool, Error> override;
+
+  [[nodiscard]] auto name() const -> std::string override {
+    return "Limit";
+  }
+
+  [[nodiscard]] auto detail() const -> std::string override {
+    return std::to_string(limit_);
+  }
+
+private:
+  std::unique_ptr<Operator> child_;
+  size_t limit_;
+  size_t remaining_;
+};
+
+// Records rows, batches, time, memory and hardware counters of the operator
+// it wraps into `profile`. Plans only contain these when a query is profiled,
+// so normal execution pays nothing for profiling.
+class ProfiledOperator : public Operator {
+public:
+  ProfiledOperator(std::unique_ptr<Operator> op, OperatorProfile *profile,
+                   const PerfCounters *perf_counters)
+      : op_(std::move(op)), profile_(profile), perf_counters_(perf_counters) {}
+
+  auto Next(TupleBatch &batch) -> std::expected<bool, Error> override;
+
+  [[nodiscard]] auto name() const -> std::string override {
+    return op_->name();
+  }
+
+  [[nodiscard]] auto detail() const -> std::string override {
+    return op_->detail();
+  }
+
+  [[nodiscard]] auto bytes_allocated() const -> size_t override {
+    return op_->bytes_allocated();
+  }
+
+  [[nodiscard]] auto bytes_spilled() const -> size_t override {
+    return op_->bytes_spilled();
+  }
+
+private:
+  std::unique_ptr<Operator> op_;
+  OperatorProfile *profile_;
+  const PerfCounters *perf_counters_;
+};
+
+} // namespace JustADb
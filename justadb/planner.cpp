@@ -0,0 +1,306 @@
+#include "planner.h"
+
+#include "statistics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+namespace JustADb {
+
+namespace {
+
+// Used for columns without statistics.
+constexpr double kDefaultEqualSelectivity = 0.005;
+constexpr double kDefaultRangeSelectivity = 1.0 / 3;
+constexpr double kDefaultNullSelectivity = 0.005;
+constexpr double kDefaultLikeSelectivity = 0.05;
+
+auto DefaultSelectivity(const Predicate &predicate) -> double {
+  const bool exact = predicate.like() &&
+                     predicate.like()->kind() == LikePattern::Kind::EXACT;
+  switch (predicate.op()) {
+  case WhereClause::Operator::LIKE:
+    return exact ? kDefaultEqualSelectivity : kDefaultLikeSelectivity;
+  case WhereClause::Operator::NOT_LIKE:
+    return 1 - (exact ? kDefaultEqualSelectivity : kDefaultLikeSelectivity);
+  case WhereClause::Operator::EQUAL:
+    return kDefaultEqualSelectivity;
+  case WhereClause::Operator::NOT_EQUAL:
+    return 1 - kDefaultEqualSelectivity;
+  case WhereClause::Operator::IN:
+    return std::min(1.0,
+                    kDefaultEqualSelectivity * predicate.operands().size());
+  case WhereClause::Operator::NOT_IN:
+    return std::max(0.0, 1 - kDefaultEqualSelectivity *
+                                 predicate.operands().size());
+  case WhereClause::Operator::IS_NULL:
+    return kDefaultNullSelectivity;
+  case WhereClause::Operator::IS_NOT_NULL:
+    return 1 - kDefaultNullSelectivity;
+  default:
+    return kDefaultRangeSelectivity;
+  }
+}
+
+// Marks the partitions that may hold keys matching `predicate`.
+void MatchPartitions(const Predicate &predicate, const PartitionSpec &spec,
+                     std::vector<bool> &matches) {
+  const auto &operands = predicate.operands();
+  // The key range [low, high] a range comparison allows.
+  auto low = static_cast<int64_t>(std::numeric_limits<int>::min());
+  auto high = static_cast<int64_t>(std::numeric_limits<int>::max());
+  switch (predicate.op()) {
+  case WhereClause::Operator::EQUAL:
+  case WhereClause::Operator::IN:
+    for (const auto &operand : operands) {
+      matches[spec.PartitionOf(operand)] = true;
+    }
+    return;
+  case WhereClause::Operator::IS_NULL:
+    // Partition keys are never NULL.
+    return;
+  default:
+    break;
+  }
+  // Hash partitions scatter any range, and only INT keys are range
+  // partitioned.
+  if (spec.kind() == PartitionSpec::Kind::HASH || operands.empty() ||
+      !std::holds_alternative<int>(operands.front().value())) {
+    std::fill(matches.begin(), matches.end(), true);
+    return;
+  }
+  switch (predicate.op()) {
+  case WhereClause::Operator::LESS_THAN:
+    high = std::get<int>(operands.front().value()) - int64_t{1};
+    break;
+  case WhereClause::Operator::LESS_THAN_OR_EQUAL:
+    high = std::get<int>(operands.front().value());
+    break;
+  case WhereClause::Operator::GREATER_THAN:
+    low = std::get<int>(operands.front().value()) + int64_t{1};
+    break;
+  case WhereClause::Operator::GREATER_THAN_OR_EQUAL:
+    low = std::get<int>(operands.front().value());
+    break;
+  default:
+    std::fill(matches.begin(), matches.end(), true);
+    return;
+  }
+  // Partition i holds [bounds[i - 1], bounds[i] - 1].
+  const auto &bounds = spec.bounds();
+  for (size_t i = 0; i < matches.size(); ++i) {
+    const auto partition_low =
+        i == 0 ? std::numeric_limits<int64_t>::min() : int64_t{bounds[i - 1]};
+    const auto partition_high = i == bounds.size()
+                                    ? std::numeric_limits<int64_t>::max()
+                                    : bounds[i] - int64_t{1};
+    matches[i] = partition_low <= high && low <= partition_high;
+  }
+}
+
+} // namespace
+
+auto Planner::Selectivity(const Predicate &predicate) const -> double {
+  const auto *statistics = table_.statistics();
+  if (statistics == nullptr) {
+    return DefaultSelectivity(predicate);
+  }
+  const auto column_statistics = statistics->GetColumn(predicate.column());
+  if (!column_statistics || (*column_statistics)->row_count() == 0) {
+    return DefaultSelectivity(predicate);
+  }
+
+  const auto &stats = **column_statistics;
+  const double not_null = 1 - stats.null_fraction();
+  const auto &histogram = stats.histogram();
+  const auto &operands = predicate.operands();
+  double equal = 0;
+  for (const auto &operand : operands) {
+    equal += stats.EqualFraction(operand);
+  }
+
+  // Only patterns that pin down a range of strings can use the statistics.
+  std::optional<double> like;
+  if (predicate.like()) {
+    if (const auto range = predicate.like()->PrefixRange(); range) {
+      const double below_upper =
+          range->second
+              ? histogram.FractionBelow(Value(*range->second), false)
+              : 1.0;
+      like = not_null * std::max(0.0, below_upper - histogram.FractionBelow(
+                                                        Value(range->first),
+                                                        false));
+    }
+  }
+
+  double selectivity = 0;
+  switch (predicate.op()) {
+  case WhereClause::Operator::LIKE:
+    if (!like) {
+      return DefaultSelectivity(predicate);
+    }
+    selectivity = *like;
+    break;
+  case WhereClause::Operator::NOT_LIKE:
+    if (!like) {
+      return DefaultSelectivity(predicate);
+    }
+    selectivity = not_null - *like;
+    break;
+  case WhereClause::Operator::IS_NULL:
+    selectivity = stats.null_fraction();
+    break;
+  case WhereClause::Operator::IS_NOT_NULL:
+    selectivity = not_null;
+    break;
+  case WhereClause::Operator::EQUAL:
+  case WhereClause::Operator::IN:
+    selectivity = equal;
+    break;
+  case WhereClause::Operator::NOT_EQUAL:
+  case WhereClause::Operator::NOT_IN:
+    selectivity = not_null - equal;
+    break;
+  case WhereClause::Operator::LESS_THAN:
+    selectivity = not_null * histogram.FractionBelow(operands.front(), false);
+    break;
+  case WhereClause::Operator::LESS_THAN_OR_EQUAL:
+    selectivity = not_null * histogram.FractionBelow(operands.front(), true);
+    break;
+  case WhereClause::Operator::GREATER_THAN:
+    selectivity =
+        not_null * (1 - histogram.FractionBelow(operands.front(), true));
+    break;
+  case WhereClause::Operator::GREATER_THAN_OR_EQUAL:
+    selectivity =
+        not_null * (1 - histogram.FractionBelow(operands.front(), false));
+    break;
+  default:
+    return DefaultSelectivity(predicate);
+  }
+  return std::clamp(selectivity, 0.0, 1.0);
+}
+
+auto Planner::EvaluationCost(const Predicate &predicate) const -> double {
+  if (predicate.op() == WhereClause::Operator::IS_NULL ||
+      predicate.op() == WhereClause::Operator::IS_NOT_NULL) {
+    return 1;
+  }
+  // IN lists are searched linearly, and strings cost more to compare than
+  // fixed-size values. General LIKE patterns may backtrack.
+  double cost = 1 + static_cast<double>(predicate.operands().size());
+  if (predicate.like() &&
+      predicate.like()->kind() == LikePattern::Kind::GENERAL) {
+    cost *= 2;
+  }
+  if (predicate.column()->type() == Column::Type::STRING) {
+    cost *= 2;
+  }
+  return cost;
+}
+
+void Planner::OrderPredicates(std::vector<Predicate> &predicates) const {
+  std::vector<std::pair<double, Predicate>> ranked;
+  ranked.reserve(predicates.size());
+  for (auto &predicate : predicates) {
+    const auto rejected = 1 - Selectivity(predicate);
+    const auto rank = rejected > 0 ? EvaluationCost(predicate) / rejected
+                                   : std::numeric_limits<double>::infinity();
+    ranked.emplace_back(rank, std::move(predicate));
+  }
+  std::stable_sort(ranked.begin(), ranked.end(),
+                   [](const auto &lhs, const auto &rhs) {
+                     return lhs.first < rhs.first;
+                   });
+  predicates.clear();
+  for (auto &[rank, predicate] : ranked) {
+    predicates.push_back(std::move(predicate));
+  }
+}
+
+auto Planner::EstimateRows(const std::vector<Predicate> &predicates) const
+    -> double {
+  double rows = static_cast<double>(table_.row_count());
+  for (const auto &predicate : predicates) {
+    rows *= Selectivity(predicate);
+  }
+  return rows;
+}
+
+auto Planner::PrunePartitions(const std::vector<Predicate> &predicates) const
+    -> std::vector<size_t> {
+  const auto partition_count = table_.partitions().size();
+  std::vector<bool> keep(partition_count, true);
+  if (const auto &spec = table_.partitioning(); spec) {
+    for (const auto &predicate : predicates) {
+      if (predicate.column() != table_.partition_column()) {
+        continue;
+      }
+      std::vector<bool> matches(partition_count, false);
+      MatchPartitions(predicate, *spec, matches);
+      for (size_t i = 0; i < partition_count; ++i) {
+        keep[i] = keep[i] && matches[i];
+      }
+    }
+  }
+  std::vector<size_t> partitions;
+  for (size_t i = 0; i < partition_count; ++i) {
+    if (keep[i]) {
+      partitions.push_back(i);
+    }
+  }
+  return partitions;
+}
+
+auto Planner::KeyRange(const std::vector<Predicate> &predicates) const
+    -> std::pair<std::optional<LsmBound>, std::optional<LsmBound>> {
+  std::optional<LsmBound> low;
+  std::optional<LsmBound> high;
+  // A strictly tighter key replaces the bound; on equal keys, an exclusive
+  // bound is the tighter one.
+  auto tighten_low = [&low](const Value &key, bool inclusive) {
+    if (!low || low->key.value() < key.value()) {
+      low = LsmBound{key, inclusive};
+    } else if (!(key.value() < low->key.value())) {
+      low->inclusive = low->inclusive && inclusive;
+    }
+  };
+  auto tighten_high = [&high](const Value &key, bool inclusive) {
+    if (!high || key.value() < high->key.value()) {
+      high = LsmBound{key, inclusive};
+    } else if (!(high->key.value() < key.value())) {
+      high->inclusive = high->inclusive && inclusive;
+    }
+  };
+  for (const auto &predicate : predicates) {
+    if (predicate.column() != table_.lsm_key_column()) {
+      continue;
+    }
+    const auto &operands = predicate.operands();
+    switch (predicate.op()) {
+    case WhereClause::Operator::EQUAL:
+      tighten_low(operands.front(), true);
+      tighten_high(operands.front(), true);
+      break;
+    case WhereClause::Operator::LESS_THAN:
+      tighten_high(operands.front(), false);
+      break;
+    case WhereClause::Operator::LESS_THAN_OR_EQUAL:
+      tighten_high(operands.front(), true);
+      break;
+    case WhereClause::Operator::GREATER_THAN:
+      tighten_low(operands.front(), false);
+      break;
+    case WhereClause::Operator::GREATER_THAN_OR_EQUAL:
+      tighten_low(operands.front(), true);
+      break;
+    default:
+      break;
+    }
+  }
+  return {std::move(low), std::move(high)};
+}
+
+} // namespace JustADb
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ddl.h"
+#include "lsm.h"
+#include "predicate.h"
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace JustADb {
+
+// Cost estimates for one table, from its ANALYZE statistics when it has been
+// analyzed and from fixed guesses otherwise.
+class Planner {
+public:
+  explicit Planner(const Table &table) : table_(table) {}
+
+  // The fraction of the table's rows that `predicate` keeps.
+  [[nodiscard]] auto Selectivity(const Predicate &predicate) const -> double;
+
+  // The relative cost of evaluating `predicate` on one row.
+  [[nodiscard]] auto EvaluationCost(const Predicate &predicate) const
+      -> double;
+
+  // Orders the conjuncts of a filter so that the ones that reject the most
+  // rows per unit of cost run first: ascending cost / (1 - selectivity).
+  void OrderPredicates(std::vector<Predicate> &predicates) const;
+
+  // Rows left after all of `predicates`, assuming they are independent.
+  [[nodiscard]] auto
+  EstimateRows(const std::vector<Predicate> &predicates) const -> double;
+
+  // The partitions that may hold rows matching all of `predicates`, in
+  // order. Only predicates on the partition key prune: equality and IN for
+  // either kind of partitioning, and ranges for range partitioning.
+  [[nodiscard]] auto
+  PrunePartitions(const std::vector<Predicate> &predicates) const
+      -> std::vector<size_t>;
+
+  // The narrowest key range of an LSM table that holds every row matching
+  // all of `predicates`, from equality and range comparisons on the key. A
+  // missing bound leaves that end open.
+  [[nodiscard]] auto KeyRange(const std::vector<Predicate> &predicates) const
+      -> std::pair<std::optional<LsmBound>, std::optional<LsmBound>>;
+
+private:
+  const Table &table_;
+};
+
+} // namespace JustADb
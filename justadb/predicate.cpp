@@ -0,0 +1,231 @@
+#include "predicate.h"
+
+#include <charconv>
+#include <sstream>
+
+namespace JustADb {
+
+auto CompareValues(const Value &lhs, const Value &rhs) -> std::weak_ordering {
+  const auto &l = lhs.value();
+  const auto &r = rhs.value();
+  if (l.index() != r.index()) {
+    return l.index() <=> r.index();
+  }
+  return std::visit(
+      [&r](const auto &lv) -> std::weak_ordering {
+        using T = std::decay_t<decltype(lv)>;
+        const auto &rv = std::get<T>(r);
+        if (lv < rv) {
+          return std::weak_ordering::less;
+        }
+        if (rv < lv) {
+          return std::weak_ordering::greater;
+        }
+        return std::weak_ordering::equivalent;
+      },
+      l);
+}
+
+auto ValueToString(const Value &value) -> std::string {
+  return std::visit(
+      [](const auto &v) -> std::string {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, std::string>) {
+          return "'" + v + "'";
+        } else if constexpr (std::is_same_v<T, bool>) {
+          return v ? "true" : "false";
+        } else {
+          return std::to_string(v);
+        }
+      },
+      value.value());
+}
+
+auto OperatorToString(WhereClause::Operator op) -> std::string {
+  switch (op) {
+  case WhereClause::Operator::EQUAL:
+    return "=";
+  case WhereClause::Operator::NOT_EQUAL:
+    return "!=";
+  case WhereClause::Operator::GREATER_THAN:
+    return ">";
+  case WhereClause::Operator::GREATER_THAN_OR_EQUAL:
+    return ">=";
+  case WhereClause::Operator::LESS_THAN:
+    return "<";
+  case WhereClause::Operator::LESS_THAN_OR_EQUAL:
+    return "<=";
+  case WhereClause::Operator::LIKE:
+    return "LIKE";
+  case WhereClause::Operator::NOT_LIKE:
+    return "NOT LIKE";
+  case WhereClause::Operator::IN:
+    return "IN";
+  case WhereClause::Operator::NOT_IN:
+    return "NOT IN";
+  case WhereClause::Operator::IS_NULL:
+    return "IS NULL";
+  case WhereClause::Operator::IS_NOT_NULL:
+    return "IS NOT NULL";
+  }
+  return "?";
+}
+
+auto ParseLiteral(const std::string &literal, Column::Type type)
+    -> std::expected<Value, Error> {
+  const auto *begin = literal.data();
+  const auto *end = literal.data() + literal.size();
+  switch (type) {
+  case Column::Type::STRING:
+    return Value(literal);
+  case Column::Type::INT: {
+    int value = 0;
+    auto [ptr, ec] = std::from_chars(begin, end, value);
+    if (ec != std::errc() || ptr != end) {
+      return std::unexpected(Error("Invalid INT literal: " + literal));
+    }
+    return Value(value);
+  }
+  case Column::Type::FLOAT: {
+    float value = 0;
+    auto [ptr, ec] = std::from_chars(begin, end, value);
+    if (ec != std::errc() || ptr != end) {
+      return std::unexpected(Error("Invalid FLOAT literal: " + literal));
+    }
+    return Value(value);
+  }
+  case Column::Type::BOOL:
+    if (literal == "true" || literal == "1") {
+      return Value(true);
+    }
+    if (literal == "false" || literal == "0") {
+      return Value(false);
+    }
+    return std::unexpected(Error("Invalid BOOL literal: " + literal));
+  }
+  return std::unexpected(Error("Unknown column type"));
+}
+
+auto Predicate::Compile(const WhereClause &where, const Table &table)
+    -> std::expected<Predicate, Error> {
+  auto column = table.GetColumn(where.column());
+  if (!column) {
+    return std::unexpected(
+        Error("No column found: " + where.column(), Error::Kind::NoColumnFound));
+  }
+  return Compile(where, *column);
+}
+
+auto Predicate::Compile(const WhereClause &where, const Column *column)
+    -> std::expected<Predicate, Error> {
+  std::vector<Value> operands;
+  switch (where.op()) {
+  case WhereClause::Operator::IS_NULL:
+  case WhereClause::Operator::IS_NOT_NULL:
+    break;
+  case WhereClause::Operator::LIKE:
+  case WhereClause::Operator::NOT_LIKE:
+    if (column->type() != Column::Type::STRING) {
+      return std::unexpected(
+          Error("LIKE requires a STRING column: " + where.column()));
+    }
+    operands.emplace_back(where.value());
+    return Predicate(column, where.op(), std::move(operands),
+                     LikePattern::Compile(where.value()));
+  case WhereClause::Operator::IN:
+  case WhereClause::Operator::NOT_IN: {
+    // The literal is a comma separated list.
+    std::istringstream list(where.value());
+    std::string item;
+    while (std::getline(list, item, ',')) {
+      auto operand = ParseLiteral(item, column->type());
+      if (!operand) {
+        return std::unexpected(operand.error());
+      }
+      operands.push_back(std::move(*operand));
+    }
+    break;
+  }
+  default: {
+    auto operand = ParseLiteral(where.value(), column->type());
+    if (!operand) {
+      return std::unexpected(operand.error());
+    }
+    operands.push_back(std::move(*operand));
+  }
+  }
+  return Predicate(column, where.op(), std::move(operands));
+}
+
+auto Predicate::ToString() const -> std::string {
+  auto text = column_name_ + " " + OperatorToString(op_);
+  if (op_ == WhereClause::Operator::IN || op_ == WhereClause::Operator::NOT_IN) {
+    text += " (";
+    for (size_t i = 0; i < operands_.size(); ++i) {
+      text += (i > 0 ? ", " : "") + ValueToString(operands_[i]);
+    }
+    return text + ")";
+  }
+  if (!operands_.empty()) {
+    text += " " + ValueToString(operands_.front());
+  }
+  return text;
+}
+
+auto Predicate::Matches(const Tuple &tuple) const -> bool {
+  const auto *value = column_->Read(tuple);
+  if (op_ == WhereClause::Operator::IS_NULL) {
+    return value == nullptr;
+  }
+  if (op_ == WhereClause::Operator::IS_NOT_NULL) {
+    return value != nullptr;
+  }
+  if (value == nullptr) {
+    return false;
+  }
+
+  const auto &lhs = *value;
+  if (like_) {
+    const auto *text = std::get_if<std::string>(&lhs.value());
+    return text != nullptr &&
+           like_->Matches(*text) == (op_ == WhereClause::Operator::LIKE);
+  }
+  if (op_ == WhereClause::Operator::IN || op_ == WhereClause::Operator::NOT_IN) {
+    if (!operands_.empty() &&
+        lhs.value().index() != operands_.front().value().index()) {
+      return false;
+    }
+    bool found = false;
+    for (const auto &operand : operands_) {
+      if (CompareValues(lhs, operand) == 0) {
+        found = true;
+        break;
+      }
+    }
+    return found == (op_ == WhereClause::Operator::IN);
+  }
+
+  const auto &rhs = operands_.front();
+  if (lhs.value().index() != rhs.value().index()) {
+    return false;
+  }
+  const auto order = CompareValues(lhs, rhs);
+  switch (op_) {
+  case WhereClause::Operator::EQUAL:
+    return order == 0;
+  case WhereClause::Operator::NOT_EQUAL:
+    return order != 0;
+  case WhereClause::Operator::GREATER_THAN:
+    return order > 0;
+  case WhereClause::Operator::GREATER_THAN_OR_EQUAL:
+    return order >= 0;
+  case WhereClause::Operator::LESS_THAN:
+    return order < 0;
+  case WhereClause::Operator::LESS_THAN_OR_EQUAL:
+    return order <= 0;
+  default:
+    return false;
+  }
+}
+
+} // namespace JustADb
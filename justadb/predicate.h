@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ddl.h"
+#include "dml.h"
+#include "like.h"
+#include "utils.h"
+
+#include <compare>
+#include <expected>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace JustADb {
+
+// Orders two values of the same type. Values of different types are ordered
+// by their type so that sorting a mixed column is still well defined.
+[[nodiscard]] auto CompareValues(const Value &lhs, const Value &rhs)
+    -> std::weak_ordering;
+
+[[nodiscard]] auto ValueToString(const Value &value) -> std::string;
+
+[[nodiscard]] auto OperatorToString(WhereClause::Operator op) -> std::string;
+
+// Parses a where-clause literal as a value of the given column type.
+auto ParseLiteral(const std::string &literal, Column::Type type)
+    -> std::expected<Value, Error>;
+
+// A where-clause bound to a table: the column is checked and the literal
+// parsed once when the query is planned, not for every row.
+class Predicate {
+public:
+  static auto Compile(const WhereClause &where, const Table &table)
+      -> std::expected<Predicate, Error>;
+
+  // Binds the clause to `column`, e.g. one of a view's.
+  static auto Compile(const WhereClause &where, const Column *column)
+      -> std::expected<Predicate, Error>;
+
+  // A missing or null value is NULL and only matches IS_NULL. Values of a
+  // different type than the literal never match.
+  [[nodiscard]] auto Matches(const Tuple &tuple) const -> bool;
+
+  // E.g. "id >= 50", for EXPLAIN output.
+  [[nodiscard]] auto ToString() const -> std::string;
+
+  [[nodiscard]] auto column_name() const -> const std::string & {
+    return column_name_;
+  }
+
+  [[nodiscard]] auto column() const -> const Column * {
+    return column_;
+  }
+
+  [[nodiscard]] auto op() const {
+    return op_;
+  }
+
+  [[nodiscard]] auto operands() const -> const std::vector<Value> & {
+    return operands_;
+  }
+
+  // The compiled pattern of a LIKE / NOT_LIKE.
+  [[nodiscard]] auto like() const -> const std::optional<LikePattern> & {
+    return like_;
+  }
+
+private:
+  Predicate(const Column *column, WhereClause::Operator op,
+            std::vector<Value> operands,
+            std::optional<LikePattern> like = std::nullopt)
+      : column_(column), column_name_(column->name()), op_(op),
+        operands_(std::move(operands)), like_(std::move(like)) {}
+
+  const Column *column_;
+  std::string column_name_;
+  WhereClause::Operator op_;
+  // A single literal, or the list of an IN / NOT_IN. For LIKE, the pattern.
+  std::vector<Value> operands_;
+  std::optional<LikePattern> like_;
+};
+
+} // namespace JustADb
@@ -0,0 +1,243 @@
+#include "profile.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace JustADb {
+
+namespace {
+
+auto OpenCounter(uint64_t config, int group_fd) -> int {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.disabled = group_fd == -1 ? 1 : 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(
+      syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+void AppendJsonString(std::string &out, const std::string &value) {
+  out += '"';
+  for (const char c : value) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out += escaped;
+      } else {
+        out += c;
+      }
+    }
+  }
+  out += '"';
+}
+
+void AppendJson(std::string &out, const OperatorProfile &node) {
+  out += "{\"operator\":";
+  AppendJsonString(out, node.name);
+  out += ",\"detail\":";
+  AppendJsonString(out, node.detail);
+  out += ",\"rows_in\":" + std::to_string(node.rows_in());
+  out += ",\"rows_out\":" + std::to_string(node.rows_out);
+  if (node.estimated_rows) {
+    out += ",\"estimated_rows\":" +
+           std::to_string(static_cast<uint64_t>(*node.estimated_rows + 0.5));
+  }
+  out += ",\"batches\":" + std::to_string(node.batches);
+  out += ",\"wall_ns\":" + std::to_string(node.wall_ns);
+  out += ",\"self_ns\":" + std::to_string(node.self_ns());
+  out += ",\"bytes_allocated\":" + std::to_string(node.bytes_allocated);
+  out += ",\"bytes_spilled\":" + std::to_string(node.bytes_spilled);
+  if (node.counters) {
+    out += ",\"cycles\":" + std::to_string(node.counters->cycles);
+    out += ",\"cache_misses\":" + std::to_string(node.counters->cache_misses);
+    out += ",\"branch_misses\":" + std::to_string(node.counters->branch_misses);
+  }
+  out += ",\"children\":[";
+  for (size_t i = 0; i < node.children.size(); ++i) {
+    if (i > 0) {
+      out += ',';
+    }
+    AppendJson(out, *node.children[i]);
+  }
+  out += "]}";
+}
+
+void AppendText(std::string &out, const OperatorProfile &node, int depth) {
+  out += std::string(2 * depth, ' ') + node.name;
+  if (!node.detail.empty()) {
+    out += " (" + node.detail + ")";
+  }
+  out += ": rows_in=" + std::to_string(node.rows_in()) +
+         " rows_out=" + std::to_string(node.rows_out);
+  if (node.estimated_rows) {
+    out += " (estimated " +
+           std::to_string(static_cast<uint64_t>(*node.estimated_rows + 0.5)) +
+           ")";
+  }
+  out += " time=" + std::to_string(node.wall_ns / 1000) + "us" +
+         " self=" + std::to_string(node.self_ns() / 1000) + "us";
+  if (node.bytes_allocated > 0) {
+    out += " bytes=" + std::to_string(node.bytes_allocated);
+  }
+  if (node.bytes_spilled > 0) {
+    out += " spilled=" + std::to_string(node.bytes_spilled);
+  }
+  if (node.counters) {
+    out += " cycles=" + std::to_string(node.counters->cycles) +
+           " cache_misses=" + std::to_string(node.counters->cache_misses) +
+           " branch_misses=" + std::to_string(node.counters->branch_misses);
+  }
+  out += '\n';
+  for (const auto &child : node.children) {
+    AppendText(out, *child, depth + 1);
+  }
+}
+
+} // namespace
+
+auto HardwareCounters::operator+=(const HardwareCounters &other)
+    -> HardwareCounters & {
+  cycles += other.cycles;
+  cache_misses += other.cache_misses;
+  branch_misses += other.branch_misses;
+  return *this;
+}
+
+auto HardwareCounters::operator-(const HardwareCounters &other) const
+    -> HardwareCounters {
+  return {cycles - other.cycles, cache_misses - other.cache_misses,
+          branch_misses - other.branch_misses};
+}
+
+auto PerfCounters::Open() -> std::optional<PerfCounters> {
+  PerfCounters counters;
+  counters.fds_[0] = OpenCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (counters.fds_[0] < 0) {
+    return std::nullopt;
+  }
+  counters.fds_[1] = OpenCounter(PERF_COUNT_HW_CACHE_MISSES, counters.fds_[0]);
+  counters.fds_[2] = OpenCounter(PERF_COUNT_HW_BRANCH_MISSES, counters.fds_[0]);
+  if (counters.fds_[1] < 0 || counters.fds_[2] < 0) {
+    return std::nullopt;
+  }
+  ioctl(counters.fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(counters.fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return counters;
+}
+
+PerfCounters::PerfCounters(PerfCounters &&other) noexcept {
+  for (int i = 0; i < 3; ++i) {
+    fds_[i] = std::exchange(other.fds_[i], -1);
+  }
+}
+
+auto PerfCounters::operator=(PerfCounters &&other) noexcept -> PerfCounters & {
+  if (this != &other) {
+    CloseAll();
+    for (int i = 0; i < 3; ++i) {
+      fds_[i] = std::exchange(other.fds_[i], -1);
+    }
+  }
+  return *this;
+}
+
+PerfCounters::~PerfCounters() {
+  CloseAll();
+}
+
+void PerfCounters::CloseAll() {
+  for (auto &fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+}
+
+auto PerfCounters::Read() const -> HardwareCounters {
+  // PERF_FORMAT_GROUP: the number of counters, then their values in the order
+  // they joined the group.
+  uint64_t values[4] = {};
+  if (read(fds_[0], values, sizeof(values)) < 0 || values[0] != 3) {
+    return {};
+  }
+  return {values[1], values[2], values[3]};
+}
+
+auto OperatorProfile::rows_in() const -> uint64_t {
+  if (children.empty()) {
+    return rows_out;
+  }
+  uint64_t rows = 0;
+  for (const auto &child : children) {
+    rows += child->rows_out;
+  }
+  return rows;
+}
+
+auto OperatorProfile::self_ns() const -> uint64_t {
+  uint64_t children_ns = 0;
+  for (const auto &child : children) {
+    children_ns += child->wall_ns;
+  }
+  return wall_ns > children_ns ? wall_ns - children_ns : 0;
+}
+
+QueryProfile::QueryProfile(bool hardware_counters) {
+  if (hardware_counters) {
+    perf_counters_ = PerfCounters::Open();
+  }
+}
+
+auto QueryProfile::Push(std::unique_ptr<OperatorProfile> node)
+    -> OperatorProfile * {
+  if (root_) {
+    node->children.push_back(std::move(root_));
+  }
+  root_ = std::move(node);
+  return root_.get();
+}
+
+auto QueryProfile::ToJson() const -> std::string {
+  std::string out = "{\"hardware_counters\":";
+  out += perf_counters_ ? "true" : "false";
+  out += ",\"plan\":";
+  if (root_) {
+    AppendJson(out, *root_);
+  } else {
+    out += "null";
+  }
+  out += '}';
+  return out;
+}
+
+auto QueryProfile::ToText() const -> std::string {
+  std::string out;
+  if (root_) {
+    AppendText(out, *root_, 0);
+  }
+  return out;
+}
+
+} // namespace JustADb
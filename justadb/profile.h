@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace JustADb {
+
+struct HardwareCounters {
+  uint64_t cycles = 0;
+  uint64_t cache_misses = 0;
+  uint64_t branch_misses = 0;
+
+  auto operator+=(const HardwareCounters &other) -> HardwareCounters &;
+  auto operator-(const HardwareCounters &other) const -> HardwareCounters;
+};
+
+// A group of perf_event_open() counters for the calling thread. Opening fails
+// when the kernel does not allow it (e.g. perf_event_paranoid, containers), in
+// which case profiles simply carry no hardware counters.
+class PerfCounters {
+public:
+  static auto Open() -> std::optional<PerfCounters>;
+
+  PerfCounters(PerfCounters &&other) noexcept;
+  auto operator=(PerfCounters &&other) noexcept -> PerfCounters &;
+
+  PerfCounters(const PerfCounters &) = delete;
+  auto operator=(const PerfCounters &) -> PerfCounters & = delete;
+
+  ~PerfCounters();
+
+  // Counts since Open().
+  auto Read() const -> HardwareCounters;
+
+private:
+  PerfCounters() = default;
+
+  void CloseAll();
+
+  // The cycles counter leads the group.
+  int fds_[3] = {-1, -1, -1};
+};
+
+// What one operator did during a query. Times and counters are inclusive of
+// the operator's children.
+struct OperatorProfile {
+  OperatorProfile(std::string name, std::string detail)
+      : name(std::move(name)), detail(std::move(detail)) {}
+
+  std::string name;
+  std::string detail;
+  uint64_t rows_out = 0;
+  uint64_t batches = 0;
+  uint64_t wall_ns = 0;
+  // The most memory the operator held at once.
+  uint64_t bytes_allocated = 0;
+  // What it wrote to spill files once its memory ran out.
+  uint64_t bytes_spilled = 0;
+  std::optional<HardwareCounters> counters;
+  // The planner's guess at rows_out, when it made one.
+  std::optional<double> estimated_rows;
+  std::vector<std::unique_ptr<OperatorProfile>> children;
+
+  // Rows the operator consumed: its children's output, or for a leaf the
+  // rows it produced.
+  [[nodiscard]] auto rows_in() const -> uint64_t;
+
+  // Time spent in this operator alone.
+  [[nodiscard]] auto self_ns() const -> uint64_t;
+};
+
+// The execution profile of one query, produced by EXPLAIN ANALYZE.
+class QueryProfile {
+public:
+  // Hardware counters are collected only when `hardware_counters` is set and
+  // the kernel allows it.
+  explicit QueryProfile(bool hardware_counters = true);
+
+  // Makes `node` the new root, adopting the current root as its child. Plans
+  // are built bottom-up, so each operator wraps the one added before it.
+  auto Push(std::unique_ptr<OperatorProfile> node) -> OperatorProfile *;
+
+  // Detaches the current root, leaving the profile empty. A plan with two
+  // inputs builds one of them, takes it, builds the other, then attaches the
+  // taken tree to the node it pushes on top.
+  auto TakeRoot() -> std::unique_ptr<OperatorProfile> {
+    return std::move(root_);
+  }
+
+  [[nodiscard]] auto root() const -> const OperatorProfile * {
+    return root_.get();
+  }
+
+  [[nodiscard]] auto perf_counters() const -> const PerfCounters * {
+    return perf_counters_ ? &*perf_counters_ : nullptr;
+  }
+
+  auto ToJson() const -> std::string;
+
+  // An indented operator tree, one line per operator.
+  auto ToText() const -> std::string;
+
+private:
+  std::unique_ptr<OperatorProfile> root_;
+  std::optional<PerfCounters> perf_counters_;
+};
+
+} // namespace JustADb
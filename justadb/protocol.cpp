@@ -0,0 +1,919 @@
+#include "protocol.h"
+
+#include <bit>
+#include <memory>
+#include <type_traits>
+
+namespace JustADb {
+
+namespace {
+
+enum class ValueTag : uint8_t { NUL, STRING, INT, FLOAT, BOOL };
+
+auto Truncated() -> Error {
+  return Error("Truncated message");
+}
+
+void PutColumn(WireWriter &writer, const Column &column) {
+  writer.PutString(column.name());
+  writer.PutU8(static_cast<uint8_t>(column.type()));
+  writer.PutValue(column.default_value());
+}
+
+auto GetColumnType(WireReader &reader) -> std::expected<Column::Type, Error> {
+  auto type = reader.GetU8();
+  if (!type) {
+    return std::unexpected(type.error());
+  }
+  if (*type > static_cast<uint8_t>(Column::Type::FLOAT)) {
+    return std::unexpected(Error("Invalid column type"));
+  }
+  return static_cast<Column::Type>(*type);
+}
+
+// A decoded column, which owns its default value until the whole request
+// has been decoded: a malformed request then frees what it allocated.
+struct DecodedColumn {
+  std::string name;
+  Column::Type type;
+  std::unique_ptr<Value> default_value;
+
+  // A new column that takes over the default value, for a query that hands
+  // it on to the table.
+  auto Release() -> Column * {
+    return new Column(std::move(name), type, default_value.release());
+  }
+};
+
+auto GetColumn(WireReader &reader) -> std::expected<DecodedColumn, Error> {
+  auto name = reader.GetString();
+  if (!name) {
+    return std::unexpected(name.error());
+  }
+  auto type = GetColumnType(reader);
+  if (!type) {
+    return std::unexpected(type.error());
+  }
+  auto default_value = reader.GetValue();
+  if (!default_value) {
+    return std::unexpected(default_value.error());
+  }
+  return DecodedColumn{
+      std::move(*name), *type,
+      *default_value ? std::make_unique<Value>(std::move(**default_value))
+                     : nullptr};
+}
+
+void EncodeQuery(WireWriter &writer, const CreateDatabaseQuery &query) {
+  writer.PutString(query.db_name());
+}
+
+void EncodeQuery(WireWriter &writer, const DropDatabaseQuery &query) {
+  writer.PutString(query.db_name());
+}
+
+void EncodeQuery(WireWriter &writer, const UseDatabaseQuery &query) {
+  writer.PutString(query.db_name());
+}
+
+void EncodeQuery(WireWriter &writer, const CreateTableQuery &query) {
+  writer.PutString(query.table_name());
+  writer.PutU32(query.columns().size());
+  for (const auto *column : query.columns()) {
+    PutColumn(writer, *column);
+  }
+  const auto &partitioning = query.partitioning();
+  writer.PutU8(partitioning.has_value());
+  if (partitioning) {
+    writer.PutU8(static_cast<uint8_t>(partitioning->kind()));
+    writer.PutString(partitioning->column());
+    writer.PutU64(partitioning->partition_count());
+    for (const auto bound : partitioning->bounds()) {
+      writer.PutU32(static_cast<uint32_t>(bound));
+    }
+  }
+  const auto &storage = query.storage();
+  writer.PutU8(static_cast<uint8_t>(storage.engine));
+  writer.PutString(storage.key_column);
+  writer.PutU64(storage.memtable_rows);
+  writer.PutU32(query.foreign_keys().size());
+  for (const auto &foreign_key : query.foreign_keys()) {
+    writer.PutString(foreign_key.column);
+    writer.PutString(foreign_key.parent_table);
+    writer.PutString(foreign_key.parent_column);
+  }
+}
+
+void EncodeQuery(WireWriter &writer, const DropTableQuery &query) {
+  writer.PutString(query.table_name());
+}
+
+void EncodeQuery(WireWriter &writer, const AnalyzeTableQuery &query) {
+  writer.PutString(query.table_name());
+}
+
+void EncodeQuery(WireWriter &writer, const DropPartitionQuery &query) {
+  writer.PutString(query.table_name());
+  writer.PutU64(query.partition());
+}
+
+void EncodeQuery(WireWriter &writer, const DropViewQuery &query) {
+  writer.PutString(query.view_name());
+}
+
+void EncodeQuery(WireWriter &writer, const CreateViewQuery &query) {
+  writer.PutString(query.view_name());
+  writer.PutString(query.table_name());
+  writer.PutU32(query.columns().size());
+  for (const auto &column : query.columns()) {
+    writer.PutString(column);
+  }
+  writer.PutU32(query.where_clause().size());
+  for (const auto &where : query.where_clause()) {
+    writer.PutString(where.column());
+    writer.PutString(where.value());
+    writer.PutU8(static_cast<uint8_t>(where.op()));
+  }
+  writer.PutU32(query.aggregates().size());
+  for (const auto &aggregate : query.aggregates()) {
+    writer.PutU8(static_cast<uint8_t>(aggregate.function()));
+    writer.PutString(aggregate.column());
+  }
+}
+
+void EncodeQuery(WireWriter &writer, const AlterTableQuery &query) {
+  writer.PutString(query.table_name());
+  writer.PutU8(static_cast<uint8_t>(query.alter_type()));
+  PutColumn(writer, *query.column());
+  writer.PutU8(query.new_column_name().has_value());
+  if (query.new_column_name()) {
+    writer.PutString(*query.new_column_name());
+  }
+  writer.PutU8(query.new_column_type().has_value());
+  if (query.new_column_type()) {
+    writer.PutU8(static_cast<uint8_t>(*query.new_column_type()));
+  }
+}
+
+void EncodeQuery(WireWriter &writer, const SelectQuery &query) {
+  writer.PutString(query.table_name());
+  writer.PutU32(query.columns().size());
+  for (const auto &column : query.columns()) {
+    PutColumn(writer, column);
+  }
+  writer.PutU32(query.where_clause().size());
+  for (const auto &where : query.where_clause()) {
+    writer.PutString(where.column());
+    writer.PutString(where.value());
+    writer.PutU8(static_cast<uint8_t>(where.op()));
+  }
+  const auto order_by = query.orderByClause();
+  writer.PutU8(order_by.has_value());
+  if (order_by) {
+    writer.PutString(order_by->column());
+    writer.PutU8(static_cast<uint8_t>(order_by->order()));
+  }
+  writer.PutU8(query.limit().has_value());
+  if (query.limit()) {
+    writer.PutU64(*query.limit());
+  }
+  const auto join = query.join();
+  writer.PutU8(join.has_value());
+  if (join) {
+    writer.PutString(join->table());
+    writer.PutString(join->left_column());
+    writer.PutString(join->right_column());
+  }
+}
+
+void EncodeQuery(WireWriter &writer, const ExplainAnalyzeQuery &query) {
+  EncodeQuery(writer, query.select());
+}
+
+void EncodeQuery(WireWriter &writer, const InsertQuery &query) {
+  writer.PutString(query.table_name());
+  writer.PutU32(query.rows().size());
+  for (const auto &values : query.rows()) {
+    writer.PutU32(values.size());
+    for (const auto &[column_name, value] : values) {
+      writer.PutString(column_name);
+      writer.PutValue(&value);
+    }
+  }
+}
+
+auto DecodeNamedQuery(WireReader &reader, MessageType type)
+    -> std::expected<Request, Error> {
+  auto name = reader.GetString();
+  if (!name) {
+    return std::unexpected(name.error());
+  }
+  switch (type) {
+  case MessageType::CREATE_DB:
+    return CreateDatabaseQuery(std::move(*name));
+  case MessageType::DROP_DB:
+    return DropDatabaseQuery(*name);
+  case MessageType::USE_DB:
+    return UseDatabaseQuery(std::move(*name));
+  case MessageType::ANALYZE_TABLE:
+    return AnalyzeTableQuery(std::move(*name));
+  case MessageType::DROP_VIEW:
+    return DropViewQuery(std::move(*name));
+  default:
+    return DropTableQuery(std::move(*name));
+  }
+}
+
+auto GetPartitioning(WireReader &reader)
+    -> std::expected<std::optional<PartitionSpec>, Error> {
+  auto has_partitioning = reader.GetU8();
+  if (!has_partitioning) {
+    return std::unexpected(Truncated());
+  }
+  if (!*has_partitioning) {
+    return std::nullopt;
+  }
+  auto kind = reader.GetU8();
+  auto column = reader.GetString();
+  auto partition_count = reader.GetU64();
+  if (!kind || !column || !partition_count) {
+    return std::unexpected(Truncated());
+  }
+  if (*kind > static_cast<uint8_t>(PartitionSpec::Kind::HASH)) {
+    return std::unexpected(Error("Invalid partitioning kind"));
+  }
+  if (static_cast<PartitionSpec::Kind>(*kind) == PartitionSpec::Kind::HASH) {
+    return PartitionSpec::Hash(std::move(*column), *partition_count);
+  }
+  if (*partition_count == 0) {
+    return std::unexpected(Error("A table needs at least one partition"));
+  }
+  std::vector<int> bounds;
+  for (uint64_t i = 1; i < *partition_count; ++i) {
+    auto bound = reader.GetU32();
+    if (!bound) {
+      return std::unexpected(bound.error());
+    }
+    bounds.push_back(static_cast<int>(*bound));
+  }
+  return PartitionSpec::Range(std::move(*column), std::move(bounds));
+}
+
+auto DecodeCreateTable(WireReader &reader) -> std::expected<Request, Error> {
+  auto table_name = reader.GetString();
+  auto column_count = reader.GetU32();
+  if (!table_name || !column_count) {
+    return std::unexpected(Truncated());
+  }
+  std::vector<DecodedColumn> decoded_columns;
+  for (uint32_t i = 0; i < *column_count; ++i) {
+    auto column = GetColumn(reader);
+    if (!column) {
+      return std::unexpected(column.error());
+    }
+    decoded_columns.push_back(std::move(*column));
+  }
+
+  auto partitioning = GetPartitioning(reader);
+  if (!partitioning) {
+    return std::unexpected(partitioning.error());
+  }
+  auto engine = reader.GetU8();
+  auto key_column = reader.GetString();
+  auto memtable_rows = reader.GetU64();
+  if (!engine || !key_column || !memtable_rows) {
+    return std::unexpected(Truncated());
+  }
+  if (*engine > static_cast<uint8_t>(StorageOptions::Engine::LSM)) {
+    return std::unexpected(Error("Invalid storage engine"));
+  }
+  StorageOptions storage{static_cast<StorageOptions::Engine>(*engine),
+                         std::move(*key_column), *memtable_rows};
+
+  auto foreign_key_count = reader.GetU32();
+  if (!foreign_key_count) {
+    return std::unexpected(foreign_key_count.error());
+  }
+  std::vector<ForeignKey> foreign_keys;
+  for (uint32_t i = 0; i < *foreign_key_count; ++i) {
+    auto column = reader.GetString();
+    auto parent_table = reader.GetString();
+    auto parent_column = reader.GetString();
+    if (!column || !parent_table || !parent_column) {
+      return std::unexpected(Truncated());
+    }
+    foreign_keys.push_back({std::move(*column), std::move(*parent_table),
+                            std::move(*parent_column)});
+  }
+
+  std::vector<Column *> columns;
+  for (auto &column : decoded_columns) {
+    columns.push_back(column.Release());
+  }
+  CreateTableQuery query(std::move(*table_name), std::move(columns),
+                         std::move(*partitioning), std::move(storage));
+  for (auto &foreign_key : foreign_keys) {
+    query.References(std::move(foreign_key.column),
+                     std::move(foreign_key.parent_table),
+                     std::move(foreign_key.parent_column));
+  }
+  return query;
+}
+
+auto DecodeDropPartition(WireReader &reader)
+    -> std::expected<Request, Error> {
+  auto table_name = reader.GetString();
+  auto partition = reader.GetU64();
+  if (!table_name || !partition) {
+    return std::unexpected(Truncated());
+  }
+  return DropPartitionQuery(std::move(*table_name), *partition);
+}
+
+auto DecodeCreateView(WireReader &reader) -> std::expected<Request, Error> {
+  auto view_name = reader.GetString();
+  auto table_name = reader.GetString();
+  auto column_count = reader.GetU32();
+  if (!view_name || !table_name || !column_count) {
+    return std::unexpected(Truncated());
+  }
+  std::vector<std::string> columns;
+  for (uint32_t i = 0; i < *column_count; ++i) {
+    auto column = reader.GetString();
+    if (!column) {
+      return std::unexpected(column.error());
+    }
+    columns.push_back(std::move(*column));
+  }
+  CreateViewQuery query(std::move(*view_name), std::move(*table_name),
+                        std::move(columns));
+
+  auto where_count = reader.GetU32();
+  if (!where_count) {
+    return std::unexpected(where_count.error());
+  }
+  for (uint32_t i = 0; i < *where_count; ++i) {
+    auto column = reader.GetString();
+    auto value = reader.GetString();
+    auto op = reader.GetU8();
+    if (!column || !value || !op) {
+      return std::unexpected(Truncated());
+    }
+    if (*op > static_cast<uint8_t>(WhereClause::Operator::IS_NOT_NULL)) {
+      return std::unexpected(Error("Invalid where operator"));
+    }
+    query.Where(*column, *value, static_cast<WhereClause::Operator>(*op));
+  }
+
+  auto aggregate_count = reader.GetU32();
+  if (!aggregate_count) {
+    return std::unexpected(aggregate_count.error());
+  }
+  for (uint32_t i = 0; i < *aggregate_count; ++i) {
+    auto function = reader.GetU8();
+    auto column = reader.GetString();
+    if (!function || !column) {
+      return std::unexpected(Truncated());
+    }
+    if (*function > static_cast<uint8_t>(AggregateClause::Function::AVG)) {
+      return std::unexpected(Error("Invalid aggregate function"));
+    }
+    query.Aggregate(static_cast<AggregateClause::Function>(*function),
+                    std::move(*column));
+  }
+  return query;
+}
+
+auto DecodeAlterTable(WireReader &reader) -> std::expected<Request, Error> {
+  auto table_name = reader.GetString();
+  auto alter_type = reader.GetU8();
+  if (!table_name || !alter_type) {
+    return std::unexpected(Truncated());
+  }
+  if (*alter_type >
+      static_cast<uint8_t>(AlterTableQuery::AlterType::MODIFY_DATATYPE)) {
+    return std::unexpected(Error("Invalid alter type"));
+  }
+  auto column = GetColumn(reader);
+  if (!column) {
+    return std::unexpected(column.error());
+  }
+
+  std::optional<std::string> new_column_name;
+  auto has_new_name = reader.GetU8();
+  if (!has_new_name) {
+    return std::unexpected(Truncated());
+  }
+  if (*has_new_name) {
+    auto new_name = reader.GetString();
+    if (!new_name) {
+      return std::unexpected(new_name.error());
+    }
+    new_column_name = std::move(*new_name);
+  }
+
+  std::optional<Column::Type> new_column_type;
+  auto has_new_type = reader.GetU8();
+  if (!has_new_type) {
+    return std::unexpected(Truncated());
+  }
+  if (*has_new_type) {
+    auto new_type = GetColumnType(reader);
+    if (!new_type) {
+      return std::unexpected(new_type.error());
+    }
+    new_column_type = *new_type;
+  }
+
+  return AlterTableQuery(
+      std::move(*table_name),
+      static_cast<AlterTableQuery::AlterType>(*alter_type),
+      column->Release(), std::move(new_column_name),
+      new_column_type);
+}
+
+auto DecodeSelect(WireReader &reader) -> std::expected<Request, Error> {
+  auto table_name = reader.GetString();
+  auto column_count = reader.GetU32();
+  if (!table_name || !column_count) {
+    return std::unexpected(Truncated());
+  }
+  std::vector<Column> columns;
+  for (uint32_t i = 0; i < *column_count; ++i) {
+    auto column = GetColumn(reader);
+    if (!column) {
+      return std::unexpected(column.error());
+    }
+    // A selected column's default value means nothing.
+    columns.emplace_back(std::move(column->name), column->type);
+  }
+  SelectQuery query(std::move(*table_name), std::move(columns));
+
+  auto where_count = reader.GetU32();
+  if (!where_count) {
+    return std::unexpected(where_count.error());
+  }
+  for (uint32_t i = 0; i < *where_count; ++i) {
+    auto column = reader.GetString();
+    auto value = reader.GetString();
+    auto op = reader.GetU8();
+    if (!column || !value || !op) {
+      return std::unexpected(Truncated());
+    }
+    if (*op > static_cast<uint8_t>(WhereClause::Operator::IS_NOT_NULL)) {
+      return std::unexpected(Error("Invalid where operator"));
+    }
+    query.Where(*column, *value, static_cast<WhereClause::Operator>(*op));
+  }
+
+  auto has_order_by = reader.GetU8();
+  if (!has_order_by) {
+    return std::unexpected(has_order_by.error());
+  }
+  if (*has_order_by) {
+    auto column = reader.GetString();
+    auto order = reader.GetU8();
+    if (!column || !order) {
+      return std::unexpected(Truncated());
+    }
+    if (*order > static_cast<uint8_t>(OrderByClause::Order::DESCENDING)) {
+      return std::unexpected(Error("Invalid sort order"));
+    }
+    query.OrderBy(std::move(*column),
+                  static_cast<OrderByClause::Order>(*order));
+  }
+
+  auto has_limit = reader.GetU8();
+  if (!has_limit) {
+    return std::unexpected(has_limit.error());
+  }
+  if (*has_limit) {
+    auto limit = reader.GetU64();
+    if (!limit) {
+      return std::unexpected(limit.error());
+    }
+    query.Limit(*limit);
+  }
+
+  auto has_join = reader.GetU8();
+  if (!has_join) {
+    return std::unexpected(has_join.error());
+  }
+  if (*has_join) {
+    auto table = reader.GetString();
+    auto left_column = reader.GetString();
+    auto right_column = reader.GetString();
+    if (!table || !left_column || !right_column) {
+      return std::unexpected(Truncated());
+    }
+    query.Join(std::move(*table), std::move(*left_column),
+               std::move(*right_column));
+  }
+  return query;
+}
+
+auto DecodeInsert(WireReader &reader) -> std::expected<Request, Error> {
+  auto table_name = reader.GetString();
+  auto row_count = reader.GetU32();
+  if (!table_name || !row_count) {
+    return std::unexpected(Truncated());
+  }
+  std::vector<InsertQuery::Row> rows;
+  for (uint32_t row = 0; row < *row_count; ++row) {
+    auto value_count = reader.GetU32();
+    if (!value_count) {
+      return std::unexpected(value_count.error());
+    }
+    InsertQuery::Row values;
+    for (uint32_t i = 0; i < *value_count; ++i) {
+      auto column_name = reader.GetString();
+      if (!column_name) {
+        return std::unexpected(column_name.error());
+      }
+      auto value = reader.GetValue();
+      if (!value) {
+        return std::unexpected(value.error());
+      }
+      if (!value->has_value()) {
+        return std::unexpected(Error("Cannot insert a null value"));
+      }
+      values.insert({std::move(*column_name), std::move(**value)});
+    }
+    rows.push_back(std::move(values));
+  }
+  return InsertQuery::Batch(std::move(*table_name), std::move(rows));
+}
+
+template <typename Query> constexpr auto MessageTypeOf() -> MessageType {
+  if constexpr (std::is_same_v<Query, CreateDatabaseQuery>) {
+    return MessageType::CREATE_DB;
+  } else if constexpr (std::is_same_v<Query, DropDatabaseQuery>) {
+    return MessageType::DROP_DB;
+  } else if constexpr (std::is_same_v<Query, UseDatabaseQuery>) {
+    return MessageType::USE_DB;
+  } else if constexpr (std::is_same_v<Query, CreateTableQuery>) {
+    return MessageType::CREATE_TABLE;
+  } else if constexpr (std::is_same_v<Query, DropTableQuery>) {
+    return MessageType::DROP_TABLE;
+  } else if constexpr (std::is_same_v<Query, AlterTableQuery>) {
+    return MessageType::ALTER_TABLE;
+  } else if constexpr (std::is_same_v<Query, SelectQuery>) {
+    return MessageType::SELECT;
+  } else if constexpr (std::is_same_v<Query, ExplainAnalyzeQuery>) {
+    return MessageType::EXPLAIN_ANALYZE;
+  } else if constexpr (std::is_same_v<Query, AnalyzeTableQuery>) {
+    return MessageType::ANALYZE_TABLE;
+  } else if constexpr (std::is_same_v<Query, DropPartitionQuery>) {
+    return MessageType::DROP_PARTITION;
+  } else if constexpr (std::is_same_v<Query, CreateViewQuery>) {
+    return MessageType::CREATE_VIEW;
+  } else if constexpr (std::is_same_v<Query, DropViewQuery>) {
+    return MessageType::DROP_VIEW;
+  } else {
+    static_assert(std::is_same_v<Query, InsertQuery>);
+    return MessageType::INSERT;
+  }
+}
+
+} // namespace
+
+void WireWriter::PutU8(uint8_t value) {
+  buffer_.push_back(static_cast<char>(value));
+}
+
+void WireWriter::PutU32(uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    buffer_.push_back(static_cast<char>((value >> shift) & 0xff));
+  }
+}
+
+void WireWriter::PutU64(uint64_t value) {
+  PutU32(static_cast<uint32_t>(value));
+  PutU32(static_cast<uint32_t>(value >> 32));
+}
+
+void WireWriter::PutString(std::string_view value) {
+  PutU32(value.size());
+  buffer_.append(value);
+}
+
+void WireWriter::PutValue(const Value *value) {
+  if (value == nullptr) {
+    PutU8(static_cast<uint8_t>(ValueTag::NUL));
+    return;
+  }
+  std::visit(
+      [this](const auto &v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, std::string>) {
+          PutU8(static_cast<uint8_t>(ValueTag::STRING));
+          PutString(v);
+        } else if constexpr (std::is_same_v<T, int>) {
+          PutU8(static_cast<uint8_t>(ValueTag::INT));
+          PutU32(static_cast<uint32_t>(v));
+        } else if constexpr (std::is_same_v<T, float>) {
+          PutU8(static_cast<uint8_t>(ValueTag::FLOAT));
+          PutU32(std::bit_cast<uint32_t>(v));
+        } else {
+          PutU8(static_cast<uint8_t>(ValueTag::BOOL));
+          PutU8(v ? 1 : 0);
+        }
+      },
+      value->value());
+}
+
+auto WireReader::Take(size_t size) -> std::expected<std::string_view, Error> {
+  if (buffer_.size() < size) {
+    return std::unexpected(Truncated());
+  }
+  auto bytes = buffer_.substr(0, size);
+  buffer_.remove_prefix(size);
+  return bytes;
+}
+
+auto WireReader::GetU8() -> std::expected<uint8_t, Error> {
+  auto bytes = Take(1);
+  if (!bytes) {
+    return std::unexpected(bytes.error());
+  }
+  return static_cast<uint8_t>((*bytes)[0]);
+}
+
+auto WireReader::GetU32() -> std::expected<uint32_t, Error> {
+  auto bytes = Take(4);
+  if (!bytes) {
+    return std::unexpected(bytes.error());
+  }
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= static_cast<uint32_t>(static_cast<uint8_t>((*bytes)[i]))
+             << (8 * i);
+  }
+  return value;
+}
+
+auto WireReader::GetU64() -> std::expected<uint64_t, Error> {
+  auto low = GetU32();
+  auto high = GetU32();
+  if (!low || !high) {
+    return std::unexpected(Truncated());
+  }
+  return static_cast<uint64_t>(*high) << 32 | *low;
+}
+
+auto WireReader::GetString() -> std::expected<std::string, Error> {
+  auto size = GetU32();
+  if (!size) {
+    return std::unexpected(size.error());
+  }
+  auto bytes = Take(*size);
+  if (!bytes) {
+    return std::unexpected(bytes.error());
+  }
+  return std::string(*bytes);
+}
+
+auto WireReader::GetValue() -> std::expected<std::optional<Value>, Error> {
+  auto tag = GetU8();
+  if (!tag) {
+    return std::unexpected(tag.error());
+  }
+  switch (static_cast<ValueTag>(*tag)) {
+  case ValueTag::NUL:
+    return std::nullopt;
+  case ValueTag::STRING: {
+    auto value = GetString();
+    if (!value) {
+      return std::unexpected(value.error());
+    }
+    return Value(std::move(*value));
+  }
+  case ValueTag::INT: {
+    auto value = GetU32();
+    if (!value) {
+      return std::unexpected(value.error());
+    }
+    return Value(static_cast<int>(*value));
+  }
+  case ValueTag::FLOAT: {
+    auto value = GetU32();
+    if (!value) {
+      return std::unexpected(value.error());
+    }
+    return Value(std::bit_cast<float>(*value));
+  }
+  case ValueTag::BOOL: {
+    auto value = GetU8();
+    if (!value) {
+      return std::unexpected(value.error());
+    }
+    return Value(*value != 0);
+  }
+  }
+  return std::unexpected(Error("Invalid value tag"));
+}
+
+void AppendFrame(std::string &out, uint32_t request_id, MessageType type,
+                 std::string_view payload) {
+  WireWriter header;
+  header.PutU32(payload.size());
+  header.PutU32(request_id);
+  header.PutU8(static_cast<uint8_t>(type));
+  out.append(header.buffer());
+  out.append(payload);
+}
+
+auto ParseFrame(std::string_view buffer, size_t &consumed)
+    -> std::expected<std::optional<Frame>, Error> {
+  if (buffer.size() < kFrameHeaderSize) {
+    return std::nullopt;
+  }
+  WireReader header(buffer.substr(0, kFrameHeaderSize));
+  const auto payload_size = header.GetU32().value();
+  const auto request_id = header.GetU32().value();
+  const auto type = header.GetU8().value();
+  if (payload_size > kMaxFramePayloadSize) {
+    return std::unexpected(Error("Frame too large"));
+  }
+  if (buffer.size() < kFrameHeaderSize + payload_size) {
+    return std::nullopt;
+  }
+  consumed = kFrameHeaderSize + payload_size;
+  return Frame{request_id, static_cast<MessageType>(type),
+               std::string(buffer.substr(kFrameHeaderSize, payload_size))};
+}
+
+auto EncodeRequest(uint32_t request_id, const Request &request)
+    -> std::string {
+  std::string out;
+  std::visit(
+      [&](const auto &query) {
+        WireWriter writer;
+        EncodeQuery(writer, query);
+        AppendFrame(out, request_id,
+                    MessageTypeOf<std::decay_t<decltype(query)>>(),
+                    writer.buffer());
+      },
+      request);
+  return out;
+}
+
+auto DecodeRequest(const Frame &frame) -> std::expected<Request, Error> {
+  WireReader reader(frame.payload);
+  std::expected<Request, Error> request =
+      std::unexpected(Error("Unknown request type"));
+  switch (frame.type) {
+  case MessageType::CREATE_DB:
+  case MessageType::DROP_DB:
+  case MessageType::USE_DB:
+  case MessageType::DROP_TABLE:
+  case MessageType::ANALYZE_TABLE:
+  case MessageType::DROP_VIEW:
+    request = DecodeNamedQuery(reader, frame.type);
+    break;
+  case MessageType::CREATE_TABLE:
+    request = DecodeCreateTable(reader);
+    break;
+  case MessageType::ALTER_TABLE:
+    request = DecodeAlterTable(reader);
+    break;
+  case MessageType::DROP_PARTITION:
+    request = DecodeDropPartition(reader);
+    break;
+  case MessageType::CREATE_VIEW:
+    request = DecodeCreateView(reader);
+    break;
+  case MessageType::SELECT:
+    request = DecodeSelect(reader);
+    break;
+  case MessageType::INSERT:
+    request = DecodeInsert(reader);
+    break;
+  case MessageType::EXPLAIN_ANALYZE:
+    request = DecodeSelect(reader);
+    if (request) {
+      request = ExplainAnalyzeQuery(std::get<SelectQuery>(std::move(*request)));
+    }
+    break;
+  default:
+    break;
+  }
+  if (request && !reader.empty()) {
+    return std::unexpected(Error("Trailing bytes after request"));
+  }
+  return request;
+}
+
+void AppendOk(std::string &out, uint32_t request_id, uint64_t affected_rows) {
+  WireWriter writer;
+  writer.PutU64(affected_rows);
+  AppendFrame(out, request_id, MessageType::OK, writer.buffer());
+}
+
+void AppendError(std::string &out, uint32_t request_id, const Error &error) {
+  WireWriter writer;
+  writer.PutString(error.message());
+  AppendFrame(out, request_id, MessageType::ERROR, writer.buffer());
+}
+
+void AppendResultHeader(std::string &out, uint32_t request_id,
+                        const std::vector<std::string> &column_names) {
+  WireWriter writer;
+  writer.PutU32(column_names.size());
+  for (const auto &name : column_names) {
+    writer.PutString(name);
+  }
+  AppendFrame(out, request_id, MessageType::RESULT_HEADER, writer.buffer());
+}
+
+void AppendResultBatch(std::string &out, uint32_t request_id,
+                       const std::vector<std::vector<const Value *>> &columns) {
+  WireWriter writer;
+  writer.PutU32(columns.size());
+  writer.PutU32(columns.empty() ? 0 : columns.front().size());
+  for (const auto &column : columns) {
+    for (const auto *value : column) {
+      writer.PutValue(value);
+    }
+  }
+  AppendFrame(out, request_id, MessageType::RESULT_BATCH, writer.buffer());
+}
+
+void AppendResultEnd(std::string &out, uint32_t request_id,
+                     uint64_t row_count) {
+  WireWriter writer;
+  writer.PutU64(row_count);
+  AppendFrame(out, request_id, MessageType::RESULT_END, writer.buffer());
+}
+
+auto ApplyResponseFrame(const Frame &frame, Response &response)
+    -> std::expected<bool, Error> {
+  response.request_id = frame.request_id;
+  WireReader reader(frame.payload);
+  switch (frame.type) {
+  case MessageType::OK: {
+    auto affected_rows = reader.GetU64();
+    if (!affected_rows) {
+      return std::unexpected(affected_rows.error());
+    }
+    response.affected_rows = *affected_rows;
+    return true;
+  }
+  case MessageType::ERROR: {
+    auto message = reader.GetString();
+    if (!message) {
+      return std::unexpected(message.error());
+    }
+    response.error = Error(*message);
+    return true;
+  }
+  case MessageType::RESULT_HEADER: {
+    auto column_count = reader.GetU32();
+    if (!column_count) {
+      return std::unexpected(column_count.error());
+    }
+    response.column_names.clear();
+    for (uint32_t i = 0; i < *column_count; ++i) {
+      auto name = reader.GetString();
+      if (!name) {
+        return std::unexpected(name.error());
+      }
+      response.column_names.push_back(std::move(*name));
+    }
+    response.columns.assign(*column_count, {});
+    return false;
+  }
+  case MessageType::RESULT_BATCH: {
+    auto column_count = reader.GetU32();
+    auto row_count = reader.GetU32();
+    if (!column_count || !row_count) {
+      return std::unexpected(Truncated());
+    }
+    if (*column_count != response.columns.size()) {
+      return std::unexpected(Error("Result batch does not match header"));
+    }
+    for (auto &column : response.columns) {
+      for (uint32_t r = 0; r < *row_count; ++r) {
+        auto value = reader.GetValue();
+        if (!value) {
+          return std::unexpected(value.error());
+        }
+        column.push_back(std::move(*value));
+      }
+    }
+    return false;
+  }
+  case MessageType::RESULT_END: {
+    auto row_count = reader.GetU64();
+    if (!row_count) {
+      return std::unexpected(row_count.error());
+    }
+    response.row_count = *row_count;
+    return true;
+  }
+  default:
+    return std::unexpected(Error("Unexpected response frame"));
+  }
+}
+
+} // namespace JustADb
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "ddl.h"
+#include "dml.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace JustADb {
+
+// Every message on the wire is a frame:
+//
+//   u32 payload_length | u32 request_id | u8 message_type | payload
+//
+// All integers are little-endian. A client may pipeline any number of request
+// frames; the server answers them in order, tagging every response frame with
+// the request_id of the request it belongs to.
+enum class MessageType : uint8_t {
+  // Requests.
+  CREATE_DB = 1,
+  DROP_DB = 2,
+  USE_DB = 3,
+  CREATE_TABLE = 4,
+  DROP_TABLE = 5,
+  ALTER_TABLE = 6,
+  SELECT = 7,
+  INSERT = 8,
+  // Payload as for SELECT; answered by a one-column "plan" result holding the
+  // query's profile as JSON.
+  EXPLAIN_ANALYZE = 9,
+  // Payload: the table name. OK carries the table's row count.
+  ANALYZE_TABLE = 10,
+  // Payload: the table name and a u64 partition index. OK carries the number
+  // of rows dropped.
+  DROP_PARTITION = 11,
+  // Payload: the view name, the table name, a u32 count of columns, the where
+  // clauses as for SELECT and a u32 count of aggregates, each a u8 function
+  // and a column name (empty to count rows).
+  CREATE_VIEW = 12,
+  // Payload: the view name.
+  DROP_VIEW = 13,
+
+  // Responses. A request is answered either by a single OK or ERROR frame, or
+  // by a RESULT_HEADER, zero or more RESULT_BATCH frames and a RESULT_END.
+  OK = 64,
+  ERROR = 65,
+  RESULT_HEADER = 66,
+  RESULT_BATCH = 67,
+  RESULT_END = 68,
+};
+
+constexpr size_t kFrameHeaderSize = 9;
+constexpr uint32_t kMaxFramePayloadSize = 64u << 20;
+
+struct Frame {
+  uint32_t request_id;
+  MessageType type;
+  std::string payload;
+};
+
+class WireWriter {
+public:
+  void PutU8(uint8_t value);
+  void PutU32(uint32_t value);
+  void PutU64(uint64_t value);
+  void PutString(std::string_view value);
+
+  // A null value is written for missing cells.
+  void PutValue(const Value *value);
+
+  [[nodiscard]] auto buffer() const -> const std::string & {
+    return buffer_;
+  }
+
+  auto Release() -> std::string {
+    return std::move(buffer_);
+  }
+
+private:
+  std::string buffer_;
+};
+
+class WireReader {
+public:
+  explicit WireReader(std::string_view buffer) : buffer_(buffer) {}
+
+  auto GetU8() -> std::expected<uint8_t, Error>;
+  auto GetU32() -> std::expected<uint32_t, Error>;
+  auto GetU64() -> std::expected<uint64_t, Error>;
+  auto GetString() -> std::expected<std::string, Error>;
+
+  // Returns std::nullopt for a null value.
+  auto GetValue() -> std::expected<std::optional<Value>, Error>;
+
+  [[nodiscard]] auto empty() const {
+    return buffer_.empty();
+  }
+
+private:
+  auto Take(size_t size) -> std::expected<std::string_view, Error>;
+
+  std::string_view buffer_;
+};
+
+// Appends one encoded frame to `out`.
+void AppendFrame(std::string &out, uint32_t request_id, MessageType type,
+                 std::string_view payload);
+
+// Cuts one complete frame off the front of `buffer`. Returns std::nullopt when
+// more bytes are needed, and sets `consumed` to the size of the frame otherwise.
+auto ParseFrame(std::string_view buffer, size_t &consumed)
+    -> std::expected<std::optional<Frame>, Error>;
+
+using Request =
+    std::variant<CreateDatabaseQuery, DropDatabaseQuery, UseDatabaseQuery,
+                 CreateTableQuery, DropTableQuery, AlterTableQuery, SelectQuery,
+                 InsertQuery, ExplainAnalyzeQuery, AnalyzeTableQuery,
+                 DropPartitionQuery, CreateViewQuery, DropViewQuery>;
+
+auto EncodeRequest(uint32_t request_id, const Request &request) -> std::string;
+
+auto DecodeRequest(const Frame &frame) -> std::expected<Request, Error>;
+
+// Response encoders, used by the server.
+void AppendOk(std::string &out, uint32_t request_id, uint64_t affected_rows);
+
+void AppendError(std::string &out, uint32_t request_id, const Error &error);
+
+void AppendResultHeader(std::string &out, uint32_t request_id,
+                        const std::vector<std::string> &column_names);
+
+// `columns` is column-major: columns[c][r] is row r of column c.
+void AppendResultBatch(std::string &out, uint32_t request_id,
+                       const std::vector<std::vector<const Value *>> &columns);
+
+void AppendResultEnd(std::string &out, uint32_t request_id, uint64_t row_count);
+
+// A fully decoded response, assembled by the client from one or more frames.
+struct Response {
+  uint32_t request_id = 0;
+  std::optional<Error> error;
+  uint64_t affected_rows = 0;
+  uint64_t row_count = 0;
+  std::vector<std::string> column_names;
+  // Column-major, like RESULT_BATCH.
+  std::vector<std::vector<std::optional<Value>>> columns;
+};
+
+// Folds one response frame into `response`. Returns true once the frame that
+// completes the response has been applied.
+auto ApplyResponseFrame(const Frame &frame, Response &response)
+    -> std::expected<bool, Error>;
+
+} // namespace JustADb
@@ -0,0 +1,148 @@
+#include "result_cache.h"
+
+#include <algorithm>
+
+namespace JustADb {
+
+namespace {
+
+// Fields are length-prefixed so that no two queries run together into the
+// same key.
+void AppendField(std::string &key, const std::string &field) {
+  key += std::to_string(field.size());
+  key += ':';
+  key += field;
+}
+
+} // namespace
+
+auto ResultCache::Key(const Database &db, const SelectQuery &query)
+    -> std::string {
+  std::string key;
+  AppendField(key, db.name());
+  AppendField(key, query.table_name());
+  key += 'c';
+  for (const auto &column : query.columns()) {
+    AppendField(key, column.name());
+  }
+
+  // The where clauses are a conjunction, so their order does not matter.
+  std::vector<std::string> where_clauses;
+  for (const auto &where : query.where_clause()) {
+    std::string clause;
+    AppendField(clause, where.column());
+    clause += std::to_string(static_cast<int>(where.op()));
+    AppendField(clause, where.value());
+    where_clauses.push_back(std::move(clause));
+  }
+  std::ranges::sort(where_clauses);
+  key += 'w';
+  for (const auto &clause : where_clauses) {
+    key += clause;
+  }
+
+  if (const auto order_by = query.orderByClause(); order_by) {
+    key += 'o';
+    AppendField(key, order_by->column());
+    key += std::to_string(static_cast<int>(order_by->order()));
+  }
+  if (const auto limit = query.limit(); limit) {
+    key += 'l';
+    AppendField(key, std::to_string(*limit));
+  }
+  if (const auto join = query.join(); join) {
+    key += 'j';
+    AppendField(key, join->table());
+    AppendField(key, join->left_column());
+    AppendField(key, join->right_column());
+  }
+  return key;
+}
+
+auto ResultCache::CurrentVersions(const Database &db, const SelectQuery &query)
+    -> std::optional<Versions> {
+  Versions versions;
+  versions.catalog = db.catalog_version();
+  auto add = [&db, &versions](const std::string &name) {
+    const Table *table = nullptr;
+    if (const auto found = db.GetTable(name); found) {
+      table = *found;
+    } else if (const auto view = db.GetView(name); view) {
+      table = (*view)->table();
+    } else {
+      return false;
+    }
+    versions.tables.emplace_back(table, table->data_version(),
+                                 table->schema_version());
+    return true;
+  };
+  if (!add(query.table_name())) {
+    return std::nullopt;
+  }
+  if (const auto join = query.join(); join && !add(join->table())) {
+    return std::nullopt;
+  }
+  return versions;
+}
+
+auto ResultCache::Lookup(const std::string &key, const Versions &versions)
+    -> std::optional<Result> {
+  const std::lock_guard lock(mutex_);
+  const auto found = index_.find(key);
+  if (found == index_.end()) {
+    ++misses_;
+    return std::nullopt;
+  }
+  const auto entry = found->second;
+  if (entry->versions != versions) {
+    // A table changed since: the result is never current again.
+    Erase(entry);
+    ++misses_;
+    return std::nullopt;
+  }
+  entries_.splice(entries_.begin(), entries_, entry);
+  ++hits_;
+  return entry->result;
+}
+
+void ResultCache::Insert(std::string key, Versions versions, Result result) {
+  const auto bytes = key.size() + SizeOf(*result.rows);
+  const std::lock_guard lock(mutex_);
+  if (const auto found = index_.find(key); found != index_.end()) {
+    Erase(found->second);
+  }
+  while (!memory_.TryReserve(bytes)) {
+    if (entries_.empty()) {
+      return;
+    }
+    Erase(std::prev(entries_.end()));
+  }
+  entries_.push_front(
+      Entry{key, std::move(versions), std::move(result), bytes});
+  index_.emplace(std::move(key), entries_.begin());
+}
+
+auto ResultCache::SizeOf(const ResultBatch &rows) -> size_t {
+  const auto cells = rows.columns.size() * rows.row_count();
+  // At most one copy per cell.
+  const auto copies = rows.owners.empty() ? 0 : cells * sizeof(Value);
+  return sizeof(ResultBatch) + cells * sizeof(const Value *) + copies;
+}
+
+auto ResultCache::hits() const -> uint64_t {
+  const std::lock_guard lock(mutex_);
+  return hits_;
+}
+
+auto ResultCache::misses() const -> uint64_t {
+  const std::lock_guard lock(mutex_);
+  return misses_;
+}
+
+void ResultCache::Erase(std::list<Entry>::iterator entry) {
+  memory_.Release(entry->bytes);
+  index_.erase(entry->key);
+  entries_.erase(entry);
+}
+
+} // namespace JustADb
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "cursor.h"
+#include "ddl.h"
+#include "dml.h"
+#include "memory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace JustADb {
+
+// Results of selects, kept in least recently used order until they take more
+// than the cache's capacity. A result is stored with the versions of what it
+// was computed from: the database's catalog and every table the query read
+// (for a view, the view's table). A lookup only returns a result whose
+// versions are still current, and drops it otherwise, so no write has to
+// know about the cache. Thread-safe.
+//
+// The cached values are the tables' own, or copies the result keeps, as in
+// any ResultBatch, so a result stays readable after its tables change.
+class ResultCache {
+public:
+  struct Versions {
+    uint64_t catalog = 0;
+    // Each table with its data and schema versions.
+    std::vector<std::tuple<const Table *, uint64_t, uint64_t>> tables;
+
+    auto operator==(const Versions &other) const -> bool = default;
+  };
+
+  struct Result {
+    std::shared_ptr<const ResultBatch> rows;
+    std::vector<std::string> column_names;
+  };
+
+  // The cache's memory is tracked under the process tracker, and the
+  // capacity is its limit.
+  explicit ResultCache(size_t capacity_bytes)
+      : memory_("result cache", &MemoryTracker::Process(), capacity_bytes) {}
+
+  ResultCache(const ResultCache &) = delete;
+  auto operator=(const ResultCache &) -> ResultCache & = delete;
+
+  // Identifies the query in `db`, independent of the order of its where
+  // clauses.
+  static auto Key(const Database &db, const SelectQuery &query)
+      -> std::string;
+
+  // The current versions of what the query reads, or std::nullopt if it
+  // names a table or view that does not exist.
+  static auto CurrentVersions(const Database &db, const SelectQuery &query)
+      -> std::optional<Versions>;
+
+  auto Lookup(const std::string &key, const Versions &versions)
+      -> std::optional<Result>;
+
+  // Replaces any result under `key`; one larger than the capacity is not
+  // kept.
+  void Insert(std::string key, Versions versions, Result result);
+
+  // What a result takes in the cache.
+  static auto SizeOf(const ResultBatch &rows) -> size_t;
+
+  [[nodiscard]] auto capacity() const -> size_t {
+    return memory_.limit().value_or(0);
+  }
+
+  [[nodiscard]] auto hits() const -> uint64_t;
+  [[nodiscard]] auto misses() const -> uint64_t;
+  [[nodiscard]] auto bytes() const -> size_t {
+    return memory_.current();
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    Versions versions;
+    Result result;
+    size_t bytes;
+  };
+
+  void Erase(std::list<Entry>::iterator entry);
+
+  mutable std::mutex mutex_;
+  MemoryTracker memory_;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+} // namespace JustADb
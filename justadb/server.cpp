@@ -0,0 +1,705 @@
+#include "server.h"
+
+#include "dml.h"
+#include "result_cache.h"
+#include "statistics.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <exception>
+#include <type_traits>
+
+namespace JustADb {
+
+namespace {
+
+constexpr int kMaxEvents = 64;
+constexpr size_t kReadChunkSize = 64 * 1024;
+
+auto SystemError(const std::string &what) -> Error {
+  return Error(what + ": " + std::strerror(errno));
+}
+
+// Spooled frames are stored as records, each prefixed with its size, so that
+// they are read back whole.
+auto SpoolFrames(SpillFile &spool, const std::string &frames)
+    -> std::expected<void, Error> {
+  const uint64_t size = frames.size();
+  if (auto written = spool.Write(&size, sizeof(size)); !written) {
+    return written;
+  }
+  return spool.Write(frames.data(), frames.size());
+}
+
+// The next record, or an empty string after the last.
+auto ReadSpooledFrames(SpillFile &spool) -> std::expected<std::string, Error> {
+  uint64_t size = 0;
+  auto read = spool.Read(&size, sizeof(size));
+  if (!read) {
+    return std::unexpected(read.error());
+  }
+  if (*read == 0) {
+    return std::string();
+  }
+  std::string frames(size, '\0');
+  if (*read == sizeof(size)) {
+    read = spool.Read(frames.data(), frames.size());
+    if (!read) {
+      return std::unexpected(read.error());
+    }
+    if (*read == frames.size()) {
+      return frames;
+    }
+  }
+  return std::unexpected(Error("Spooled result is truncated"));
+}
+
+template <typename T>
+auto AffectedRows(const std::expected<T, Error> &result, uint64_t rows = 0)
+    -> std::expected<uint64_t, Error> {
+  if (!result) {
+    return std::unexpected(result.error());
+  }
+  return rows;
+}
+
+} // namespace
+
+Server::Server(DatabaseManager *db_manager, ServerOptions options)
+    : db_manager_(db_manager), options_(std::move(options)),
+      executors_(options_.executor_threads) {
+  if (options_.result_cache_bytes > 0) {
+    result_cache_ = std::make_unique<ResultCache>(options_.result_cache_bytes);
+  }
+}
+
+Server::~Server() {
+  Stop();
+}
+
+auto Server::Start() -> std::expected<void, Error> {
+  if (auto listening = Listen(); !listening) {
+    return listening;
+  }
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wakeup_fd_ < 0) {
+    return std::unexpected(SystemError("Cannot create event loop"));
+  }
+  for (int fd : {listen_fd_, wakeup_fd_}) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+  }
+
+  loop_thread_ = std::thread([this] { EventLoop(); });
+  return std::expected<void, Error>(std::in_place);
+}
+
+void Server::Stop() {
+  if (!loop_thread_.joinable()) {
+    return;
+  }
+  stopping_ = true;
+  uint64_t one = 1;
+  (void)write(wakeup_fd_, &one, sizeof(one));
+  loop_thread_.join();
+
+  // Nothing flushes any more; release executors blocked in Emit().
+  for (auto &[fd, connection] : connections_) {
+    {
+      std::lock_guard lock(connection->mutex);
+      connection->closed = true;
+    }
+    connection->flushed.notify_all();
+  }
+  executors_.Shutdown();
+
+  for (auto &[fd, connection] : connections_) {
+    close(fd);
+  }
+  connections_.clear();
+  for (int *fd : {&listen_fd_, &epoll_fd_, &wakeup_fd_}) {
+    close(*fd);
+    *fd = -1;
+  }
+  if (options_.unix_socket_path) {
+    unlink(options_.unix_socket_path->c_str());
+  }
+}
+
+auto Server::Listen() -> std::expected<void, Error> {
+  if (options_.unix_socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (options_.unix_socket_path->size() >= sizeof(address.sun_path)) {
+      return std::unexpected(Error("Unix socket path too long"));
+    }
+    std::strcpy(address.sun_path, options_.unix_socket_path->c_str());
+    unlink(address.sun_path);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0 ||
+        bind(listen_fd_, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) < 0) {
+      return std::unexpected(SystemError("Cannot bind unix socket"));
+    }
+  } else {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr) != 1) {
+      return std::unexpected(Error("Invalid listen address"));
+    }
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int reuse = 1;
+    if (listen_fd_ < 0 ||
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                   sizeof(reuse)) < 0 ||
+        bind(listen_fd_, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) < 0) {
+      return std::unexpected(SystemError("Cannot bind tcp socket"));
+    }
+
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr *>(&address), &length);
+    port_ = ntohs(address.sin_port);
+  }
+
+  if (listen(listen_fd_, SOMAXCONN) < 0) {
+    return std::unexpected(SystemError("Cannot listen"));
+  }
+  return std::expected<void, Error>(std::in_place);
+}
+
+void Server::EventLoop() {
+  epoll_event events[kMaxEvents];
+  while (!stopping_) {
+    const int count = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == listen_fd_) {
+        Accept();
+        continue;
+      }
+
+      if (fd == wakeup_fd_) {
+        uint64_t ignored;
+        (void)read(wakeup_fd_, &ignored, sizeof(ignored));
+        std::vector<std::shared_ptr<Connection>> writable;
+        {
+          std::lock_guard lock(writable_mutex_);
+          writable.swap(writable_);
+        }
+        for (const auto &connection : writable) {
+          Flush(connection);
+        }
+        continue;
+      }
+
+      auto it = connections_.find(fd);
+      if (it == connections_.end()) {
+        continue;
+      }
+      auto connection = it->second;
+      if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+        Close(connection);
+        continue;
+      }
+      if (events[i].events & EPOLLIN) {
+        Read(connection);
+      }
+      if (events[i].events & EPOLLOUT) {
+        Flush(connection);
+      }
+    }
+  }
+}
+
+void Server::Accept() {
+  while (true) {
+    const int fd = accept4(listen_fd_, nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    if (!options_.unix_socket_path) {
+      int no_delay = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    }
+
+    auto connection = std::make_shared<Connection>();
+    connection->fd = fd;
+    connections_[fd] = connection;
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+void Server::Read(const std::shared_ptr<Connection> &connection) {
+  char chunk[kReadChunkSize];
+  while (true) {
+    const ssize_t n = recv(connection->fd, chunk, sizeof(chunk), 0);
+    if (n > 0) {
+      connection->read_buffer.append(chunk, n);
+      continue;
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      Close(connection);
+      return;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    break;
+  }
+
+  // Cut every complete frame out of the buffer; a pipelining client may have
+  // sent many of them in a single segment.
+  std::vector<Frame> frames;
+  std::string_view buffer = connection->read_buffer;
+  size_t offset = 0;
+  while (true) {
+    size_t consumed = 0;
+    auto frame = ParseFrame(buffer.substr(offset), consumed);
+    if (!frame) {
+      Close(connection);
+      return;
+    }
+    if (!frame->has_value()) {
+      break;
+    }
+    frames.push_back(std::move(**frame));
+    offset += consumed;
+  }
+  connection->read_buffer.erase(0, offset);
+  if (frames.empty()) {
+    return;
+  }
+
+  bool schedule = false;
+  {
+    std::lock_guard lock(connection->mutex);
+    for (auto &frame : frames) {
+      connection->pending.push_back(std::move(frame));
+    }
+    if (!connection->executing) {
+      connection->executing = true;
+      schedule = true;
+    }
+  }
+  if (schedule) {
+    executors_.Submit([this, connection] { Drain(connection); });
+  }
+}
+
+void Server::Flush(const std::shared_ptr<Connection> &connection) {
+  bool failed = false;
+  {
+    std::lock_guard lock(connection->mutex);
+    if (connection->closed) {
+      return;
+    }
+
+    auto &buffer = connection->write_buffer;
+    size_t written = 0;
+    while (written < buffer.size()) {
+      const ssize_t n = send(connection->fd, buffer.data() + written,
+                             buffer.size() - written, MSG_NOSIGNAL);
+      if (n > 0) {
+        written += n;
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else {
+        failed = n < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+        break;
+      }
+    }
+    buffer.erase(0, written);
+    if (written > 0) {
+      connection->flushed.notify_all();
+    }
+
+    // Only wait for EPOLLOUT while the socket buffer is full.
+    const bool want_write = !buffer.empty();
+    if (!failed && want_write != connection->want_write) {
+      connection->want_write = want_write;
+      epoll_event event{};
+      event.events = EPOLLIN | (want_write ? static_cast<uint32_t>(EPOLLOUT)
+                                           : uint32_t{0});
+      event.data.fd = connection->fd;
+      epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection->fd, &event);
+    }
+  }
+  if (failed) {
+    Close(connection);
+  }
+}
+
+void Server::Close(const std::shared_ptr<Connection> &connection) {
+  {
+    std::lock_guard lock(connection->mutex);
+    if (connection->closed) {
+      return;
+    }
+    connection->closed = true;
+    connection->pending.clear();
+  }
+  connection->flushed.notify_all();
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->fd, nullptr);
+  connections_.erase(connection->fd);
+  close(connection->fd);
+}
+
+void Server::NotifyWritable(const std::shared_ptr<Connection> &connection) {
+  {
+    std::lock_guard lock(writable_mutex_);
+    writable_.push_back(connection);
+  }
+  uint64_t one = 1;
+  (void)write(wakeup_fd_, &one, sizeof(one));
+}
+
+void Server::Drain(const std::shared_ptr<Connection> &connection) {
+  while (true) {
+    Frame frame;
+    {
+      std::lock_guard lock(connection->mutex);
+      if (connection->closed || connection->pending.empty()) {
+        connection->executing = false;
+        return;
+      }
+      frame = std::move(connection->pending.front());
+      connection->pending.pop_front();
+    }
+    // A failing request must not take the server down with it.
+    try {
+      Execute(frame, connection);
+    } catch (const std::exception &e) {
+      std::string out;
+      AppendError(out, frame.request_id,
+                  Error(std::string("Internal error: ") + e.what()));
+      Emit(connection, std::move(out));
+    }
+  }
+}
+
+auto Server::Emit(const std::shared_ptr<Connection> &connection,
+                  std::string frames) -> bool {
+  return *Enqueue(connection, frames, true);
+}
+
+auto Server::TryEmit(const std::shared_ptr<Connection> &connection,
+                     std::string &frames) -> std::optional<bool> {
+  return Enqueue(connection, frames, false);
+}
+
+auto Server::Enqueue(const std::shared_ptr<Connection> &connection,
+                     std::string &frames, bool wait) -> std::optional<bool> {
+  bool notify = false;
+  {
+    std::unique_lock lock(connection->mutex);
+    auto has_room = [&connection] {
+      return connection->closed ||
+             connection->write_buffer.size() < kWriteHighWatermark;
+    };
+    if (wait) {
+      connection->flushed.wait(lock, has_room);
+    } else if (!has_room()) {
+      return std::nullopt;
+    }
+    if (connection->closed) {
+      return false;
+    }
+    // A non-empty buffer already has a flush on the way, so responses of
+    // pipelined requests coalesce into a single wakeup and write.
+    notify = connection->write_buffer.empty();
+    connection->write_buffer.append(frames);
+    frames.clear();
+  }
+  if (notify) {
+    NotifyWritable(connection);
+  }
+  return true;
+}
+
+void Server::Execute(const Frame &frame,
+                     const std::shared_ptr<Connection> &connection) {
+  std::string out;
+  const auto request_id = frame.request_id;
+  auto request = DecodeRequest(frame);
+  if (!request) {
+    AppendError(out, request_id, request.error());
+    Emit(connection, std::move(out));
+    return;
+  }
+
+  if (const auto *select = std::get_if<SelectQuery>(&*request)) {
+    ExecuteSelect(request_id, *select, connection);
+    return;
+  }
+  if (const auto *explain = std::get_if<ExplainAnalyzeQuery>(&*request)) {
+    ExecuteExplainAnalyze(request_id, *explain, connection);
+    return;
+  }
+
+  std::unique_lock lock(catalog_latch_);
+
+  // DdlQueryExec works on the manager's current database, which is shared by
+  // all connections; point it at this connection's database first.
+  std::optional<Database *> database;
+  if (connection->database) {
+    database = db_manager_->GetDatabase(*connection->database);
+    if (database) {
+      db_manager_->SetCurrentDatabase(*database);
+    }
+  }
+
+  DdlQueryExec ddl_exec(db_manager_);
+  const auto result = std::visit(
+      [&](const auto &query) -> std::expected<uint64_t, Error> {
+        using Query = std::decay_t<decltype(query)>;
+        if constexpr (std::is_same_v<Query, CreateDatabaseQuery>) {
+          return AffectedRows(ddl_exec.ExecuteCreateDatabaseQuery(query));
+        } else if constexpr (std::is_same_v<Query, DropDatabaseQuery>) {
+          if (connection->database == query.db_name()) {
+            connection->database.reset();
+          }
+          return AffectedRows(ddl_exec.ExecuteDropDatabaseQuery(query));
+        } else if constexpr (std::is_same_v<Query, UseDatabaseQuery>) {
+          auto used = ddl_exec.ExecuteUseDatabaseQuery(query);
+          if (used) {
+            connection->database = query.db_name();
+          }
+          return AffectedRows(used);
+        } else if constexpr (std::is_same_v<Query, SelectQuery> ||
+                             std::is_same_v<Query, ExplainAnalyzeQuery>) {
+          return std::unexpected(Error("Unreachable"));
+        } else {
+          if (!database) {
+            return std::unexpected(Error("No database selected"));
+          }
+          if constexpr (std::is_same_v<Query, CreateTableQuery>) {
+            const auto created = ddl_exec.ExecuteCreateTableQuery(query);
+            if (!created) {
+              // Only a created table takes the decoded columns.
+              for (const auto *column : query.columns()) {
+                delete column->default_value();
+                delete column;
+              }
+            }
+            return AffectedRows(created);
+          } else if constexpr (std::is_same_v<Query, DropTableQuery>) {
+            return AffectedRows(ddl_exec.ExecuteDropTableQuery(query));
+          } else if constexpr (std::is_same_v<Query, AlterTableQuery>) {
+            const auto altered = ddl_exec.ExecuteAlterTableQuery(query);
+            auto table = (*database)->GetModifiableTable(query.table_name());
+            if (altered && table && (*table)->conversion_pending()) {
+              ScheduleConversion(*table);
+            }
+            return AffectedRows(altered);
+          } else if constexpr (std::is_same_v<Query, AnalyzeTableQuery>) {
+            const auto statistics = ddl_exec.ExecuteAnalyzeTableQuery(query);
+            return AffectedRows(statistics,
+                                statistics ? (*statistics)->row_count() : 0);
+          } else if constexpr (std::is_same_v<Query, DropPartitionQuery>) {
+            const auto dropped = ddl_exec.ExecuteDropPartitionQuery(query);
+            return AffectedRows(dropped, dropped ? *dropped : 0);
+          } else if constexpr (std::is_same_v<Query, CreateViewQuery>) {
+            DmlQueryExec dml_exec(**database);
+            return AffectedRows(dml_exec.ExecuteCreateViewQuery(query));
+          } else if constexpr (std::is_same_v<Query, DropViewQuery>) {
+            DmlQueryExec dml_exec(**database);
+            return AffectedRows(dml_exec.ExecuteDropViewQuery(query));
+          } else {
+            DmlQueryExec dml_exec(**database);
+            const auto inserted = dml_exec.ExecuteInsertQuery(query);
+            return AffectedRows(inserted, inserted ? inserted->size() : 0);
+          }
+        }
+      },
+      *request);
+
+  if (result) {
+    AppendOk(out, request_id, *result);
+  } else {
+    AppendError(out, request_id, result.error());
+  }
+  lock.unlock();
+  Emit(connection, std::move(out));
+}
+
+void Server::ScheduleConversion(Table *table) {
+  // Tables are never freed, so the task stays safe even if the table is
+  // dropped before it runs.
+  executors_.Submit([this, table] {
+    std::unique_lock lock(catalog_latch_);
+    if (!table->ConvertRows(options_.conversion_chunk_rows)) {
+      lock.unlock();
+      ScheduleConversion(table);
+    }
+  });
+}
+
+void Server::ExecuteSelect(uint32_t request_id, const SelectQuery &query,
+                           const std::shared_ptr<Connection> &connection) {
+  std::string out;
+  std::shared_lock lock(catalog_latch_);
+
+  std::optional<Database *> database;
+  if (connection->database) {
+    database = db_manager_->GetDatabase(*connection->database);
+  }
+  if (!database) {
+    lock.unlock();
+    AppendError(out, request_id, Error("No database selected"));
+    Emit(connection, std::move(out));
+    return;
+  }
+
+  DmlQueryExec dml_exec(**database);
+  dml_exec.set_query_memory_limit(options_.query_memory_limit);
+  dml_exec.set_result_cache(result_cache_.get());
+  auto cursor = dml_exec.ExecuteSelectQuery(query, options_.batch_rows);
+  if (!cursor) {
+    lock.unlock();
+    AppendError(out, request_id, cursor.error());
+    Emit(connection, std::move(out));
+    return;
+  }
+
+  // Batches go out as they are produced while the client keeps up. Once it
+  // falls behind, the rest of the result is spooled to disk and sent after
+  // the latch is released, so that writers never wait on a slow client and
+  // the result is never held in memory whole.
+  AppendResultHeader(out, request_id, cursor->column_names());
+  std::optional<SpillFile> spool;
+  while (true) {
+    auto batch = cursor->NextBatch();
+    if (!batch) {
+      // The header has been sent; the error ends the response instead.
+      AppendError(out, request_id, batch.error());
+      break;
+    }
+    if (!batch->has_value()) {
+      AppendResultEnd(out, request_id, cursor->rows_produced());
+      break;
+    }
+    AppendResultBatch(out, request_id, (*batch)->columns);
+    if (!spool) {
+      const auto emitted = TryEmit(connection, out);
+      if (emitted) {
+        if (!*emitted) {
+          // The client went away: stop producing rows.
+          cursor->Close();
+          return;
+        }
+        continue;
+      }
+      auto file = SpillFile::Create();
+      if (!file) {
+        AppendError(out, request_id, file.error());
+        break;
+      }
+      spool = std::move(*file);
+    }
+    auto spooled = SpoolFrames(*spool, out);
+    out.clear();
+    if (!spooled) {
+      AppendError(out, request_id, spooled.error());
+      break;
+    }
+  }
+  cursor->Close();
+  lock.unlock();
+  if (spool) {
+    const auto sent = EmitSpooled(connection, *spool);
+    if (sent && !*sent) {
+      return;
+    }
+    if (!sent) {
+      // Only whole frames went out, so an error can still end the response.
+      out.clear();
+      AppendError(out, request_id, sent.error());
+    }
+  }
+  Emit(connection, std::move(out));
+}
+
+auto Server::EmitSpooled(const std::shared_ptr<Connection> &connection,
+                         SpillFile &spool) -> std::expected<bool, Error> {
+  if (auto rewound = spool.Rewind(); !rewound) {
+    return std::unexpected(rewound.error());
+  }
+  while (true) {
+    auto frames = ReadSpooledFrames(spool);
+    if (!frames) {
+      return std::unexpected(frames.error());
+    }
+    if (frames->empty()) {
+      return true;
+    }
+    if (!Emit(connection, std::move(*frames))) {
+      return false;
+    }
+  }
+}
+
+void Server::ExecuteExplainAnalyze(
+    uint32_t request_id, const ExplainAnalyzeQuery &query,
+    const std::shared_ptr<Connection> &connection) {
+  std::string out;
+  std::shared_lock lock(catalog_latch_);
+
+  std::optional<Database *> database;
+  if (connection->database) {
+    database = db_manager_->GetDatabase(*connection->database);
+  }
+  if (!database) {
+    lock.unlock();
+    AppendError(out, request_id, Error("No database selected"));
+    Emit(connection, std::move(out));
+    return;
+  }
+
+  DmlQueryExec dml_exec(**database);
+  dml_exec.set_query_memory_limit(options_.query_memory_limit);
+  auto profile = dml_exec.ExecuteExplainAnalyzeQuery(query);
+  lock.unlock();
+  if (!profile) {
+    AppendError(out, request_id, profile.error());
+    Emit(connection, std::move(out));
+    return;
+  }
+
+  const Value plan(profile->ToJson());
+  AppendResultHeader(out, request_id, {"plan"});
+  AppendResultBatch(out, request_id, {{&plan}});
+  AppendResultEnd(out, request_id, 1);
+  Emit(connection, std::move(out));
+}
+
+} // namespace JustADb
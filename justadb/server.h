@@ -0,0 +1,171 @@
+#pragma once
+
+#include "ddl.h"
+#include "memory.h"
+#include "protocol.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace JustADb {
+
+struct ServerOptions {
+  // Listens on host:port over TCP unless `unix_socket_path` is set. Port 0
+  // picks a free port, see Server::port().
+  std::string host = "127.0.0.1";
+  uint16_t port = 0;
+  std::optional<std::string> unix_socket_path;
+
+  size_t executor_threads = std::thread::hardware_concurrency();
+
+  // Maximum number of rows per RESULT_BATCH frame.
+  size_t batch_rows = 1024;
+
+  // Rows a column type change converts per turn; the catalog latch is held
+  // exclusively for one turn at a time.
+  size_t conversion_chunk_rows = 4096;
+
+  // Bytes one SELECT may hold before its sorts and joins spill to disk.
+  std::optional<size_t> query_memory_limit;
+
+  // Bytes of SELECT results kept for repeated queries; 0 turns the result
+  // cache off.
+  size_t result_cache_bytes = 0;
+};
+
+// Serves the wire protocol from protocol.h. A single thread runs an epoll loop
+// that accepts connections, reads and parses request frames and writes
+// responses back; the queries themselves run on a pool of executor threads.
+//
+// Requests from one connection execute one after another in arrival order, so
+// a client can pipeline dependent requests (e.g. USE_DB followed by SELECT).
+// Requests from different connections run in parallel: DDL and INSERT take the
+// catalog latch exclusively, SELECT takes it shared, but never while waiting
+// for a slow client to read its result. ALTER TABLE changing a column's type
+// returns at once; the rows are converted by executor tasks in between other
+// requests.
+class Server {
+public:
+  static constexpr size_t kWriteHighWatermark = 4 << 20;
+
+  Server(DatabaseManager *db_manager, ServerOptions options);
+
+  Server(const Server &) = delete;
+  auto operator=(const Server &) -> Server & = delete;
+
+  ~Server();
+
+  // Binds the listening socket and starts the event loop thread.
+  auto Start() -> std::expected<void, Error>;
+
+  void Stop();
+
+  // The bound TCP port, useful when ServerOptions::port is 0.
+  [[nodiscard]] auto port() const {
+    return port_;
+  }
+
+private:
+  struct Connection {
+    int fd;
+    std::string read_buffer;
+
+    std::mutex mutex;
+    std::deque<Frame> pending;
+    bool executing = false;
+    std::string write_buffer;
+    // Signalled whenever the event loop has written some of `write_buffer`.
+    std::condition_variable flushed;
+    bool closed = false;
+    bool want_write = false;
+
+    // The database selected by this connection's last USE_DB.
+    std::optional<std::string> database;
+  };
+
+  auto Listen() -> std::expected<void, Error>;
+  void EventLoop();
+  void Accept();
+  void Read(const std::shared_ptr<Connection> &connection);
+  void Flush(const std::shared_ptr<Connection> &connection);
+  void Close(const std::shared_ptr<Connection> &connection);
+
+  // Runs the queued requests of `connection` on an executor thread.
+  void Drain(const std::shared_ptr<Connection> &connection);
+
+  // Executes one request and emits its response frames.
+  void Execute(const Frame &frame,
+               const std::shared_ptr<Connection> &connection);
+
+  // Streams the result batches as the cursor produces them.
+  void ExecuteSelect(uint32_t request_id, const SelectQuery &query,
+                     const std::shared_ptr<Connection> &connection);
+
+  void ExecuteExplainAnalyze(uint32_t request_id,
+                             const ExplainAnalyzeQuery &query,
+                             const std::shared_ptr<Connection> &connection);
+
+  // Converts one chunk of the table's pending type change, then queues the
+  // next chunk behind whatever requests arrived meanwhile.
+  void ScheduleConversion(Table *table);
+
+  // Queues response frames for writing. Blocks while more than
+  // kWriteHighWatermark bytes are waiting for a slow client, so a large
+  // result is produced no faster than the client consumes it. Returns false
+  // once the connection is gone.
+  auto Emit(const std::shared_ptr<Connection> &connection, std::string frames)
+      -> bool;
+
+  // Emit() that does not wait: returns std::nullopt, leaving `frames` as they
+  // are, while too much is waiting for the client. Clears `frames` otherwise.
+  auto TryEmit(const std::shared_ptr<Connection> &connection,
+               std::string &frames) -> std::optional<bool>;
+
+  auto Enqueue(const std::shared_ptr<Connection> &connection,
+               std::string &frames, bool wait) -> std::optional<bool>;
+
+  // Emit()s the frames spooled for a client that fell behind. Returns false
+  // once the connection is gone.
+  auto EmitSpooled(const std::shared_ptr<Connection> &connection,
+                   SpillFile &spool) -> std::expected<bool, Error>;
+
+  // Wakes the event loop to write out responses of `connection`.
+  void NotifyWritable(const std::shared_ptr<Connection> &connection);
+
+  DatabaseManager *db_manager_;
+  ServerOptions options_;
+  uint16_t port_ = 0;
+
+  int listen_fd_ = -1;
+  int epoll_fd_ = -1;
+  int wakeup_fd_ = -1;
+  std::atomic<bool> stopping_ = false;
+  std::thread loop_thread_;
+
+  std::unordered_map<int, std::shared_ptr<Connection>> connections_;
+
+  std::mutex writable_mutex_;
+  std::vector<std::shared_ptr<Connection>> writable_;
+
+  std::shared_mutex catalog_latch_;
+
+  std::unique_ptr<ResultCache> result_cache_;
+
+  // Declared last so that it is destroyed (and its workers joined) first.
+  ThreadPool executors_;
+};
+
+} // namespace JustADb
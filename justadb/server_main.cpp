@@ -0,0 +1,79 @@
+#include "ddl.h"
+#include "server.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+namespace {
+
+auto FlagValue(std::string_view arg, std::string_view flag)
+    -> std::optional<std::string> {
+  if (arg.starts_with(flag) && arg.size() > flag.size() &&
+      arg[flag.size()] == '=') {
+    return std::string(arg.substr(flag.size() + 1));
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  JustADb::ServerOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (auto value = FlagValue(arg, "--host")) {
+      options.host = *value;
+    } else if (auto value = FlagValue(arg, "--port")) {
+      options.port = static_cast<uint16_t>(std::stoi(*value));
+    } else if (auto value = FlagValue(arg, "--unix")) {
+      options.unix_socket_path = *value;
+    } else if (auto value = FlagValue(arg, "--threads")) {
+      options.executor_threads = std::stoul(*value);
+    } else if (auto value = FlagValue(arg, "--batch_rows")) {
+      options.batch_rows = std::stoul(*value);
+    } else if (auto value = FlagValue(arg, "--query_memory")) {
+      options.query_memory_limit = std::stoul(*value);
+    } else if (auto value = FlagValue(arg, "--spill_dir")) {
+      JustADb::SpillFile::set_directory(*value);
+    } else if (auto value = FlagValue(arg, "--result_cache")) {
+      options.result_cache_bytes = std::stoul(*value);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--host=ADDR] [--port=N] [--unix=PATH] [--threads=N]"
+                   " [--batch_rows=N] [--query_memory=BYTES]"
+                   " [--spill_dir=PATH] [--result_cache=BYTES]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  // Block the shutdown signals before any thread is started so that only
+  // sigwait() below ever sees them.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  JustADb::DatabaseManager db_manager;
+  JustADb::Server server(&db_manager, options);
+  if (auto started = server.Start(); !started) {
+    std::cerr << "Error: " << started.error().message() << std::endl;
+    return 1;
+  }
+
+  if (options.unix_socket_path) {
+    std::cout << "Listening on " << *options.unix_socket_path << std::endl;
+  } else {
+    std::cout << "Listening on " << options.host << ":" << server.port()
+              << std::endl;
+  }
+
+  int signal = 0;
+  sigwait(&signals, &signal);
+  server.Stop();
+  return 0;
+}
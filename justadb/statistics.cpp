@@ -0,0 +1,253 @@
+#include "statistics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace JustADb {
+
+namespace {
+
+auto ToNumber(const Value &value) -> std::optional<double> {
+  if (const auto *i = std::get_if<int>(&value.value())) {
+    return *i;
+  }
+  if (const auto *f = std::get_if<float>(&value.value())) {
+    return *f;
+  }
+  return std::nullopt;
+}
+
+auto Less(const Value &lhs, const Value &rhs) -> bool {
+  return lhs.value() < rhs.value();
+}
+
+} // namespace
+
+HyperLogLog::HyperLogLog(uint8_t precision)
+    : precision_(precision), registers_(size_t{1} << precision, 0) {}
+
+void HyperLogLog::Add(uint64_t hash) {
+  const auto index = hash >> (64 - precision_);
+  // The rank of the first set bit among the remaining 64 - precision bits.
+  const auto rest = hash << precision_;
+  const auto rank = static_cast<uint8_t>(
+      rest == 0 ? 64 - precision_ + 1 : std::countl_zero(rest) + 1);
+  registers_[index] = std::max(registers_[index], rank);
+}
+
+auto HyperLogLog::Estimate() const -> double {
+  const auto m = static_cast<double>(registers_.size());
+  double sum = 0;
+  size_t zeros = 0;
+  for (const auto rank : registers_) {
+    sum += std::ldexp(1.0, -rank);
+    zeros += rank == 0;
+  }
+  const double alpha = 0.7213 / (1 + 1.079 / m);
+  const double estimate = alpha * m * m / sum;
+  // Linear counting is more accurate while many registers are still empty.
+  if (estimate <= 2.5 * m && zeros > 0) {
+    return m * std::log(m / zeros);
+  }
+  return estimate;
+}
+
+auto Histogram::Build(const std::vector<const Value *> &sorted) -> Histogram {
+  Histogram histogram;
+  if (sorted.empty()) {
+    return histogram;
+  }
+  const auto buckets = std::min(kMaxBuckets, sorted.size());
+  histogram.bounds_.push_back(*sorted.front());
+  size_t begin = 0;
+  for (size_t bucket = 1; bucket <= buckets; ++bucket) {
+    const auto end = sorted.size() * bucket / buckets;
+    histogram.bounds_.push_back(*sorted[end - 1]);
+    histogram.counts_.push_back(end - begin);
+    begin = end;
+  }
+  histogram.total_ = sorted.size();
+  return histogram;
+}
+
+void Histogram::Add(const Value &value) {
+  if (counts_.empty()) {
+    return;
+  }
+  ++total_;
+  if (Less(value, bounds_.front())) {
+    bounds_.front() = value;
+    ++counts_.front();
+    return;
+  }
+  if (Less(bounds_.back(), value)) {
+    bounds_.back() = value;
+    ++counts_.back();
+    return;
+  }
+  const auto upper = std::lower_bound(bounds_.begin() + 1, bounds_.end(),
+                                      value, Less);
+  ++counts_[upper - bounds_.begin() - 1];
+}
+
+auto Histogram::FractionBelow(const Value &value, bool inclusive) const
+    -> double {
+  if (total_ == 0) {
+    return 0;
+  }
+  double below = 0;
+  for (size_t bucket = 0; bucket < counts_.size(); ++bucket) {
+    const auto &low = bounds_[bucket];
+    const auto &high = bounds_[bucket + 1];
+    if (inclusive ? !Less(value, high) : Less(high, value)) {
+      below += counts_[bucket];
+      continue;
+    }
+    if (inclusive ? Less(value, low) : !Less(low, value)) {
+      break;
+    }
+    // `value` falls inside this bucket.
+    double fraction = 0.5;
+    const auto number = ToNumber(value);
+    const auto low_number = ToNumber(low);
+    const auto high_number = ToNumber(high);
+    if (number && low_number && high_number && *high_number > *low_number) {
+      fraction = (*number - *low_number) / (*high_number - *low_number);
+    }
+    below += fraction * counts_[bucket];
+    break;
+  }
+  return below / total_;
+}
+
+auto ColumnStatistics::null_fraction() const -> double {
+  return row_count_ == 0 ? 0 : static_cast<double>(null_count_) / row_count_;
+}
+
+auto ColumnStatistics::distinct_count() const -> double {
+  // The estimate may overshoot on tiny columns.
+  return std::min(distinct_.Estimate(),
+                  static_cast<double>(row_count_ - null_count_));
+}
+
+auto ColumnStatistics::EqualFraction(const Value &value) const -> double {
+  if (row_count_ == 0) {
+    return 0;
+  }
+  uint64_t common_rows = 0;
+  for (const auto &[common, rows] : most_common_values_) {
+    if (common.value() == value.value()) {
+      return static_cast<double>(rows) / row_count_;
+    }
+    common_rows += rows;
+  }
+  // Spread the remaining rows evenly over the remaining distinct values.
+  const double other_rows =
+      static_cast<double>(row_count_ - null_count_) - common_rows;
+  const double other_values =
+      distinct_count() - static_cast<double>(most_common_values_.size());
+  if (other_rows <= 0 || other_values < 1) {
+    return 0;
+  }
+  return other_rows / other_values / row_count_;
+}
+
+void ColumnStatistics::Add(const Value *value) {
+  ++row_count_;
+  if (value == nullptr) {
+    ++null_count_;
+    return;
+  }
+  distinct_.Add(HashValue(*value));
+  histogram_.Add(*value);
+  for (auto &[common, rows] : most_common_values_) {
+    if (common.value() == value->value()) {
+      ++rows;
+      break;
+    }
+  }
+}
+
+auto TableStatistics::Analyze(const Table &table)
+    -> std::unique_ptr<TableStatistics> {
+  std::unique_ptr<TableStatistics> statistics(new TableStatistics());
+  const auto tuples = table.tuples();
+  statistics->row_count_ = tuples.size();
+  for (const auto *column : table.columns()) {
+    auto &column_statistics = statistics->columns_[column];
+    column_statistics.row_count_ = tuples.size();
+
+    std::vector<const Value *> values;
+    values.reserve(tuples.size());
+    for (const auto *tuple : tuples) {
+      const auto *value = column->Read(*tuple);
+      if (value == nullptr) {
+        ++column_statistics.null_count_;
+        continue;
+      }
+      column_statistics.distinct_.Add(HashValue(*value));
+      values.push_back(value);
+    }
+    std::sort(values.begin(), values.end(),
+              [](const Value *lhs, const Value *rhs) {
+                return Less(*lhs, *rhs);
+              });
+    column_statistics.histogram_ = Histogram::Build(values);
+
+    // Runs of equal values in sorted order; a value is only worth keeping if
+    // it repeats.
+    std::vector<std::pair<const Value *, uint64_t>> runs;
+    for (const auto *value : values) {
+      if (!runs.empty() && runs.back().first->value() == value->value()) {
+        ++runs.back().second;
+      } else {
+        runs.emplace_back(value, 1);
+      }
+    }
+    std::erase_if(runs, [](const auto &run) { return run.second < 2; });
+    const auto kept =
+        std::min(ColumnStatistics::kMaxMostCommonValues, runs.size());
+    std::partial_sort(runs.begin(), runs.begin() + kept, runs.end(),
+                      [](const auto &lhs, const auto &rhs) {
+                        return lhs.second > rhs.second;
+                      });
+    for (size_t i = 0; i < kept; ++i) {
+      column_statistics.most_common_values_.emplace_back(*runs[i].first,
+                                                         runs[i].second);
+    }
+  }
+  return statistics;
+}
+
+void TableStatistics::Add(const Tuple &tuple) {
+  ++row_count_;
+  ++rows_since_analyze_;
+  for (auto &[column, column_statistics] : columns_) {
+    column_statistics.Add(column->Read(tuple));
+  }
+}
+
+void TableStatistics::AddColumn(const Column *column) {
+  if (column->default_value() != nullptr) {
+    // Existing rows read the default; leave the column to the next ANALYZE.
+    return;
+  }
+  auto &column_statistics = columns_[column];
+  column_statistics.row_count_ = row_count_;
+  column_statistics.null_count_ = row_count_;
+}
+
+void TableStatistics::DropColumn(const Column *column) {
+  columns_.erase(column);
+}
+
+auto TableStatistics::GetColumn(const Column *column) const
+    -> std::optional<const ColumnStatistics *> {
+  if (auto it = columns_.find(column); it != columns_.end()) {
+    return &it->second;
+  }
+  return std::nullopt;
+}
+
+} // namespace JustADb
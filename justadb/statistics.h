@@ -0,0 +1,135 @@
+#pragma once
+
+#include "ddl.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace JustADb {
+
+// Approximate distinct counting in 2^precision one-byte registers.
+class HyperLogLog {
+public:
+  explicit HyperLogLog(uint8_t precision = 12);
+
+  void Add(uint64_t hash);
+
+  [[nodiscard]] auto Estimate() const -> double;
+
+private:
+  uint8_t precision_;
+  std::vector<uint8_t> registers_;
+};
+
+// Equi-depth when built: every bucket starts with about the same number of
+// values. Later inserts only bump the count of the bucket they fall into.
+class Histogram {
+public:
+  static constexpr size_t kMaxBuckets = 64;
+
+  // `sorted` must be in ascending order.
+  static auto Build(const std::vector<const Value *> &sorted) -> Histogram;
+
+  void Add(const Value &value);
+
+  // The fraction of the values that are below `value` (or equal to it, with
+  // `inclusive`), interpolating within a bucket for numeric columns.
+  [[nodiscard]] auto FractionBelow(const Value &value, bool inclusive) const
+      -> double;
+
+  [[nodiscard]] auto empty() const {
+    return counts_.empty();
+  }
+
+  [[nodiscard]] auto bucket_count() const {
+    return counts_.size();
+  }
+
+private:
+  // bounds_[i] and bounds_[i + 1] delimit bucket i, both inclusive.
+  std::vector<Value> bounds_;
+  std::vector<uint64_t> counts_;
+  uint64_t total_ = 0;
+};
+
+class ColumnStatistics {
+public:
+  static constexpr size_t kMaxMostCommonValues = 16;
+
+  // Rows seen, NULL included.
+  [[nodiscard]] auto row_count() const {
+    return row_count_;
+  }
+
+  [[nodiscard]] auto null_count() const {
+    return null_count_;
+  }
+
+  [[nodiscard]] auto null_fraction() const -> double;
+
+  [[nodiscard]] auto distinct_count() const -> double;
+
+  [[nodiscard]] auto histogram() const -> const Histogram & {
+    return histogram_;
+  }
+
+  // The most frequent values with their number of rows, most common first.
+  [[nodiscard]] auto most_common_values() const
+      -> const std::vector<std::pair<Value, uint64_t>> & {
+    return most_common_values_;
+  }
+
+  // The fraction of the rows equal to `value`.
+  [[nodiscard]] auto EqualFraction(const Value &value) const -> double;
+
+private:
+  friend class TableStatistics;
+
+  void Add(const Value *value);
+
+  uint64_t row_count_ = 0;
+  uint64_t null_count_ = 0;
+  HyperLogLog distinct_;
+  Histogram histogram_;
+  std::vector<std::pair<Value, uint64_t>> most_common_values_;
+};
+
+// Collected by ANALYZE and kept current as rows are inserted.
+class TableStatistics {
+public:
+  static auto Analyze(const Table &table) -> std::unique_ptr<TableStatistics>;
+
+  // Folds a newly inserted row in.
+  void Add(const Tuple &tuple);
+
+  // Called when a column is added after ANALYZE. Without a default it starts
+  // out all NULL.
+  void AddColumn(const Column *column);
+
+  void DropColumn(const Column *column);
+
+  [[nodiscard]] auto row_count() const {
+    return row_count_;
+  }
+
+  // Rows inserted since ANALYZE, which the histograms and most common values
+  // only partly reflect.
+  [[nodiscard]] auto rows_since_analyze() const {
+    return rows_since_analyze_;
+  }
+
+  // Keyed by column rather than name so that a rename keeps its statistics.
+  [[nodiscard]] auto GetColumn(const Column *column) const
+      -> std::optional<const ColumnStatistics *>;
+
+private:
+  uint64_t row_count_ = 0;
+  uint64_t rows_since_analyze_ = 0;
+  std::unordered_map<const Column *, ColumnStatistics> columns_;
+};
+
+} // namespace JustADb
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace JustADb {
+
+// A fixed set of worker threads draining a FIFO task queue.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t thread_count);
+
+  ThreadPool(const ThreadPool &) = delete;
+  auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+
+  ~ThreadPool();
+
+  void Submit(std::function<void()> task);
+
+  // Runs the tasks that are already queued, then joins the workers. Tasks
+  // submitted after this call are dropped.
+  void Shutdown();
+
+  [[nodiscard]] auto thread_count() const {
+    return workers_.size();
+  }
+
+private:
+  void WorkerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+} // namespace JustADb
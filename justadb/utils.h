@@ -8,6 +8,7 @@ class Error {
 public:
   enum class Kind {
     NoColumnFound,
+    MemoryLimitExceeded,
     Unknown,
   };
 
@@ -0,0 +1,327 @@
+#include "view.h"
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <unordered_set>
+
+namespace JustADb {
+
+namespace {
+
+auto SaturatedInt(int64_t value) -> Value {
+  return Value(static_cast<int>(std::clamp<int64_t>(value, INT_MIN, INT_MAX)));
+}
+
+} // namespace
+
+auto MaterializedView::Create(const CreateViewQuery &query,
+                              const Table &table)
+    -> std::expected<std::unique_ptr<MaterializedView>, Error> {
+  if (query.view_name().empty()) {
+    return std::unexpected(Error("View name cannot be empty"));
+  }
+  if (query.columns().empty() && query.aggregates().empty()) {
+    return std::unexpected(Error("A view needs columns or aggregates"));
+  }
+  auto find_column = [&table](const std::string &name)
+      -> std::expected<const Column *, Error> {
+    if (const auto column = table.GetColumn(name); column) {
+      return *column;
+    }
+    return std::unexpected(
+        Error("No column found: " + name, Error::Kind::NoColumnFound));
+  };
+
+  std::vector<Predicate> predicates;
+  std::vector<const Column *> read_columns;
+  for (const auto &where : query.where_clause()) {
+    auto predicate = Predicate::Compile(where, table);
+    if (!predicate) {
+      return std::unexpected(predicate.error());
+    }
+    read_columns.push_back(predicate->column());
+    predicates.push_back(std::move(*predicate));
+  }
+  std::unique_ptr<MaterializedView> view(
+      new MaterializedView(query.view_name(), &table, std::move(predicates)));
+
+  for (const auto &name : query.columns()) {
+    auto column = find_column(name);
+    if (!column) {
+      return std::unexpected(column.error());
+    }
+    read_columns.push_back(*column);
+    if (query.aggregates().empty()) {
+      view->columns_.push_back(*column);
+    } else {
+      view->group_columns_.push_back(*column);
+    }
+  }
+
+  // An aggregate view's rows are its own, and so are its columns.
+  auto add_column = [&view](std::string name, Column::Type type) {
+    auto column = std::make_unique<Column>(std::move(name), type);
+    column->set_slot(view->columns_.size());
+    view->columns_.push_back(column.get());
+    view->owned_columns_.push_back(std::move(column));
+  };
+  if (!query.aggregates().empty()) {
+    for (const auto *column : view->group_columns_) {
+      add_column(column->name(), column->type());
+    }
+  }
+  for (const auto &aggregate : query.aggregates()) {
+    const auto function = aggregate.function();
+    const Column *column = nullptr;
+    if (!aggregate.column().empty()) {
+      auto found = find_column(aggregate.column());
+      if (!found) {
+        return std::unexpected(found.error());
+      }
+      column = *found;
+      read_columns.push_back(column);
+    } else if (function != AggregateClause::Function::COUNT) {
+      return std::unexpected(Error(aggregate.name() + " needs a column"));
+    }
+    const bool numeric = column != nullptr &&
+                         (column->type() == Column::Type::INT ||
+                          column->type() == Column::Type::FLOAT);
+    auto type = column != nullptr ? column->type() : Column::Type::INT;
+    switch (function) {
+    case AggregateClause::Function::COUNT:
+      type = Column::Type::INT;
+      break;
+    case AggregateClause::Function::AVG:
+      type = Column::Type::FLOAT;
+      [[fallthrough]];
+    case AggregateClause::Function::SUM:
+      if (!numeric) {
+        return std::unexpected(
+            Error(aggregate.name() + " needs an INT or FLOAT column"));
+      }
+      break;
+    default:
+      break;
+    }
+    add_column(aggregate.name(), type);
+    view->aggregates_.push_back(aggregate);
+    view->aggregate_columns_.push_back(column);
+  }
+  view->read_columns_ = std::move(read_columns);
+
+  if (view->aggregated() && view->group_columns_.empty()) {
+    view->Refresh(*view->AddGroup({}));
+  }
+  view->RowsInserted(table.tuples());
+  return view;
+}
+
+auto MaterializedView::GetColumn(const std::string &name) const
+    -> std::optional<const Column *> {
+  for (const auto *column : columns_) {
+    if (column->name() == name) {
+      return column;
+    }
+  }
+  return std::nullopt;
+}
+
+auto MaterializedView::ReadsColumn(const Column *column) const -> bool {
+  return std::ranges::find(read_columns_, column) != read_columns_.end();
+}
+
+void MaterializedView::RowsInserted(const std::vector<Tuple *> &tuples) {
+  TupleBatch batch(tuples.begin(), tuples.end());
+  filter_.Apply(batch);
+  if (aggregated()) {
+    Aggregate(batch, 1);
+  } else {
+    rows_.insert(rows_.end(), batch.begin(), batch.end());
+  }
+}
+
+void MaterializedView::RowsRemoved(const std::vector<Tuple *> &tuples) {
+  TupleBatch batch(tuples.begin(), tuples.end());
+  filter_.Apply(batch);
+  if (batch.empty()) {
+    return;
+  }
+  if (aggregated()) {
+    Aggregate(batch, -1);
+    return;
+  }
+  const std::unordered_set<const Tuple *> removed(batch.begin(), batch.end());
+  std::erase_if(rows_,
+                [&removed](const Tuple *row) { return removed.contains(row); });
+}
+
+auto MaterializedView::ValueLess::operator()(const Value *lhs,
+                                             const Value *rhs) const -> bool {
+  return CompareValues(*lhs, *rhs) < 0;
+}
+
+auto MaterializedView::GroupKeyHash::operator()(const GroupKey &key) const
+    -> size_t {
+  uint64_t hash = 0;
+  for (const auto *value : key) {
+    hash = std::rotl(hash, 17) ^ (value != nullptr ? HashValue(*value) : 0);
+  }
+  return hash;
+}
+
+auto MaterializedView::GroupKeyEqual::operator()(const GroupKey &lhs,
+                                                 const GroupKey &rhs) const
+    -> bool {
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    if (lhs[i] == nullptr || rhs[i] == nullptr) {
+      if (lhs[i] != rhs[i]) {
+        return false;
+      }
+    } else if (lhs[i]->value() != rhs[i]->value()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto MaterializedView::AddGroup(const GroupKey &key) -> Group * {
+  auto group = std::make_unique<Group>();
+  group->key = key;
+  group->states.resize(aggregates_.size());
+  group->position = rows_.size();
+  auto *added = group.get();
+  rows_.push_back(&added->tuple);
+  ordered_groups_.push_back(added);
+  groups_.emplace(key, std::move(group));
+  return added;
+}
+
+void MaterializedView::RemoveGroup(Group &group) {
+  const auto position = group.position;
+  ordered_groups_[position] = ordered_groups_.back();
+  ordered_groups_[position]->position = position;
+  ordered_groups_.pop_back();
+  rows_[position] = rows_.back();
+  rows_.pop_back();
+  // The key goes with the group.
+  const auto key = group.key;
+  groups_.erase(key);
+}
+
+void MaterializedView::Aggregate(TupleBatch &batch, int sign) {
+  std::vector<Group *> changed;
+  GroupKey key(group_columns_.size());
+  for (const auto *tuple : batch) {
+    for (size_t i = 0; i < group_columns_.size(); ++i) {
+      key[i] = group_columns_[i]->Read(*tuple);
+    }
+    // A removed row's group always exists.
+    const auto found = groups_.find(key);
+    auto *group = found != groups_.end() ? found->second.get() : AddGroup(key);
+    group->rows += sign;
+    for (size_t a = 0; a < aggregates_.size(); ++a) {
+      if (const auto *column = aggregate_columns_[a]; column != nullptr) {
+        Accumulate(group->states[a], aggregates_[a].function(),
+                   column->Read(*tuple), sign);
+      }
+    }
+    if (!group->dirty) {
+      group->dirty = true;
+      changed.push_back(group);
+    }
+  }
+  for (auto *group : changed) {
+    group->dirty = false;
+    if (group->rows == 0 && !group_columns_.empty()) {
+      RemoveGroup(*group);
+    } else {
+      Refresh(*group);
+    }
+  }
+}
+
+void MaterializedView::Accumulate(AggregateState &state,
+                                  AggregateClause::Function function,
+                                  const Value *value, int sign) {
+  if (value == nullptr) {
+    return;
+  }
+  state.count += sign;
+  switch (function) {
+  case AggregateClause::Function::SUM:
+  case AggregateClause::Function::AVG:
+    if (const auto *i = std::get_if<int>(&value->value())) {
+      state.int_sum += sign * static_cast<int64_t>(*i);
+    } else {
+      state.float_sum += sign * static_cast<double>(std::get<float>(
+                                    value->value()));
+    }
+    break;
+  case AggregateClause::Function::MIN:
+  case AggregateClause::Function::MAX:
+    if (sign > 0) {
+      ++state.values[value];
+    } else if (const auto found = state.values.find(value);
+               --found->second == 0) {
+      state.values.erase(found);
+    }
+    break;
+  case AggregateClause::Function::COUNT:
+    break;
+  }
+}
+
+void MaterializedView::Refresh(Group &group) const {
+  Tuple::Values values;
+  values.reserve(columns_.size());
+  for (size_t i = 0; i < group.key.size(); ++i) {
+    values.emplace_back(columns_[i]->storage_key(), group.key[i]);
+  }
+  group.values.clear();
+  for (size_t a = 0; a < aggregates_.size(); ++a) {
+    const auto &state = group.states[a];
+    const bool is_int = aggregate_columns_[a] != nullptr &&
+                        aggregate_columns_[a]->type() == Column::Type::INT;
+    const double sum = is_int ? static_cast<double>(state.int_sum)
+                              : state.float_sum;
+    std::optional<Value> computed;
+    // MIN and MAX point at the table's values instead of copying them.
+    const Value *value = nullptr;
+    switch (aggregates_[a].function()) {
+    case AggregateClause::Function::COUNT:
+      computed = SaturatedInt(aggregate_columns_[a] != nullptr ? state.count
+                                                               : group.rows);
+      break;
+    case AggregateClause::Function::SUM:
+      if (state.count > 0) {
+        computed = is_int ? SaturatedInt(state.int_sum)
+                          : Value(static_cast<float>(sum));
+      }
+      break;
+    case AggregateClause::Function::AVG:
+      if (state.count > 0) {
+        computed = Value(static_cast<float>(sum / state.count));
+      }
+      break;
+    case AggregateClause::Function::MIN:
+      if (!state.values.empty()) {
+        value = state.values.begin()->first;
+      }
+      break;
+    case AggregateClause::Function::MAX:
+      if (!state.values.empty()) {
+        value = state.values.rbegin()->first;
+      }
+      break;
+    }
+    if (computed) {
+      group.values.push_back(std::make_unique<Value>(std::move(*computed)));
+      value = group.values.back().get();
+    }
+    values.emplace_back(columns_[group.key.size() + a]->storage_key(), value);
+  }
+  group.tuple.set_values(std::move(values));
+}
+
+} // namespace JustADb
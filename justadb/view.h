@@ -0,0 +1,145 @@
+#pragma once
+
+#include "ddl.h"
+#include "dml.h"
+#include "kernels.h"
+#include "predicate.h"
+#include "utils.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace JustADb {
+
+// A view whose rows are stored and kept current from the changes its table
+// reports, so that keeping it costs time in the rows changed rather than in
+// the size of the table, and reading it costs time in the size of the view.
+//
+// Without aggregates, the view's rows are the table's own tuples that match
+// the where clauses, in insertion order, and its columns are the table's.
+// With aggregates, each row is a group the view owns, in no particular order
+// (without grouping columns there is always exactly one), and an aggregate's
+// value is replaced whenever its group changes: values read from such a view
+// are only valid until its table next changes, so queries on it return
+// copies (see ResultCursor::CopyValues).
+class MaterializedView : public View {
+public:
+  static auto Create(const CreateViewQuery &query, const Table &table)
+      -> std::expected<std::unique_ptr<MaterializedView>, Error>;
+
+  [[nodiscard]] auto name() const -> const std::string & override {
+    return name_;
+  }
+
+  [[nodiscard]] auto table() const -> const Table * override {
+    return table_;
+  }
+
+  void RowsInserted(const std::vector<Tuple *> &tuples) override;
+
+  void RowsRemoved(const std::vector<Tuple *> &tuples) override;
+
+  [[nodiscard]] auto ReadsColumn(const Column *column) const -> bool override;
+
+  [[nodiscard]] auto columns() const -> const std::vector<const Column *> & {
+    return columns_;
+  }
+
+  [[nodiscard]] auto GetColumn(const std::string &name) const
+      -> std::optional<const Column *>;
+
+  [[nodiscard]] auto rows() const -> const std::vector<const Tuple *> & {
+    return rows_;
+  }
+
+  [[nodiscard]] auto aggregated() const {
+    return !aggregates_.empty();
+  }
+
+private:
+  // Orders the distinct values of a MIN or MAX aggregate.
+  struct ValueLess {
+    auto operator()(const Value *lhs, const Value *rhs) const -> bool;
+  };
+
+  struct AggregateState {
+    // Non-NULL inputs.
+    int64_t count = 0;
+    int64_t int_sum = 0;
+    double float_sum = 0;
+    // For MIN and MAX, each distinct input with how often it occurs, so that
+    // removing the smallest or largest one finds the next.
+    std::map<const Value *, size_t, ValueLess> values;
+  };
+
+  // The values of the grouping columns; NULL is a group of its own.
+  using GroupKey = std::vector<const Value *>;
+
+  struct GroupKeyHash {
+    auto operator()(const GroupKey &key) const -> size_t;
+  };
+
+  struct GroupKeyEqual {
+    auto operator()(const GroupKey &lhs, const GroupKey &rhs) const -> bool;
+  };
+
+  struct Group {
+    GroupKey key;
+    int64_t rows = 0;
+    std::vector<AggregateState> states;
+    // The group's row: the key, then the aggregates' values, which it owns.
+    Tuple tuple;
+    std::vector<std::unique_ptr<Value>> values;
+    // Its index in rows_.
+    size_t position = 0;
+    // Set while a change to the group is pending Refresh().
+    bool dirty = false;
+  };
+
+  MaterializedView(std::string name, const Table *table,
+                   std::vector<Predicate> predicates)
+      : name_(std::move(name)), table_(table), filter_(std::move(predicates)) {}
+
+  // Adds an empty group.
+  auto AddGroup(const GroupKey &key) -> Group *;
+
+  // Adds (`sign` 1) or takes away (-1) the rows of `batch` that match.
+  void Aggregate(TupleBatch &batch, int sign);
+
+  static void Accumulate(AggregateState &state,
+                         AggregateClause::Function function,
+                         const Value *value, int sign);
+
+  // Recomputes the values of the group's row.
+  void Refresh(Group &group) const;
+
+  void RemoveGroup(Group &group);
+
+  std::string name_;
+  const Table *table_;
+  // The view's columns: the table's, or those below for an aggregate view.
+  std::vector<const Column *> columns_;
+  std::vector<std::unique_ptr<Column>> owned_columns_;
+  CompiledFilter filter_;
+  // The table's columns the where clauses, grouping and aggregates read.
+  std::vector<const Column *> read_columns_;
+  std::vector<const Column *> group_columns_;
+  std::vector<AggregateClause> aggregates_;
+  // The table's column under each aggregate, or nullptr for COUNT of rows.
+  std::vector<const Column *> aggregate_columns_;
+  std::unordered_map<GroupKey, std::unique_ptr<Group>, GroupKeyHash,
+                     GroupKeyEqual>
+      groups_;
+  // The groups in the order of rows_.
+  std::vector<Group *> ordered_groups_;
+  std::vector<const Tuple *> rows_;
+};
+
+} // namespace JustADb
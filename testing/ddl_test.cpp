@@ -1,4 +1,8 @@
 #include "justadb/ddl.h"
+#include "justadb/key_index.h"
+#include "justadb/lsm.h"
+#include "justadb/memory.h"
+#include "justadb/statistics.h"
 #include <gtest/gtest.h>
 
 TEST(DDLTest, DdlQueriesTest) {
@@ -114,3 +118,556 @@ TEST(DDLTest, DdlQueriesTest) {
   EXPECT_TRUE(drop_db_exec_result) << "Error while executing drop db query: " << drop_db_exec_result.error().message();
   EXPECT_FALSE(db_manager.GetDatabase(DB_NAME)) << "Database not dropped";
 }
+
+TEST(DDLTest, AnalyzeTableTest) {
+  using namespace JustADb;
+  DatabaseManager db_manager;
+  DdlQueryExec ddl_query_exec(&db_manager);
+  ASSERT_TRUE(
+      ddl_query_exec.ExecuteCreateDatabaseQuery(CreateDatabaseQuery("test_db")));
+  ASSERT_TRUE(
+      ddl_query_exec.ExecuteUseDatabaseQuery(UseDatabaseQuery("test_db")));
+  auto *id = new Column("id", Column::Type::INT);
+  auto *bucket = new Column("bucket", Column::Type::INT);
+  ASSERT_TRUE(ddl_query_exec.ExecuteCreateTableQuery(
+      CreateTableQuery("test_table", {id, bucket})));
+  auto *table = db_manager.GetDatabase("test_db").value()
+                    ->GetModifiableTable("test_table")
+                    .value();
+
+  // ids 0..9999, buckets 0..99 with 7 the most common value; every tenth
+  // bucket is NULL.
+  for (int i = 0; i < 10000; ++i) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue("id", new Value(i));
+    tuple->InsertValue("bucket", i % 10 == 0 ? nullptr
+                                 : new Value(i % 3 == 0 ? 7 : i % 100));
+    ASSERT_TRUE(table->InsertTuple(tuple));
+  }
+  EXPECT_EQ(nullptr, table->statistics()) << "Statistics before ANALYZE";
+
+  auto analyzed =
+      ddl_query_exec.ExecuteAnalyzeTableQuery(AnalyzeTableQuery("test_table"));
+  ASSERT_TRUE(analyzed) << analyzed.error().message();
+  const auto *statistics = *analyzed;
+  EXPECT_EQ(10000u, statistics->row_count());
+
+  const auto *id_statistics = statistics->GetColumn(id).value();
+  EXPECT_EQ(0u, id_statistics->null_count());
+  EXPECT_NEAR(10000, id_statistics->distinct_count(), 10000 * 0.05)
+      << "HyperLogLog estimate off";
+  EXPECT_EQ(Histogram::kMaxBuckets, id_statistics->histogram().bucket_count());
+  EXPECT_NEAR(0.25,
+              id_statistics->histogram().FractionBelow(Value(2500), false),
+              0.01);
+  EXPECT_TRUE(id_statistics->most_common_values().empty())
+      << "Unique values are not common";
+
+  const auto *bucket_statistics = statistics->GetColumn(bucket).value();
+  EXPECT_DOUBLE_EQ(0.1, bucket_statistics->null_fraction());
+  ASSERT_FALSE(bucket_statistics->most_common_values().empty());
+  EXPECT_EQ(7, std::get<int>(
+                   bucket_statistics->most_common_values()[0].first.value()));
+  EXPECT_NEAR(0.3, bucket_statistics->EqualFraction(Value(7)), 0.01);
+
+  // Inserts after ANALYZE are folded in.
+  for (int i = 10000; i < 12000; ++i) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue("id", new Value(i));
+    tuple->InsertValue("bucket", new Value(7));
+    ASSERT_TRUE(table->InsertTuple(tuple));
+  }
+  EXPECT_EQ(12000u, statistics->row_count());
+  EXPECT_EQ(2000u, statistics->rows_since_analyze());
+  EXPECT_NEAR(12000, id_statistics->distinct_count(), 12000 * 0.05);
+  EXPECT_NEAR(5000.0 / 12000, bucket_statistics->EqualFraction(Value(7)), 0.01);
+  EXPECT_NEAR(10000.0 / 12000,
+              id_statistics->histogram().FractionBelow(Value(10000), false),
+              0.01)
+      << "Histogram did not grow past its last bound";
+
+  // Statistics follow their column through a rename, and a new column
+  // starts out all NULL.
+  id->rename_column("key");
+  EXPECT_TRUE(statistics->GetColumn(id));
+  auto *added = new Column("added", Column::Type::INT);
+  ASSERT_TRUE(table->AddColumn(added));
+  EXPECT_DOUBLE_EQ(1.0, statistics->GetColumn(added).value()->null_fraction());
+
+  // ANALYZE again replaces the statistics, starting over from the rows.
+  analyzed =
+      ddl_query_exec.ExecuteAnalyzeTableQuery(AnalyzeTableQuery("test_table"));
+  ASSERT_TRUE(analyzed) << analyzed.error().message();
+  EXPECT_EQ(table->statistics(), *analyzed);
+  EXPECT_EQ(0u, (*analyzed)->rows_since_analyze());
+
+  EXPECT_FALSE(
+      ddl_query_exec.ExecuteAnalyzeTableQuery(AnalyzeTableQuery("missing")));
+}
+
+TEST(DDLTest, OnlineAlterTableTest) {
+  using namespace JustADb;
+  auto *id = new Column("id", Column::Type::INT);
+  Table table("test_table", {id});
+  auto insert = [&table](std::vector<std::pair<const Column *, Value *>> row) {
+    auto *tuple = new Tuple();
+    for (const auto &[column, value] : row) {
+      tuple->InsertValue(column->storage_key(), value);
+    }
+    return table.InsertTuple(tuple);
+  };
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(insert({{id, new Value(i)}}));
+  }
+  const auto *first = table.tuples().front();
+
+  // ADD COLUMN only changes metadata; old rows read the default.
+  auto *flag = new Column("flag", Column::Type::INT, new Value(42));
+  ASSERT_TRUE(table.AddColumn(flag));
+  EXPECT_EQ(42, std::get<int>(flag->Read(*first)->value()));
+  ASSERT_TRUE(insert({{id, new Value(100)}})) << "Default not filled in";
+  EXPECT_EQ(42, std::get<int>(flag->Read(*table.tuples().back())->value()));
+  EXPECT_FALSE(table.AddColumn(new Column("bad", Column::Type::INT,
+                                          new Value(std::string("x")))))
+      << "Default of the wrong type accepted";
+
+  // Without a default the column is required for new rows and NULL for old
+  // ones, even if a dropped column of the same name had values there.
+  ASSERT_TRUE(insert({{id, new Value(101)}, {flag, new Value(7)}}));
+  ASSERT_TRUE(table.DropColumn("flag"));
+  auto *readded = new Column("flag", Column::Type::INT);
+  ASSERT_TRUE(table.AddColumn(readded));
+  EXPECT_EQ(nullptr, readded->Read(*table.tuples().back()))
+      << "Dropped column's value showed through";
+  EXPECT_FALSE(insert({{id, new Value(102)}}));
+  ASSERT_TRUE(table.DropColumn("flag"));
+
+  ASSERT_TRUE(table.RenameColumn("id", "key"));
+  EXPECT_EQ(5, std::get<int>(id->Read(*table.tuples()[5])->value()));
+  EXPECT_EQ(1u, table.SelectTuple("key", id->Read(*table.tuples()[5])).size())
+      << "Renamed column not found by its new name";
+  EXPECT_FALSE(table.RenameColumn("key", "key")) << "Duplicate name accepted";
+  // A NUL in a name could collide with the storage key of an added column.
+  EXPECT_FALSE(table.RenameColumn("key", std::string("key\0" "1", 5)))
+      << "Name with NUL accepted";
+  EXPECT_FALSE(table.AddColumn(
+      new Column(std::string("key\0" "1", 5), Column::Type::INT)))
+      << "Name with NUL accepted";
+
+  // MODIFY_DATATYPE converts in chunks; the column keeps its type until every
+  // row, including rows inserted meanwhile, is converted.
+  const auto version = table.schema_version();
+  ASSERT_TRUE(table.ModifyColumnType("key", Column::Type::STRING));
+  EXPECT_TRUE(table.conversion_pending());
+  EXPECT_FALSE(table.ModifyColumnType("key", Column::Type::FLOAT))
+      << "Second conversion started";
+  EXPECT_FALSE(table.ConvertRows(60));
+  EXPECT_EQ(Column::Type::INT, id->type());
+  EXPECT_EQ(10, std::get<int>(id->Read(*table.tuples()[10])->value()));
+  ASSERT_TRUE(insert({{id, new Value(-1)}}));
+  EXPECT_EQ(1u, table.tuples().back()->values().size())
+      << "Row ahead of the conversion converted twice";
+  EXPECT_TRUE(table.ConvertRows(60));
+  EXPECT_FALSE(table.conversion_pending());
+  EXPECT_EQ(Column::Type::STRING, id->type());
+  EXPECT_GT(table.schema_version(), version);
+  EXPECT_EQ("10",
+            std::get<std::string>(id->Read(*table.tuples()[10])->value()));
+  EXPECT_EQ("-1",
+            std::get<std::string>(id->Read(*table.tuples().back())->value()));
+
+  // Values without a representation in the new type become NULL.
+  ASSERT_TRUE(insert({{id, new Value(std::string("abc"))}}));
+  ASSERT_TRUE(table.ModifyColumnType("key", Column::Type::INT));
+  EXPECT_TRUE(table.ConvertRows(1000));
+  EXPECT_EQ(-1, std::get<int>(id->Read(*table.tuples()[102])->value()));
+  EXPECT_EQ(nullptr, id->Read(*table.tuples().back()));
+}
+
+TEST(DDLTest, ConvertValueTest) {
+  using namespace JustADb;
+  auto convert = [](Value value, Column::Type type) {
+    return ConvertValue(value, type);
+  };
+  EXPECT_EQ(2.0f,
+            std::get<float>(convert(Value(2), Column::Type::FLOAT)->value()));
+  EXPECT_EQ(2, std::get<int>(convert(Value(2.9f), Column::Type::INT)->value()));
+  EXPECT_EQ("1.5", std::get<std::string>(
+                       convert(Value(1.5f), Column::Type::STRING)->value()));
+  EXPECT_EQ("true", std::get<std::string>(
+                        convert(Value(true), Column::Type::STRING)->value()));
+  EXPECT_EQ(1, std::get<int>(convert(Value(true), Column::Type::INT)->value()));
+  EXPECT_TRUE(std::get<bool>(
+      convert(Value(std::string("1")), Column::Type::BOOL)->value()));
+  EXPECT_FALSE(convert(Value(std::string("1x")), Column::Type::INT));
+  EXPECT_FALSE(convert(Value(1e20f), Column::Type::INT)) << "INT overflow";
+}
+
+TEST(DDLTest, PartitionedTableTest) {
+  using namespace JustADb;
+  Database db("test_db");
+  auto *id = new Column("id", Column::Type::INT);
+  auto *name = new Column("name", Column::Type::STRING);
+
+  EXPECT_FALSE(db.CreateTable("bad", {id, name},
+                              PartitionSpec::Range("name", {10})))
+      << "Range partitioning accepted a STRING key";
+  EXPECT_FALSE(db.CreateTable("bad", {id, name},
+                              PartitionSpec::Range("id", {20, 10})))
+      << "Descending bounds accepted";
+  EXPECT_FALSE(db.CreateTable("bad", {id, name}, PartitionSpec::Hash("id", 0)))
+      << "Zero hash partitions accepted";
+  EXPECT_FALSE(db.CreateTable("bad", {id, name},
+                              PartitionSpec::Hash("missing", 4)))
+      << "Partitioning on a missing column accepted";
+  EXPECT_FALSE(db.CreateTable(
+      "bad", {id, new Column(std::string("a\0b", 3), Column::Type::INT)}))
+      << "Column name with NUL accepted";
+
+  ASSERT_TRUE(db.CreateTable("ranged", {id, name},
+                             PartitionSpec::Range("id", {100, 200})));
+  auto *table = db.GetModifiableTable("ranged").value();
+  auto insert = [id, name](Table *table, const Value *id_value) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue(id->storage_key(), id_value);
+    tuple->InsertValue(name->storage_key(), new Value(std::string("row")));
+    return table->InsertTuple(tuple);
+  };
+  for (int i = -50; i < 250; ++i) {
+    ASSERT_TRUE(insert(table, new Value(i)));
+  }
+  EXPECT_FALSE(insert(table, nullptr)) << "NULL partition key accepted";
+  // A rejected row is handed back as it was, without defaults filled in.
+  ASSERT_TRUE(table->AddColumn(
+      new Column("flag", Column::Type::INT, new Value(0))));
+  Tuple rejected;
+  rejected.InsertValue(id->storage_key(), nullptr);
+  rejected.InsertValue(name->storage_key(), nullptr);
+  EXPECT_FALSE(table->InsertTuple(&rejected));
+  EXPECT_EQ(2u, rejected.values().size()) << "Rejected row was changed";
+  ASSERT_TRUE(table->DropColumn("flag"));
+  ASSERT_EQ(3u, table->partitions().size());
+  EXPECT_EQ(150u, table->partitions()[0]->tuples.size());
+  EXPECT_EQ(100u, table->partitions()[1]->tuples.size());
+  EXPECT_EQ(50u, table->partitions()[2]->tuples.size());
+  EXPECT_EQ(300u, table->row_count());
+
+  EXPECT_FALSE(table->DropColumn("id")) << "Partition key dropped";
+  EXPECT_FALSE(table->ModifyColumnType("id", Column::Type::FLOAT))
+      << "Partition key type changed";
+
+  // Converting another column visits every partition, including rows
+  // inserted into partitions the conversion has already passed.
+  ASSERT_TRUE(table->ModifyColumnType("name", Column::Type::INT));
+  EXPECT_FALSE(table->ConvertRows(160));
+  ASSERT_TRUE(insert(table, new Value(0)));
+  while (!table->ConvertRows(64)) {
+  }
+  EXPECT_EQ(Column::Type::INT, name->type());
+  for (const auto *tuple : table->tuples()) {
+    EXPECT_EQ(nullptr, name->Read(*tuple)) << "'row' converted to an INT";
+  }
+
+  // Dropping a partition detaches its rows; its range takes new rows.
+  auto dropped = table->DropPartition(0);
+  ASSERT_TRUE(dropped);
+  EXPECT_EQ(151u, *dropped);
+  EXPECT_EQ(150u, table->row_count());
+  EXPECT_FALSE(table->DropPartition(3)) << "Dropped a missing partition";
+  ASSERT_TRUE(insert(table, new Value(-7)));
+  EXPECT_EQ(1u, table->partitions()[0]->tuples.size());
+
+  // Hash partitioning keeps equal keys together.
+  ASSERT_TRUE(db.CreateTable("hashed", {new Column("id", Column::Type::INT)},
+                             PartitionSpec::Hash("id", 4)));
+  auto *hashed = db.GetModifiableTable("hashed").value();
+  for (int i = 0; i < 400; ++i) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue("id", new Value(i % 40));
+    ASSERT_TRUE(hashed->InsertTuple(tuple));
+  }
+  for (const auto *partition : hashed->partitions()) {
+    EXPECT_FALSE(partition->tuples.empty()) << "Empty hash partition";
+    for (const auto *tuple : partition->tuples) {
+      const auto *key = tuple->GetValue("id").value();
+      EXPECT_EQ(partition, hashed->partitions()[hashed->partitioning()
+                                                    ->PartitionOf(*key)]);
+    }
+  }
+}
+
+TEST(DDLTest, LsmTableTest) {
+  using namespace JustADb;
+  Database db("lsm_db");
+  auto *id = new Column("id", Column::Type::INT);
+  auto *name = new Column("name", Column::Type::STRING);
+
+  EXPECT_FALSE(db.CreateTable("bad", {id, name}, std::nullopt,
+                              StorageOptions::Lsm("missing")))
+      << "LSM key on a missing column accepted";
+  EXPECT_FALSE(db.CreateTable("bad", {id, name}, PartitionSpec::Hash("id", 4),
+                              StorageOptions::Lsm("id")))
+      << "Partitioned LSM table accepted";
+
+  // A small memtable, so that the rows end up spread over runs and levels.
+  ASSERT_TRUE(db.CreateTable("events", {id, name}, std::nullopt,
+                             StorageOptions::Lsm("id", 64)));
+  auto *table = db.GetModifiableTable("events").value();
+  auto insert = [id, name](Table *table, const Value *id_value) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue(id->storage_key(), id_value);
+    tuple->InsertValue(name->storage_key(), new Value(std::string("row")));
+    return table->InsertTuple(tuple);
+  };
+  // Keys arrive out of order and every key twice.
+  constexpr int kKeys = 5000;
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < kKeys; ++i) {
+      ASSERT_TRUE(insert(table, new Value((i * 7919) % kKeys)));
+    }
+  }
+  EXPECT_FALSE(insert(table, nullptr)) << "NULL LSM key accepted";
+  EXPECT_EQ(2u * kKeys, table->row_count());
+  EXPECT_TRUE(table->partitions().empty());
+  EXPECT_FALSE(table->DropPartition(0))
+      << "Dropped a partition of an LSM table";
+  EXPECT_FALSE(table->DropColumn("id")) << "LSM key dropped";
+  EXPECT_FALSE(table->ModifyColumnType("id", Column::Type::FLOAT))
+      << "LSM key type changed";
+
+  auto *lsm = const_cast<LsmTree *>(table->lsm());
+  lsm->WaitForCompaction();
+  const auto levels = lsm->LevelSizes();
+  EXPECT_GT(levels.size(), 2u) << "No level below level 0 after compaction";
+  size_t total = 0;
+  for (const auto size : levels) {
+    total += size;
+  }
+  EXPECT_EQ(2u * kKeys, total);
+
+  // Every row, in key order.
+  const auto tuples = table->tuples();
+  ASSERT_EQ(2u * kKeys, tuples.size());
+  for (size_t i = 0; i < tuples.size(); ++i) {
+    EXPECT_EQ(static_cast<int>(i / 2),
+              std::get<int>(id->Read(*tuples[i])->value()));
+  }
+
+  // A range scan stops at its upper bound.
+  auto cursor =
+      lsm->Scan(LsmBound{Value(100), false}, LsmBound{Value(110), true});
+  std::vector<const Tuple *> range;
+  while (cursor.Next(3, range)) {
+  }
+  ASSERT_EQ(20u, range.size());
+  EXPECT_EQ(101, std::get<int>(id->Read(*range.front())->value()));
+  EXPECT_EQ(110, std::get<int>(id->Read(*range.back())->value()));
+
+  // Point reads consult the Bloom filters; missing keys skip most runs.
+  EXPECT_EQ(2u, table->SelectByKey("id", Value(4321)).size());
+  EXPECT_EQ(2u, table->SelectByKey("name", Value(std::string("row"))).size() /
+                    kKeys);
+  const auto skips = lsm->bloom_skips();
+  EXPECT_TRUE(table->SelectByKey("id", Value(kKeys + 1)).empty());
+  EXPECT_GT(lsm->bloom_skips(), skips) << "No run skipped for a missing key";
+
+  // A cursor does not see rows inserted after it was created.
+  auto snapshot = lsm->Scan(std::nullopt, std::nullopt);
+  ASSERT_TRUE(insert(table, new Value(-1)));
+  std::vector<const Tuple *> rows;
+  while (snapshot.Next(1024, rows)) {
+  }
+  EXPECT_EQ(2u * kKeys, rows.size());
+  EXPECT_EQ(2u * kKeys + 1, table->row_count());
+
+  // Type changes walk the rows of the tree.
+  ASSERT_TRUE(table->ModifyColumnType("name", Column::Type::INT));
+  while (!table->ConvertRows(1000)) {
+  }
+  EXPECT_EQ(Column::Type::INT, name->type());
+  EXPECT_EQ(nullptr, name->Read(*table->tuples().back()));
+
+  // Dropping the table stops its compaction; the rows stay readable.
+  ASSERT_TRUE(db.DropTable("events"));
+  EXPECT_TRUE(lsm->stopped());
+  lsm->WaitForCompaction();
+  EXPECT_EQ(2u, table->SelectByKey("id", Value(4321)).size());
+}
+
+TEST(DDLTest, ForeignKeyTest) {
+  using namespace JustADb;
+  Database db("fk_db");
+  auto *customer_id = new Column("id", Column::Type::INT);
+  ASSERT_TRUE(db.CreateTable("customers", {customer_id}));
+  auto *customers = db.GetModifiableTable("customers").value();
+  auto row = [](const Column *column, const Value *value) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue(column->storage_key(), value);
+    return tuple;
+  };
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(customers->InsertTuple(row(customer_id, new Value(i))));
+  }
+
+  auto *order_customer = new Column("customer_id", Column::Type::INT);
+  auto *amount =
+      new Column("amount", Column::Type::FLOAT, new Value(0.0f));
+  EXPECT_FALSE(db.CreateTable("orders", {order_customer, amount}, std::nullopt,
+                              {}, {{"customer_id", "missing", "id"}}))
+      << "Foreign key into a missing table accepted";
+  EXPECT_FALSE(db.CreateTable("orders", {order_customer, amount}, std::nullopt,
+                              {}, {{"amount", "customers", "id"}}))
+      << "Foreign key between columns of different types accepted";
+  EXPECT_FALSE(db.CreateTable("orders", {order_customer, amount}, std::nullopt,
+                              {}, {{"customer_id", "customers", "id"},
+                                   {"customer_id", "missing", "id"}}))
+      << "Second foreign key into a missing table accepted";
+  EXPECT_FALSE(db.GetTable("orders")) << "Failed create left a table behind";
+  EXPECT_EQ(nullptr, customers->key_index(customer_id))
+      << "Failed create left an index on the parent";
+  EXPECT_TRUE(customers->referenced_by().empty());
+  ASSERT_TRUE(db.CreateTable("orders", {order_customer, amount}, std::nullopt,
+                             {}, {{"customer_id", "customers", "id"}}));
+  auto *orders = db.GetModifiableTable("orders").value();
+  ASSERT_EQ(1u, customers->referenced_by().size());
+  const auto *index = customers->key_index(customer_id);
+  ASSERT_NE(nullptr, index);
+  EXPECT_EQ(100u, index->size());
+
+  EXPECT_TRUE(orders->InsertTuple(row(order_customer, new Value(42))));
+  EXPECT_TRUE(orders->InsertTuple(row(order_customer, nullptr)))
+      << "NULL foreign key rejected";
+  const auto missing = orders->InsertTuple(row(order_customer, new Value(100)));
+  ASSERT_FALSE(missing) << "Dangling foreign key accepted";
+  EXPECT_EQ("Foreign key violation: customer_id has no match in "
+            "customers.id",
+            missing.error().message());
+
+  // A batch with one bad row inserts nothing.
+  std::vector<Tuple *> batch;
+  for (int i = 0; i < 50; ++i) {
+    batch.push_back(row(order_customer, new Value(i * 3)));
+  }
+  const auto rejects = index->bloom_rejects();
+  EXPECT_FALSE(orders->InsertTuples(batch)) << "Batch with a bad key accepted";
+  EXPECT_GT(index->bloom_rejects(), rejects)
+      << "Missing key not rejected by the Bloom filter";
+  EXPECT_EQ(2u, orders->row_count());
+  batch.resize(30);
+  EXPECT_TRUE(orders->InsertTuples(batch));
+  EXPECT_EQ(32u, orders->row_count());
+
+  // New parent rows become valid keys.
+  ASSERT_TRUE(customers->InsertTuple(row(customer_id, new Value(1000))));
+  EXPECT_TRUE(orders->InsertTuple(row(order_customer, new Value(1000))));
+
+  EXPECT_FALSE(customers->DropColumn("id")) << "Referenced column dropped";
+  EXPECT_FALSE(orders->ModifyColumnType("customer_id", Column::Type::FLOAT))
+      << "Foreign key column retyped";
+  EXPECT_FALSE(db.DropTable("customers")) << "Referenced table dropped";
+  EXPECT_FALSE(customers->DropPartition(0))
+      << "Partition of a referenced table dropped";
+  EXPECT_TRUE(orders->InsertTuple(row(order_customer, new Value(7))))
+      << "Parent keys lost";
+  EXPECT_TRUE(db.DropTable("orders"));
+  EXPECT_TRUE(customers->referenced_by().empty());
+  EXPECT_TRUE(customers->DropPartition(0));
+  EXPECT_TRUE(db.DropTable("customers"));
+}
+
+TEST(DDLTest, TupleLayoutTest) {
+  using namespace JustADb;
+  auto *a = new Column("a", Column::Type::INT);
+  auto *b = new Column("b", Column::Type::INT);
+  auto *c = new Column("c", Column::Type::INT);
+  Table table("t", {a, b, c});
+  EXPECT_EQ(0u, a->slot());
+  EXPECT_EQ(2u, c->slot());
+
+  // Rows are stored in column order, whatever order they arrive in.
+  auto *old_row = new Tuple();
+  old_row->InsertValue("c", new Value(3));
+  old_row->InsertValue("a", new Value(1));
+  old_row->InsertValue("b", new Value(2));
+  old_row->InsertValue("b", new Value(20));
+  ASSERT_TRUE(table.InsertTuple(old_row));
+  ASSERT_EQ(3u, old_row->values().size());
+  EXPECT_EQ("a", old_row->values()[0].first);
+  EXPECT_EQ("c", old_row->values()[2].first);
+  EXPECT_EQ(2, std::get<int>(b->Read(*old_row)->value()))
+      << "A second value for a column replaced the first";
+
+  // Later columns move up a slot; rows stored before still read right.
+  ASSERT_TRUE(table.DropColumn("b"));
+  EXPECT_EQ(1u, c->slot());
+  EXPECT_EQ(3, std::get<int>(c->Read(*old_row)->value()));
+  auto *new_row = new Tuple();
+  new_row->InsertValue("a", new Value(4));
+  new_row->InsertValue("c", new Value(6));
+  ASSERT_TRUE(table.InsertTuple(new_row));
+  EXPECT_EQ(2u, new_row->values().size());
+  EXPECT_EQ(6, std::get<int>(c->Read(*new_row)->value()));
+
+  auto *d = new Column("d", Column::Type::INT, new Value(0));
+  ASSERT_TRUE(table.AddColumn(d));
+  EXPECT_EQ(2u, d->slot());
+  EXPECT_EQ(0, std::get<int>(d->Read(*old_row)->value()));
+
+  auto *extra = new Tuple();
+  extra->InsertValue("a", new Value(7));
+  extra->InsertValue("c", new Value(8));
+  extra->InsertValue("b", new Value(9));
+  EXPECT_FALSE(table.InsertTuple(extra)) << "Row with a dropped column stored";
+}
+
+TEST(DDLTest, MemoryTrackerTest) {
+  using namespace JustADb;
+  MemoryTracker database("db", nullptr, 1000);
+  {
+    MemoryTracker query("query", &database, 600);
+    MemoryTracker sort("Sort", &query);
+    EXPECT_TRUE(sort.TryReserve(500));
+    EXPECT_EQ(500u, query.current());
+    EXPECT_EQ(500u, database.current());
+
+    // The query's limit refuses; nothing is left counted anywhere.
+    EXPECT_FALSE(sort.TryReserve(200));
+    EXPECT_EQ(500u, sort.current());
+    EXPECT_EQ(500u, database.current());
+
+    // The database's limit is hit before the query's.
+    MemoryTracker other("other", &database);
+    auto reserved = other.Reserve(600);
+    ASSERT_FALSE(reserved);
+    EXPECT_EQ(Error::Kind::MemoryLimitExceeded, reserved.error().kind());
+    EXPECT_NE(std::string::npos, reserved.error().message().find("of db"))
+        << reserved.error().message();
+
+    const auto usage = database.Usage();
+    ASSERT_EQ(2u, usage.children.size());
+    EXPECT_EQ("query", usage.children[0].name);
+    EXPECT_EQ(600u, usage.children[0].limit);
+    ASSERT_EQ(1u, usage.children[0].children.size());
+    EXPECT_EQ(500u, usage.children[0].children[0].current);
+
+    sort.Release(300);
+    EXPECT_EQ(200u, database.current());
+    EXPECT_EQ(500u, database.peak());
+  }
+  // Trackers give back what they hold when they go away.
+  EXPECT_EQ(0u, database.current());
+  EXPECT_TRUE(database.Usage().children.empty());
+
+  auto file = SpillFile::Create();
+  ASSERT_TRUE(file) << file.error().message();
+  const std::vector<int> written = {3, 1, 4, 1, 5, 9, 2, 6};
+  ASSERT_TRUE(file->Write(written.data(), written.size() * sizeof(int)));
+  EXPECT_EQ(written.size() * sizeof(int), file->bytes_written());
+  ASSERT_TRUE(file->Rewind());
+  std::vector<int> read(written.size() + 1);
+  auto bytes = file->Read(read.data(), read.size() * sizeof(int));
+  ASSERT_TRUE(bytes) << bytes.error().message();
+  EXPECT_EQ(written.size() * sizeof(int), *bytes);
+  read.resize(written.size());
+  EXPECT_EQ(written, read);
+}
@@ -1,5 +1,963 @@
 #include "justadb/dml.h"
+#include "justadb/kernels.h"
+#include "justadb/like.h"
+#include "justadb/planner.h"
+#include "justadb/result_cache.h"
 #include <gtest/gtest.h>
 
-TEST(DMLTest, DdlQueriesTest) {
+#include <numeric>
+#include <random>
+
+namespace {
+
+// Creates `test_table(id INT, name STRING)` holding ids 0..row_count-1, with
+// a NULL name for every tenth row.
+auto MakeDatabase(int row_count) -> JustADb::Database * {
+  using namespace JustADb;
+  auto *db = new Database("test_db");
+  db->CreateTable("test_table", {new Column("id", Column::Type::INT),
+                                 new Column("name", Column::Type::STRING)});
+  DmlQueryExec dml_query_exec(*db);
+  for (int id = 0; id < row_count; ++id) {
+    std::unordered_map<std::string, Value> values;
+    values.insert({"id", Value(id)});
+    values.insert({"name", Value("name_" + std::to_string(id))});
+    if (id % 10 == 0) {
+      // Bypass the query path to store a row with a NULL name.
+      auto *tuple = new Tuple();
+      tuple->InsertValue("id", new Value(id));
+      tuple->InsertValue("name", nullptr);
+      db->GetModifiableTable("test_table").value()->InsertTuple(tuple);
+      continue;
+    }
+    EXPECT_TRUE(dml_query_exec.ExecuteInsertQuery(
+        InsertQuery("test_table", std::move(values))))
+        << "Error while executing insert query";
+  }
+  return db;
+}
+
+} // namespace
+
+TEST(DMLTest, InsertQueryTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(0);
+  DmlQueryExec dml_query_exec(*db);
+
+  std::unordered_map<std::string, Value> values;
+  values.insert({"id", Value(1)});
+  values.insert({"name", Value(std::string("one"))});
+  const auto inserted =
+      dml_query_exec.ExecuteInsertQuery(InsertQuery("test_table", values));
+  ASSERT_TRUE(inserted) << inserted.error().message();
+  EXPECT_EQ(1u, inserted->size()) << "Inserted tuple not returned";
+  EXPECT_EQ(1u, db->GetTable("test_table").value()->tuples().size());
+
+  std::unordered_map<std::string, Value> wrong_type;
+  wrong_type.insert({"id", Value(std::string("two"))});
+  wrong_type.insert({"name", Value(std::string("two"))});
+  EXPECT_FALSE(
+      dml_query_exec.ExecuteInsertQuery(InsertQuery("test_table", wrong_type)))
+      << "Value of the wrong type inserted";
+
+  std::unordered_map<std::string, Value> unknown_column;
+  unknown_column.insert({"age", Value(3)});
+  EXPECT_FALSE(dml_query_exec.ExecuteInsertQuery(
+      InsertQuery("test_table", unknown_column)))
+      << "Value for an unknown column inserted";
+
+  // Rows built before the bad one are freed, not stored.
+  EXPECT_FALSE(dml_query_exec.ExecuteInsertQuery(InsertQuery::Batch(
+      "test_table", {{{"id", Value(3)}, {"name", Value(std::string("x"))}},
+                     wrong_type})))
+      << "Batch with a bad row inserted";
+  EXPECT_EQ(1u, db->GetTable("test_table").value()->tuples().size());
+}
+
+TEST(DMLTest, SelectCursorTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(100);
+  DmlQueryExec dml_query_exec(*db);
+
+  // The result arrives in batches of at most `batch_rows`.
+  SelectQuery select_all("test_table", {Column("id", Column::Type::INT)});
+  auto cursor = dml_query_exec.ExecuteSelectQuery(select_all, 32);
+  ASSERT_TRUE(cursor) << cursor.error().message();
+  std::vector<size_t> batch_sizes;
+  while (true) {
+    auto batch = cursor->NextBatch();
+    ASSERT_TRUE(batch) << batch.error().message();
+    if (!batch->has_value()) {
+      break;
+    }
+    ASSERT_EQ(1u, (*batch)->columns.size());
+    batch_sizes.push_back((*batch)->row_count());
+  }
+  EXPECT_EQ((std::vector<size_t>{32, 32, 32, 4}), batch_sizes);
+  EXPECT_EQ(100u, cursor->rows_produced());
+
+  // Filter and sort.
+  SelectQuery filtered("test_table", {Column("id", Column::Type::INT),
+                                      Column("name", Column::Type::STRING)});
+  filtered.Where("id", "50", WhereClause::Operator::GREATER_THAN_OR_EQUAL)
+      .Where("id", "60", WhereClause::Operator::LESS_THAN);
+  filtered.OrderBy("id", OrderByClause::Order::DESCENDING);
+  auto filtered_result =
+      dml_query_exec.ExecuteSelectQuery(filtered).value().Collect();
+  ASSERT_TRUE(filtered_result) << filtered_result.error().message();
+  ASSERT_EQ(10u, filtered_result->row_count());
+  EXPECT_EQ(59, std::get<int>(filtered_result->columns[0][0]->value()));
+  EXPECT_EQ(50, std::get<int>(filtered_result->columns[0][9]->value()));
+  EXPECT_EQ(nullptr, filtered_result->columns[1][9]) << "NULL name not kept";
+  EXPECT_EQ("name_59",
+            std::get<std::string>(filtered_result->columns[1][0]->value()));
+
+  // NULL handling and IN lists.
+  SelectQuery nulls("test_table", {Column("id", Column::Type::INT)});
+  nulls.Where("name", "", WhereClause::Operator::IS_NULL);
+  EXPECT_EQ(10u,
+            dml_query_exec.ExecuteSelectQuery(nulls).value().Collect()->row_count());
+  SelectQuery in_list("test_table", {Column("id", Column::Type::INT)});
+  in_list.Where("id", "3,5,10,1000", WhereClause::Operator::IN);
+  EXPECT_EQ(3u, dml_query_exec.ExecuteSelectQuery(in_list)
+                    .value()
+                    .Collect()
+                    ->row_count());
+
+  // A limit stops pulling rows once it is reached.
+  SelectQuery limited("test_table", {Column("id", Column::Type::INT)});
+  limited.Where("id", "95", WhereClause::Operator::NOT_EQUAL);
+  limited.Limit(5);
+  auto limited_cursor = dml_query_exec.ExecuteSelectQuery(limited, 2);
+  auto limited_result = limited_cursor->Collect();
+  ASSERT_TRUE(limited_result);
+  EXPECT_EQ(5u, limited_result->row_count());
+
+  // Closing a cursor early ends the result.
+  auto closed_cursor = dml_query_exec.ExecuteSelectQuery(select_all, 10);
+  ASSERT_TRUE(closed_cursor->NextBatch().value());
+  closed_cursor->Close();
+  EXPECT_FALSE(closed_cursor->NextBatch().value()) << "Closed cursor produced rows";
+
+  // Planning errors are reported before any row is produced.
+  EXPECT_FALSE(dml_query_exec.ExecuteSelectQuery(
+      SelectQuery("test_table", {Column("age", Column::Type::INT)})))
+      << "Unknown column selected";
+  SelectQuery bad_literal("test_table", {Column("id", Column::Type::INT)});
+  bad_literal.Where("id", "abc", WhereClause::Operator::EQUAL);
+  EXPECT_FALSE(dml_query_exec.ExecuteSelectQuery(bad_literal))
+      << "Invalid literal accepted";
+}
+
+TEST(DMLTest, ExplainAnalyzeTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(100);
+  DmlQueryExec dml_query_exec(*db);
+
+  SelectQuery select_query("test_table", {Column("id", Column::Type::INT)});
+  select_query.Where("id", "50", WhereClause::Operator::LESS_THAN);
+  select_query.OrderBy("id", OrderByClause::Order::DESCENDING);
+  select_query.Limit(5);
+  auto profile = dml_query_exec.ExecuteExplainAnalyzeQuery(
+      ExplainAnalyzeQuery(select_query));
+  ASSERT_TRUE(profile) << profile.error().message();
+
+  // Result <- Limit <- Sort <- Filter <- Scan, with rows flowing upwards.
+  const std::vector<std::pair<std::string, uint64_t>> expected = {
+      {"Result", 5}, {"Limit", 5}, {"Sort", 50}, {"Filter", 50}, {"Scan", 100}};
+  const auto *node = profile->root();
+  for (const auto &[name, rows_out] : expected) {
+    ASSERT_NE(nullptr, node) << "Missing " << name;
+    EXPECT_EQ(name, node->name);
+    EXPECT_EQ(rows_out, node->rows_out) << name;
+    node = node->children.empty() ? nullptr : node->children[0].get();
+  }
+  EXPECT_EQ(nullptr, node) << "Unexpected operator below Scan";
+
+  const auto *filter =
+      profile->root()->children[0]->children[0]->children[0].get();
+  EXPECT_EQ(100u, filter->rows_in());
+  EXPECT_EQ("id < 50", filter->detail);
+  EXPECT_GT(profile->root()->children[0]->children[0]->bytes_allocated, 0u)
+      << "Sort did not report its memory";
+
+  const auto json = profile->ToJson();
+  EXPECT_NE(std::string::npos, json.find("\"operator\":\"Sort\"")) << json;
+  EXPECT_NE(std::string::npos, json.find("\"detail\":\"id DESC\"")) << json;
+
+  // Planning errors surface as for a plain select.
+  EXPECT_FALSE(dml_query_exec.ExecuteExplainAnalyzeQuery(ExplainAnalyzeQuery(
+      SelectQuery("test_table", {Column("age", Column::Type::INT)}))));
+}
+
+TEST(DMLTest, PlannerTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(1000);
+  auto *table = db->GetModifiableTable("test_table").value();
+
+  WhereClause range("id", "100", WhereClause::Operator::LESS_THAN);
+  WhereClause point("id", "500", WhereClause::Operator::EQUAL);
+  WhereClause nulls("name", "", WhereClause::Operator::IS_NULL);
+  std::vector<Predicate> predicates;
+  for (const auto &where : {range, nulls, point}) {
+    predicates.push_back(Predicate::Compile(where, *table).value());
+  }
+
+  // Without statistics the planner guesses; cheap NULL checks and equality
+  // still run before ranges.
+  Planner planner(*table);
+  EXPECT_DOUBLE_EQ(1.0 / 3, planner.Selectivity(predicates[0]));
+  auto ordered = predicates;
+  planner.OrderPredicates(ordered);
+  auto ops = [&ordered] {
+    std::vector<WhereClause::Operator> ops;
+    for (const auto &predicate : ordered) {
+      ops.push_back(predicate.op());
+    }
+    return ops;
+  };
+  const std::vector<WhereClause::Operator> expected_order = {
+      WhereClause::Operator::IS_NULL, WhereClause::Operator::EQUAL,
+      WhereClause::Operator::LESS_THAN};
+  EXPECT_EQ(expected_order, ops());
+
+  table->Analyze();
+  EXPECT_NEAR(0.1, planner.Selectivity(predicates[0]), 0.01);
+  EXPECT_NEAR(0.1, planner.Selectivity(predicates[1]), 0.001);
+  EXPECT_NEAR(0.001, planner.Selectivity(predicates[2]), 0.0005);
+  EXPECT_NEAR(0.1, planner.EstimateRows({predicates[0]}) / 1000, 0.01);
+
+  // A range that keeps few rows moves ahead of a NULL check that keeps most.
+  WhereClause not_null("name", "", WhereClause::Operator::IS_NOT_NULL);
+  WhereClause narrow("id", "10", WhereClause::Operator::LESS_THAN);
+  ordered = {Predicate::Compile(not_null, *table).value(),
+             Predicate::Compile(narrow, *table).value()};
+  planner.OrderPredicates(ordered);
+  EXPECT_EQ(WhereClause::Operator::LESS_THAN, ordered[0].op());
+
+  // EXPLAIN ANALYZE reports the estimates next to the actual rows.
+  DmlQueryExec dml_query_exec(*db);
+  SelectQuery select_query("test_table", {Column("id", Column::Type::INT)});
+  select_query.Where("id", "100", WhereClause::Operator::LESS_THAN);
+  auto profile = dml_query_exec.ExecuteExplainAnalyzeQuery(
+      ExplainAnalyzeQuery(select_query));
+  ASSERT_TRUE(profile) << profile.error().message();
+  const auto *filter = profile->root()->children[0].get();
+  ASSERT_EQ("Filter", filter->name);
+  EXPECT_EQ(100u, filter->rows_out);
+  ASSERT_TRUE(filter->estimated_rows);
+  EXPECT_NEAR(100, *filter->estimated_rows, 10);
+}
+
+TEST(DMLTest, LikePatternTest) {
+  using namespace JustADb;
+  using Kind = LikePattern::Kind;
+
+  const std::vector<std::pair<std::string, Kind>> kinds = {
+      {"abc", Kind::EXACT},     {"abc%", Kind::PREFIX},
+      {"%abc", Kind::SUFFIX},   {"%abc%", Kind::CONTAINS},
+      {"%", Kind::PREFIX},      {"a%c", Kind::GENERAL},
+      {"a_c", Kind::GENERAL},   {"%a%b%", Kind::GENERAL},
+      {"100\\%", Kind::EXACT}, {"%%abc%%", Kind::CONTAINS}};
+  for (const auto &[pattern, kind] : kinds) {
+    EXPECT_EQ(kind, LikePattern::Compile(pattern).kind()) << pattern;
+  }
+  EXPECT_EQ("100%", LikePattern::Compile("100\\%").literal());
+
+  const std::vector<std::tuple<std::string, std::string, bool>> cases = {
+      {"abc", "abc", true},          {"abc", "abcd", false},
+      {"abc%", "abcd", true},        {"abc%", "xabc", false},
+      {"%abc", "xxabc", true},       {"%abc", "abcx", false},
+      {"%abc%", "xxabcxx", true},    {"%abc%", "xxabxcx", false},
+      {"%", "", true},               {"a_c", "abc", true},
+      {"a_c", "ac", false},          {"a%c", "abbbc", true},
+      {"a%c", "abbbd", false},       {"%a%b%", "xxaxxbxx", true},
+      {"%a%b%", "xxbxxaxx", false},  {"a%b%c", "aXbXbXc", true},
+      {"%ab%ab", "abxab", true},     {"100\\%", "100%", true},
+      {"100\\%", "1000", false},    {"%needle%", "hay needle hay", true}};
+  for (const auto &[pattern, text, expected] : cases) {
+    EXPECT_EQ(expected, LikePattern::Compile(pattern).Matches(text))
+        << "'" << text << "' LIKE '" << pattern << "'";
+  }
+
+  auto range = LikePattern::Compile("ab%").PrefixRange();
+  ASSERT_TRUE(range);
+  EXPECT_EQ("ab", range->first);
+  EXPECT_EQ("ac", range->second);
+  EXPECT_FALSE(LikePattern::Compile("%ab").PrefixRange());
+  EXPECT_FALSE(LikePattern::Compile("%").PrefixRange()->second)
+      << "Empty prefix has an upper bound";
+}
+
+TEST(DMLTest, FindSubstringTest) {
+  using namespace JustADb;
+  // Compare against std::string_view::find around the vector widths, with
+  // needles planted at every offset.
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> letter('a', 'c');
+  for (size_t size : {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 200}) {
+    std::string haystack(size, ' ');
+    for (auto &c : haystack) {
+      c = static_cast<char>(letter(rng));
+    }
+    for (size_t needle_size : {1, 2, 3, 5, 17, 40}) {
+      for (size_t trial = 0; trial < 20; ++trial) {
+        std::string needle(needle_size, ' ');
+        for (auto &c : needle) {
+          c = static_cast<char>(letter(rng));
+        }
+        EXPECT_EQ(std::string_view(haystack).find(needle),
+                  FindSubstring(haystack, needle))
+            << "'" << needle << "' in '" << haystack << "'";
+      }
+    }
+  }
+  const std::string haystack(100, 'x');
+  for (size_t at = 0; at + 4 <= haystack.size(); ++at) {
+    auto planted = haystack;
+    planted.replace(at, 4, "abcd");
+    EXPECT_EQ(at, FindSubstring(planted, "abcd"));
+  }
+}
+
+TEST(DMLTest, LikeSelectTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(100);
+  DmlQueryExec dml_query_exec(*db);
+
+  auto count = [&dml_query_exec](const std::string &pattern,
+                                 WhereClause::Operator op) -> size_t {
+    SelectQuery query("test_table", {Column("id", Column::Type::INT)});
+    query.Where("name", pattern, op);
+    auto result = dml_query_exec.ExecuteSelectQuery(query).value().Collect();
+    EXPECT_TRUE(result) << result.error().message();
+    return result->row_count();
+  };
+  // Every tenth name is NULL and matches neither LIKE nor NOT LIKE.
+  EXPECT_EQ(10u, count("name_5%", WhereClause::Operator::LIKE));
+  EXPECT_EQ(80u, count("name_5%", WhereClause::Operator::NOT_LIKE));
+  EXPECT_EQ(10u, count("%9", WhereClause::Operator::LIKE));
+  EXPECT_EQ(1u, count("%_77", WhereClause::Operator::LIKE));
+  EXPECT_EQ(9u, count("name_1_", WhereClause::Operator::LIKE));
+  EXPECT_EQ(1u, count("name_42", WhereClause::Operator::LIKE));
+
+  SelectQuery int_like("test_table", {Column("id", Column::Type::INT)});
+  int_like.Where("id", "1%", WhereClause::Operator::LIKE);
+  EXPECT_FALSE(dml_query_exec.ExecuteSelectQuery(int_like))
+      << "LIKE accepted on an INT column";
+}
+
+TEST(DMLTest, FilterKernelTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(200);
+  auto *table = db->GetModifiableTable("test_table").value();
+  EXPECT_TRUE(table->AddColumn(new Column("score", Column::Type::FLOAT,
+                                          new Value(0.5f))));
+  // Rows inserted after the column was added have their own scores; older
+  // rows read the default.
+  DmlQueryExec dml_query_exec(*db);
+  for (int id = 200; id < 300; ++id) {
+    std::unordered_map<std::string, Value> values;
+    values.insert({"id", Value(id)});
+    values.insert({"name", Value("name_" + std::to_string(id))});
+    values.insert({"score", Value(static_cast<float>(id % 7))});
+    EXPECT_TRUE(dml_query_exec.ExecuteInsertQuery(
+        InsertQuery("test_table", std::move(values))));
+  }
+  // A value of the wrong type matches no comparison.
+  auto *mistyped = new Tuple();
+  mistyped->InsertValue("id", new Value(std::string("7")));
+  table->InsertTuple(mistyped);
+
+  const auto tuples = table->tuples();
+  const TupleBatch batch(tuples.begin(), tuples.end());
+  const std::vector<WhereClause> wheres = {
+      {"id", "150", WhereClause::Operator::EQUAL},
+      {"id", "150", WhereClause::Operator::NOT_EQUAL},
+      {"id", "150", WhereClause::Operator::LESS_THAN},
+      {"id", "150", WhereClause::Operator::LESS_THAN_OR_EQUAL},
+      {"id", "150", WhereClause::Operator::GREATER_THAN},
+      {"id", "150", WhereClause::Operator::GREATER_THAN_OR_EQUAL},
+      {"id", "3,7,250", WhereClause::Operator::IN},
+      {"id", "3,7,250", WhereClause::Operator::NOT_IN},
+      {"name", "name_42", WhereClause::Operator::EQUAL},
+      {"name", "name_42", WhereClause::Operator::GREATER_THAN},
+      {"name", "a,name_11", WhereClause::Operator::IN},
+      {"name", "", WhereClause::Operator::IS_NULL},
+      {"name", "", WhereClause::Operator::IS_NOT_NULL},
+      {"name", "name_1%", WhereClause::Operator::LIKE},
+      {"name", "%_1_", WhereClause::Operator::NOT_LIKE},
+      {"score", "0.5", WhereClause::Operator::EQUAL},
+      {"score", "3", WhereClause::Operator::GREATER_THAN},
+      {"score", "", WhereClause::Operator::IS_NULL},
+  };
+  for (const auto &where : wheres) {
+    const auto predicate = Predicate::Compile(where, *table).value();
+    const auto kernel = SelectFilterKernel(predicate);
+    EXPECT_NE(kernel, GenericFilterKernel)
+        << predicate.ToString() << " has no specialized kernel";
+
+    std::vector<uint32_t> expected(batch.size());
+    std::iota(expected.begin(), expected.end(), 0);
+    auto actual = expected;
+    expected.resize(GenericFilterKernel(predicate, batch, expected.data(),
+                                        expected.size()));
+    actual.resize(kernel(predicate, batch, actual.data(), actual.size()));
+    EXPECT_EQ(expected, actual) << predicate.ToString();
+  }
+
+  // A conjunction keeps the rows matching every predicate, in order.
+  std::vector<Predicate> predicates;
+  for (const auto &where :
+       {WhereClause("id", "100", WhereClause::Operator::GREATER_THAN_OR_EQUAL),
+        WhereClause("score", "2", WhereClause::Operator::LESS_THAN),
+        WhereClause("name", "", WhereClause::Operator::IS_NOT_NULL)}) {
+    predicates.push_back(Predicate::Compile(where, *table).value());
+  }
+  TupleBatch expected;
+  for (const auto *tuple : batch) {
+    if (std::all_of(predicates.begin(), predicates.end(),
+                    [tuple](const Predicate &predicate) {
+                      return predicate.Matches(*tuple);
+                    })) {
+      expected.push_back(tuple);
+    }
+  }
+  CompiledFilter filter(predicates);
+  auto actual = batch;
+  filter.Apply(actual);
+  EXPECT_EQ(expected, actual);
+  EXPECT_FALSE(actual.empty());
+}
+
+TEST(DMLTest, PartitionPruningTest) {
+  using namespace JustADb;
+  Database db("test_db");
+  ASSERT_TRUE(db.CreateTable("events",
+                             {new Column("day", Column::Type::INT),
+                              new Column("name", Column::Type::STRING)},
+                             PartitionSpec::Range("day", {10, 20, 30})));
+  DmlQueryExec dml_query_exec(db);
+  for (int day = 0; day < 40; ++day) {
+    std::unordered_map<std::string, Value> values;
+    values.insert({"day", Value(day)});
+    values.insert({"name", Value("day_" + std::to_string(day))});
+    ASSERT_TRUE(dml_query_exec.ExecuteInsertQuery(
+        InsertQuery("events", std::move(values))));
+  }
+  const auto *table = db.GetTable("events").value();
+  const Planner planner(*table);
+  auto prune = [table, &planner](const std::vector<WhereClause> &wheres) {
+    std::vector<Predicate> predicates;
+    for (const auto &where : wheres) {
+      predicates.push_back(Predicate::Compile(where, *table).value());
+    }
+    return planner.PrunePartitions(predicates);
+  };
+  using Partitions = std::vector<size_t>;
+  EXPECT_EQ(Partitions({0, 1, 2, 3}), prune({}));
+  EXPECT_EQ(Partitions({0}),
+            prune({{"day", "10", WhereClause::Operator::LESS_THAN}}));
+  EXPECT_EQ(Partitions({0, 1}),
+            prune({{"day", "10", WhereClause::Operator::LESS_THAN_OR_EQUAL}}));
+  EXPECT_EQ(Partitions({1, 2}),
+            prune({{"day", "15", WhereClause::Operator::GREATER_THAN_OR_EQUAL},
+                   {"day", "29", WhereClause::Operator::LESS_THAN_OR_EQUAL}}));
+  EXPECT_EQ(Partitions({0, 3}),
+            prune({{"day", "5,35", WhereClause::Operator::IN}}));
+  EXPECT_EQ(Partitions({}),
+            prune({{"day", "35", WhereClause::Operator::EQUAL},
+                   {"day", "30", WhereClause::Operator::LESS_THAN}}));
+  EXPECT_EQ(Partitions({0, 1, 2, 3}),
+            prune({{"name", "day_1", WhereClause::Operator::EQUAL},
+                   {"day", "7", WhereClause::Operator::NOT_EQUAL}}));
+
+  // Pruned queries return the same rows and only scan what they need.
+  SelectQuery query("events", {Column("day", Column::Type::INT)});
+  query.Where("day", "25", WhereClause::Operator::GREATER_THAN_OR_EQUAL)
+      .Where("day", "32", WhereClause::Operator::LESS_THAN);
+  auto result = dml_query_exec.ExecuteSelectQuery(query).value().Collect();
+  ASSERT_TRUE(result) << result.error().message();
+  EXPECT_EQ(7u, result->row_count());
+  auto profile = dml_query_exec.ExecuteExplainAnalyzeQuery(
+      ExplainAnalyzeQuery(query));
+  ASSERT_TRUE(profile) << profile.error().message();
+  EXPECT_NE(std::string::npos,
+            profile->ToText().find("events (2 of 4 partitions)"))
+      << profile->ToText();
+
+  // Hash partitions prune on equality only.
+  ASSERT_TRUE(db.CreateTable("users", {new Column("id", Column::Type::INT)},
+                             PartitionSpec::Hash("id", 8)));
+  const Planner hash_planner(*db.GetTable("users").value());
+  std::vector<Predicate> point = {
+      Predicate::Compile({"id", "12345", WhereClause::Operator::EQUAL},
+                         *db.GetTable("users").value())
+          .value()};
+  EXPECT_EQ(1u, hash_planner.PrunePartitions(point).size());
+  std::vector<Predicate> range = {
+      Predicate::Compile({"id", "5", WhereClause::Operator::LESS_THAN},
+                         *db.GetTable("users").value())
+          .value()};
+  EXPECT_EQ(8u, hash_planner.PrunePartitions(range).size());
+
+  // Range comparisons on a non-INT hash key scan every partition.
+  ASSERT_TRUE(db.CreateTable("names",
+                             {new Column("name", Column::Type::STRING)},
+                             PartitionSpec::Hash("name", 4)));
+  for (const auto *name : {"ann", "bob", "cy"}) {
+    ASSERT_TRUE(dml_query_exec.ExecuteInsertQuery(
+        InsertQuery("names", {{"name", Value(name)}})));
+  }
+  SelectQuery names("names", {Column("name", Column::Type::STRING)});
+  names.Where("name", "b", WhereClause::Operator::GREATER_THAN);
+  auto after_b = dml_query_exec.ExecuteSelectQuery(names).value().Collect();
+  ASSERT_TRUE(after_b) << after_b.error().message();
+  EXPECT_EQ(2u, after_b->row_count());
+}
+
+TEST(DMLTest, LsmKeyRangeTest) {
+  using namespace JustADb;
+  Database db("test_db");
+  ASSERT_TRUE(db.CreateTable("events",
+                             {new Column("day", Column::Type::INT),
+                              new Column("name", Column::Type::STRING)},
+                             std::nullopt, StorageOptions::Lsm("day", 16)));
+  DmlQueryExec dml_query_exec(db);
+  for (int i = 0; i < 400; ++i) {
+    const int day = (i * 37) % 400;
+    std::unordered_map<std::string, Value> values;
+    values.insert({"day", Value(day)});
+    values.insert({"name", Value("day_" + std::to_string(day))});
+    ASSERT_TRUE(dml_query_exec.ExecuteInsertQuery(
+        InsertQuery("events", std::move(values))));
+  }
+  const auto *table = db.GetTable("events").value();
+  const Planner planner(*table);
+  std::vector<Predicate> predicates;
+  for (const auto &where : std::vector<WhereClause>{
+           {"day", "100", WhereClause::Operator::GREATER_THAN},
+           {"day", "90", WhereClause::Operator::GREATER_THAN_OR_EQUAL},
+           {"day", "120", WhereClause::Operator::LESS_THAN},
+           {"name", "day_1", WhereClause::Operator::NOT_EQUAL}}) {
+    predicates.push_back(Predicate::Compile(where, *table).value());
+  }
+  const auto [low, high] = planner.KeyRange(predicates);
+  ASSERT_TRUE(low && high);
+  EXPECT_EQ(100, std::get<int>(low->key.value()));
+  EXPECT_FALSE(low->inclusive);
+  EXPECT_EQ(120, std::get<int>(high->key.value()));
+  EXPECT_FALSE(high->inclusive);
+
+  // The scan reads only the key range, in key order.
+  SelectQuery query("events", {Column("day", Column::Type::INT)});
+  query.Where("day", "250", WhereClause::Operator::GREATER_THAN_OR_EQUAL)
+      .Where("day", "260", WhereClause::Operator::LESS_THAN);
+  auto result = dml_query_exec.ExecuteSelectQuery(query).value().Collect();
+  ASSERT_TRUE(result) << result.error().message();
+  ASSERT_EQ(10u, result->row_count());
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(250 + static_cast<int>(i),
+              std::get<int>(result->columns[0][i]->value()));
+  }
+  auto profile = dml_query_exec.ExecuteExplainAnalyzeQuery(
+      ExplainAnalyzeQuery(query));
+  ASSERT_TRUE(profile) << profile.error().message();
+  const auto *scan = profile->root();
+  while (!scan->children.empty()) {
+    scan = scan->children.front().get();
+  }
+  EXPECT_EQ("events (LSM by day)", scan->detail);
+  EXPECT_EQ(10u, scan->rows_out) << profile->ToText();
+
+  // A strictly tighter key replaces the bound's inclusivity too, whichever
+  // clause comes first.
+  using Op = WhereClause::Operator;
+  const std::vector<std::pair<std::vector<WhereClause>, size_t>> cases = {
+      {{{"day", "5", Op::GREATER_THAN},
+        {"day", "10", Op::GREATER_THAN_OR_EQUAL},
+        {"day", "12", Op::LESS_THAN}},
+       2},
+      {{{"day", "10", Op::GREATER_THAN_OR_EQUAL},
+        {"day", "5", Op::GREATER_THAN},
+        {"day", "12", Op::LESS_THAN}},
+       2},
+      {{{"day", "20", Op::LESS_THAN},
+        {"day", "10", Op::LESS_THAN_OR_EQUAL}},
+       11},
+      {{{"day", "10", Op::LESS_THAN_OR_EQUAL},
+        {"day", "20", Op::LESS_THAN}},
+       11},
+  };
+  for (const auto &[wheres, expected] : cases) {
+    SelectQuery bounded("events", {Column("day", Column::Type::INT)});
+    for (const auto &where : wheres) {
+      bounded.Where(where.column(), where.value(), where.op());
+    }
+    auto rows = dml_query_exec.ExecuteSelectQuery(bounded).value().Collect();
+    ASSERT_TRUE(rows) << rows.error().message();
+    EXPECT_EQ(expected, rows->row_count())
+        << wheres[0].column() << " " << wheres[0].value() << " first";
+  }
+}
+
+TEST(DMLTest, HashJoinTest) {
+  using namespace JustADb;
+  Database db("test_db");
+  ASSERT_TRUE(db.CreateTable("customers",
+                             {new Column("id", Column::Type::INT),
+                              new Column("name", Column::Type::STRING)}));
+  ASSERT_TRUE(db.CreateTable("orders",
+                             {new Column("id", Column::Type::INT),
+                              new Column("customer_id", Column::Type::INT)}));
+  DmlQueryExec dml_query_exec(db);
+  // Ten customers, and 1000 orders of which only those of customers 0..9
+  // have a match.
+  std::vector<InsertQuery::Row> customers;
+  for (int id = 0; id < 10; ++id) {
+    customers.push_back({{"id", Value(id)},
+                         {"name", Value("customer_" + std::to_string(id))}});
+  }
+  ASSERT_TRUE(dml_query_exec.ExecuteInsertQuery(
+      InsertQuery::Batch("customers", std::move(customers))));
+  std::vector<InsertQuery::Row> orders;
+  for (int id = 0; id < 1000; ++id) {
+    orders.push_back({{"id", Value(id)}, {"customer_id", Value(id % 100)}});
+  }
+  ASSERT_TRUE(dml_query_exec.ExecuteInsertQuery(
+      InsertQuery::Batch("orders", std::move(orders))));
+
+  SelectQuery query("orders", {Column("orders.id", Column::Type::INT),
+                               Column("name", Column::Type::STRING)});
+  query.Join("customers", "customer_id", "customers.id")
+      .OrderBy("orders.id", OrderByClause::Order::ASCENDING)
+      .Where("orders.id", "500", WhereClause::Operator::LESS_THAN)
+      .Where("customers.id", "5", WhereClause::Operator::NOT_EQUAL);
+  auto result = dml_query_exec.ExecuteSelectQuery(query).value().Collect();
+  ASSERT_TRUE(result) << result.error().message();
+  // Customers 0..9 other than 5, five orders each below id 500.
+  ASSERT_EQ(45u, result->row_count());
+  for (size_t i = 0; i < result->row_count(); ++i) {
+    const int id = std::get<int>(result->columns[0][i]->value());
+    EXPECT_LT(id % 100, 10);
+    EXPECT_NE(5, id % 100);
+    EXPECT_EQ("customer_" + std::to_string(id % 100),
+              std::get<std::string>(result->columns[1][i]->value()));
+    if (i > 0) {
+      EXPECT_LT(std::get<int>(result->columns[0][i - 1]->value()), id);
+    }
+  }
+
+  // The smaller table is hashed, and its keys filter the other table's scan
+  // before its rows reach the filter.
+  auto profile = dml_query_exec.ExecuteExplainAnalyzeQuery(
+      ExplainAnalyzeQuery(query));
+  ASSERT_TRUE(profile) << profile.error().message();
+  const auto *join = profile->root();
+  while (join->name != "HashJoin") {
+    ASSERT_FALSE(join->children.empty()) << profile->ToText();
+    join = join->children.front().get();
+  }
+  ASSERT_EQ(2u, join->children.size()) << profile->ToText();
+  EXPECT_EQ(45u, join->rows_out);
+  const auto *probe_scan = join->children[0]->children[0].get();
+  EXPECT_EQ("orders [runtime filter on customer_id]", probe_scan->detail);
+  // A false positive lets the odd order through.
+  EXPECT_LT(probe_scan->rows_out, 150u) << profile->ToText();
+  EXPECT_GE(probe_scan->rows_out, 90u) << profile->ToText();
+  const auto *build_filter = join->children[1].get();
+  EXPECT_EQ("Filter", build_filter->name);
+  EXPECT_EQ(9u, build_filter->rows_out);
+
+  auto bad = SelectQuery("orders", {Column("id", Column::Type::INT)});
+  EXPECT_FALSE(dml_query_exec.ExecuteSelectQuery(
+      SelectQuery(bad).Join("customers", "orders.id", "customer_id")))
+      << "Join within one table accepted";
+  EXPECT_FALSE(dml_query_exec.ExecuteSelectQuery(
+      SelectQuery(bad).Join("customers", "customer_id", "name")))
+      << "Join of different types accepted";
+  EXPECT_FALSE(dml_query_exec.ExecuteSelectQuery(
+      SelectQuery(bad).Join("missing", "customer_id", "id")))
+      << "Join with a missing table accepted";
+}
+
+TEST(DMLTest, SpillTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(10000);
+  DmlQueryExec dml_query_exec(*db);
+  // Room for a few thousand sort rows, but not all of them.
+  dml_query_exec.set_query_memory_limit(64 << 10);
+
+  SelectQuery sort("test_table", {Column("id", Column::Type::INT)});
+  sort.OrderBy("id", OrderByClause::Order::DESCENDING);
+  auto sorted = dml_query_exec.ExecuteSelectQuery(sort).value().Collect();
+  ASSERT_TRUE(sorted) << sorted.error().message();
+  ASSERT_EQ(10000u, sorted->row_count());
+  for (size_t i = 0; i < sorted->row_count(); ++i) {
+    EXPECT_EQ(9999 - static_cast<int>(i),
+              std::get<int>(sorted->columns[0][i]->value()));
+  }
+  auto profile =
+      dml_query_exec.ExecuteExplainAnalyzeQuery(ExplainAnalyzeQuery(sort));
+  ASSERT_TRUE(profile) << profile.error().message();
+  const auto *sort_node = profile->root()->children[0].get();
+  ASSERT_EQ("Sort", sort_node->name);
+  EXPECT_GT(sort_node->bytes_spilled, 0u) << profile->ToText();
+  EXPECT_LE(sort_node->bytes_allocated, 64u << 10) << profile->ToText();
+
+  // A self-join on id: every row matches exactly itself.
+  ASSERT_TRUE(db->CreateTable("copy", {new Column("id", Column::Type::INT)}));
+  std::vector<InsertQuery::Row> rows;
+  for (int id = 0; id < 10000; ++id) {
+    rows.push_back({{"id", Value(id)}});
+  }
+  ASSERT_TRUE(dml_query_exec.ExecuteInsertQuery(
+      InsertQuery::Batch("copy", std::move(rows))));
+  SelectQuery join("test_table", {Column("copy.id", Column::Type::INT),
+                                  Column("name", Column::Type::STRING)});
+  join.Join("copy", "test_table.id", "copy.id");
+  auto joined = dml_query_exec.ExecuteSelectQuery(join).value().Collect();
+  ASSERT_TRUE(joined) << joined.error().message();
+  ASSERT_EQ(10000u, joined->row_count());
+  std::vector<bool> seen(10000);
+  for (size_t i = 0; i < joined->row_count(); ++i) {
+    const int id = std::get<int>(joined->columns[0][i]->value());
+    EXPECT_FALSE(seen[id]) << id;
+    seen[id] = true;
+    if (id % 10 != 0) {
+      EXPECT_EQ("name_" + std::to_string(id),
+                std::get<std::string>(joined->columns[1][i]->value()));
+    }
+  }
+  profile =
+      dml_query_exec.ExecuteExplainAnalyzeQuery(ExplainAnalyzeQuery(join));
+  ASSERT_TRUE(profile) << profile.error().message();
+  const auto *join_node = profile->root()->children[0].get();
+  ASSERT_EQ("HashJoin", join_node->name);
+  EXPECT_GT(join_node->bytes_spilled, 0u) << profile->ToText();
+
+  // Below what even one batch needs, the query fails instead.
+  db->memory().set_limit(1 << 10);
+  auto failed = dml_query_exec.ExecuteSelectQuery(sort).value().Collect();
+  ASSERT_FALSE(failed);
+  EXPECT_EQ(Error::Kind::MemoryLimitExceeded, failed.error().kind());
+  EXPECT_EQ(0u, db->memory().current());
+  db->memory().set_limit(std::nullopt);
+}
+
+TEST(DMLTest, MaterializedViewTest) {
+  using namespace JustADb;
+  Database db("test_db");
+  ASSERT_TRUE(db.CreateTable("orders",
+                             {new Column("day", Column::Type::INT),
+                              new Column("region", Column::Type::STRING),
+                              new Column("amount", Column::Type::INT)},
+                             PartitionSpec::Range("day", {10})));
+  DmlQueryExec dml_query_exec(db);
+  auto insert = [&](int day, const std::string &region, int amount) {
+    return dml_query_exec.ExecuteInsertQuery(InsertQuery(
+        "orders", {{"day", Value(day)},
+                   {"region", Value(region)},
+                   {"amount", Value(amount)}}));
+  };
+  for (int day = 0; day < 20; ++day) {
+    ASSERT_TRUE(insert(day, "r" + std::to_string(day % 3), day));
+  }
+
+  CreateViewQuery big("big", "orders", {"day", "amount"});
+  big.Where("amount", "15", WhereClause::Operator::GREATER_THAN_OR_EQUAL);
+  ASSERT_TRUE(dml_query_exec.ExecuteCreateViewQuery(big));
+  CreateViewQuery by_region("by_region", "orders", {"region"});
+  by_region.Aggregate(AggregateClause::Function::COUNT)
+      .Aggregate(AggregateClause::Function::SUM, "amount")
+      .Aggregate(AggregateClause::Function::MIN, "amount")
+      .Aggregate(AggregateClause::Function::AVG, "amount");
+  ASSERT_TRUE(dml_query_exec.ExecuteCreateViewQuery(by_region));
+  CreateViewQuery totals("totals", "orders", {});
+  totals.Aggregate(AggregateClause::Function::COUNT)
+      .Aggregate(AggregateClause::Function::SUM, "amount");
+  ASSERT_TRUE(dml_query_exec.ExecuteCreateViewQuery(totals));
+
+  CreateViewQuery bad_sum("bad_sum", "orders", {});
+  bad_sum.Aggregate(AggregateClause::Function::SUM, "region");
+  EXPECT_FALSE(dml_query_exec.ExecuteCreateViewQuery(bad_sum))
+      << "SUM of a STRING column";
+  EXPECT_FALSE(dml_query_exec.ExecuteCreateViewQuery(
+      CreateViewQuery("orders", "orders", {"day"})))
+      << "A view cannot take a table's name";
+
+  auto select = [&](const SelectQuery &query) {
+    auto cursor = dml_query_exec.ExecuteSelectQuery(query);
+    EXPECT_TRUE(cursor) << cursor.error().message();
+    auto result = cursor->Collect();
+    EXPECT_TRUE(result) << result.error().message();
+    return *result;
+  };
+  auto int_at = [](const ResultBatch &result, size_t c, size_t r) {
+    return std::get<int>(result.columns[c][r]->value());
+  };
+  SelectQuery regions(
+      "by_region",
+      {Column("region", Column::Type::STRING),
+       Column("count(*)", Column::Type::INT),
+       Column("sum(amount)", Column::Type::INT),
+       Column("min(amount)", Column::Type::INT),
+       Column("avg(amount)", Column::Type::FLOAT)});
+  regions.OrderBy("region", OrderByClause::Order::ASCENDING);
+  auto result = select(regions);
+  ASSERT_EQ(3u, result.row_count());
+  EXPECT_EQ("r0", std::get<std::string>(result.columns[0][0]->value()));
+  EXPECT_EQ(7, int_at(result, 1, 0));
+  EXPECT_EQ(63, int_at(result, 2, 0));
+  EXPECT_EQ(0, int_at(result, 3, 0));
+  EXPECT_FLOAT_EQ(9, std::get<float>(result.columns[4][0]->value()));
+  EXPECT_EQ(57, int_at(result, 2, 2)) << "Sum of r2";
+
+  SelectQuery total("totals", {Column("count(*)", Column::Type::INT),
+                               Column("sum(amount)", Column::Type::INT)});
+  result = select(total);
+  ASSERT_EQ(1u, result.row_count());
+  EXPECT_EQ(20, int_at(result, 0, 0));
+  EXPECT_EQ(190, int_at(result, 1, 0));
+
+  SelectQuery big_days("big", {Column("day", Column::Type::INT)});
+  big_days.Where("day", "17", WhereClause::Operator::LESS_THAN_OR_EQUAL);
+  big_days.OrderBy("day", OrderByClause::Order::DESCENDING);
+  result = select(big_days);
+  ASSERT_EQ(3u, result.row_count());
+  EXPECT_EQ(17, int_at(result, 0, 0));
+  EXPECT_EQ(15, int_at(result, 0, 2));
+
+  // Results keep copies of the aggregates the view replaces as it changes,
+  // whether computed or cached.
+  ResultCache cache(1 << 20);
+  DmlQueryExec cached_exec(db);
+  cached_exec.set_result_cache(&cache);
+  const auto before = select(total);
+  ASSERT_TRUE(cached_exec.ExecuteSelectQuery(total)->Collect());
+  auto cached = cached_exec.ExecuteSelectQuery(total)->Collect();
+  ASSERT_TRUE(cached);
+  EXPECT_EQ(1u, cache.hits());
+
+  // Inserts reach every view, adding a group where needed.
+  ASSERT_TRUE(insert(25, "r3", 100));
+  EXPECT_EQ(4u, select(regions).row_count());
+  EXPECT_EQ(290, int_at(*cached_exec.ExecuteSelectQuery(total)->Collect(),
+                        1, 0))
+      << "Stale result served from the cache";
+  EXPECT_EQ(20, int_at(before, 0, 0)) << "Earlier result changed";
+  EXPECT_EQ(190, int_at(before, 1, 0)) << "Earlier result changed";
+  EXPECT_EQ(190, int_at(*cached, 1, 0)) << "Earlier cached result changed";
+  result = select(total);
+  EXPECT_EQ(21, int_at(result, 0, 0));
+  EXPECT_EQ(290, int_at(result, 1, 0));
+
+  // Dropping a partition takes its rows out of the views.
+  auto *table = db.GetModifiableTable("orders").value();
+  ASSERT_TRUE(table->DropPartition(0));
+  result = select(regions);
+  ASSERT_EQ(4u, result.row_count());
+  EXPECT_EQ(3, int_at(result, 1, 0)) << "Count of r0";
+  EXPECT_EQ(45, int_at(result, 2, 0)) << "Sum of r0";
+  EXPECT_EQ(12, int_at(result, 3, 0)) << "Min of r0";
+  EXPECT_EQ(100, int_at(result, 2, 3)) << "Sum of r3";
+  result = select(total);
+  EXPECT_EQ(11, int_at(result, 0, 0));
+  EXPECT_EQ(245, int_at(result, 1, 0));
+  EXPECT_EQ(6u, select(SelectQuery("big", {Column("day", Column::Type::INT)}))
+                    .row_count());
+
+  // Groups without rows go; the global aggregate stays, as COUNT 0 and NULL.
+  ASSERT_TRUE(table->DropPartition(1));
+  EXPECT_EQ(0u, select(regions).row_count());
+  result = select(total);
+  ASSERT_EQ(1u, result.row_count());
+  EXPECT_EQ(0, int_at(result, 0, 0));
+  EXPECT_EQ(nullptr, result.columns[1][0]) << "SUM of no rows";
+
+  // A view reads through the plan like a table, but cannot be joined.
+  auto profile =
+      dml_query_exec.ExecuteExplainAnalyzeQuery(ExplainAnalyzeQuery(big_days));
+  ASSERT_TRUE(profile) << profile.error().message();
+  EXPECT_NE(std::string::npos, profile->ToText().find("ViewScan"))
+      << profile->ToText();
+  SelectQuery joined("big", {Column("day", Column::Type::INT)});
+  joined.Join("orders", "big.day", "orders.day");
+  EXPECT_FALSE(dml_query_exec.ExecuteSelectQuery(joined));
+
+  // The views pin the table and the columns they read.
+  auto dropped_column = table->DropColumn("amount");
+  ASSERT_FALSE(dropped_column);
+  EXPECT_NE(std::string::npos,
+            dropped_column.error().message().find("read by view"))
+      << dropped_column.error().message();
+  EXPECT_FALSE(db.DropTable("orders"));
+  for (const auto *name : {"big", "by_region", "totals"}) {
+    EXPECT_TRUE(dml_query_exec.ExecuteDropViewQuery(DropViewQuery(name)))
+        << name;
+  }
+  EXPECT_FALSE(db.GetView("big"));
+  EXPECT_TRUE(db.DropTable("orders"));
+}
+
+TEST(DMLTest, ResultCacheTest) {
+  using namespace JustADb;
+  auto *db = MakeDatabase(1000);
+  ResultCache cache(1 << 20);
+  DmlQueryExec dml_query_exec(*db);
+  dml_query_exec.set_result_cache(&cache);
+
+  auto count = [&](const SelectQuery &query, size_t batch_rows) {
+    auto cursor = dml_query_exec.ExecuteSelectQuery(query, batch_rows);
+    EXPECT_TRUE(cursor) << cursor.error().message();
+    size_t rows = 0;
+    while (true) {
+      auto batch = cursor->NextBatch();
+      EXPECT_TRUE(batch) << batch.error().message();
+      if (!batch || !batch->has_value()) {
+        return rows;
+      }
+      EXPECT_LE((*batch)->row_count(), batch_rows);
+      rows += (*batch)->row_count();
+    }
+  };
+  SelectQuery query("test_table", {Column("id", Column::Type::INT)});
+  query.Where("id", "100", WhereClause::Operator::LESS_THAN)
+      .Where("name", "", WhereClause::Operator::IS_NOT_NULL);
+  EXPECT_EQ(90u, count(query, 1024));
+  EXPECT_EQ(0u, cache.hits());
+  EXPECT_EQ(90u, count(query, 16)) << "Cached rows in smaller batches";
+  EXPECT_EQ(1u, cache.hits());
+  EXPECT_GT(cache.bytes(), 0u);
+
+  // The where clauses' order does not matter.
+  SelectQuery reordered("test_table", {Column("id", Column::Type::INT)});
+  reordered.Where("name", "", WhereClause::Operator::IS_NOT_NULL)
+      .Where("id", "100", WhereClause::Operator::LESS_THAN);
+  EXPECT_EQ(90u, count(reordered, 1024));
+  EXPECT_EQ(2u, cache.hits());
+
+  // An insert into the table makes the result stale.
+  ASSERT_TRUE(dml_query_exec.ExecuteInsertQuery(InsertQuery(
+      "test_table", {{"id", Value(5)}, {"name", Value("again")}})));
+  EXPECT_EQ(91u, count(query, 1024));
+  EXPECT_EQ(2u, cache.hits());
+  EXPECT_EQ(91u, count(query, 1024));
+  EXPECT_EQ(3u, cache.hits());
+
+  // So does any change to the catalog.
+  ASSERT_TRUE(db->CreateTable("other", {new Column("id", Column::Type::INT)}));
+  EXPECT_EQ(91u, count(query, 1024));
+  EXPECT_EQ(3u, cache.hits());
+
+  // A result that is not read to the end is not cached.
+  SelectQuery all("test_table", {Column("id", Column::Type::INT)});
+  auto cursor = dml_query_exec.ExecuteSelectQuery(all, 16);
+  ASSERT_TRUE(cursor);
+  ASSERT_TRUE(cursor->NextBatch());
+  cursor->Close();
+  EXPECT_EQ(1001u, count(all, 1024));
+  EXPECT_EQ(3u, cache.hits());
+  EXPECT_EQ(1001u, count(all, 1024));
+  EXPECT_EQ(4u, cache.hits());
 }
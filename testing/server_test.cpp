@@ -0,0 +1,448 @@
+#include "justadb/client.h"
+#include "justadb/server.h"
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+TEST(ServerTest, ProtocolRoundTripTest) {
+  using namespace JustADb;
+
+  SelectQuery select_query("test_table", {Column("id", Column::Type::INT),
+                                          Column("name", Column::Type::STRING)});
+  select_query.Where("id", "42", WhereClause::Operator::GREATER_THAN)
+      .Where("name", "%a%", WhereClause::Operator::LIKE);
+  select_query.OrderBy("id", OrderByClause::Order::DESCENDING);
+
+  const auto encoded = EncodeRequest(7, select_query);
+  size_t consumed = 0;
+  auto frame = ParseFrame(encoded, consumed);
+  ASSERT_TRUE(frame && frame->has_value()) << "Frame not parsed";
+  EXPECT_EQ(encoded.size(), consumed) << "Frame size mismatch";
+  EXPECT_EQ(7u, (*frame)->request_id) << "Request id mismatch";
+
+  auto request = DecodeRequest(**frame);
+  ASSERT_TRUE(request) << request.error().message();
+  const auto *decoded = std::get_if<SelectQuery>(&*request);
+  ASSERT_NE(nullptr, decoded) << "Decoded request is not a select";
+  EXPECT_EQ("test_table", decoded->table_name());
+  ASSERT_EQ(2u, decoded->columns().size());
+  EXPECT_EQ(Column::Type::STRING, decoded->columns()[1].type());
+  ASSERT_EQ(2u, decoded->where_clause().size());
+  EXPECT_EQ(WhereClause::Operator::LIKE, decoded->where_clause()[1].op());
+  ASSERT_TRUE(decoded->orderByClause());
+  EXPECT_EQ(OrderByClause::Order::DESCENDING,
+            decoded->orderByClause()->order());
+
+  // Partitioning specs survive the round trip.
+  auto create = DecodeRequest(
+      *ParseFrame(EncodeRequest(8, CreateTableQuery(
+                                       "events",
+                                       {new Column("day", Column::Type::INT)},
+                                       PartitionSpec::Range("day", {-5, 10}))),
+                  consumed)
+           .value());
+  ASSERT_TRUE(create) << create.error().message();
+  const auto &partitioning =
+      std::get<CreateTableQuery>(*create).partitioning();
+  ASSERT_TRUE(partitioning);
+  EXPECT_EQ(PartitionSpec::Kind::RANGE, partitioning->kind());
+  EXPECT_EQ("day", partitioning->column());
+  EXPECT_EQ(std::vector<int>({-5, 10}), partitioning->bounds());
+  auto drop = DecodeRequest(
+      *ParseFrame(EncodeRequest(9, DropPartitionQuery("events", 2)), consumed)
+           .value());
+  ASSERT_TRUE(drop) << drop.error().message();
+  EXPECT_EQ(2u, std::get<DropPartitionQuery>(*drop).partition());
+  auto create_lsm = DecodeRequest(
+      *ParseFrame(EncodeRequest(10, CreateTableQuery(
+                                        "log",
+                                        {new Column("ts", Column::Type::INT)},
+                                        std::nullopt,
+                                        StorageOptions::Lsm("ts", 1024))),
+                  consumed)
+           .value());
+  ASSERT_TRUE(create_lsm) << create_lsm.error().message();
+  const auto &storage = std::get<CreateTableQuery>(*create_lsm).storage();
+  EXPECT_EQ(StorageOptions::Engine::LSM, storage.engine);
+  EXPECT_EQ("ts", storage.key_column);
+  EXPECT_EQ(1024u, storage.memtable_rows);
+
+  // So do foreign keys, joins and insert batches.
+  auto create_child = DecodeRequest(
+      *ParseFrame(EncodeRequest(11, CreateTableQuery(
+                                        "orders",
+                                        {new Column("customer_id",
+                                                    Column::Type::INT)})
+                                        .References("customer_id",
+                                                    "customers", "id")),
+                  consumed)
+           .value());
+  ASSERT_TRUE(create_child) << create_child.error().message();
+  const auto &foreign_keys =
+      std::get<CreateTableQuery>(*create_child).foreign_keys();
+  ASSERT_EQ(1u, foreign_keys.size());
+  EXPECT_EQ("customers", foreign_keys[0].parent_table);
+  EXPECT_EQ("id", foreign_keys[0].parent_column);
+  auto join = DecodeRequest(
+      *ParseFrame(EncodeRequest(12, SelectQuery("orders",
+                                                {Column("name",
+                                                        Column::Type::STRING)})
+                                        .Join("customers", "customer_id",
+                                              "customers.id")),
+                  consumed)
+           .value());
+  ASSERT_TRUE(join) << join.error().message();
+  const auto join_clause = std::get<SelectQuery>(*join).join();
+  ASSERT_TRUE(join_clause);
+  EXPECT_EQ("customers", join_clause->table());
+  EXPECT_EQ("customers.id", join_clause->right_column());
+  auto batch = DecodeRequest(
+      *ParseFrame(EncodeRequest(13, InsertQuery::Batch(
+                                        "orders", {{{"customer_id", Value(1)}},
+                                                   {{"customer_id",
+                                                     Value(2)}}})),
+                  consumed)
+           .value());
+  ASSERT_TRUE(batch) << batch.error().message();
+  const auto &rows = std::get<InsertQuery>(*batch).rows();
+  ASSERT_EQ(2u, rows.size());
+  EXPECT_EQ(2, std::get<int>(rows[1].at("customer_id").value()));
+
+  // A request cut short is rejected, freeing the columns decoded so far.
+  Frame truncated = ParseFrame(EncodeRequest(14, CreateTableQuery(
+                                                     "t",
+                                                     {new Column(
+                                                         "id",
+                                                         Column::Type::INT,
+                                                         new Value(1))})),
+                               consumed)
+                        ->value();
+  truncated.payload.pop_back();
+  EXPECT_FALSE(DecodeRequest(truncated)) << "Truncated request decoded";
+
+  // A partial frame needs more bytes.
+  auto partial = ParseFrame(std::string_view(encoded).substr(0, 12), consumed);
+  ASSERT_TRUE(partial);
+  EXPECT_FALSE(partial->has_value()) << "Partial frame was parsed";
+
+  // Result batches decode column-major, including nulls.
+  std::string out;
+  Value one(1);
+  Value two(2);
+  AppendResultHeader(out, 3, {"id"});
+  AppendResultBatch(out, 3, {{&one, nullptr, &two}});
+  AppendResultEnd(out, 3, 3);
+  Response response;
+  std::string_view remaining = out;
+  bool done = false;
+  while (!done) {
+    auto next = ParseFrame(remaining, consumed);
+    ASSERT_TRUE(next && next->has_value());
+    remaining.remove_prefix(consumed);
+    auto applied = ApplyResponseFrame(**next, response);
+    ASSERT_TRUE(applied) << applied.error().message();
+    done = *applied;
+  }
+  EXPECT_EQ(3u, response.row_count);
+  ASSERT_EQ(1u, response.columns.size());
+  ASSERT_EQ(3u, response.columns[0].size());
+  EXPECT_EQ(2, std::get<int>(response.columns[0][2]->value()));
+  EXPECT_FALSE(response.columns[0][1]) << "Null cell decoded as a value";
+}
+
+TEST(ServerTest, PipelinedQueriesTest) {
+  using namespace JustADb;
+
+  DatabaseManager db_manager;
+  ServerOptions options;
+  options.executor_threads = 2;
+  Server server(&db_manager, options);
+  auto started = server.Start();
+  ASSERT_TRUE(started) << started.error().message();
+
+  auto client = Client::ConnectTcp("127.0.0.1", server.port());
+  ASSERT_TRUE(client) << client.error().message();
+
+  // Send every request before reading any response.
+  std::vector<Request> requests = {
+      CreateDatabaseQuery("test_db"),
+      UseDatabaseQuery("test_db"),
+      CreateTableQuery("test_table", {new Column("id", Column::Type::INT)}),
+      InsertQuery("test_table", {{"id", Value(1)}}),
+      InsertQuery("test_table", {{"id", Value(2)}}),
+      SelectQuery("test_table", {Column("id", Column::Type::INT)}),
+      SelectQuery("missing_table", {Column("id", Column::Type::INT)}),
+  };
+  std::vector<uint32_t> request_ids;
+  for (const auto &request : requests) {
+    auto request_id = client->Send(request);
+    ASSERT_TRUE(request_id) << request_id.error().message();
+    request_ids.push_back(*request_id);
+  }
+
+  for (size_t i = 0; i < requests.size(); ++i) {
+    auto response = client->ReadResponse();
+    ASSERT_TRUE(response) << response.error().message();
+    EXPECT_EQ(request_ids[i], response->request_id)
+        << "Responses out of order";
+    if (i + 1 < requests.size()) {
+      EXPECT_FALSE(response->error)
+          << "Request " << i << " failed: " << response->error->message();
+    }
+    if (std::holds_alternative<InsertQuery>(requests[i])) {
+      EXPECT_EQ(1u, response->affected_rows) << "Row not inserted";
+    }
+    if (i + 2 == requests.size()) {
+      EXPECT_EQ(2u, response->row_count) << "Selected rows not streamed";
+      ASSERT_EQ(1u, response->columns.size());
+      ASSERT_EQ(2u, response->columns[0].size());
+      EXPECT_EQ(2, std::get<int>(response->columns[0][1]->value()));
+    } else if (i + 1 == requests.size()) {
+      EXPECT_TRUE(response->error) << "Select on a missing table succeeded";
+    }
+  }
+  EXPECT_TRUE(db_manager.GetDatabase("test_db").value()->GetTable("test_table"))
+      << "Table not created through the server";
+
+  // EXPLAIN ANALYZE answers with the profile as a single JSON cell.
+  auto explain = client->Execute(ExplainAnalyzeQuery(
+      SelectQuery("test_table", {Column("id", Column::Type::INT)})));
+  ASSERT_TRUE(explain) << explain.error().message();
+  ASSERT_FALSE(explain->error) << explain->error->message();
+  ASSERT_EQ(1u, explain->row_count);
+  const auto &plan = std::get<std::string>(explain->columns[0][0]->value());
+  EXPECT_NE(std::string::npos, plan.find("\"operator\":\"Scan\"")) << plan;
+
+  // A second connection has not selected a database yet.
+  auto other_client = Client::ConnectTcp("127.0.0.1", server.port());
+  ASSERT_TRUE(other_client) << other_client.error().message();
+  auto response = other_client->Execute(
+      SelectQuery("test_table", {Column("id", Column::Type::INT)}));
+  ASSERT_TRUE(response) << response.error().message();
+  EXPECT_TRUE(response->error) << "Database leaked across connections";
+
+  server.Stop();
+}
+
+TEST(ServerTest, SlowReaderTest) {
+  using namespace JustADb;
+
+  DatabaseManager db_manager;
+  ServerOptions options;
+  options.executor_threads = 2;
+  Server server(&db_manager, options);
+  auto started = server.Start();
+  ASSERT_TRUE(started) << started.error().message();
+  auto reader = Client::ConnectTcp("127.0.0.1", server.port());
+  ASSERT_TRUE(reader) << reader.error().message();
+  for (const Request &request :
+       {Request(CreateDatabaseQuery("test_db")),
+        Request(UseDatabaseQuery("test_db")),
+        Request(CreateTableQuery(
+            "wide", {new Column("id", Column::Type::INT),
+                     new Column("pad", Column::Type::STRING)}))}) {
+    auto response = reader->Execute(request);
+    ASSERT_TRUE(response && !response->error);
+  }
+
+  // Far more than the server queues for one client.
+  constexpr int kRows = 100000;
+  auto table =
+      db_manager.GetDatabase("test_db").value()->GetModifiableTable("wide");
+  ASSERT_TRUE(table);
+  for (int id = 0; id < kRows; ++id) {
+    auto *tuple = new Tuple();
+    tuple->InsertValue("id", new Value(id));
+    tuple->InsertValue("pad", new Value(std::string(200, 'x')));
+    ASSERT_TRUE((*table)->InsertTuple(tuple));
+  }
+
+  // A client that does not read has the rest of its result spooled to disk,
+  // and writers do not wait for it.
+  const auto spilled = SpillFile::total_bytes_written();
+  ASSERT_TRUE(reader->Send(
+      SelectQuery("wide", {Column("id", Column::Type::INT),
+                           Column("pad", Column::Type::STRING)})));
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (SpillFile::total_bytes_written() == spilled) {
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline)
+        << "Result of a slow reader not spooled";
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto writer = Client::ConnectTcp("127.0.0.1", server.port());
+  ASSERT_TRUE(writer) << writer.error().message();
+  for (const Request &request :
+       {Request(UseDatabaseQuery("test_db")),
+        Request(InsertQuery("wide", {{"id", Value(kRows)},
+                                     {"pad", Value("")}}))}) {
+    auto response = writer->Execute(request);
+    ASSERT_TRUE(response && !response->error);
+  }
+
+  auto response = reader->ReadResponse();
+  ASSERT_TRUE(response) << response.error().message();
+  ASSERT_FALSE(response->error) << response->error->message();
+  EXPECT_EQ(static_cast<uint64_t>(kRows), response->row_count);
+  ASSERT_EQ(static_cast<size_t>(kRows), response->columns[0].size());
+  EXPECT_EQ(kRows - 1, std::get<int>(response->columns[0].back()->value()));
+  server.Stop();
+}
+
+TEST(ServerTest, UnixSocketTest) {
+  using namespace JustADb;
+
+  const char *tmpdir = std::getenv("TEST_TMPDIR");
+  const auto path =
+      std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/justadb_test.sock";
+
+  DatabaseManager db_manager;
+  ServerOptions options;
+  options.unix_socket_path = path;
+  Server server(&db_manager, options);
+  auto started = server.Start();
+  ASSERT_TRUE(started) << started.error().message();
+
+  auto client = Client::ConnectUnix(path);
+  ASSERT_TRUE(client) << client.error().message();
+  auto response = client->Execute(CreateDatabaseQuery("test_db"));
+  ASSERT_TRUE(response) << response.error().message();
+  EXPECT_FALSE(response->error) << response->error->message();
+  EXPECT_TRUE(db_manager.GetDatabase("test_db")) << "Database not created";
+}
+
+TEST(ServerTest, OnlineAlterTableTest) {
+  using namespace JustADb;
+
+  DatabaseManager db_manager;
+  ServerOptions options;
+  options.executor_threads = 2;
+  options.conversion_chunk_rows = 64;
+  Server server(&db_manager, options);
+  auto started = server.Start();
+  ASSERT_TRUE(started) << started.error().message();
+  auto client = Client::ConnectTcp("127.0.0.1", server.port());
+  ASSERT_TRUE(client) << client.error().message();
+
+  std::vector<Request> requests = {
+      CreateDatabaseQuery("test_db"), UseDatabaseQuery("test_db"),
+      CreateTableQuery("test_table", {new Column("id", Column::Type::INT)})};
+  for (int id = 0; id < 1000; ++id) {
+    requests.push_back(InsertQuery("test_table", {{"id", Value(id)}}));
+  }
+  // Old rows read the default of a column added afterwards.
+  requests.push_back(AlterTableQuery(
+      "test_table", AlterTableQuery::AlterType::ADD_COLUMN,
+      new Column("score", Column::Type::INT, new Value(5))));
+  requests.push_back(
+      AlterTableQuery("test_table", AlterTableQuery::AlterType::MODIFY_DATATYPE,
+                      new Column("id", Column::Type::INT), std::nullopt,
+                      Column::Type::STRING));
+  for (const auto &request : requests) {
+    auto response = client->Execute(request);
+    ASSERT_TRUE(response) << response.error().message();
+    ASSERT_FALSE(response->error) << response->error->message();
+  }
+
+  // Reads keep working while the rows are converted.
+  SelectQuery select_query("test_table", {Column("id", Column::Type::STRING),
+                                          Column("score", Column::Type::INT)});
+  select_query.Where("score", "5", WhereClause::Operator::EQUAL);
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (true) {
+    auto response = client->Execute(select_query);
+    ASSERT_TRUE(response) << response.error().message();
+    ASSERT_FALSE(response->error) << response->error->message();
+    ASSERT_EQ(1000u, response->row_count);
+    if (std::holds_alternative<std::string>(
+            response->columns[0][999]->value())) {
+      EXPECT_EQ("999",
+                std::get<std::string>(response->columns[0][999]->value()));
+      break;
+    }
+    ASSERT_LT(std::chrono::steady_clock::now(), deadline)
+        << "Conversion did not finish";
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+TEST(ServerTest, ViewAndResultCacheTest) {
+  using namespace JustADb;
+
+  CreateViewQuery create_view("by_region", "orders", {"region"});
+  create_view.Where("amount", "0", WhereClause::Operator::GREATER_THAN);
+  create_view.Aggregate(AggregateClause::Function::COUNT)
+      .Aggregate(AggregateClause::Function::MAX, "amount");
+  size_t consumed = 0;
+  auto decoded = DecodeRequest(
+      *ParseFrame(EncodeRequest(1, create_view), consumed).value());
+  ASSERT_TRUE(decoded) << decoded.error().message();
+  const auto &view = std::get<CreateViewQuery>(*decoded);
+  EXPECT_EQ("by_region", view.view_name());
+  EXPECT_EQ("orders", view.table_name());
+  EXPECT_EQ(std::vector<std::string>({"region"}), view.columns());
+  ASSERT_EQ(1u, view.where_clause().size());
+  ASSERT_EQ(2u, view.aggregates().size());
+  EXPECT_EQ("max(amount)", view.aggregates()[1].name());
+
+  DatabaseManager db_manager;
+  ServerOptions options;
+  options.executor_threads = 2;
+  options.result_cache_bytes = 1 << 20;
+  Server server(&db_manager, options);
+  auto started = server.Start();
+  ASSERT_TRUE(started) << started.error().message();
+  auto client = Client::ConnectTcp("127.0.0.1", server.port());
+  ASSERT_TRUE(client) << client.error().message();
+
+  std::vector<Request> requests = {
+      CreateDatabaseQuery("test_db"), UseDatabaseQuery("test_db"),
+      CreateTableQuery("orders", {new Column("region", Column::Type::STRING),
+                                  new Column("amount", Column::Type::INT)})};
+  for (int i = 0; i < 100; ++i) {
+    requests.push_back(
+        InsertQuery("orders", {{"region", Value(i % 2 == 0 ? "east" : "west")},
+                               {"amount", Value(i)}}));
+  }
+  requests.push_back(create_view);
+  for (const auto &request : requests) {
+    auto response = client->Execute(request);
+    ASSERT_TRUE(response) << response.error().message();
+    ASSERT_FALSE(response->error) << response->error->message();
+  }
+
+  SelectQuery select_query("by_region",
+                           {Column("count(*)", Column::Type::INT),
+                            Column("max(amount)", Column::Type::INT)});
+  select_query.Where("region", "east", WhereClause::Operator::EQUAL);
+  // The second read is answered from the result cache.
+  for (int i = 0; i < 2; ++i) {
+    auto response = client->Execute(select_query);
+    ASSERT_TRUE(response) << response.error().message();
+    ASSERT_FALSE(response->error) << response->error->message();
+    ASSERT_EQ(1u, response->row_count);
+    EXPECT_EQ(49, std::get<int>(response->columns[0][0]->value()));
+    EXPECT_EQ(98, std::get<int>(response->columns[1][0]->value()));
+  }
+  auto inserted = client->Execute(InsertQuery(
+      "orders", {{"region", Value("east")}, {"amount", Value(500)}}));
+  ASSERT_TRUE(inserted && !inserted->error);
+  auto response = client->Execute(select_query);
+  ASSERT_TRUE(response) << response.error().message();
+  ASSERT_FALSE(response->error) << response->error->message();
+  EXPECT_EQ(50, std::get<int>(response->columns[0][0]->value()));
+  EXPECT_EQ(500, std::get<int>(response->columns[1][0]->value()));
+
+  response = client->Execute(DropTableQuery("orders"));
+  ASSERT_TRUE(response);
+  EXPECT_TRUE(response->error) << "The view reads the table";
+  response = client->Execute(DropViewQuery("by_region"));
+  ASSERT_TRUE(response);
+  EXPECT_FALSE(response->error) << response->error->message();
+  response = client->Execute(select_query);
+  ASSERT_TRUE(response);
+  EXPECT_TRUE(response->error) << "The dropped view was read";
+}